@@ -17,6 +17,7 @@
 #include "main9900_r3.h"
 #include "utilities_r3.h"
 #include "common_h_cmd_r3.h"
+#include "hartcommand_r3.h"
 /*!
  *  This flag is used by commands 11 & 21 to indicate the tag did not match, and that
  *  processHartCommand() should return false. All other commands set the value to false.
@@ -35,63 +36,50 @@ unsigned char badTagFlag = FALSE;
  */
 void common_cmd_0(void)
 {
+	stRespCursor rc = respOpen();
 	// Byte Count
-	szHartResp[respBufferSize] = 24;  // Byte count
-	++respBufferSize;							
+	put_u8(&rc, 24);  // Byte count
 	// Device Status High Byte
-	szHartResp[respBufferSize] = 0;   // Device Status high byte
-	++respBufferSize;					
+	put_u8(&rc, 0);   // Device Status high byte
 	// Status Low Byte		
-	szHartResp[respBufferSize] = (startUpDataLocalV.fromPrimary) ? 
-		startUpDataLocalNv.Primary_status : 
-		startUpDataLocalNv.Secondary_status;  // status byte
-	++respBufferSize;							
+	put_u8(&rc, (hartDevice.v.fromPrimary) ? 
+		hartDevice.v.Primary_status : 
+		hartDevice.v.Secondary_status);  // status byte
 	// 0 - Response Code
-	szHartResp[respBufferSize] = 254;  // Response Code
-	++respBufferSize;	
+	put_u8(&rc, 254);  // Response Code
 	// 1-2 Expanded Device Type
-	copyIntToRespBuf(startUpDataLocalV.expandedDevType);
+	put_u16be(&rc, hartDevice.v.expandedDevType);
 	// 3  Min number of preambles M -> S
-	szHartResp[respBufferSize] = startUpDataLocalV.minPreamblesM2S;
-	++respBufferSize;	
+	put_u8(&rc, hartDevice.v.minPreamblesM2S);
 	// 4  HART revision
-	szHartResp[respBufferSize] = startUpDataLocalV.majorHartRevision;
-	++respBufferSize;	
+	put_u8(&rc, hartDevice.v.majorHartRevision);
 	// 5  Device Revision
-	szHartResp[respBufferSize] = startUpDataLocalV.deviceRev;
-	++respBufferSize;	
+	put_u8(&rc, hartDevice.v.deviceRev);
 	// 6  sw revision
-	szHartResp[respBufferSize] = startUpDataLocalV.swRev;
-	++respBufferSize;	
+	put_u8(&rc, hartDevice.v.swRev);
 	// 7  hw revision (5 msb) & signal code (3-lsb) combined
-	unsigned char temp = startUpDataLocalV.hwRev << 3;
-	temp |= (startUpDataLocalV.physSignalCode & 0x07);
-	szHartResp[respBufferSize] = temp;
-	++respBufferSize;	
+	unsigned char temp = hartDevice.v.hwRev << 3;
+	temp |= (hartDevice.v.physSignalCode & 0x07);
+	put_u8(&rc, temp);
 	// 8  flags
-	szHartResp[respBufferSize] = startUpDataLocalV.flags;
-	++respBufferSize;	
+	put_u8(&rc, hartDevice.v.flags);
 	// 9-11 Device ID
-	memcpy(&(szHartResp[respBufferSize]), &startUpDataLocalNv.DeviceID, 3);
-	respBufferSize += 3;
-	// 12 Min number of preambles S -> M
-	szHartResp[respBufferSize] = startUpDataLocalV.minPreamblesS2M;
-	++respBufferSize;	
+	put_bytes(&rc, &hartDevice.nv.DeviceID, 3);
+	// 12 Min number of preambles S -> M, as configured for this master by command 59
+	put_u8(&rc, hartDevice.nv.respPreambles[(hartDevice.v.fromPrimary) ? 0 : 1]);
 	// 13 Max device vars
-	szHartResp[respBufferSize] = startUpDataLocalV.maxNumDevVars;
-	++respBufferSize;	
+	put_u8(&rc, hartDevice.v.maxNumDevVars);
 	// 14-15  config change counter
-	copyIntToRespBuf(startUpDataLocalNv.configChangeCount);
+	put_u16be(&rc, hartDevice.nv.configChangeCount);
 	// 16 Extended field device status
-	szHartResp[respBufferSize] = startUpDataLocalV.extendFieldDevStatus;  
-	++respBufferSize;							
+	put_u8(&rc, hartDevice.v.extendFieldDevStatus);
 	// 17-18 Manufacturer ID
-	copyIntToRespBuf(startUpDataLocalNv.ManufacturerIdCode);
+	put_u16be(&rc, hartDevice.nv.ManufacturerIdCode);
 	// 19-20  Private Label distributor ID
-	copyIntToRespBuf(startUpDataLocalV.PrivDistCode);
+	put_u16be(&rc, hartDevice.v.PrivDistCode);
 	// 21 Device Profile
-	szHartResp[respBufferSize] = startUpDataLocalV.devProfile;  
-	++respBufferSize;		
+	put_u8(&rc, hartDevice.v.devProfile);
+	respClose(&rc);
 }
 
 /*!
@@ -100,34 +88,26 @@ void common_cmd_0(void)
  */
 void common_cmd_1(void)
 {
-	unsigned char respCode = (updateDelay) ? UPDATE_FAILURE : RESP_SUCCESS;
-	
-	if (respCode)
-	{
-		szHartResp[respBufferSize] = 3;  // Byte count
-	}
-	else
+	unsigned char respCode = RESP_SUCCESS;
+	// While the 9900 updates are delayed, the master waits for fresh values with a delayed response
+	if (updateDelay && drNew == drLookup(&respCode))
 	{
-		szHartResp[respBufferSize] = 7;  // Byte count
+		respCode = drInitiate(FALSE);
 	}
-	++respBufferSize;							
-	szHartResp[respBufferSize] = 0;   // Device Status high byte
-	++respBufferSize;							
-	szHartResp[respBufferSize] = (startUpDataLocalV.fromPrimary) ? 
-		startUpDataLocalNv.Primary_status : 
-		startUpDataLocalNv.Secondary_status;  // Status byte
-	++respBufferSize;
 	if (respCode)
 	{
-		szHartResp[respBufferSize] = respCode;   // Command-specific response code
-		++respBufferSize;							
-	}
-	else
-	{							
-		szHartResp[respBufferSize] = u9900Database.db.UnitsPrimaryVar;   // PV Units
-		++respBufferSize;
-		copyFloatToRespBuf(PVvalue);
+		common_tx_error(respCode);
+		return;
 	}
+	stRespCursor rc = respOpen();
+	put_u8(&rc, 7);  // Byte count
+	put_u8(&rc, 0);   // Device Status high byte
+	put_u8(&rc, (hartDevice.v.fromPrimary) ? 
+		hartDevice.v.Primary_status : 
+		hartDevice.v.Secondary_status);  // Status byte
+	put_u8(&rc, hsbCtx.database.db.UnitsPrimaryVar);   // PV Units
+	put_f32be(&rc, PVvalue);
+	respClose(&rc);
 }
 
 
@@ -138,39 +118,32 @@ void common_cmd_1(void)
 void common_cmd_2(void)
 {
 	// Capture the loop current value first so it doesn't change
-	// while building the response
-	float loopCurrent = (TRUE == updateInProgress) ? reportingLoopCurrent : ma4_20;
-	float pvPercent = CalculatePercentRange(u9900Database.db.LOOP_SET_HIGH_LIMIT.floatVal,
-		u9900Database.db.LOOP_SET_LOW_LIMIT.floatVal, PVvalue);
+	// while building the response. Both are refreshed with each update, just copy them
+	float loopCurrent = pvDerived.loopCurrent;
+	float pvPercent = pvDerived.pvPercentRange;
 	
-	unsigned char respCode = (updateDelay) ? UPDATE_FAILURE : RESP_SUCCESS;
-	if (respCode)
+	unsigned char respCode = RESP_SUCCESS;
+	// While the 9900 updates are delayed, the master waits for fresh values with a delayed response
+	if (updateDelay && drNew == drLookup(&respCode))
 	{
-		szHartResp[respBufferSize] = 3;  // Byte count
+		respCode = drInitiate(FALSE);
 	}
-	else
-	{
-		szHartResp[respBufferSize] = 10;  // Byte count
-	}
-	++respBufferSize;							
-	szHartResp[respBufferSize] = 0;   // Device Status high byte
-	++respBufferSize;							
-	szHartResp[respBufferSize] = (startUpDataLocalV.fromPrimary) ? 
-		startUpDataLocalNv.Primary_status : 
-		startUpDataLocalNv.Secondary_status;  // Status byte
-	++respBufferSize;		
 	if (respCode)
 	{
-		szHartResp[respBufferSize] = respCode;   // Command-specific response code
-		++respBufferSize;							
-	}
-	else
-	{
-		// Loop current
-		copyFloatToRespBuf(loopCurrent);
-		// Now PV as a % of range	
-		copyFloatToRespBuf(pvPercent);
+		common_tx_error(respCode);
+		return;
 	}
+	stRespCursor rc = respOpen();
+	put_u8(&rc, 10);  // Byte count
+	put_u8(&rc, 0);   // Device Status high byte
+	put_u8(&rc, (hartDevice.v.fromPrimary) ? 
+		hartDevice.v.Primary_status : 
+		hartDevice.v.Secondary_status);  // Status byte
+	// Loop current
+	put_f32be(&rc, loopCurrent);
+	// Now PV as a % of range	
+	put_f32be(&rc, pvPercent);
+	respClose(&rc);
 }
 
 /*!
@@ -179,50 +152,41 @@ void common_cmd_2(void)
  */
 void common_cmd_3(void)
 {
-	float loopCurrent = (TRUE == updateInProgress) ? reportingLoopCurrent : ma4_20;
-	unsigned char respCode = (updateDelay) ? UPDATE_FAILURE : RESP_SUCCESS;
+	float loopCurrent = pvDerived.loopCurrent;
 	// Make sure the SV units returned are capped at 250 
-	unsigned char SVunits = (250 <= u9900Database.db.UnitsSecondaryVar) ? NOT_USED : 
-		u9900Database.db.UnitsSecondaryVar;
-	if (respCode)
+	unsigned char SVunits = (250 <= hsbCtx.database.db.UnitsSecondaryVar) ? NOT_USED : 
+		hsbCtx.database.db.UnitsSecondaryVar;
+	unsigned char respCode = RESP_SUCCESS;
+	// While the 9900 updates are delayed, the master waits for fresh values with a delayed response
+	if (updateDelay && drNew == drLookup(&respCode))
 	{
-		szHartResp[respBufferSize] = 3;  // Byte count
+		respCode = drInitiate(FALSE);
 	}
-	else
-	{
-		// returning both PV & SV
-		//szHartResp[respBufferSize] = 16;  // Byte count
-	  //!MH  1/17/13 Fix: UAL011b 3262 Command 9 and Command 3 secondary values are not consist
-	  //  We should not send more than supported
-	  szHartResp[respBufferSize] = (NOT_USED == SVunits) ? 11 : 16;  // Byte count
-	}
-	++respBufferSize;							
-	szHartResp[respBufferSize] = 0;   // Device Status high byte
-	++respBufferSize;							
-	szHartResp[respBufferSize] = (startUpDataLocalV.fromPrimary) ? 
-		startUpDataLocalNv.Primary_status : startUpDataLocalNv.Secondary_status;  // Status byte
-	++respBufferSize;	
 	if (respCode)
 	{
-		// Cmd-specific response code
-		szHartResp[respBufferSize] = respCode;   // Command-specific response code
-		++respBufferSize;							
+		common_tx_error(respCode);
+		return;
 	}
-	else
+	// returning both PV & SV
+	//szHartResp[respBufferSize] = 16;  // Byte count
+	//!MH  1/17/13 Fix: UAL011b 3262 Command 9 and Command 3 secondary values are not consist
+	//  We should not send more than supported
+	stRespCursor rc = respOpen();
+	put_u8(&rc, (NOT_USED == SVunits) ? 11 : 16);  // Byte count
+	put_u8(&rc, 0);   // Device Status high byte
+	put_u8(&rc, (hartDevice.v.fromPrimary) ? 
+		hartDevice.v.Primary_status : hartDevice.v.Secondary_status);  // Status byte
+	// Loop current first	
+	put_f32be(&rc, loopCurrent);					
+	// Now the PV
+	put_u8(&rc, hsbCtx.database.db.UnitsPrimaryVar);
+	put_f32be(&rc, PVvalue);					
+	if (NOT_USED != SVunits)    //!MH - DO not send ANY reference to SV if instrument can't handle
 	{
-		// Loop current first	
-		copyFloatToRespBuf(loopCurrent);					
-		// Now the PV
-		szHartResp[respBufferSize] = u9900Database.db.UnitsPrimaryVar;
-		++respBufferSize;
-		copyFloatToRespBuf(PVvalue);					
-		if (NOT_USED != SVunits)    //!MH - DO not send ANY reference to SV if instrument can't handle
-		{
-			szHartResp[respBufferSize] = SVunits;
-			++respBufferSize;
-			copyFloatToRespBuf(SVvalue);
-		}
-	}					
+		put_u8(&rc, SVunits);
+		put_f32be(&rc, SVvalue);
+	}
+	respClose(&rc);
 }
 
 /*!
@@ -233,11 +197,11 @@ void common_cmd_6(void)
 {
 	unsigned char pollAddress;
 	// First check to see if we have too few bytes
-	unsigned char respCode = (0 == hartDataCount) ? TOO_FEW_DATA_BYTES : RESP_SUCCESS;
+	unsigned char respCode = (0 == hartCtx.dataCount) ? TOO_FEW_DATA_BYTES : RESP_SUCCESS;
 	// If we have enough bytes, make sure the poll address is valid
 	if (!respCode)
 	{
-		pollAddress = (longAddressFlag) ? szHartCmd[LONG_DATA_OFFSET] : szHartCmd[SHORT_DATA_OFFSET];
+		pollAddress = (hartCtx.bLongAddr) ? hartCtx.cmd[LONG_DATA_OFFSET] : hartCtx.cmd[SHORT_DATA_OFFSET];
 		if (63 < pollAddress)
 		{
 			respCode = INVALID_POLL_ADDR_SEL;
@@ -251,57 +215,51 @@ void common_cmd_6(void)
 	else // We can execute the command from here
 	{
 		// Change the poll address in the local startup data
-		startUpDataLocalNv.PollingAddress = pollAddress;
+		hartDevice.nv.PollingAddress = pollAddress;
 		// Now grab the current mode from the command buffer if it is there
-		if (2 == hartDataCount)
+		if (2 == hartCtx.dataCount)
 		{
-			startUpDataLocalNv.currentMode = (longAddressFlag) ? szHartCmd[LONG_DATA_OFFSET+1] : szHartCmd[SHORT_DATA_OFFSET+1];
+			hartDevice.nv.currentMode = (hartCtx.bLongAddr) ? hartCtx.cmd[LONG_DATA_OFFSET+1] : hartCtx.cmd[SHORT_DATA_OFFSET+1];
 		}
-		else if ((1 == hartDataCount) && (0 < pollAddress))
+		else if ((1 == hartCtx.dataCount) && (0 < pollAddress))
 		{
 			// Current mode is disabled for a single byte, non-0 poll address
-			startUpDataLocalNv.currentMode = CURRENT_MODE_DISABLE;
+			hartDevice.nv.currentMode = CURRENT_MODE_DISABLE;
 		}
-		else if ((1 == hartDataCount) && (0 == pollAddress))
+		else if ((1 == hartCtx.dataCount) && (0 == pollAddress))
 		{
 			// Current mode is disabled for a single byte, non-0 poll address
-			startUpDataLocalNv.currentMode = CURRENT_MODE_ENABLE;
+			hartDevice.nv.currentMode = CURRENT_MODE_ENABLE;
 		}
 		// Now set the current based upon the command
-		if (CURRENT_MODE_DISABLE == startUpDataLocalNv.currentMode)
+		if (CURRENT_MODE_DISABLE == hartDevice.nv.currentMode)
 		{
 			// Tell the 9900 to go to fixed current mode at 4 mA
 			setFixedCurrentMode(4.0);
-			setPrimaryStatusBits(FD_STATUS_PV_ANALOG_FIXED);
-			setSecondaryStatusBits(FD_STATUS_PV_ANALOG_FIXED);
+			setStatusBits(STATUS_BOTH, FD_STATUS_PV_ANALOG_FIXED);
 		}
 		else
 		{
 			// Tell the 9900 to go to loop reporting current mode
 			setFixedCurrentMode(0.0);
-			clrPrimaryStatusBits(FD_STATUS_PV_ANALOG_FIXED);
-			clrSecondaryStatusBits(FD_STATUS_PV_ANALOG_FIXED);
+			clrStatusBits(STATUS_BOTH, FD_STATUS_PV_ANALOG_FIXED);
 		}
 		// Set the change flags
-		setPrimaryMasterChg();
-		setSecondaryMasterChg();
+		setStatusBits(STATUS_BOTH, FD_STATUS_CONFIG_CHANGED);
 		incrementConfigCount();
 		// Set up to write RAM to FLASH
-		updateNvRam = TRUE;					
+		markNvDirty(NV_DIRTY_LOOP);					
 		// Now build the response buffer
-		szHartResp[respBufferSize] = 4;
-		++respBufferSize;
-		szHartResp[respBufferSize] = 0;   // Device Status high byte
-		++respBufferSize;							
-		szHartResp[respBufferSize] = (startUpDataLocalV.fromPrimary) ? 
-			startUpDataLocalNv.Primary_status : startUpDataLocalNv.Secondary_status;  // Status byte
-		++respBufferSize;
+		stRespCursor rc = respOpen();
+		put_u8(&rc, 4);
+		put_u8(&rc, 0);   // Device Status high byte
+		put_u8(&rc, (hartDevice.v.fromPrimary) ? 
+			hartDevice.v.Primary_status : hartDevice.v.Secondary_status);  // Status byte
 		// Parrot back the poll address							
-		szHartResp[respBufferSize] = startUpDataLocalNv.PollingAddress;   
-		++respBufferSize;	
+		put_u8(&rc, hartDevice.nv.PollingAddress);
 		// Return the current mode
-		szHartResp[respBufferSize] = startUpDataLocalNv.currentMode; 
-		++respBufferSize;	
+		put_u8(&rc, hartDevice.nv.currentMode);
+		respClose(&rc);
 	}	
 }
 
@@ -312,18 +270,15 @@ void common_cmd_6(void)
 void common_cmd_7(void)
 {
 	// This command always succeeds
-	szHartResp[respBufferSize] = 4;  // Byte count
-	++respBufferSize;							
-	szHartResp[respBufferSize] = 0;   // Device Status high byte
-	++respBufferSize;							
-	szHartResp[respBufferSize] = (startUpDataLocalV.fromPrimary) ? 
-		startUpDataLocalNv.Primary_status : 
-		startUpDataLocalNv.Secondary_status;  // Status byte
-	++respBufferSize;		
-	szHartResp[respBufferSize] = startUpDataLocalNv.PollingAddress;   // Polling address
-	++respBufferSize;							
-	szHartResp[respBufferSize] = startUpDataLocalNv.currentMode;   // Loop current mode
-	++respBufferSize;							
+	stRespCursor rc = respOpen();
+	put_u8(&rc, 4);  // Byte count
+	put_u8(&rc, 0);   // Device Status high byte
+	put_u8(&rc, (hartDevice.v.fromPrimary) ? 
+		hartDevice.v.Primary_status : 
+		hartDevice.v.Secondary_status);  // Status byte
+	put_u8(&rc, hartDevice.nv.PollingAddress);   // Polling address
+	put_u8(&rc, hartDevice.nv.currentMode);   // Loop current mode
+	respClose(&rc);
 }
 
 /*!
@@ -332,42 +287,37 @@ void common_cmd_7(void)
  */
 void common_cmd_8(void)
 {
-	szHartResp[respBufferSize] = 6;  // Byte count
-	++respBufferSize;							
-	szHartResp[respBufferSize] = 0;   // Device Status high byte
-	++respBufferSize;							
-	szHartResp[respBufferSize] = (startUpDataLocalV.fromPrimary) ? 
-		startUpDataLocalNv.Primary_status : startUpDataLocalNv.Secondary_status;  // Status byte
-	++respBufferSize;	
+	stRespCursor rc = respOpen();
+	put_u8(&rc, 6);  // Byte count
+	put_u8(&rc, 0);   // Device Status high byte
+	put_u8(&rc, (hartDevice.v.fromPrimary) ? 
+		hartDevice.v.Primary_status : hartDevice.v.Secondary_status);  // Status byte
 	//
-	unsigned char PvHartClassification = u9900Database.db.Hart_Dev_Var_Class;
+	unsigned char PvHartClassification = hsbCtx.database.db.Hart_Dev_Var_Class;
 	// PV classification
-	szHartResp[respBufferSize] = PvHartClassification;
-	++respBufferSize;
+	put_u8(&rc, PvHartClassification);
 	//
 	//!MH 1/17/13  Fix to pass test UAL012
 	unsigned char SvHartClassification = DVC_TEMPERATURE;   // Works for most SV
 
-	if (250 <= u9900Database.db.UnitsSecondaryVar)          //  We don't have SV
+	if (250 <= hsbCtx.database.db.UnitsSecondaryVar)          //  We don't have SV
 	  SvHartClassification = NOT_USED;  // !MH was 0;
 	else
 	  /* We have a SV and need to know its classification, Temp is set as default */
 	  if(PvHartClassification == DVC_LEVEL)                 // Is the special case LEVEL */
-	    if(u9900Database.db.UnitsSecondaryVar == VOLUME_PER_MASS_UNITS_LB ||
-	        u9900Database.db.UnitsSecondaryVar == VOLUME_PER_MASS_UNITS_KG )  // last 2 cases by asking used units in SV
+	    if(hsbCtx.database.db.UnitsSecondaryVar == VOLUME_PER_MASS_UNITS_LB ||
+	        hsbCtx.database.db.UnitsSecondaryVar == VOLUME_PER_MASS_UNITS_KG )  // last 2 cases by asking used units in SV
 	      SvHartClassification = DVC_VOLUME_PER_MASS;
 	    else
 	      SvHartClassification = DVC_VOLUME_PER_VOLUME;
 
-	szHartResp[respBufferSize] = SvHartClassification;
-	++respBufferSize;	
+	put_u8(&rc, SvHartClassification);
 
 	// units are the TV units				
-	szHartResp[respBufferSize] = NOT_USED;   
-	++respBufferSize;	
+	put_u8(&rc, NOT_USED);
 	// units are the QV units				
-	szHartResp[respBufferSize] = NOT_USED;   
-	++respBufferSize;	
+	put_u8(&rc, NOT_USED);
+	respClose(&rc);
 }
 
 
@@ -377,25 +327,25 @@ void common_cmd_8(void)
  */
 void common_cmd_9(void)
 {
-	float loopCurrent = (TRUE == updateInProgress) ? reportingLoopCurrent : ma4_20;
-	float pvPercent = CalculatePercentRange(u9900Database.db.LOOP_SET_HIGH_LIMIT.floatVal,
-		u9900Database.db.LOOP_SET_LOW_LIMIT.floatVal, PVvalue);
+	// The loop current and percent of range are refreshed with each update, just copy them
+	float loopCurrent = pvDerived.loopCurrent;
+	float pvPercent = pvDerived.pvPercentRange;
 	unsigned char respCode = (deviceBusyFlag) ? HART_DEVICE_BUSY : RESP_SUCCESS;
 	// Make sure we don't respond to more than 8 requests
-	unsigned char numVars = (hartDataCount > 8) ? 8 : hartDataCount;
+	unsigned char numVars = (hartCtx.dataCount > 8) ? 8 : hartCtx.dataCount;
 	unsigned char index, reqVar, reqVarIdx;
 	// Did we request too few variables?
-	if (0 == hartDataCount)
+	if (0 == hartCtx.dataCount)
 	{
 		respCode = TOO_FEW_DATA_BYTES;
 	}
 	// get the index to the first requested variable
-	reqVarIdx = respBufferSize+1;
+	reqVarIdx = hartCtx.respSize+1;
 	// Now determine if there is an invalid selection of 0xFF. If any requested variable
 	// is illegal, set the response code & exit with error
 	for (index = 0; index < numVars; ++index)
 	{
-		if (DVC_INVALID_SELECTION == szHartCmd[index + reqVarIdx])
+		if (DVC_INVALID_SELECTION == hartCtx.cmd[index + reqVarIdx])
 		{
 			respCode = INVALID_SELECTION;
 			break;
@@ -408,59 +358,48 @@ void common_cmd_9(void)
 	else
 	{
 		// Calculate response size
-		szHartResp[respBufferSize] = (numVars * 8) + 7;  // Byte count
-		++respBufferSize;							
-		szHartResp[respBufferSize] = respCode;   // Device Status high byte (response code)
-		++respBufferSize;							
-		szHartResp[respBufferSize] = (startUpDataLocalV.fromPrimary) ? 
-			startUpDataLocalNv.Primary_status : startUpDataLocalNv.Secondary_status;  // Status byte
-		++respBufferSize;							
+		stRespCursor rc = respOpen();
+		put_u8(&rc, (numVars * 8) + 7);  // Byte count
+		put_u8(&rc, respCode);   // Device Status high byte (response code)
+		put_u8(&rc, (hartDevice.v.fromPrimary) ? 
+			hartDevice.v.Primary_status : hartDevice.v.Secondary_status);  // Status byte
 		// First byte: extended status
-		szHartResp[respBufferSize] = startUpDataLocalV.extendFieldDevStatus;
-		++respBufferSize;							
+		put_u8(&rc, hartDevice.v.extendFieldDevStatus);
 		// now loop through each request. Only respond t 0 & 1
 		for (index = 0; index < numVars; ++index)
 		{
 			// What variable is requested?
-			reqVar = szHartCmd[index + reqVarIdx];
+			reqVar = hartCtx.cmd[index + reqVarIdx];
 			// what we do depends on the variable requested
 			switch (reqVar)
 			{
 			case DVC_PV: // return PV
 			case DVC_PRIMARY_VARIABLE:
 				// Device Variable code
-				szHartResp[respBufferSize] = reqVar;   
-				++respBufferSize;		
+				put_u8(&rc, reqVar);
 				// Device variable classification - read from 9900 database					
-				szHartResp[respBufferSize] = u9900Database.db.Hart_Dev_Var_Class;   
-				++respBufferSize;			
+				put_u8(&rc, hsbCtx.database.db.Hart_Dev_Var_Class);
 				// Units code				
-				szHartResp[respBufferSize] = u9900Database.db.UnitsPrimaryVar;   
-				++respBufferSize;
+				put_u8(&rc, hsbCtx.database.db.UnitsPrimaryVar);
 				// Value
-				copyFloatToRespBuf(PVvalue);
+				put_f32be(&rc, PVvalue);
 				// Status							
-				szHartResp[respBufferSize] = PVvariableStatus;   
-				++respBufferSize;			
+				put_u8(&rc, PVvariableStatus);
 				break;
 			case DVC_SV: // return SV
 			case DVC_SECONDARY_VARIABLE:
 				// Device Variable code
-				szHartResp[respBufferSize] = reqVar;   
-				++respBufferSize;
-				if (NOT_USED > u9900Database.db.UnitsSecondaryVar)
+				put_u8(&rc, reqVar);
+				if (NOT_USED > hsbCtx.database.db.UnitsSecondaryVar)
 				{		
 					// Device variable classification					
-					szHartResp[respBufferSize] = u9900Database.db.Hart_Dev_Var_Class;   
-					++respBufferSize;			
+					put_u8(&rc, hsbCtx.database.db.Hart_Dev_Var_Class);
 					// Units code				
-					szHartResp[respBufferSize] = u9900Database.db.UnitsSecondaryVar;   
-					++respBufferSize;
+					put_u8(&rc, hsbCtx.database.db.UnitsSecondaryVar);
 					// Value
-					copyFloatToRespBuf(SVvalue);
+					put_f32be(&rc, SVvalue);
 					// Status - it is just considered good							
-					szHartResp[respBufferSize] = PVvariableStatus;   
-					++respBufferSize;			
+					put_u8(&rc, PVvariableStatus);
 				}
 				else
 				{
@@ -472,84 +411,62 @@ void common_cmd_9(void)
 				  //  Status = BAD,  Limit= CONSTANT, Unit code 250 (NOT_USED)
 
 				  // Device variable classification
-					szHartResp[respBufferSize] = DVC_DEVICE_VAR_NOT_CLASSIFIED;
-					++respBufferSize;
+					put_u8(&rc, DVC_DEVICE_VAR_NOT_CLASSIFIED);
 					// Units code				
-					szHartResp[respBufferSize] = NOT_USED;
-					++respBufferSize;
+					put_u8(&rc, NOT_USED);
 					// Value
-					szHartResp[respBufferSize] = 0x7F;   
-					++respBufferSize;			
-					szHartResp[respBufferSize] = 0xA0;   
-					++respBufferSize;			
-					szHartResp[respBufferSize] = 0;   
-					++respBufferSize;			
-					szHartResp[respBufferSize] = 0;   
-					++respBufferSize;		
+					put_u8(&rc, 0x7F);
+					put_u8(&rc, 0xA0);
+					put_u8(&rc, 0);
+					put_u8(&rc, 0);
 					// Status							
-					szHartResp[respBufferSize] = VAR_STATUS_BAD | LIM_STATUS_CONST;   
-					++respBufferSize;			
+					put_u8(&rc, VAR_STATUS_BAD | LIM_STATUS_CONST);
 				}
 				break;
 			case DVC_PERCENT_RANGE:
 				// Device Variable code
-				szHartResp[respBufferSize] = reqVar;   
-				++respBufferSize;		
+				put_u8(&rc, reqVar);
 				// Device variable classification					
-				szHartResp[respBufferSize] = u9900Database.db.Hart_Dev_Var_Class;   
-				++respBufferSize;			
+				put_u8(&rc, hsbCtx.database.db.Hart_Dev_Var_Class);
 				// Units code				
-				szHartResp[respBufferSize] = PERCENT;   
-				++respBufferSize;
+				put_u8(&rc, PERCENT);
 				// calculate the % of range
-				copyFloatToRespBuf(pvPercent);
+				put_f32be(&rc, pvPercent);
 				// Status							
-				szHartResp[respBufferSize] = PVvariableStatus;   
-				++respBufferSize;			
+				put_u8(&rc, PVvariableStatus);
 				break;
 			case DVC_LOOP_CURRENT:	
 				// Device Variable code
-				szHartResp[respBufferSize] = reqVar;   
-				++respBufferSize;		
+				put_u8(&rc, reqVar);
 				// Device variable classification					
-				szHartResp[respBufferSize] = u9900Database.db.Hart_Dev_Var_Class;   
-				++respBufferSize;			
+				put_u8(&rc, hsbCtx.database.db.Hart_Dev_Var_Class);
 				// Units code				
-				szHartResp[respBufferSize] = MILLIAMPS;   
-				++respBufferSize;
+				put_u8(&rc, MILLIAMPS);
 				// Value
-				copyFloatToRespBuf(loopCurrent);
+				put_f32be(&rc, loopCurrent);
 				// Status							
-				szHartResp[respBufferSize] = PVvariableStatus;   
-				++respBufferSize;			
+				put_u8(&rc, PVvariableStatus);
 				break;
 			default: // return the not supported response
 				// Device Variable code
-				szHartResp[respBufferSize] = reqVar;   
-				++respBufferSize;		
+				put_u8(&rc, reqVar);
 				// Device variable classification					
-				szHartResp[respBufferSize] = 0;   
-				++respBufferSize;			
+				put_u8(&rc, 0);
 				// Units code				
-				szHartResp[respBufferSize] = NOT_USED;   
-				++respBufferSize;							
+				put_u8(&rc, NOT_USED);
 				// Value		
-				szHartResp[respBufferSize] = 0x7f;   
-				++respBufferSize;							
-				szHartResp[respBufferSize] = 0xa0;   
-				++respBufferSize;							
-				szHartResp[respBufferSize] = 0;   
-				++respBufferSize;							
-				szHartResp[respBufferSize] = 0;   
-				++respBufferSize;	
+				put_u8(&rc, 0x7f);
+				put_u8(&rc, 0xa0);
+				put_u8(&rc, 0);
+				put_u8(&rc, 0);
 				// Status						
-				szHartResp[respBufferSize] = VAR_STATUS_BAD | LIM_STATUS_CONST;   
-				++respBufferSize;					
+				put_u8(&rc, VAR_STATUS_BAD | LIM_STATUS_CONST);
 				break;
 			}
 		}
 		// data time stamp 
-		copyLongToRespBuf(dataTimeStamp);
+		put_u32be(&rc, dataTimeStamp);
+		respClose(&rc);
 	}
 }
 
@@ -559,7 +476,7 @@ void common_cmd_9(void)
  */
 void common_cmd_11(void)
 {
-	if (!memcmp(&(szHartCmd[respBufferSize+1]), &(startUpDataLocalNv.TagName[0]), SHORT_TAG_SIZE))
+	if (!memcmp(&(hartCtx.cmd[hartCtx.respSize+1]), &(hartDevice.nv.TagName[0]), SHORT_TAG_SIZE))
 	{
 		badTagFlag = FALSE;
 		// the first part of the response is identical to command 0
@@ -572,7 +489,7 @@ void common_cmd_11(void)
 		// rtsRcv();   // MH: Not necessary as in "Run to completion" we don't send partial messages
 		// Get ready for a new command
 		// MH substituted prepareToRxFrame();
-		initHartRxSm();
+		initHartRxSm(&hartCtx);
 	}							
 }
 
@@ -583,31 +500,25 @@ void common_cmd_11(void)
 void common_cmd_12(void)
 {
 	unsigned char respCode = (deviceBusyFlag) ? HART_DEVICE_BUSY : RESP_SUCCESS;
+	stRespCursor rc = respOpen();
 	if (respCode)
 	{
-		szHartResp[respBufferSize] = 3;  // Byte count
-		++respBufferSize;							
-		szHartResp[respBufferSize] = 0;   // Device Status high byte
-		++respBufferSize;							
-		szHartResp[respBufferSize] = (startUpDataLocalV.fromPrimary) ? 
-			startUpDataLocalNv.Primary_status : startUpDataLocalNv.Secondary_status;  // Status byte
-		++respBufferSize;							
+		put_u8(&rc, 3);  // Byte count
+		put_u8(&rc, 0);   // Device Status high byte
+		put_u8(&rc, (hartDevice.v.fromPrimary) ? 
+			hartDevice.v.Primary_status : hartDevice.v.Secondary_status);  // Status byte
 		// Cmd-specific response code
-		szHartResp[respBufferSize] = respCode;   // Command-specific response code
-		++respBufferSize;							
+		put_u8(&rc, respCode);   // Command-specific response code
 	}
 	else
 	{
-		szHartResp[respBufferSize] = 26;  // Byte count
-		++respBufferSize;							
-		szHartResp[respBufferSize] = 0;   // Device Status high byte
-		++respBufferSize;							
-		szHartResp[respBufferSize] = (startUpDataLocalV.fromPrimary) ? 
-			startUpDataLocalNv.Primary_status : startUpDataLocalNv.Secondary_status;  // Status byte
-		++respBufferSize;							
-		memcpy(&(szHartResp[respBufferSize]), &startUpDataLocalNv.HARTmsg, 24);
-		respBufferSize += 24;
+		put_u8(&rc, 26);  // Byte count
+		put_u8(&rc, 0);   // Device Status high byte
+		put_u8(&rc, (hartDevice.v.fromPrimary) ? 
+			hartDevice.v.Primary_status : hartDevice.v.Secondary_status);  // Status byte
+		put_bytes(&rc, &hartDevice.nv.HARTmsg, 24);
 	}
+	respClose(&rc);
 }
 
 /*!
@@ -617,32 +528,26 @@ void common_cmd_12(void)
 void common_cmd_13(void)
 {
 	unsigned char respCode = (deviceBusyFlag) ? HART_DEVICE_BUSY : RESP_SUCCESS;
+	stRespCursor rc = respOpen();
 	if (respCode)
 	{
-		szHartResp[respBufferSize] = 3;  // Byte count
-		++respBufferSize;							
-		szHartResp[respBufferSize] = 0;   // Device Status high byte
-		++respBufferSize;							
-		szHartResp[respBufferSize] = (startUpDataLocalV.fromPrimary) ? 
-			startUpDataLocalNv.Primary_status : startUpDataLocalNv.Secondary_status;  // Status byte
-		++respBufferSize;							
+		put_u8(&rc, 3);  // Byte count
+		put_u8(&rc, 0);   // Device Status high byte
+		put_u8(&rc, (hartDevice.v.fromPrimary) ? 
+			hartDevice.v.Primary_status : hartDevice.v.Secondary_status);  // Status byte
 		// Cmd-specific response code
-		szHartResp[respBufferSize] = respCode;   // Command-specific response code
-		++respBufferSize;							
+		put_u8(&rc, respCode);   // Command-specific response code
 	}
 	else
 	{
-		szHartResp[respBufferSize] = 23;  // Byte count
-		++respBufferSize;							
-		szHartResp[respBufferSize] = 0;   // Device Status high byte
-		++respBufferSize;							
-		szHartResp[respBufferSize] = (startUpDataLocalV.fromPrimary) ? 
-			startUpDataLocalNv.Primary_status : startUpDataLocalNv.Secondary_status;  // Status byte
-		++respBufferSize;
+		put_u8(&rc, 23);  // Byte count
+		put_u8(&rc, 0);   // Device Status high byte
+		put_u8(&rc, (hartDevice.v.fromPrimary) ? 
+			hartDevice.v.Primary_status : hartDevice.v.Secondary_status);  // Status byte
 		// Since the are store together, just write them out	
-		memcpy(&(szHartResp[respBufferSize]), &startUpDataLocalNv.TagName, 21);
-		respBufferSize += 21;	
+		put_bytes(&rc, &hartDevice.nv.TagName, 21);
 	}					
+	respClose(&rc);
 }
 
 
@@ -654,45 +559,36 @@ void common_cmd_14(void)
 {
 	float span = 0.0;
 	unsigned char respCode = (deviceBusyFlag) ? HART_DEVICE_BUSY : RESP_SUCCESS;
+	stRespCursor rc = respOpen();
 	if (respCode)
 	{
-		szHartResp[respBufferSize] = 3;  // Byte count
-		++respBufferSize;							
-		szHartResp[respBufferSize] = 0;   // Device Status high byte
-		++respBufferSize;							
-		szHartResp[respBufferSize] = (startUpDataLocalV.fromPrimary) ? 
-			startUpDataLocalNv.Primary_status : startUpDataLocalNv.Secondary_status;  // Status byte
-		++respBufferSize;							
+		put_u8(&rc, 3);  // Byte count
+		put_u8(&rc, 0);   // Device Status high byte
+		put_u8(&rc, (hartDevice.v.fromPrimary) ? 
+			hartDevice.v.Primary_status : hartDevice.v.Secondary_status);  // Status byte
 		// Cmd-specific response code
-		szHartResp[respBufferSize] = respCode;   // Command-specific response code
-		++respBufferSize;							
+		put_u8(&rc, respCode);   // Command-specific response code
 	}
 	else
 	{
-		szHartResp[respBufferSize] = 18;  // Byte count
-		++respBufferSize;							
-		szHartResp[respBufferSize] = 0;   // Device Status high byte
-		++respBufferSize;							
-		szHartResp[respBufferSize] = (startUpDataLocalV.fromPrimary) ? 
-			startUpDataLocalNv.Primary_status : startUpDataLocalNv.Secondary_status;  // Status byte
-		++respBufferSize;	
+		put_u8(&rc, 18);  // Byte count
+		put_u8(&rc, 0);   // Device Status high byte
+		put_u8(&rc, (hartDevice.v.fromPrimary) ? 
+			hartDevice.v.Primary_status : hartDevice.v.Secondary_status);  // Status byte
 		// The transducer S/N is 0
-		szHartResp[respBufferSize] = 0;   // Sensor S/N
-		++respBufferSize;							
-		szHartResp[respBufferSize] = 0;   // Sensor S/N
-		++respBufferSize;							
-		szHartResp[respBufferSize] = 0;   // Sensor S/N
-		++respBufferSize;			
+		put_u8(&rc, 0);   // Sensor S/N
+		put_u8(&rc, 0);   // Sensor S/N
+		put_u8(&rc, 0);   // Sensor S/N
 		// Transducer units are the PV units
-		szHartResp[respBufferSize] = u9900Database.db.UnitsPrimaryVar;   
-		++respBufferSize;			
+		put_u8(&rc, hsbCtx.database.db.UnitsPrimaryVar);
 		// Now the High limit from the database				
-		copyFloatToRespBuf(u9900Database.db.LOOP_SET_HIGH_LIMIT.floatVal);					
+		put_f32be(&rc, hsbCtx.database.db.LOOP_SET_HIGH_LIMIT.floatVal);					
 		// Now the low limit from the database				
-		copyFloatToRespBuf(u9900Database.db.LOOP_SET_LOW_LIMIT.floatVal);					
+		put_f32be(&rc, hsbCtx.database.db.LOOP_SET_LOW_LIMIT.floatVal);					
 		// the minimum span is 0				
-		copyFloatToRespBuf(span);					
+		put_f32be(&rc, span);					
 	}
+	respClose(&rc);
 }
 
 
@@ -704,53 +600,42 @@ void common_cmd_15(void)
 {
 	float damping = 0.0;
 	unsigned char respCode = (deviceBusyFlag) ? HART_DEVICE_BUSY : RESP_SUCCESS;
+	stRespCursor rc = respOpen();
 	if (respCode)
 	{
-		szHartResp[respBufferSize] = 3;  // Byte count
-		++respBufferSize;							
-		szHartResp[respBufferSize] = 0;   // Device Status high byte
-		++respBufferSize;							
-		szHartResp[respBufferSize] = (startUpDataLocalV.fromPrimary) ? 
-			startUpDataLocalNv.Primary_status : startUpDataLocalNv.Secondary_status;  // Status byte
-		++respBufferSize;							
+		put_u8(&rc, 3);  // Byte count
+		put_u8(&rc, 0);   // Device Status high byte
+		put_u8(&rc, (hartDevice.v.fromPrimary) ? 
+			hartDevice.v.Primary_status : hartDevice.v.Secondary_status);  // Status byte
 		// Cmd-specific response code
-		szHartResp[respBufferSize] = respCode;   // Command-specific response code
-		++respBufferSize;							
+		put_u8(&rc, respCode);   // Command-specific response code
 	}
 	else
 	{
-		szHartResp[respBufferSize] = 20;  // Byte count
-		++respBufferSize;							
-		szHartResp[respBufferSize] = DEV_STATUS_HIGH_BYTE;   // Device Status high byte
-		++respBufferSize;							
-		szHartResp[respBufferSize] = (startUpDataLocalV.fromPrimary) ? 
-			startUpDataLocalNv.Primary_status : startUpDataLocalNv.Secondary_status;  // Status byte
-		++respBufferSize;	
+		put_u8(&rc, 20);  // Byte count
+		put_u8(&rc, DEV_STATUS_HIGH_BYTE);   // Device Status high byte
+		put_u8(&rc, (hartDevice.v.fromPrimary) ? 
+			hartDevice.v.Primary_status : hartDevice.v.Secondary_status);  // Status byte
 		// Alarm selection
-		szHartResp[respBufferSize] = ALARM_CODE_LOOP_HIGH;   
-		++respBufferSize;	
+		put_u8(&rc, ALARM_CODE_LOOP_HIGH);
 		// Transfer function						
-		szHartResp[respBufferSize] = XFR_FUNCTION_NONE;   
-		++respBufferSize;	
+		put_u8(&rc, XFR_FUNCTION_NONE);
 		// Upper & lower range units from the DB
-		szHartResp[respBufferSize] = u9900Database.db.UnitsPrimaryVar;   
-		++respBufferSize;	
+		put_u8(&rc, hsbCtx.database.db.UnitsPrimaryVar);
 		// Now the High limit from the database				
-		copyFloatToRespBuf(u9900Database.db.LOOP_SET_HIGH_LIMIT.floatVal);					
+		put_f32be(&rc, hsbCtx.database.db.LOOP_SET_HIGH_LIMIT.floatVal);					
 		// Now the low limit from the database				
-		copyFloatToRespBuf(u9900Database.db.LOOP_SET_LOW_LIMIT.floatVal);					
+		put_f32be(&rc, hsbCtx.database.db.LOOP_SET_LOW_LIMIT.floatVal);					
 		// PV damping value				
-		copyFloatToRespBuf(damping);					
+		put_f32be(&rc, damping);					
 		// Write protect code
-		szHartResp[respBufferSize] = NO_WRITE_PROTECT;   
-		++respBufferSize;	
+		put_u8(&rc, NO_WRITE_PROTECT);
 		// Reserved for now
-		szHartResp[respBufferSize] = NOT_USED;   
-		++respBufferSize;	
+		put_u8(&rc, NOT_USED);
 		// Analog channel bits
-		szHartResp[respBufferSize] = ANALOG_CHANNEL_FLAG;   
-		++respBufferSize;	
+		put_u8(&rc, ANALOG_CHANNEL_FLAG);
 	}
+	respClose(&rc);
 }
 
 /*!
@@ -760,32 +645,26 @@ void common_cmd_15(void)
 void common_cmd_16(void)
 {
 	unsigned char respCode = (deviceBusyFlag) ? HART_DEVICE_BUSY : RESP_SUCCESS;
+	stRespCursor rc = respOpen();
 	if (respCode)
 	{
-		szHartResp[respBufferSize] = 3;  // Byte count
-		++respBufferSize;							
-		szHartResp[respBufferSize] = 0;   // Device Status high byte
-		++respBufferSize;							
-		szHartResp[respBufferSize] = (startUpDataLocalV.fromPrimary) ? 
-			startUpDataLocalNv.Primary_status : startUpDataLocalNv.Secondary_status;  // Status byte
-		++respBufferSize;							
+		put_u8(&rc, 3);  // Byte count
+		put_u8(&rc, 0);   // Device Status high byte
+		put_u8(&rc, (hartDevice.v.fromPrimary) ? 
+			hartDevice.v.Primary_status : hartDevice.v.Secondary_status);  // Status byte
 		// Cmd-specific response code
-		szHartResp[respBufferSize] = respCode;   // Command-specific response code
-		++respBufferSize;							
+		put_u8(&rc, respCode);   // Command-specific response code
 	}
 	else
 	{
-		szHartResp[respBufferSize] = FINAL_ASSY_SIZE+2;  // Byte count
-		++respBufferSize;							
-		szHartResp[respBufferSize] = 0;   // Device Status high byte
-		++respBufferSize;							
-		szHartResp[respBufferSize] = (startUpDataLocalV.fromPrimary) ? 
-			startUpDataLocalNv.Primary_status : startUpDataLocalNv.Secondary_status;  // Status byte
-		++respBufferSize;
+		put_u8(&rc, FINAL_ASSY_SIZE+2);  // Byte count
+		put_u8(&rc, 0);   // Device Status high byte
+		put_u8(&rc, (hartDevice.v.fromPrimary) ? 
+			hartDevice.v.Primary_status : hartDevice.v.Secondary_status);  // Status byte
 		// Final Assembly
-		memcpy(&(szHartResp[respBufferSize]), &startUpDataLocalNv.FinalAssy, FINAL_ASSY_SIZE);
-		respBufferSize += FINAL_ASSY_SIZE;	
+		put_bytes(&rc, &hartDevice.nv.FinalAssy, FINAL_ASSY_SIZE);
 	}
+	respClose(&rc);
 }
 
 
@@ -796,7 +675,7 @@ void common_cmd_16(void)
 void common_cmd_17(void)
 {
 	// First check to see if we have too few bytes
-	unsigned char respCode = (HART_MSG_SIZE > hartDataCount) ? TOO_FEW_DATA_BYTES : RESP_SUCCESS;
+	unsigned char respCode = (HART_MSG_SIZE > hartCtx.dataCount) ? TOO_FEW_DATA_BYTES : RESP_SUCCESS;
 	// If we have enough bytes, make sure the poll address is valid
 	if (!respCode)
 	{
@@ -810,24 +689,21 @@ void common_cmd_17(void)
 	else // We can execute the command from here
 	{
 		// Set the change flags
-		setPrimaryMasterChg();
-		setSecondaryMasterChg();
+		setStatusBits(STATUS_BOTH, FD_STATUS_CONFIG_CHANGED);
 		incrementConfigCount();
 		// Copy the data into the local structure
-		memcpy(startUpDataLocalNv.HARTmsg, &(szHartCmd[respBufferSize+1]), HART_MSG_SIZE);
+		memcpy(hartDevice.nv.HARTmsg, &(hartCtx.cmd[hartCtx.respSize+1]), HART_MSG_SIZE);
 		// Set up to write RAM to FLASH
-		updateNvRam = TRUE;					
+		markNvDirty(NV_DIRTY_IDENT);					
 		// Build the response				
-		szHartResp[respBufferSize] = HART_MSG_SIZE+2;  // Byte count
-		++respBufferSize;							
-		szHartResp[respBufferSize] = 0;   // Device Status high byte
-		++respBufferSize;							
-		szHartResp[respBufferSize] = (startUpDataLocalV.fromPrimary) ? 
-			startUpDataLocalNv.Primary_status : startUpDataLocalNv.Secondary_status;  // Status byte
-		++respBufferSize;	
+		stRespCursor rc = respOpen();
+		put_u8(&rc, HART_MSG_SIZE+2);  // Byte count
+		put_u8(&rc, 0);   // Device Status high byte
+		put_u8(&rc, (hartDevice.v.fromPrimary) ? 
+			hartDevice.v.Primary_status : hartDevice.v.Secondary_status);  // Status byte
 		// Write back the message
-		memcpy(&(szHartResp[respBufferSize]), &startUpDataLocalNv.HARTmsg, HART_MSG_SIZE);
-		respBufferSize += HART_MSG_SIZE;
+		put_bytes(&rc, &hartDevice.nv.HARTmsg, HART_MSG_SIZE);
+		respClose(&rc);
 	}
 }
 
@@ -838,7 +714,7 @@ void common_cmd_17(void)
 void common_cmd_18(void)
 {
 	// First check to see if we have too few bytes
-	unsigned char respCode = (TAG_DESCRIPTOR_DATE_SIZE > hartDataCount) ? TOO_FEW_DATA_BYTES : RESP_SUCCESS;
+	unsigned char respCode = (TAG_DESCRIPTOR_DATE_SIZE > hartCtx.dataCount) ? TOO_FEW_DATA_BYTES : RESP_SUCCESS;
 	// If we have enough bytes, make sure the poll address is valid
 	if (!respCode)
 	{
@@ -852,24 +728,21 @@ void common_cmd_18(void)
 	else // We can execute the command from here
 	{
 		// Set the change flags
-		setPrimaryMasterChg();
-		setSecondaryMasterChg();
+		setStatusBits(STATUS_BOTH, FD_STATUS_CONFIG_CHANGED);
 		incrementConfigCount();
 		// Copy the received string directly into the structure
-		memcpy(&startUpDataLocalNv.TagName, &(szHartCmd[respBufferSize+1]), TAG_DESCRIPTOR_DATE_SIZE);	
+		memcpy(&hartDevice.nv.TagName, &(hartCtx.cmd[hartCtx.respSize+1]), TAG_DESCRIPTOR_DATE_SIZE);	
 		// Set up to write RAM to FLASH
-		updateNvRam = TRUE;					
+		markNvDirty(NV_DIRTY_IDENT);					
 		// Build response
-		szHartResp[respBufferSize] = TAG_DESCRIPTOR_DATE_SIZE+2;  // Byte count
-		++respBufferSize;							
-		szHartResp[respBufferSize] = 0;   // Device Status high byte
-		++respBufferSize;							
-		szHartResp[respBufferSize] = (startUpDataLocalV.fromPrimary) ? 
-			startUpDataLocalNv.Primary_status : startUpDataLocalNv.Secondary_status;  // Status byte
-		++respBufferSize;	
+		stRespCursor rc = respOpen();
+		put_u8(&rc, TAG_DESCRIPTOR_DATE_SIZE+2);  // Byte count
+		put_u8(&rc, 0);   // Device Status high byte
+		put_u8(&rc, (hartDevice.v.fromPrimary) ? 
+			hartDevice.v.Primary_status : hartDevice.v.Secondary_status);  // Status byte
 		// Parrot back what was written
-		memcpy(&(szHartResp[respBufferSize]), &startUpDataLocalNv.TagName, TAG_DESCRIPTOR_DATE_SIZE);
-		respBufferSize += TAG_DESCRIPTOR_DATE_SIZE;
+		put_bytes(&rc, &hartDevice.nv.TagName, TAG_DESCRIPTOR_DATE_SIZE);
+		respClose(&rc);
 	}
 }
 
@@ -880,7 +753,7 @@ void common_cmd_18(void)
 void common_cmd_19(void)
 {
 	// First check to see if we have too few bytes
-	unsigned char respCode = (FINAL_ASSY_SIZE > hartDataCount) ? TOO_FEW_DATA_BYTES : RESP_SUCCESS;
+	unsigned char respCode = (FINAL_ASSY_SIZE > hartCtx.dataCount) ? TOO_FEW_DATA_BYTES : RESP_SUCCESS;
 	// If we have enough bytes, make sure the poll address is valid
 	if (!respCode)
 	{
@@ -894,24 +767,21 @@ void common_cmd_19(void)
 	else // We can execute the command from here
 	{
 		// Set the change flags	
-		setPrimaryMasterChg();
-		setSecondaryMasterChg();
+		setStatusBits(STATUS_BOTH, FD_STATUS_CONFIG_CHANGED);
 		incrementConfigCount();
 		// Copy the final assembly into the database
-		memcpy(&startUpDataLocalNv.FinalAssy, &(szHartCmd[respBufferSize+1]), 3);	
+		memcpy(&hartDevice.nv.FinalAssy, &(hartCtx.cmd[hartCtx.respSize+1]), 3);	
 		// Set up to write RAM to FLASH
-		updateNvRam = TRUE;					
+		markNvDirty(NV_DIRTY_IDENT);					
 		// Build the response
-		szHartResp[respBufferSize] = FINAL_ASSY_SIZE+2;  // Byte count
-		++respBufferSize;							
-		szHartResp[respBufferSize] = 0;   // Device Status high byte
-		++respBufferSize;							
-		szHartResp[respBufferSize] = (startUpDataLocalV.fromPrimary) ? 
-			startUpDataLocalNv.Primary_status : startUpDataLocalNv.Secondary_status;  // Status byte
-		++respBufferSize;	
+		stRespCursor rc = respOpen();
+		put_u8(&rc, FINAL_ASSY_SIZE+2);  // Byte count
+		put_u8(&rc, 0);   // Device Status high byte
+		put_u8(&rc, (hartDevice.v.fromPrimary) ? 
+			hartDevice.v.Primary_status : hartDevice.v.Secondary_status);  // Status byte
 		// Parrot back the final assy
-		memcpy(&(szHartResp[respBufferSize]), &startUpDataLocalNv.FinalAssy, FINAL_ASSY_SIZE);
-		respBufferSize += FINAL_ASSY_SIZE;
+		put_bytes(&rc, &hartDevice.nv.FinalAssy, FINAL_ASSY_SIZE);
+		respClose(&rc);
 	}
 }
 
@@ -923,32 +793,26 @@ void common_cmd_20(void)
 {
 	unsigned char respCode = (deviceBusyFlag) ? HART_DEVICE_BUSY : RESP_SUCCESS;
 
+	stRespCursor rc = respOpen();
 	if (respCode)
 	{
-		szHartResp[respBufferSize] = 3;  // Byte count
-		++respBufferSize;							
-		szHartResp[respBufferSize] = 0;   // Device Status high byte
-		++respBufferSize;							
-		szHartResp[respBufferSize] = (startUpDataLocalV.fromPrimary) ? 
-			startUpDataLocalNv.Primary_status : startUpDataLocalNv.Secondary_status;  // Status byte
-		++respBufferSize;							
+		put_u8(&rc, 3);  // Byte count
+		put_u8(&rc, 0);   // Device Status high byte
+		put_u8(&rc, (hartDevice.v.fromPrimary) ? 
+			hartDevice.v.Primary_status : hartDevice.v.Secondary_status);  // Status byte
 		// Cmd-specific response code
-		szHartResp[respBufferSize] = respCode;   // Command-specific response code
-		++respBufferSize;							
+		put_u8(&rc, respCode);   // Command-specific response code
 	}
 	else
 	{
-		szHartResp[respBufferSize] = LONG_TAG_SIZE + 2;  // Byte count
-		++respBufferSize;							
-		szHartResp[respBufferSize] = 0;   // Device Status high byte
-		++respBufferSize;							
-		szHartResp[respBufferSize] = (startUpDataLocalV.fromPrimary) ? 
-			startUpDataLocalNv.Primary_status : startUpDataLocalNv.Secondary_status;  // Status byte
-		++respBufferSize;
+		put_u8(&rc, LONG_TAG_SIZE + 2);  // Byte count
+		put_u8(&rc, 0);   // Device Status high byte
+		put_u8(&rc, (hartDevice.v.fromPrimary) ? 
+			hartDevice.v.Primary_status : hartDevice.v.Secondary_status);  // Status byte
 		// Final Assembly
-		memcpy(&(szHartResp[respBufferSize]), &startUpDataLocalNv.LongTag, LONG_TAG_SIZE);
-		respBufferSize += LONG_TAG_SIZE;	
+		put_bytes(&rc, &hartDevice.nv.LongTag, LONG_TAG_SIZE);
 	}
+	respClose(&rc);
 }
 
 /*!
@@ -957,7 +821,7 @@ void common_cmd_20(void)
  */
 void common_cmd_21(void)
 {
-	if (!memcmp(&szHartCmd[respBufferSize+1], &startUpDataLocalNv.LongTag, LONG_TAG_SIZE))
+	if (!memcmp(&hartCtx.cmd[hartCtx.respSize+1], &hartDevice.nv.LongTag, LONG_TAG_SIZE))
 	{
 		badTagFlag = FALSE;
 		// the first part of the response is identical to command 0
@@ -970,7 +834,7 @@ void common_cmd_21(void)
 		// rtsRcv();   // MH: Not necessary as in "Run to completion" we don't send partial messages
 		// Get ready for a new command
 		//MH substituted prepareToRxFrame();
-		initHartRxSm();
+		initHartRxSm(&hartCtx);
 	}							
 }
 
@@ -981,7 +845,7 @@ void common_cmd_21(void)
 void common_cmd_22(void)
 {
 	// First check to see if we have too few bytes
-	unsigned char respCode = (LONG_TAG_SIZE > hartDataCount) ? TOO_FEW_DATA_BYTES : RESP_SUCCESS;
+	unsigned char respCode = (LONG_TAG_SIZE > hartCtx.dataCount) ? TOO_FEW_DATA_BYTES : RESP_SUCCESS;
 	// If we have enough bytes, make sure the poll address is valid
 	if (!respCode)
 	{
@@ -995,24 +859,21 @@ void common_cmd_22(void)
 	else // We can execute the command from here
 	{
 		// Set the change flags	
-		setPrimaryMasterChg();
-		setSecondaryMasterChg();
+		setStatusBits(STATUS_BOTH, FD_STATUS_CONFIG_CHANGED);
 		incrementConfigCount();
 		// Copy the final assembly into the database
-		memcpy(&startUpDataLocalNv.LongTag, &(szHartCmd[respBufferSize+1]), LONG_TAG_SIZE);	
+		memcpy(&hartDevice.nv.LongTag, &(hartCtx.cmd[hartCtx.respSize+1]), LONG_TAG_SIZE);	
 		// Set up to write RAM to FLASH
-		updateNvRam = TRUE;					
+		markNvDirty(NV_DIRTY_IDENT);					
 		// Build the response
-		szHartResp[respBufferSize] = LONG_TAG_SIZE+2;  // Byte count
-		++respBufferSize;							
-		szHartResp[respBufferSize] = 0;   // Device Status high byte
-		++respBufferSize;							
-		szHartResp[respBufferSize] = (startUpDataLocalV.fromPrimary) ? 
-			startUpDataLocalNv.Primary_status : startUpDataLocalNv.Secondary_status;  // Status byte
-		++respBufferSize;	
+		stRespCursor rc = respOpen();
+		put_u8(&rc, LONG_TAG_SIZE+2);  // Byte count
+		put_u8(&rc, 0);   // Device Status high byte
+		put_u8(&rc, (hartDevice.v.fromPrimary) ? 
+			hartDevice.v.Primary_status : hartDevice.v.Secondary_status);  // Status byte
 		// Parrot back the final assy
-		memcpy(&(szHartResp[respBufferSize]), &startUpDataLocalNv.LongTag, LONG_TAG_SIZE);
-		respBufferSize += LONG_TAG_SIZE;
+		put_bytes(&rc, &hartDevice.nv.LongTag, LONG_TAG_SIZE);
+		respClose(&rc);
 	}
 }
 
@@ -1042,7 +903,7 @@ void common_cmd_35(void)
 	if (!respCode)
 	{
 		// Check for too few bytes sent 
-		if (9 > hartDataCount)
+		if (9 > hartCtx.dataCount)
 		{
 			respCode = TOO_FEW_DATA_BYTES;
 		} 
@@ -1057,36 +918,39 @@ void common_cmd_35(void)
 	else
 	{
 		// extract the data from the commands
-		if (longAddressFlag)
+		if (hartCtx.bLongAddr)
 		{
-			units = szHartCmd[LONG_DATA_OFFSET];
-			upper = decodeBufferFloat(&(szHartCmd[LONG_DATA_OFFSET+1]));
-			lower = decodeBufferFloat(&(szHartCmd[LONG_DATA_OFFSET+5]));
+			units = hartCtx.cmd[LONG_DATA_OFFSET];
+			upper = decodeBufferFloat(&(hartCtx.cmd[LONG_DATA_OFFSET+1]));
+			lower = decodeBufferFloat(&(hartCtx.cmd[LONG_DATA_OFFSET+5]));
 		}
 		else
 		{
-			units = szHartCmd[SHORT_DATA_OFFSET];
-			upper = decodeBufferFloat(&(szHartCmd[SHORT_DATA_OFFSET+1]));
-			lower = decodeBufferFloat(&(szHartCmd[SHORT_DATA_OFFSET+5]));
+			units = hartCtx.cmd[SHORT_DATA_OFFSET];
+			upper = decodeBufferFloat(&(hartCtx.cmd[SHORT_DATA_OFFSET+1]));
+			lower = decodeBufferFloat(&(hartCtx.cmd[SHORT_DATA_OFFSET+5]));
+		}
+		// set up the request, busy if the 9900 request queue is full
+		respCode = setBothRangeVals(upper, lower);
+		if (respCode)
+		{
+			common_tx_error(respCode);
+			return;
 		}
-		// set up the request
-		setBothRangeVals(upper, lower);
 		// Now build the response
 		// Now build the response buffer
-		szHartResp[respBufferSize] = 11;
-		++respBufferSize;
+		stRespCursor rc = respOpen();
+		put_u8(&rc, 11);
 		// Send status as usual
-		szHartResp[respBufferSize] = 0;   // Device Status high byte
-		++respBufferSize;							
-		szHartResp[respBufferSize] = (startUpDataLocalV.fromPrimary) ? 
-			startUpDataLocalNv.Primary_status : startUpDataLocalNv.Secondary_status;  // Status byte
-		++respBufferSize;
+		put_u8(&rc, 0);   // Device Status high byte
+		put_u8(&rc, (hartDevice.v.fromPrimary) ? 
+			hartDevice.v.Primary_status : hartDevice.v.Secondary_status);  // Status byte
 		// parrot back the units
-		szHartResp[respBufferSize] = units;   // Device Status high byte
-		++respBufferSize;							
+		put_u8(&rc, units);   // Device Status high byte
 		// Now parrot back the range values
-		copyFloatToRespBuf(upper);
-		copyFloatToRespBuf(lower);
+		put_f32be(&rc, upper);
+		put_f32be(&rc, lower);
+		respClose(&rc);
 	}
 }
 
@@ -1115,29 +979,20 @@ void common_cmd_36(void)
 	// only possible choices
 	if (!respCode)
 	{
-		// execute
-		setUpperRangeVal();
+		// execute, busy if the 9900 request queue is full
+		respCode = setUpperRangeVal();
 	}
 	if (respCode)
 	{
-		szHartResp[respBufferSize] = 3;  // Byte count
-	}
-	else
-	{
-		szHartResp[respBufferSize] = 2;  // Byte count
+		common_tx_error(respCode);
+		return;
 	}
-	++respBufferSize;							
-	szHartResp[respBufferSize] = 0;   // Device Status high byte
-	++respBufferSize;							
-	szHartResp[respBufferSize] = (startUpDataLocalV.fromPrimary) ? 
-		startUpDataLocalNv.Primary_status : startUpDataLocalNv.Secondary_status;  // Status byte
-	++respBufferSize;
-	if (respCode)
-	{							
-		// Cmd-specific response code
-		szHartResp[respBufferSize] = respCode;   // Command-specific response code
-		++respBufferSize;	
-	}						
+	stRespCursor rc = respOpen();
+	put_u8(&rc, 2);  // Byte count
+	put_u8(&rc, 0);   // Device Status high byte
+	put_u8(&rc, (hartDevice.v.fromPrimary) ? 
+		hartDevice.v.Primary_status : hartDevice.v.Secondary_status);  // Status byte
+	respClose(&rc);
 }
 
 ///////////////////////////////////////////////////////////////////////////////////////////
@@ -1165,15 +1020,17 @@ void common_cmd_37(void)
 	// only possible choices
 	if (!respCode)
 	{
-		// execute
-		setLowerRangeVal();
-		szHartResp[respBufferSize] = 2;  // Byte count
-		++respBufferSize;							
-		szHartResp[respBufferSize] = 0;   // Device Status high byte
-		++respBufferSize;							
-		szHartResp[respBufferSize] = (startUpDataLocalV.fromPrimary) ? 
-			startUpDataLocalNv.Primary_status : startUpDataLocalNv.Secondary_status;  // Status byte
-		++respBufferSize;
+		// execute, busy if the 9900 request queue is full
+		respCode = setLowerRangeVal();
+	}
+	if (!respCode)
+	{
+		stRespCursor rc = respOpen();
+		put_u8(&rc, 2);  // Byte count
+		put_u8(&rc, 0);   // Device Status high byte
+		put_u8(&rc, (hartDevice.v.fromPrimary) ? 
+			hartDevice.v.Primary_status : hartDevice.v.Secondary_status);  // Status byte
+		respClose(&rc);
 	}
 	else
 	{
@@ -1194,31 +1051,28 @@ void common_cmd_38(void)
 	// If there are no data bytes, we assume the master is not rev 7, and simply reset the 
 	// status bit
 	// First check to see if we have too few bytes
-	if (0 == hartDataCount)
+	if (0 == hartCtx.dataCount)
 	{
 		// Clear the status bit							
-		(startUpDataLocalV.fromPrimary) ? clrPrimaryMasterChg() : clrSecondaryMasterChg();
+		clrStatusBits(STATUS_REQUESTER, FD_STATUS_CONFIG_CHANGED);
 		// Build the response								
-		szHartResp[respBufferSize] = 4;  // Byte count
-		++respBufferSize;							
-		szHartResp[respBufferSize] = 0;   // Device Status high byte
-		++respBufferSize;							
-		szHartResp[respBufferSize] = (startUpDataLocalV.fromPrimary) ? 
-			startUpDataLocalNv.Primary_status : startUpDataLocalNv.Secondary_status;  // Status byte
-		++respBufferSize;	
+		stRespCursor rc = respOpen();
+		put_u8(&rc, 4);  // Byte count
+		put_u8(&rc, 0);   // Device Status high byte
+		put_u8(&rc, (hartDevice.v.fromPrimary) ? 
+			hartDevice.v.Primary_status : hartDevice.v.Secondary_status);  // Status byte
 		// Now send back the configuration changed counter
-		configCounter.i = startUpDataLocalNv.configChangeCount;
-		szHartResp[respBufferSize] = configCounter.b[1];   // Device Status high byte
-		++respBufferSize;							
-		szHartResp[respBufferSize] = configCounter.b[0];   // Device Status high byte
-		++respBufferSize;							
+		configCounter.i = hartDevice.nv.configChangeCount;
+		put_u8(&rc, configCounter.b[1]);   // Device Status high byte
+		put_u8(&rc, configCounter.b[0]);   // Device Status high byte
+		respClose(&rc);
 	}
 	else
 	{
-		configCounter.b[1] = szHartCmd[respBufferSize+1];
-		configCounter.b[0] = szHartCmd[respBufferSize+2];
+		configCounter.b[1] = hartCtx.cmd[hartCtx.respSize+1];
+		configCounter.b[0] = hartCtx.cmd[hartCtx.respSize+2];
 		// First check to see if we have too few bytes
-		respCode = (CONFIG_COUNTER_SIZE > hartDataCount) ? TOO_FEW_DATA_BYTES : RESP_SUCCESS;
+		respCode = (CONFIG_COUNTER_SIZE > hartCtx.dataCount) ? TOO_FEW_DATA_BYTES : RESP_SUCCESS;
 		// If we have enough bytes, make sure the poll address is valid
 		if (!respCode)
 		{
@@ -1227,7 +1081,7 @@ void common_cmd_38(void)
 		// Now check to see if the config counter sent matches the local count
 		if (!respCode)
 		{
-			respCode = (configCounter.i != startUpDataLocalNv.configChangeCount) ? CONFIG_COUNTER_MISMATCH : RESP_SUCCESS;
+			respCode = (configCounter.i != hartDevice.nv.configChangeCount) ? CONFIG_COUNTER_MISMATCH : RESP_SUCCESS;
 		}
 		// If we do not have a successful response code, send back a short reply, do
 		// not execute the command
@@ -1238,21 +1092,18 @@ void common_cmd_38(void)
 		else
 		{
 			// execute the command
-			(startUpDataLocalV.fromPrimary) ? clrPrimaryMasterChg() : clrSecondaryMasterChg();
+			clrStatusBits(STATUS_REQUESTER, FD_STATUS_CONFIG_CHANGED);
 			// Build the response
-			szHartResp[respBufferSize] = CONFIG_COUNTER_SIZE+2;  // Byte count
-			++respBufferSize;							
-			szHartResp[respBufferSize] = 0;   // Device Status high byte
-			++respBufferSize;							
-			szHartResp[respBufferSize] = (startUpDataLocalV.fromPrimary) ? 
-				startUpDataLocalNv.Primary_status : startUpDataLocalNv.Secondary_status;  // Status byte
-			++respBufferSize;	
+			stRespCursor rc = respOpen();
+			put_u8(&rc, CONFIG_COUNTER_SIZE+2);  // Byte count
+			put_u8(&rc, 0);   // Device Status high byte
+			put_u8(&rc, (hartDevice.v.fromPrimary) ? 
+				hartDevice.v.Primary_status : hartDevice.v.Secondary_status);  // Status byte
 			// Now send back the configuration changed counter
-			configCounter.i = startUpDataLocalNv.configChangeCount;
-			szHartResp[respBufferSize] = configCounter.b[1];   // Device Status high byte
-			++respBufferSize;							
-			szHartResp[respBufferSize] = configCounter.b[0];   // Device Status high byte
-			++respBufferSize;							
+			configCounter.i = hartDevice.nv.configChangeCount;
+			put_u8(&rc, configCounter.b[1]);   // Device Status high byte
+			put_u8(&rc, configCounter.b[0]);   // Device Status high byte
+			respClose(&rc);
 		}
 	}
 }
@@ -1264,9 +1115,9 @@ void common_cmd_38(void)
  */
 void common_cmd_39(void)
 {
-	unsigned char burnCommand = szHartCmd[respBufferSize+1];
+	unsigned char burnCommand = hartCtx.cmd[hartCtx.respSize+1];
 	// First check to see if we have too few bytes
-	unsigned char respCode = (1 > hartDataCount) ? TOO_FEW_DATA_BYTES : RESP_SUCCESS;
+	unsigned char respCode = (1 > hartCtx.dataCount) ? TOO_FEW_DATA_BYTES : RESP_SUCCESS;
 	// If we have enough bytes, make sure the poll address is valid
 	if (!respCode)
 	{
@@ -1301,17 +1152,15 @@ void common_cmd_39(void)
 	else // We can execute the command from here
 	{
 		// Now build the response buffer
-		szHartResp[respBufferSize] = 3;
-		++respBufferSize;
+		stRespCursor rc = respOpen();
+		put_u8(&rc, 3);
 		// Send status as usual
-		szHartResp[respBufferSize] = 0;   // Device Status high byte
-		++respBufferSize;							
-		szHartResp[respBufferSize] = (startUpDataLocalV.fromPrimary) ? 
-			startUpDataLocalNv.Primary_status : startUpDataLocalNv.Secondary_status;  // Status byte
-		++respBufferSize;
+		put_u8(&rc, 0);   // Device Status high byte
+		put_u8(&rc, (hartDevice.v.fromPrimary) ? 
+			hartDevice.v.Primary_status : hartDevice.v.Secondary_status);  // Status byte
 		// Parrot back the command byte
-		szHartResp[respBufferSize] = burnCommand;
-		++respBufferSize;
+		put_u8(&rc, burnCommand);
+		respClose(&rc);
 	}
 }
 
@@ -1323,24 +1172,30 @@ void common_cmd_39(void)
 void common_cmd_40 (void)
 {
 	U_LONG_FLOAT cmdCurrent;
+	tDrStatus drStatus = drNew;
 	// Are we busy?
 	unsigned char respCode = (deviceBusyFlag) ? HART_DEVICE_BUSY : RESP_SUCCESS;
 	// Is loop current signaling disabled?
-	if (CURRENT_MODE_DISABLE == startUpDataLocalNv.currentMode)
+	if (CURRENT_MODE_DISABLE == hartDevice.nv.currentMode)
 	{
 		respCode = LOOP_CURRENT_NOT_ACTIVE;
 	}
 	// Did we receive enough bytes?
 	if (!respCode)
 	{
-		respCode = (4 > hartDataCount) ? TOO_FEW_DATA_BYTES : RESP_SUCCESS;
+		respCode = (4 > hartCtx.dataCount) ? TOO_FEW_DATA_BYTES : RESP_SUCCESS;
 	}
-	// Determine if the commanded value is too large or too small
+	// decode the commanded current, only there when enough bytes came in (0 on every refused path)
+	cmdCurrent.fVal = (!respCode) ? decodeBufferFloat(&(hartCtx.cmd[hartCtx.respSize+1])) : 0.0;
+	// A retry of a delayed request gets its state or its outcome
 	if (!respCode)
+	{
+		drStatus = drLookup(&respCode);
+	}
+	// Determine if the commanded value is too large or too small
+	if (!respCode && drNew == drStatus)
 	{
 		updateInProgress = TRUE;
-		// decode the commanded current
-		cmdCurrent.fVal = decodeBufferFloat(&(szHartCmd[respBufferSize+1]));
 		// Save the current value of the loop for later, if needed
 		if ((0.0 < cmdCurrent.fVal) && (LOOP_OPERATIONAL == loopMode))
 		{
@@ -1348,49 +1203,47 @@ void common_cmd_40 (void)
 		}
 		// Set the loop current
 		respCode = setFixedCurrentMode(cmdCurrent.fVal);
+		if (respCode)
+		{
+			// clear the update in progress flag
+			updateInProgress = FALSE; 
+			updateRequestSent = FALSE;
+		}
+		else
+		{
+			// Now store the command value so that the 9900 can be periodically
+			// reminded if it is in fixed current state
+			lastRequestedCurrentValue = cmdCurrent.fVal;
+			if (0.0 == cmdCurrent.fVal)
+			{
+				clrStatusBits(STATUS_BOTH, FD_STATUS_PV_ANALOG_FIXED);
+			}
+			else
+			{
+				setStatusBits(STATUS_BOTH, FD_STATUS_PV_ANALOG_FIXED);
+			}
+			// Copy the requested loop current value or the saved value to the reported loop variable
+			reportingLoopCurrent = (0.0 == cmdCurrent.fVal) ? savedLoopCurrent : cmdCurrent.fVal;
+			refreshPvDerived();
+			// The 9900 confirms the change on a later update, the master retries for the outcome
+			respCode = drInitiate(TRUE);
+		}
 	}
 	if (respCode)
 	{
-		// clear the update in progress flag
-		updateInProgress = FALSE; 
-		updateRequestSent = FALSE;
 		common_tx_error(respCode);
 	}
 	else
 	{
-		// Now store the command value so that the 9900 can be periodically
-		// reminded if it is in fixed current state
-		lastRequestedCurrentValue = cmdCurrent.fVal;
-		if (0.0 == cmdCurrent.fVal)
-		{
-			clrPrimaryStatusBits(FD_STATUS_PV_ANALOG_FIXED);
-			clrSecondaryStatusBits(FD_STATUS_PV_ANALOG_FIXED);
-		}
-		else
-		{
-			setPrimaryStatusBits(FD_STATUS_PV_ANALOG_FIXED);
-			setSecondaryStatusBits(FD_STATUS_PV_ANALOG_FIXED);
-		}
-		// Now build the response
-		szHartResp[respBufferSize] = 6;  // Byte count
-		++respBufferSize;							
-		szHartResp[respBufferSize] = 0;   // Device Status high byte
-		++respBufferSize;							
-		szHartResp[respBufferSize] = (startUpDataLocalV.fromPrimary) ? 
-			startUpDataLocalNv.Primary_status : startUpDataLocalNv.Secondary_status;  // Status byte
-		++respBufferSize;							
-		// Copy in the requested loop current value or the saved value to the response and to
-		// the reported loop variable
-		if (0.0 == cmdCurrent.fVal)
-		{
-			copyFloatToRespBuf(savedLoopCurrent);
-			reportingLoopCurrent = savedLoopCurrent;
-		}
-		else
-		{
-			copyFloatToRespBuf(cmdCurrent.fVal);
-			reportingLoopCurrent = cmdCurrent.fVal;
-		}
+		// The delayed request completed, build the response
+		stRespCursor rc = respOpen();
+		put_u8(&rc, 6);  // Byte count
+		put_u8(&rc, 0);   // Device Status high byte
+		put_u8(&rc, (hartDevice.v.fromPrimary) ? 
+			hartDevice.v.Primary_status : hartDevice.v.Secondary_status);  // Status byte
+		// Copy in the requested loop current value or the saved value
+		put_f32be(&rc, (0.0 == cmdCurrent.fVal) ? savedLoopCurrent : cmdCurrent.fVal);
+		respClose(&rc);
 	}
 }
 
@@ -1410,13 +1263,12 @@ void common_cmd_42 (void)
 	else
 	{
 		cmdReset = TRUE;
-		szHartResp[respBufferSize] = 2;  // Byte count
-		++respBufferSize;							
-		szHartResp[respBufferSize] = 0;   // Device Status high byte
-		++respBufferSize;							
-		szHartResp[respBufferSize] = (startUpDataLocalV.fromPrimary) ? 
-			startUpDataLocalNv.Primary_status : startUpDataLocalNv.Secondary_status;  // Status byte
-		++respBufferSize;							
+		stRespCursor rc = respOpen();
+		put_u8(&rc, 2);  // Byte count
+		put_u8(&rc, 0);   // Device Status high byte
+		put_u8(&rc, (hartDevice.v.fromPrimary) ? 
+			hartDevice.v.Primary_status : hartDevice.v.Secondary_status);  // Status byte
+		respClose(&rc);
 	}
 }
 
@@ -1429,52 +1281,68 @@ void common_cmd_42 (void)
 void common_cmd_45 (void)
 {
 	U_LONG_FLOAT cmdCurrent;
+	tDrStatus drStatus = drNew;
 	// Are we busy?
 	unsigned char respCode = (deviceBusyFlag) ? HART_DEVICE_BUSY : RESP_SUCCESS;
 
 	//  MH - 1/24/13 Reset the 9900 reminder
 	modeUpdateCount =0;
 	// Is loop current signaling disabled?
-	if (CURRENT_MODE_DISABLE == startUpDataLocalNv.currentMode)
+	if (CURRENT_MODE_DISABLE == hartDevice.nv.currentMode)
 	{
 		respCode = LOOP_CURRENT_NOT_ACTIVE;
 	}
 	// Did we receive enough bytes?
 	if (!respCode)
 	{
-		respCode = (4 > hartDataCount) ? TOO_FEW_DATA_BYTES : RESP_SUCCESS;
+		respCode = (4 > hartCtx.dataCount) ? TOO_FEW_DATA_BYTES : RESP_SUCCESS;
+	}
+	// decode the commanded current, only there when enough bytes came in (0 on every refused path)
+	cmdCurrent.fVal = (!respCode) ? decodeBufferFloat(&(hartCtx.cmd[hartCtx.respSize+1])) : 0.0;
+	// A retry of a delayed request gets its state or its outcome
+	if (!respCode)
+	{
+		drStatus = drLookup(&respCode);
 	}
 	// Make sure the loop is set up correctly
-	if ((!respCode) && (FALSE == setToMinValue))
+	if ((!respCode) && drNew == drStatus && (FALSE == setToMinValue))
 	{
 		respCode = INCORRECT_LOOP_MODE;
 	}
-	// Determine if the commanded value is too large or too small
-	if (!respCode)
+	// Try to execute the command if no errors so far
+	if (!respCode && drNew == drStatus)
 	{
 		updateInProgress = TRUE;
-		cmdCurrent.fVal = decodeBufferFloat(&(szHartCmd[respBufferSize+1]));
 		respCode = trimLoopCurrentZero(cmdCurrent.fVal);
+		if (respCode)
+		{
+			updateInProgress = FALSE;
+			updateRequestSent = FALSE;
+		}
+		else
+		{
+			// Set the reporting current value
+			reportingLoopCurrent = cmdCurrent.fVal;
+			refreshPvDerived();
+			// The 9900 confirms the trim on a later update, the master retries for the outcome
+			respCode = drInitiate(TRUE);
+		}
 	}
 	if (respCode)
 	{
-		updateInProgress = FALSE;
-		updateRequestSent = FALSE;
 		common_tx_error(respCode);
 	}
 	else
 	{
-		reportingLoopCurrent = cmdCurrent.fVal;
-		// Now build the response
-		szHartResp[respBufferSize] = 6;  // Byte count
-		++respBufferSize;							
-		szHartResp[respBufferSize] = 0;   // Device Status high byte
-		++respBufferSize;							
-		szHartResp[respBufferSize] = (startUpDataLocalV.fromPrimary) ? 
-			startUpDataLocalNv.Primary_status : startUpDataLocalNv.Secondary_status;  // Status byte
-		++respBufferSize;							
-		// Copy in the requested loop current value for the response. The 9900 will catch up later
-		copyFloatToRespBuf(cmdCurrent.fVal);
+		// The delayed request completed, build the response
+		stRespCursor rc = respOpen();
+		put_u8(&rc, 6);  // Byte count
+		put_u8(&rc, 0);   // Device Status high byte
+		put_u8(&rc, (hartDevice.v.fromPrimary) ? 
+			hartDevice.v.Primary_status : hartDevice.v.Secondary_status);  // Status byte
+		// Copy in the requested loop current value for the response
+		put_f32be(&rc, cmdCurrent.fVal);
+		respClose(&rc);
 	}
 }
 
@@ -1486,52 +1354,67 @@ void common_cmd_45 (void)
 void common_cmd_46 (void)
 {
 	U_LONG_FLOAT cmdCurrent;
+	tDrStatus drStatus = drNew;
 	// Are we busy?
 	unsigned char respCode = (deviceBusyFlag) ? HART_DEVICE_BUSY : RESP_SUCCESS;
 	//  Reset 9900 reminder
 	modeUpdateCount =0;
 	// Is loop current signaling disabled?
-	if (CURRENT_MODE_DISABLE == startUpDataLocalNv.currentMode)
+	if (CURRENT_MODE_DISABLE == hartDevice.nv.currentMode)
 	{
 		respCode = LOOP_CURRENT_NOT_ACTIVE;
 	}
 	// Did we receive enough bytes?
 	if (!respCode)
 	{
-		respCode = (4 > hartDataCount) ? TOO_FEW_DATA_BYTES : RESP_SUCCESS;
+		respCode = (4 > hartCtx.dataCount) ? TOO_FEW_DATA_BYTES : RESP_SUCCESS;
+	}
+	// decode the commanded current, only there when enough bytes came in (0 on every refused path)
+	cmdCurrent.fVal = (!respCode) ? decodeBufferFloat(&(hartCtx.cmd[hartCtx.respSize+1])) : 0.0;
+	// A retry of a delayed request gets its state or its outcome
+	if (!respCode)
+	{
+		drStatus = drLookup(&respCode);
 	}
 	// Make sure the loop is set up correctly
-	if ((!respCode) && (FALSE == setToMaxValue))
+	if ((!respCode) && drNew == drStatus && (FALSE == setToMaxValue))
 	{
 		respCode = INCORRECT_LOOP_MODE;
 	}
 	// Try to execute the command if no errors so far
-	if (!respCode)
+	if (!respCode && drNew == drStatus)
 	{
 		updateInProgress = TRUE;
-		cmdCurrent.fVal = decodeBufferFloat(&(szHartCmd[respBufferSize+1]));
 		respCode = trimLoopCurrentGain(cmdCurrent.fVal);
+		if (respCode)
+		{
+			updateInProgress = FALSE;
+			updateRequestSent = FALSE;
+		}
+		else
+		{
+			// Set the reporting current value
+			reportingLoopCurrent = cmdCurrent.fVal;
+			refreshPvDerived();
+			// The 9900 confirms the trim on a later update, the master retries for the outcome
+			respCode = drInitiate(TRUE);
+		}
 	}
 	if (respCode)
 	{
-		updateInProgress = FALSE;
-		updateRequestSent = FALSE;
 		common_tx_error(respCode);
 	}
 	else
 	{
-		// Set the reporting current value
-		reportingLoopCurrent = cmdCurrent.fVal;
-		// Now build the response
-		szHartResp[respBufferSize] = 6;  // Byte count
-		++respBufferSize;							
-		szHartResp[respBufferSize] = 0;   // Device Status high byte
-		++respBufferSize;							
-		szHartResp[respBufferSize] = (startUpDataLocalV.fromPrimary) ? 
-			startUpDataLocalNv.Primary_status : startUpDataLocalNv.Secondary_status;  // Status byte
-		++respBufferSize;							
-		// Copy in the requested loop current value for the response. The 9900 will catch up later
-		copyFloatToRespBuf(cmdCurrent.fVal);
+		// The delayed request completed, build the response
+		stRespCursor rc = respOpen();
+		put_u8(&rc, 6);  // Byte count
+		put_u8(&rc, 0);   // Device Status high byte
+		put_u8(&rc, (hartDevice.v.fromPrimary) ? 
+			hartDevice.v.Primary_status : hartDevice.v.Secondary_status);  // Status byte
+		// Copy in the requested loop current value for the response
+		put_f32be(&rc, cmdCurrent.fVal);
+		respClose(&rc);
 	}
 }
 
@@ -1543,77 +1426,72 @@ void common_cmd_46 (void)
 void common_cmd_48(void)
 {
 	unsigned char match = TRUE;
-	if ((0 < hartDataCount) && (9 > hartDataCount))
+	if ((0 < hartCtx.dataCount) && (9 > hartCtx.dataCount))
 	{
 		common_tx_error(TOO_FEW_DATA_BYTES);
 		return;
 	}
 	// First, check to see if we have to clear the more status available bit.
 	// This is only true if we have 9 or more request bytes
-	if (9 <= hartDataCount)
+	if (9 <= hartCtx.dataCount)
 	{
 		// Were are only going to compare the first 9 bytes
-		if (szHartCmd[respBufferSize+1] != startUpDataLocalV.DeviceSpecificStatus[0]) 
+		if (hartCtx.cmd[hartCtx.respSize+1] != hartDevice.v.DeviceSpecificStatus[0]) 
 		{
 			match = FALSE;
 		}
-		if (szHartCmd[respBufferSize+2] != startUpDataLocalV.DeviceSpecificStatus[1])
+		if (hartCtx.cmd[hartCtx.respSize+2] != hartDevice.v.DeviceSpecificStatus[1])
 		{
 			match = FALSE;
 		}
-		if (szHartCmd[respBufferSize+3] != startUpDataLocalV.DeviceSpecificStatus[2])
+		if (hartCtx.cmd[hartCtx.respSize+3] != hartDevice.v.DeviceSpecificStatus[2])
 		{
 			match = FALSE;
 		}
-		if (szHartCmd[respBufferSize+4] != startUpDataLocalV.DeviceSpecificStatus[3])
+		if (hartCtx.cmd[hartCtx.respSize+4] != hartDevice.v.DeviceSpecificStatus[3])
 		{
 			match = FALSE;
 		}
-		if (szHartCmd[respBufferSize+5] != startUpDataLocalV.DeviceSpecificStatus[4])
+		if (hartCtx.cmd[hartCtx.respSize+5] != hartDevice.v.DeviceSpecificStatus[4])
 		{
 			match = FALSE;
 		}
-		if (szHartCmd[respBufferSize+6] != startUpDataLocalV.DeviceSpecificStatus[5])
+		if (hartCtx.cmd[hartCtx.respSize+6] != hartDevice.v.DeviceSpecificStatus[5])
 		{
 			match = FALSE;
 		}
-		if (szHartCmd[respBufferSize+7] != startUpDataLocalV.extendFieldDevStatus)
+		if (hartCtx.cmd[hartCtx.respSize+7] != hartDevice.v.extendFieldDevStatus)
 		{
 			match = FALSE;
 		}
-		if (szHartCmd[respBufferSize+8] != startUpDataLocalV.DeviceOpMode)
+		if (hartCtx.cmd[hartCtx.respSize+8] != hartDevice.v.DeviceOpMode)
 		{
 			match = FALSE;
 		}
-		if (szHartCmd[respBufferSize+9] != startUpDataLocalV.StandardStatus0)
+		if (hartCtx.cmd[hartCtx.respSize+9] != hartDevice.v.StandardStatus0)
 		{
 			match = FALSE;
 		}
 		if (TRUE == match)
 		{
-			(startUpDataLocalV.fromPrimary) ? clrPrimaryMoreAvailable() : clrSecondaryMoreAvailable();
+			clrStatusBits(STATUS_REQUESTER, FD_STATUS_MORE_STATUS_AVAIL);
 		}
 	}
 	// Build the response			
-	szHartResp[respBufferSize] = 11;  // Byte count
-	++respBufferSize;							
-	szHartResp[respBufferSize] = 0;   // Device Status high byte
-	++respBufferSize;							
-	szHartResp[respBufferSize] = (startUpDataLocalV.fromPrimary) ? 
-		startUpDataLocalNv.Primary_status : startUpDataLocalNv.Secondary_status;  // Status byte
-	++respBufferSize;	
+	stRespCursor rc = respOpen();
+	put_u8(&rc, 11);  // Byte count
+	put_u8(&rc, 0);   // Device Status high byte
+	put_u8(&rc, (hartDevice.v.fromPrimary) ? 
+		hartDevice.v.Primary_status : hartDevice.v.Secondary_status);  // Status byte
 	// Device specific status
-	memcpy(&szHartResp[respBufferSize], startUpDataLocalV.DeviceSpecificStatus, DEV_SPECIFIC_STATUS_SIZE);
-	respBufferSize += DEV_SPECIFIC_STATUS_SIZE;
+	put_bytes(&rc, hartDevice.v.DeviceSpecificStatus, DEV_SPECIFIC_STATUS_SIZE);
 	// Extended device status
-	szHartResp[respBufferSize] = startUpDataLocalV.extendFieldDevStatus;   
-	++respBufferSize;							
+	put_u8(&rc, hartDevice.v.extendFieldDevStatus);
 	// Device operating mode
-	szHartResp[respBufferSize] = startUpDataLocalV.DeviceOpMode;   
-	++respBufferSize;							
+	put_u8(&rc, hartDevice.v.DeviceOpMode);
 	// standard status 0
-	szHartResp[respBufferSize] = startUpDataLocalV.StandardStatus0;   
-	++respBufferSize;							
+	put_u8(&rc, hartDevice.v.StandardStatus0);
+	respClose(&rc);
 }
 
 /*!
@@ -1633,11 +1511,11 @@ void common_cmd_54 (void)
 	float span = 0.0;
 	float damping = 0.0;
 	unsigned char respCode = (deviceBusyFlag) ? HART_DEVICE_BUSY : RESP_SUCCESS;
-	unsigned char requestedVariable = szHartCmd[respBufferSize+1];
+	unsigned char requestedVariable = hartCtx.cmd[hartCtx.respSize+1];
 	// Did we receive enough bytes?
 	if (!respCode)
 	{
-		respCode = (1 > hartDataCount) ? TOO_FEW_DATA_BYTES : RESP_SUCCESS;
+		respCode = (1 > hartCtx.dataCount) ? TOO_FEW_DATA_BYTES : RESP_SUCCESS;
 	}
 	// Now check to make sure the selection is valid
 	if (!respCode)
@@ -1663,31 +1541,24 @@ void common_cmd_54 (void)
 	}
 	else
 	{
-		szHartResp[respBufferSize] = 29;  // Byte count
-		++respBufferSize;							
-		szHartResp[respBufferSize] = 0;   // Device Status high byte
-		++respBufferSize;							
-		szHartResp[respBufferSize] = (startUpDataLocalV.fromPrimary) ? 
-			startUpDataLocalNv.Primary_status : startUpDataLocalNv.Secondary_status;  // Status byte
-		++respBufferSize;	
+		stRespCursor rc = respOpen();
+		put_u8(&rc, 29);  // Byte count
+		put_u8(&rc, 0);   // Device Status high byte
+		put_u8(&rc, (hartDevice.v.fromPrimary) ? 
+			hartDevice.v.Primary_status : hartDevice.v.Secondary_status);  // Status byte
 		// Device Variable Code
-		szHartResp[respBufferSize] = requestedVariable;   
-		++respBufferSize;							
+		put_u8(&rc, requestedVariable);
 		// The transducer S/N is 0
-		szHartResp[respBufferSize] = 0;   // Sensor S/N
-		++respBufferSize;							
-		szHartResp[respBufferSize] = 0;   // Sensor S/N
-		++respBufferSize;							
-		szHartResp[respBufferSize] = 0;   // Sensor S/N
-		++respBufferSize;	
+		put_u8(&rc, 0);   // Sensor S/N
+		put_u8(&rc, 0);   // Sensor S/N
+		put_u8(&rc, 0);   // Sensor S/N
 		switch(requestedVariable)
 		{
 		case DVC_SV:						
 		case DVC_SECONDARY_VARIABLE:
 			// Transducer units are the PV units
-			szHartResp[respBufferSize] = (NOT_USED <= u9900Database.db.UnitsSecondaryVar) ? NOT_USED :
-				u9900Database.db.UnitsSecondaryVar;   
-			++respBufferSize;	
+			put_u8(&rc, (NOT_USED <= hsbCtx.database.db.UnitsSecondaryVar) ? NOT_USED :
+				hsbCtx.database.db.UnitsSecondaryVar);
 			break;
 		case DVC_PV:						
 		case DVC_PERCENT_RANGE:			
@@ -1695,26 +1566,24 @@ void common_cmd_54 (void)
 		case DVC_PRIMARY_VARIABLE:	
 		default:
 			// Transducer units are the PV units
-			szHartResp[respBufferSize] = u9900Database.db.UnitsPrimaryVar;   
-			++respBufferSize;	
+			put_u8(&rc, hsbCtx.database.db.UnitsPrimaryVar);
 			break;
 		}		
 		// Now the High limit from the database				
-		copyFloatToRespBuf(u9900Database.db.LOOP_SET_HIGH_LIMIT.floatVal);					
+		put_f32be(&rc, hsbCtx.database.db.LOOP_SET_HIGH_LIMIT.floatVal);					
 		// Now the low limit from the database				
-		copyFloatToRespBuf(u9900Database.db.LOOP_SET_LOW_LIMIT.floatVal);					
+		put_f32be(&rc, hsbCtx.database.db.LOOP_SET_LOW_LIMIT.floatVal);					
 		// the  damping is 0				
-		copyFloatToRespBuf(damping);					
+		put_f32be(&rc, damping);					
 		// the minimum span is 0				
-		copyFloatToRespBuf(span);	
+		put_f32be(&rc, span);	
 		// device variable classification
 		switch(requestedVariable)
 		{
 		case DVC_SV:						
 		case DVC_SECONDARY_VARIABLE:
 			// SV units are not classified
-			szHartResp[respBufferSize] = 0;   
-			++respBufferSize;	
+			put_u8(&rc, 0);
 			break;
 		case DVC_PV:						
 		case DVC_PERCENT_RANGE:			
@@ -1722,22 +1591,17 @@ void common_cmd_54 (void)
 		case DVC_PRIMARY_VARIABLE:	
 		default:
 			// Transducer units are the PV units
-			szHartResp[respBufferSize] = u9900Database.db.Hart_Dev_Var_Class;   
-			++respBufferSize;	
+			put_u8(&rc, hsbCtx.database.db.Hart_Dev_Var_Class);
 			break;
 		}		
 		// device variable family
-		szHartResp[respBufferSize] = NOT_USED;   
-		++respBufferSize;							
+		put_u8(&rc, NOT_USED);
 		// Update time period			
-		szHartResp[respBufferSize] = UpdateTime.b[3];   
-		++respBufferSize;							
-		szHartResp[respBufferSize] = UpdateTime.b[2];   
-		++respBufferSize;							
-		szHartResp[respBufferSize] = UpdateTime.b[1];   
-		++respBufferSize;							
-		szHartResp[respBufferSize] = UpdateTime.b[0];   
-		++respBufferSize;							
+		put_u8(&rc, UpdateTime.b[3]);
+		put_u8(&rc, UpdateTime.b[2]);
+		put_u8(&rc, UpdateTime.b[1]);
+		put_u8(&rc, UpdateTime.b[0]);
+		respClose(&rc);
 	}
 }
 
@@ -1762,6 +1626,55 @@ void common_cmd_58 (void)
 	common_cmd_18();
 }
 
+/*!
+ *  \fn     common_cmd_59()
+ *  \brief  Process the HART command 59 : Write Number of Response Preambles
+ *
+ *  The count is kept per master: the requester's own replies use it from now on
+ */
+void common_cmd_59 (void)
+{
+	unsigned char preambles;
+	// First check to see if we have too few bytes
+	unsigned char respCode = (0 == hartCtx.dataCount) ? TOO_FEW_DATA_BYTES : RESP_SUCCESS;
+	// If we have enough bytes, make sure the count is within HART limits
+	if (!respCode)
+	{
+		preambles = (hartCtx.bLongAddr) ? hartCtx.cmd[LONG_DATA_OFFSET] : hartCtx.cmd[SHORT_DATA_OFFSET];
+		if (MAX_RESP_PREAMBLES < preambles)
+		{
+			respCode = PASSED_PARM_TOO_LARGE;
+		}
+		else if (MIN_RESP_PREAMBLES > preambles)
+		{
+			respCode = PASSED_PARM_TOO_SMALL;
+		}
+	}
+	// If we have a non-zero code, send back the error return
+	if (respCode)
+	{
+		common_tx_error(respCode);
+	}
+	else // We can execute the command from here
+	{
+		hartDevice.nv.respPreambles[(hartDevice.v.fromPrimary) ? 0 : 1] = preambles;
+		// Set the change flags
+		setStatusBits(STATUS_BOTH, FD_STATUS_CONFIG_CHANGED);
+		incrementConfigCount();
+		// Set up to write RAM to FLASH
+		markNvDirty(NV_DIRTY_PREAMBLES);
+		// Now build the response buffer
+		stRespCursor rc = respOpen();
+		put_u8(&rc, 3);
+		put_u8(&rc, 0);   // Device Status high byte
+		put_u8(&rc, (hartDevice.v.fromPrimary) ? 
+			hartDevice.v.Primary_status : hartDevice.v.Secondary_status);  // Status byte
+		// Parrot back the number of preambles
+		put_u8(&rc, preambles);
+		respClose(&rc);
+	}
+}
+
 /*!
  *  \fn  common_cmd_110()
  *  \brief Process the HART command 110 : Read All Dynamic Variables (Deprecated)
@@ -1770,21 +1683,18 @@ void common_cmd_110 (void)
 {
 	//unsigned char respCode = (updateDelay) ? UPDATE_FAILURE : RESP_SUCCESS;
 	
-	szHartResp[respBufferSize] = 12;  // Byte count
-	++respBufferSize;							
-	szHartResp[respBufferSize] = 0;   // Device Status high byte
-	++respBufferSize;							
-	szHartResp[respBufferSize] = (startUpDataLocalV.fromPrimary) ? 
-		startUpDataLocalNv.Primary_status : startUpDataLocalNv.Secondary_status;  // Status byte
-	++respBufferSize;	
+	stRespCursor rc = respOpen();
+	put_u8(&rc, 12);  // Byte count
+	put_u8(&rc, 0);   // Device Status high byte
+	put_u8(&rc, (hartDevice.v.fromPrimary) ? 
+		hartDevice.v.Primary_status : hartDevice.v.Secondary_status);  // Status byte
 	// Now the PV
-	szHartResp[respBufferSize] = u9900Database.db.UnitsPrimaryVar;
-	++respBufferSize;
-	copyFloatToRespBuf(PVvalue);					
+	put_u8(&rc, hsbCtx.database.db.UnitsPrimaryVar);
+	put_f32be(&rc, PVvalue);					
 	// Now the SV
-	szHartResp[respBufferSize] = u9900Database.db.UnitsSecondaryVar;
-	++respBufferSize;
-	copyFloatToRespBuf(SVvalue);					
+	put_u8(&rc, hsbCtx.database.db.UnitsSecondaryVar);
+	put_f32be(&rc, SVvalue);					
+	respClose(&rc);
 }
 
 /*!
@@ -1793,20 +1703,18 @@ void common_cmd_110 (void)
  *
  *  \param  respCode  The response code to send
  *
- *  Global respBufferSize indicates the position in the buffer\n
- *  The response is built in a global buffer szHartResp[] , and respBufferSize is incremented to
- *  point to next position on buffer.
+ *  The response is appended to hartCtx.resp[] through a response cursor, hartCtx.respSize is
+ *  updated when the cursor is closed.
  */
 
 void common_tx_error(unsigned char respCode)
 {
-	szHartResp[respBufferSize] = 2; // Byte count
-	++respBufferSize;
-	szHartResp[respBufferSize] = respCode; // response code
-	++respBufferSize;
-	szHartResp[respBufferSize] = (startUpDataLocalV.fromPrimary) ? 
-		startUpDataLocalNv.Primary_status : startUpDataLocalNv.Secondary_status; // primary or secondary status
-	++respBufferSize;
+	stRespCursor rc = respOpen();
+	put_u8(&rc, 2); // Byte count
+	put_u8(&rc, respCode); // response code
+	put_u8(&rc, (hartDevice.v.fromPrimary) ? 
+		hartDevice.v.Primary_status : hartDevice.v.Secondary_status); // primary or secondary status
+	respClose(&rc);
 }
 
 
@@ -1817,33 +1725,29 @@ void common_tx_error(unsigned char respCode)
  */
 void common_tx_comm_error(void)
 {
-	
-	szHartResp[respBufferSize] = 2;  // Byte count
-	++respBufferSize;							
-	szHartResp[respBufferSize] = COMM_ERROR;  // Communication Error
+	unsigned char commError = COMM_ERROR;  // Communication Error
+
 	if (HartErrRegister & BUFFER_OVERFLOW)
 	{
-		szHartResp[respBufferSize] |= BOVF_ERROR;  // Buffer Overflow Error
-		++respBufferSize;							
+		commError |= BOVF_ERROR;  // Buffer Overflow Error
 	}
 	if (HartErrRegister & RCV_BAD_LRC)
 	{
-		szHartResp[respBufferSize] |= LPAR_ERROR;  // LRC Error
-		++respBufferSize;							
+		commError |= LPAR_ERROR;  // LRC Error
 	}
 	if (HartErrRegister & RCV_PARITY_ERROR)
 	{
-		szHartResp[respBufferSize] |= VPAR_ERROR;  // Parity Error
-		++respBufferSize;							
+		commError |= VPAR_ERROR;  // Parity Error
 	}							
 	if (HartErrRegister & RCV_FRAMING_ERROR)
 	{
-		szHartResp[respBufferSize] |= FRAM_ERROR;  // Framing Error
-		++respBufferSize;							
+		commError |= FRAM_ERROR;  // Framing Error
 	}							
-	++respBufferSize;							
-	szHartResp[respBufferSize] = 0;  // status byte
-	++respBufferSize;							
+	stRespCursor rc = respOpen();
+	put_u8(&rc, 2);  // Byte count
+	put_u8(&rc, commError);
+	put_u8(&rc, 0);  // status byte
+	respClose(&rc);
 }
 
 
@@ -1856,7 +1760,7 @@ void common_tx_comm_error(void)
 void mfr_cmd_219(void)
 {
 	// First check to see if we have too few bytes
-	unsigned char respCode = (FINAL_ASSY_SIZE > hartDataCount) ? TOO_FEW_DATA_BYTES : RESP_SUCCESS;
+	unsigned char respCode = (FINAL_ASSY_SIZE > hartCtx.dataCount) ? TOO_FEW_DATA_BYTES : RESP_SUCCESS;
 	// If we have enough bytes, make sure the poll address is valid
 	if (!respCode)
 	{
@@ -1870,26 +1774,23 @@ void mfr_cmd_219(void)
 	else // We can execute the command from here
 	{
 		// Set the change flags	
-		setPrimaryMasterChg();
-		setSecondaryMasterChg();
+		setStatusBits(STATUS_BOTH, FD_STATUS_CONFIG_CHANGED);
 		incrementConfigCount();
 		// Copy the new Device ID to FLASH
-		copyDeviceIdToFlash(&(szHartCmd[respBufferSize+1]));
+		copyDeviceIdToFlash(&(hartCtx.cmd[hartCtx.respSize+1]));
 		// Copy the final assembly into the database
-		memcpy(&startUpDataLocalNv.DeviceID, &(szHartCmd[respBufferSize+1]), DEVICE_ID_SIZE);	
+		memcpy(&hartDevice.nv.DeviceID, &(hartCtx.cmd[hartCtx.respSize+1]), DEVICE_ID_SIZE);	
 		// Set up to write RAM to FLASH
-		updateNvRam = TRUE;					
+		markNvDirty(NV_DIRTY_DEVICE_ID);					
 		// Build the response
-		szHartResp[respBufferSize] = DEVICE_ID_SIZE+2;  // Byte count
-		++respBufferSize;							
-		szHartResp[respBufferSize] = 0;   // Device Status high byte
-		++respBufferSize;							
-		szHartResp[respBufferSize] = (startUpDataLocalV.fromPrimary) ? 
-			startUpDataLocalNv.Primary_status : startUpDataLocalNv.Secondary_status;  // Status byte
-		++respBufferSize;	
+		stRespCursor rc = respOpen();
+		put_u8(&rc, DEVICE_ID_SIZE+2);  // Byte count
+		put_u8(&rc, 0);   // Device Status high byte
+		put_u8(&rc, (hartDevice.v.fromPrimary) ? 
+			hartDevice.v.Primary_status : hartDevice.v.Secondary_status);  // Status byte
 		// Parrot back the final assy
-		memcpy(&(szHartResp[respBufferSize]), &startUpDataLocalNv.DeviceID, DEVICE_ID_SIZE);
-		respBufferSize += DEVICE_ID_SIZE;
+		put_bytes(&rc, &hartDevice.nv.DeviceID, DEVICE_ID_SIZE);
+		respClose(&rc);
 	}
 }
 
@@ -1911,46 +1812,45 @@ void mfr_cmd_220(void)
 	else // We can execute the command from here
 	{
 		// Build the response
-		szHartResp[respBufferSize] = 2 + 24 + 38;  // Byte count
-		++respBufferSize;					
+		stRespCursor rc = respOpen();
+		put_u8(&rc, 2 + 24 + 38);  // Byte count
 		// RC & Status		
-		szHartResp[respBufferSize] = 0;   // Device Status high byte
-		++respBufferSize;							
-		szHartResp[respBufferSize] = (startUpDataLocalV.fromPrimary) ? 
-			startUpDataLocalNv.Primary_status : startUpDataLocalNv.Secondary_status;  // Status byte
-		++respBufferSize;	
+		put_u8(&rc, 0);   // Device Status high byte
+		put_u8(&rc, (hartDevice.v.fromPrimary) ? 
+			hartDevice.v.Primary_status : hartDevice.v.Secondary_status);  // Status byte
 		// Copy the number of messages ready to process
-		copyLongToRespBuf(numMsgReadyToProcess);
+		put_u32be(&rc, numMsgReadyToProcess);
 		// Copy the number of messages ready to process
-		copyLongToRespBuf(numMsgProcessed);
+		put_u32be(&rc, numMsgProcessed);
 		// Copy the number of messages ready to process
-		copyLongToRespBuf(numMsgUnableToProcess);
+		put_u32be(&rc, numMsgUnableToProcess);
 		// Copy the number of messages ready to process
-		copyLongToRespBuf(xmtMsgCounter);
+		put_u32be(&rc, xmtMsgCounter);
 		// Copy the number of messages ready to process
-		copyLongToRespBuf(errMsgCounter);
+		put_u32be(&rc, errMsgCounter);
 		// Copy the number of flash writes
-		copyLongToRespBuf(flashWriteCount);
+		put_u32be(&rc, flashWriteCount);
 		// Now copy in the error counters from the startup data structure
-		copyIntToRespBuf(startUpDataLocalV.errorCounter[0]);
-		copyIntToRespBuf(startUpDataLocalV.errorCounter[1]);
-		copyIntToRespBuf(startUpDataLocalV.errorCounter[2]);
-		copyIntToRespBuf(startUpDataLocalV.errorCounter[3]);
-		copyIntToRespBuf(startUpDataLocalV.errorCounter[4]);
-		copyIntToRespBuf(startUpDataLocalV.errorCounter[5]);
-		copyIntToRespBuf(startUpDataLocalV.errorCounter[6]);
-		copyIntToRespBuf(startUpDataLocalV.errorCounter[7]);
-		copyIntToRespBuf(startUpDataLocalV.errorCounter[8]);
-		copyIntToRespBuf(startUpDataLocalV.errorCounter[9]);
-		copyIntToRespBuf(startUpDataLocalV.errorCounter[10]);
-		copyIntToRespBuf(startUpDataLocalV.errorCounter[11]);
-		copyIntToRespBuf(startUpDataLocalV.errorCounter[12]);
-		copyIntToRespBuf(startUpDataLocalV.errorCounter[13]);
-		copyIntToRespBuf(startUpDataLocalV.errorCounter[14]);
-		copyIntToRespBuf(startUpDataLocalV.errorCounter[15]);
-		copyIntToRespBuf(startUpDataLocalV.errorCounter[16]);
-		copyIntToRespBuf(startUpDataLocalV.errorCounter[17]);
-		copyIntToRespBuf(startUpDataLocalV.errorCounter[18]);
+		put_u16be(&rc, hartDevice.v.errorCounter[0]);
+		put_u16be(&rc, hartDevice.v.errorCounter[1]);
+		put_u16be(&rc, hartDevice.v.errorCounter[2]);
+		put_u16be(&rc, hartDevice.v.errorCounter[3]);
+		put_u16be(&rc, hartDevice.v.errorCounter[4]);
+		put_u16be(&rc, hartDevice.v.errorCounter[5]);
+		put_u16be(&rc, hartDevice.v.errorCounter[6]);
+		put_u16be(&rc, hartDevice.v.errorCounter[7]);
+		put_u16be(&rc, hartDevice.v.errorCounter[8]);
+		put_u16be(&rc, hartDevice.v.errorCounter[9]);
+		put_u16be(&rc, hartDevice.v.errorCounter[10]);
+		put_u16be(&rc, hartDevice.v.errorCounter[11]);
+		put_u16be(&rc, hartDevice.v.errorCounter[12]);
+		put_u16be(&rc, hartDevice.v.errorCounter[13]);
+		put_u16be(&rc, hartDevice.v.errorCounter[14]);
+		put_u16be(&rc, hartDevice.v.errorCounter[15]);
+		put_u16be(&rc, hartDevice.v.errorCounter[16]);
+		put_u16be(&rc, hartDevice.v.errorCounter[17]);
+		put_u16be(&rc, hartDevice.v.errorCounter[18]);
+		respClose(&rc);
 	}
 }
 
@@ -1982,51 +1882,50 @@ void mfr_cmd_221(void)
 		// reset the counters in the startup data to 0
 		for (index = 0; index < 19; ++index)
 		{
-			startUpDataLocalV.errorCounter[index] = 0;
+			hartDevice.v.errorCounter[index] = 0;
 		}
 		// Now signal the fact the NVRAM haas to change
 		//cmdSyncToFlash = TRUE;
 		// Build the response
-		szHartResp[respBufferSize] = 2 + 24 + 38;  // Byte count
-		++respBufferSize;					
+		stRespCursor rc = respOpen();
+		put_u8(&rc, 2 + 24 + 38);  // Byte count
 		// RC & Status		
-		szHartResp[respBufferSize] = 0;   // Device Status high byte
-		++respBufferSize;							
-		szHartResp[respBufferSize] = (startUpDataLocalV.fromPrimary) ? 
-			startUpDataLocalNv.Primary_status : startUpDataLocalNv.Secondary_status;  // Status byte
-		++respBufferSize;	
+		put_u8(&rc, 0);   // Device Status high byte
+		put_u8(&rc, (hartDevice.v.fromPrimary) ? 
+			hartDevice.v.Primary_status : hartDevice.v.Secondary_status);  // Status byte
 		// Copy the number of messages ready to process
-		copyLongToRespBuf(numMsgReadyToProcess);
+		put_u32be(&rc, numMsgReadyToProcess);
 		// Copy the number of messages ready to process
-		copyLongToRespBuf(numMsgProcessed);
+		put_u32be(&rc, numMsgProcessed);
 		// Copy the number of messages ready to process
-		copyLongToRespBuf(numMsgUnableToProcess);
+		put_u32be(&rc, numMsgUnableToProcess);
 		// Copy the number of messages ready to process
-		copyLongToRespBuf(xmtMsgCounter);
+		put_u32be(&rc, xmtMsgCounter);
 		// Copy the number of messages ready to process
-		copyLongToRespBuf(errMsgCounter);
+		put_u32be(&rc, errMsgCounter);
 		// Copy the number of flash writes
-		copyLongToRespBuf(flashWriteCount);
+		put_u32be(&rc, flashWriteCount);
 		// Now copy in the error counters from the startup data structure
-		copyIntToRespBuf(startUpDataLocalV.errorCounter[0]);
-		copyIntToRespBuf(startUpDataLocalV.errorCounter[1]);
-		copyIntToRespBuf(startUpDataLocalV.errorCounter[2]);
-		copyIntToRespBuf(startUpDataLocalV.errorCounter[3]);
-		copyIntToRespBuf(startUpDataLocalV.errorCounter[4]);
-		copyIntToRespBuf(startUpDataLocalV.errorCounter[5]);
-		copyIntToRespBuf(startUpDataLocalV.errorCounter[6]);
-		copyIntToRespBuf(startUpDataLocalV.errorCounter[7]);
-		copyIntToRespBuf(startUpDataLocalV.errorCounter[8]);
-		copyIntToRespBuf(startUpDataLocalV.errorCounter[9]);
-		copyIntToRespBuf(startUpDataLocalV.errorCounter[10]);
-		copyIntToRespBuf(startUpDataLocalV.errorCounter[11]);
-		copyIntToRespBuf(startUpDataLocalV.errorCounter[12]);
-		copyIntToRespBuf(startUpDataLocalV.errorCounter[13]);
-		copyIntToRespBuf(startUpDataLocalV.errorCounter[14]);
-		copyIntToRespBuf(startUpDataLocalV.errorCounter[15]);
-		copyIntToRespBuf(startUpDataLocalV.errorCounter[16]);
-		copyIntToRespBuf(startUpDataLocalV.errorCounter[17]);
-		copyIntToRespBuf(startUpDataLocalV.errorCounter[18]);
+		put_u16be(&rc, hartDevice.v.errorCounter[0]);
+		put_u16be(&rc, hartDevice.v.errorCounter[1]);
+		put_u16be(&rc, hartDevice.v.errorCounter[2]);
+		put_u16be(&rc, hartDevice.v.errorCounter[3]);
+		put_u16be(&rc, hartDevice.v.errorCounter[4]);
+		put_u16be(&rc, hartDevice.v.errorCounter[5]);
+		put_u16be(&rc, hartDevice.v.errorCounter[6]);
+		put_u16be(&rc, hartDevice.v.errorCounter[7]);
+		put_u16be(&rc, hartDevice.v.errorCounter[8]);
+		put_u16be(&rc, hartDevice.v.errorCounter[9]);
+		put_u16be(&rc, hartDevice.v.errorCounter[10]);
+		put_u16be(&rc, hartDevice.v.errorCounter[11]);
+		put_u16be(&rc, hartDevice.v.errorCounter[12]);
+		put_u16be(&rc, hartDevice.v.errorCounter[13]);
+		put_u16be(&rc, hartDevice.v.errorCounter[14]);
+		put_u16be(&rc, hartDevice.v.errorCounter[15]);
+		put_u16be(&rc, hartDevice.v.errorCounter[16]);
+		put_u16be(&rc, hartDevice.v.errorCounter[17]);
+		put_u16be(&rc, hartDevice.v.errorCounter[18]);
+		respClose(&rc);
 	}
 }
 
@@ -2059,9 +1958,8 @@ void mfr_cmd_222(void)
 {
 	// First check to see if we have too few bytes
 	unsigned char respCode;
-	unsigned char index;
 	//unsigned char * pNvMem = VALID_SEGMENT_1;
-	unsigned char * pNvMem = (unsigned char *)&startUpDataLocalNv;
+	unsigned char * pNvMem = (unsigned char *)&hartDevice.nv;
 	
 	respCode = (deviceBusyFlag) ? HART_DEVICE_BUSY : RESP_SUCCESS;
 	// If we have a non-zero code, send back the error return
@@ -2072,27 +1970,62 @@ void mfr_cmd_222(void)
 	else // We can execute the command from here
 	{
 		// Build the response
-		szHartResp[respBufferSize] = 2 + sizeof(HART_STARTUP_DATA_NONVOLATILE) + 1;  // Byte count
-		++respBufferSize;					
+		stRespCursor rc = respOpen();
+		put_u8(&rc, 2 + sizeof(HART_STARTUP_DATA_NONVOLATILE) + 1);  // Byte count
 		// RC & Status		
-		szHartResp[respBufferSize] = 0;   // Device Status high byte
-		++respBufferSize;							
-		szHartResp[respBufferSize] = (startUpDataLocalV.fromPrimary) ? 
-			startUpDataLocalNv.Primary_status : startUpDataLocalNv.Secondary_status;  // Status byte
-		++respBufferSize;
-		// Now copy out the NV Flash byte by byte
-		for (index = 0; index < sizeof(HART_STARTUP_DATA_NONVOLATILE); ++index)
-		{
-			szHartResp[respBufferSize] = *(pNvMem + index);   // the NV memory
-			++respBufferSize;							
-		}	
+		put_u8(&rc, 0);   // Device Status high byte
+		put_u8(&rc, (hartDevice.v.fromPrimary) ? 
+			hartDevice.v.Primary_status : hartDevice.v.Secondary_status);  // Status byte
+		// Now copy out the NV memory
+		put_bytes(&rc, pNvMem, sizeof(HART_STARTUP_DATA_NONVOLATILE));
 		// Send back the key from the current setting logic
-		szHartResp[respBufferSize] = currentMsgSent;   // last message sent
-		++respBufferSize;							
+		put_u8(&rc, currentMsgSent);   // last message sent
+		respClose(&rc);
 		
 	}
 }
 
+/*!
+ *  \fn     mfr_cmd_223()
+ *  \brief  Process the HART command 223 : Read boot timestamps and clock statistics
+ *          mS from reset to: clock OK (XT1 drives ACLK), Hart RX enabled and first reply,
+ *          0 if the phase has not been reached. Then the number of MCLK bursts, the time
+ *          spent in them (ACLK/8 counts) and the estimated charge of that work (uC) in bursts
+ *          and at the idle clock, see clockChargeUc(). Not to be published in the DD
+ *
+ */
+void mfr_cmd_223(void)
+{
+	unsigned char respCode;
+	
+	respCode = (deviceBusyFlag) ? HART_DEVICE_BUSY : RESP_SUCCESS;
+	// If we have a non-zero code, send back the error return
+	if (respCode)
+	{
+		common_tx_error(respCode);
+	}
+	else // We can execute the command from here
+	{
+		// If this is the very first reply, report its own time
+		markBootTime(&bootTimes.firstReply);
+		// Build the response
+		stRespCursor rc = respOpen();
+		put_u8(&rc, 2 + 12 + 16);  // Byte count
+		// RC & Status		
+		put_u8(&rc, 0);   // Device Status high byte
+		put_u8(&rc, (hartDevice.v.fromPrimary) ? 
+			hartDevice.v.Primary_status : hartDevice.v.Secondary_status);  // Status byte
+		put_u32be(&rc, bootTimes.clockOk);
+		put_u32be(&rc, bootTimes.hartRxEnabled);
+		put_u32be(&rc, bootTimes.firstReply);
+		put_u32be(&rc, clockStats.bursts);
+		put_u32be(&rc, clockStats.burstCounts);
+		put_u32be(&rc, clockChargeUc(FALSE));
+		put_u32be(&rc, clockChargeUc(TRUE));
+		respClose(&rc);
+	}
+}
+
 
 
 
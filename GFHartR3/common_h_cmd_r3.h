@@ -37,6 +37,7 @@ void common_cmd_48(void);
 void common_cmd_54 (void);
 void common_cmd_57 (void);
 void common_cmd_58 (void);
+void common_cmd_59 (void);
 void common_cmd_110 (void);
 
 
@@ -44,6 +45,7 @@ void mfr_cmd_219(void);
 void mfr_cmd_220(void);
 void mfr_cmd_221(void);
 void mfr_cmd_222(void);
+void mfr_cmd_223(void);
 
 
 void common_tx_error(unsigned char);
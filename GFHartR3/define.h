@@ -11,6 +11,7 @@
 #ifndef DEFINE_H_
 #define DEFINE_H_
 
+#include <stdint.h>
 
 /* Type definitions */
 typedef unsigned      char      BOOLEAN;  //!<  Provide a bool for C
@@ -18,8 +19,8 @@ typedef unsigned      char      BYTE;     //!<  Provide a 8-bit unsigned
 typedef signed        char      SBYTE;    //!<  Provide a 8-bit signed
 typedef unsigned      int       WORD;     //!<  Provide a 16-bit unsigned
 typedef signed        int       SWORD;    //!<  Provide a 16-bit signed
-typedef unsigned long int       LWORD;    //!<  Provide a 32-bit unsigned
-typedef signed   long int       SLWORD;   //!<  Provide a 32-bit signed
+typedef uint32_t                LWORD;    //!<  Provide a 32-bit unsigned, also on a 64-bit host build
+typedef int32_t                 SLWORD;   //!<  Provide a 32-bit signed
 
 // These typedefs are used for 9900 communications
 typedef unsigned char int8u;              //!<  Provide a 8-bit unsigned
@@ -112,7 +112,7 @@ volatile BOOLEAN  flashWriteEnable = FALSE;           //!<  Indicates to the mai
 //==============================================================================
 //  LOCAL DATA
 //==============================================================================
-BYTE hartRxfifoBuffer[hartRxFifoLen*2];   //!< Allocates static memory for Hart Receiver Buffer (data, status)
+BYTE hartRxfifoBuffer[hartRxFifoLen*sizeof(WORD)]; //!< Allocates static memory for Hart Receiver Buffer (data, status)
 BYTE hartTxfifoBuffer[hartTxFifoLen];     //!< Allocates static memory for Hart Transmit Buffer
 BYTE hsbRxfifoBuffer[hsbRxFifoLen];				//!< Allocates static memory for High Speed Serial Bus receiver buffer
 BYTE hsbTxfifoBuffer[hsbTxFifoLen];				//!< Allocates static memory for High Speed Serial transmit Buffer
@@ -149,6 +149,9 @@ BOOLEAN initUart(stUart *pUart)
   pUart->bTxMode = FALSE;
   pUart->bRxFifoOverrun = FALSE;
   pUart->bTxDriveEnable = FALSE;
+  pUart->bTxStreamOpen = FALSE;
+  pUart->bRxSkip = FALSE;
+  pUart->bRxHunt = FALSE;
 
   //	If Uart requires RTS control provide it here
   if(	pUart->bRtsControl && pUart->hTxDriver.disable != NULL)
@@ -250,6 +253,7 @@ __interrupt void hartSerialIsr(void)
   static volatile WORD rxword;
   static volatile WORD u ;
   static BYTE status;
+  BOOLEAN bWakeUp = TRUE;   // a skipped character leaves the main loop asleep
   // see recycle #2
 
   u =UCA1IV;            // Get the Interrupt source
@@ -301,6 +305,35 @@ __interrupt void hartSerialIsr(void)
     {
       // Uart is in Recvd Mode
       kickHartGapTimer();                       //  kick the Gap timer as soon as received the 11th bit
+      if(hartUart.bRxSkip)                      //  Frames for other devices (see hartReceiver())
+      {
+        if(!hartUart.bRxHunt)                   //  Still inside the frame, the gap timer starts the hunt
+        {
+          bWakeUp = FALSE;
+          break;
+        }
+        if(HART_PREAMBLE == (BYTE)rxword && !(status & UCRXERR))
+        {
+          if(hartUart.nRxSkipPreambles < HART_SKIP_PREAMBLES)
+            ++hartUart.nRxSkipPreambles;
+          bWakeUp = FALSE;
+          break;
+        }
+        if(hartUart.nRxSkipPreambles && HART_FRAME_STX != ((BYTE)rxword & HART_FRAME_TYPE_MASK))
+        {
+          hartUart.bRxHunt = FALSE;             //  Another slave replying (or bursting): skip it too
+          bWakeUp = FALSE;
+          break;
+        }
+        //  A master frame (or noise): the receiver gets it with the preambles it had
+        hartUart.bRxSkip = FALSE;
+        hartUart.bRxHunt = FALSE;
+        while(hartUart.nRxSkipPreambles && !isRxFull(&hartUart))
+        {
+          putwFifo(&hartUart.rxFifo, HART_PREAMBLE);
+          --hartUart.nRxSkipPreambles;
+        }
+      }
       //  1/15/2013 We read everything (error included) and take decisions at later on as response depends on error location
       if(!isRxFull(&hartUart))                //  put data in input stream if no errors
       {
@@ -325,6 +358,12 @@ __interrupt void hartSerialIsr(void)
       hartUart.bUsciTxBufEmpty = FALSE;    //  enable "chain" isrs
 
     }
+    else if(hartUart.bTxStreamOpen)
+    {
+      //  The response body is not there yet: keep the carrier with one more preamble
+      //  (no gap is allowed inside a Hart frame, extra preambles are)
+      hartUart.txChar(HART_PREAMBLE);
+    }
     else
     {
       // in Half DUplex we reach this point (look oscope carefully) while moving last char
@@ -337,7 +376,8 @@ __interrupt void hartSerialIsr(void)
     break;
   }
 #ifdef LOW_POWERMODE_ENABLED
-  _bic_SR_register_on_exit(LPM_BITS);
+  if(bWakeUp)
+    _bic_SR_register_on_exit(LPM_BITS);
   _no_operation();    //
   _no_operation();
   _no_operation();
@@ -357,9 +397,7 @@ __interrupt void hsbSerialIsr(void)
 	//
 	volatile BYTE rxbyte;
 	volatile BYTE status;
-	static volatile BOOLEAN hsbMsgInProgress = FALSE;
-	static volatile BYTE bLastRxChar;
-	static volatile WORD i9900CmdBuf;       // This is the local Index
+	stHsbContext *pCtx = &hsbCtx;           //  Receiver state (former statics) lives in the Hsb context
 
 	BOOLEAN volatile rxError = FALSE;     //  Take same action for Rx error at the end
 	volatile WORD u =UCA0IV;              //  Get the Interrupt source
@@ -381,7 +419,7 @@ __interrupt void hsbSerialIsr(void)
 	        hsbUart.hRxInter.disable();         //  ===== THIS comes from TX ====
 	        //  HSB has finished here
 	        hsbActivitySlot = FALSE;            //  HSB for Hart has ended, allow to sleep and ignore any traffic until wake-up
-	        hsbMsgInProgress = FALSE;           //  Everything has been shifted out
+	        pCtx->rxMsgInProgress = FALSE;           //  Everything has been shifted out
 	        CLEARB(TP_PORTOUT,TP2_MASK);        // HSB message 4) End of HSB message
 
 	      }
@@ -392,35 +430,35 @@ __interrupt void hsbSerialIsr(void)
 	    else
 	    {
 	      // Code for reception of a character UART-error free:
-	      if(hsbMsgInProgress)
+	      if(pCtx->rxMsgInProgress)
 	      {
 	        //  Bare bone reception is done here
 	        if(rxbyte == HART_MSG_END)
 	        {
 	          SET_SYSTEM_EVENT(evHsbRecComplete);
 	          CLEARB(TP_PORTOUT, TP2_MASK);         // HSB message 2) All characters in buffer
-	          hsbMsgInProgress = FALSE;
+	          pCtx->rxMsgInProgress = FALSE;
 	          //  hsbUart.hRxInter.disable();       //  We can't do this here - need to disable at TX shift out
 
 	        }
 	        else  // Keep storing rx chars
-	          if(i9900CmdBuf < MAX_9900_CMD_SIZE)
-	            sz9900CmdBuffer[i9900CmdBuf++] = rxbyte;
+	          if(pCtx->rxIdx < MAX_9900_CMD_SIZE)
+	            pCtx->cmd[pCtx->rxIdx++] = rxbyte;
 	          else
 	            rxError = TRUE;   //  command buffer overrun
 	      }
 	      else
-	      if( bLastRxChar == ATTENTION && rxbyte == HART_ADDRESS )  // We get the start of a $H
+	      if( pCtx->rxLastChar == ATTENTION && rxbyte == HART_ADDRESS )  // We get the start of a $H
 	      {
 	        startHsbAttentionTimer();       // This will Enable RXIE again before Attention arrives
 	        SETB(TP_PORTOUT, TP2_MASK);     // HSB message 1) Start detected $H
-	        hsbMsgInProgress = TRUE;
+	        pCtx->rxMsgInProgress = TRUE;
 	        //  To be compatible with what Process9900Command() requires first two be '$','H'
-	        sz9900CmdBuffer[0] = ATTENTION;
-	        i9900CmdBuf=1;
-	        sz9900CmdBuffer[i9900CmdBuf++] = HART_ADDRESS;
+	        pCtx->cmd[0] = ATTENTION;
+	        pCtx->rxIdx=1;
+	        pCtx->cmd[pCtx->rxIdx++] = HART_ADDRESS;
 	      }
-	      bLastRxChar = rxbyte;   // The sequence of last two chars is the signature
+	      pCtx->rxLastChar = rxbyte;   // The sequence of last two chars is the signature
 	    }
 	    break;
 
@@ -449,14 +487,14 @@ __interrupt void hsbSerialIsr(void)
 	{
 	  // TOGGLEB(TP_PORTOUT, TP3_MASK);        //  catch errors: Errors are detected when shorting HSB bus, no errors due protocol handling
 	  hsbUart.bRxError = TRUE;              //  signal the error
-	  bLastRxChar =0;                       //  Reset start sequence
+	  pCtx->rxLastChar =0;                       //  Reset start sequence
 	  hsbActivitySlot = TRUE;               //  HSB do not sleep, listen everything
 
 	  // In error condition This is my basic Failure State Recover
 	  //  1) UART should be listening but buffers set to init conditions
-	  i9900CmdBuf =0;
+	  pCtx->rxIdx =0;
 	  // Loog for the $H again
-	  hsbMsgInProgress = FALSE;             //  Reset the simple two-state machine
+	  pCtx->rxMsgInProgress = FALSE;             //  Reset the simple two-state machine
 	}
 
 #ifdef LOW_POWERMODE_ENABLED
@@ -73,7 +73,11 @@ typedef struct
               bUsciTxBufEmpty,          //!< Status of msp430 Serial buffer (write direct to txsbuf)
               bTxMode,                  //!< When Half Duplex, ignore Rx characters but last one
               bRxFifoOverrun,           //!< Fifo overrun indicator
-              bTxDriveEnable;           //!< Indicates TxMode in Half-Duplex, TRUE in Full-Duplex
+              bTxDriveEnable,           //!< Indicates TxMode in Half-Duplex, TRUE in Full-Duplex
+              bTxStreamOpen,            //!< Frame still being appended: the Tx isr fills with preambles if the fifo runs dry
+              bRxSkip,                  //!< Frame for another device: the Rx isr drops characters until the next master frame
+              bRxHunt;                  //!< Skip between frames: preambles are counted, the next delimiter ends the skip if STX
+  volatile BYTE nRxSkipPreambles;       //!< Preambles dropped while hunting
 } stUart;
 
 /*************************************************************************
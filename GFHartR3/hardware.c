@@ -15,6 +15,7 @@
 #include "hardware.h"
 #include "driverUart.h"
 #include "hartMain.h"
+#include "protocols.h"
 
 //==============================================================================
 //  LOCAL DEFINES
@@ -24,17 +25,27 @@
 //  LOCAL PROTOTYPES.
 //==============================================================================
 static void toggleRtsLine();
+static void lowerVcore(unsigned char level);
+static void setDco(WORD dcorsel, WORD flld, WORD dco);
 //==============================================================================
 //  GLOBAL DATA
 //==============================================================================
 volatile WORD SistemTick125mS=0;
 unsigned char currentMsgSent = NO_CURRENT_MESSAGE_SENT;
 volatile BOOLEAN bHartRecvFrameCompleted = FALSE;
+BOOLEAN xt1Running = FALSE;
+stBootTimes bootTimes;
+stClockStats clockStats;
 
 //  volatile WORD flashWriteTimer =0;   // Original timer was 4000 mS, local var
 //==============================================================================
 //  LOCAL DATA
 //==============================================================================
+static BYTE xt1StableTicks;     //!<  Consecutive ticks XT1 has run without a fault
+static BOOLEAN clockInBurst;    //!<  MCLK runs from DCOCLK at the burst Vcore
+static WORD burstStartCount;    //!<  TB0R when the present burst started
+static WORD idleDco;            //!<  UCSCTL0 (DCO tap and modulation) the FLL settled on in the idle setting
+static WORD burstDco;           //!<  and in the burst setting, 0 until the first burst ends
 
 //==============================================================================
 // FUNCTIONS
@@ -69,6 +80,7 @@ void INIT_SVS_supervisor(void)
 void INIT_set_Vcore (unsigned char level)
 {
   PMMCTL0_H = 0xA5;   // Unlock PMM module registers to allow write access
+  PMMIFG &= ~SVSMLDLYIFG;                   // A stale delay flag would end the settle wait below at once
 
   // Set SVS/M high side to new level
   SVSMHCTL = (SVSMHCTL & ~(SVSHRVL0*3 + SVSMHRRL0)) | \
@@ -80,8 +92,8 @@ void INIT_set_Vcore (unsigned char level)
   SVSMLCTL = (SVSMLCTL & ~(SVSMLRRL_3)) | (SVMLE + SVSMLRRL0 * level);
 
   while ((PMMIFG & SVSMLDLYIFG) == 0);      // Wait till SVM is settled (Delay)
+  PMMIFG &= ~(SVMLVLRIFG + SVMLIFG);        // Clear already set flags, before the level changes
   PMMCTL0_L = PMMCOREV0 * level;            // Set VCore to x
-  PMMIFG &= ~(SVMLVLRIFG + SVMLIFG);        // Clear already set flags
 
   if ((PMMIFG & SVMLIFG))
     while ((PMMIFG & SVMLVLRIFG) == 0);     // Wait till level is reached
@@ -93,6 +105,109 @@ void INIT_set_Vcore (unsigned char level)
   PMMCTL0_H = 0x00;   // Lock PMM module registers to prevent write access
 }
 
+/*!
+ * \fn  lowerVcore
+ *
+ * \brief     Steps VCore down, TI's lowering sequence: the SVS/M low side goes to the new level first,
+ *            then PMMCOREV (INIT_set_Vcore() is the raising sequence)
+ * \param     Vcore Level
+ * \return    none
+ *
+ */
+static void lowerVcore(unsigned char level)
+{
+  PMMCTL0_H = 0xA5;   // Unlock PMM module registers to allow write access
+  PMMIFG &= ~(SVMLVLRIFG + SVMLIFG + SVSMLDLYIFG);    // Clear the flags the settle wait looks at
+
+  // Set SVS/M Low side to new level
+  SVSMLCTL = (SVSMLCTL & ~(SVSLRVL0*3 + SVSMLRRL_3)) | \
+             (SVSLE + SVSLRVL0 * level + SVMLE + SVSMLRRL0 * level);
+  while ((PMMIFG & SVSMLDLYIFG) == 0);      // Wait till SVM is settled (Delay)
+  PMMCTL0_L = PMMCOREV0 * level;            // Set VCore to x
+
+  PMMCTL0_H = 0x00;   // Lock PMM module registers to prevent write access
+}
+
+/*!
+ * \fn  setDco
+ * \brief  Moves the DCO to the idle or the burst setting, DCOCLKDIV (SMCLK) stays at 1.048MHz
+ *
+ * The FLL is held while the range, the loop divider and the tap change together. The tap is the one
+ * the FLL settled on the last time the setting was used, so the loop resumes close to lock instead
+ * of searching from the bottom of the range.
+ */
+static void setDco(WORD dcorsel, WORD flld, WORD dco)
+{
+  __bis_SR_register(SCG0);  //  Disable the FLL control loop
+  UCSCTL1 = dcorsel;
+  UCSCTL2 = flld | CLOCK_FLLN;
+  UCSCTL0 = dco;
+  __bic_SR_register(SCG0);  //  Enable the FLL control loop
+}
+
+/*!
+ * \fn  clockBurst(void)
+ * \brief  Speeds MCLK up to DCOCLK (8.4MHz) for a burst of work: reply building, 9900 commands
+ *
+ * Vcore is raised first (the PMM settle time, about 0.2mS at the idle MCLK, comes before the work),
+ * then the DCO is moved to the burst setting. The first burst starts the DCO from the idle tap: the
+ * burst range runs ~4x faster per tap, the same as the FLLD ratio, so SMCLK is only a few % off
+ * while the FLL finishes the lock. ACLK is not touched, so the Hart Uart and timers keep their timing.
+ * The burst lasts until clockIdle() is called, right before the main loop sleeps.
+ */
+void clockBurst(void)
+{
+  if(clockInBurst)
+    return;
+  INIT_set_Vcore(CLOCK_BURST_VCORE);
+  INIT_SVS_supervisor();
+  idleDco = UCSCTL0;
+  setDco(CLOCK_BURST_DCORSEL, CLOCK_BURST_FLLD, (burstDco) ? burstDco : idleDco);
+  UCSCTL4 = (UCSCTL4 & ~SELM_7) | SELM_3;   //  MCLK = DCOCLK
+  clockInBurst = TRUE;
+  burstStartCount = TB0R;
+  ++clockStats.bursts;
+}
+
+/*!
+ * \fn  clockIdle(void)
+ * \brief  Ends a burst: MCLK back to DCOCLKDIV (1.048MHz), the DCO to the idle setting, then Vcore down
+ *
+ * The burst duration is added to clockStats in ACLK/8 counts, so the time spent awake per burst
+ * can be compared with the same work at 1MHz (see clockChargeUc()).
+ */
+void clockIdle(void)
+{
+  WORD now;
+  if(!clockInBurst)
+    return;
+  UCSCTL4 = (UCSCTL4 & ~SELM_7) | SELM_4;   //  MCLK = DCOCLKDIV
+  burstDco = UCSCTL0;
+  setDco(CLOCK_IDLE_DCORSEL, CLOCK_IDLE_FLLD, idleDco);
+  lowerVcore(CLOCK_IDLE_VCORE);
+  INIT_SVS_supervisor();
+  clockInBurst = FALSE;
+  now = TB0R;
+  clockStats.burstCounts += (now >= burstStartCount) ? now - burstStartCount :
+                                                       now + (SYSTEM_TICK_TPRESET +1) - burstStartCount;
+}
+
+/*!
+ * \fn  clockChargeUc(BOOLEAN atIdleClock)
+ * \brief  Estimated supply charge of the work done in bursts, uC (uA x S)
+ *
+ * From the burst time in clockStats and the datasheet active currents in hardware.h, it is an
+ * estimate, not a measurement. With atIdleClock the same work is priced at the idle MCLK: it takes
+ * CLOCK_BURST_RATIO times longer at CLOCK_IDLE_ACTIVE_UA. The difference is the race to idle saving
+ * (less the PMM settle time at every burst, and the LPM0 current the idle clock would not spend).
+ */
+unsigned long clockChargeUc(BOOLEAN atIdleClock)
+{
+  unsigned long counts = clockStats.burstCounts;
+  unsigned long uA = (atIdleClock) ? (unsigned long)CLOCK_IDLE_ACTIVE_UA * CLOCK_BURST_RATIO : CLOCK_BURST_ACTIVE_UA;
+  return (counts / CLOCK_STATS_COUNTS_PER_SEC) * uA + (counts % CLOCK_STATS_COUNTS_PER_SEC) * uA / CLOCK_STATS_COUNTS_PER_SEC;
+}
+
 /*!
  * \fn checkClock
  * Checks and clear any oscillator fault
@@ -110,13 +225,16 @@ void checkClock(void)
 
 /*!
  * \fn  initClock(void)
- * \brief     Set clocks MCLK & SMCLK - DCO 1.048576MHz enable FLL:XT1,
- *            ACLK -XT1 xtal 32.768KHz
+ * \brief     Set clocks MCLK & SMCLK - DCO 1.048576MHz enable FLL:REFO,
+ *            ACLK -REFO 32.768KHz until XT1 starts, see pollXt1Startup()
  *
  * Main clock MCLK source is DCO, maximum permissible freq is 1.048MHz for Low power
- * DCO stabilized by FLL (as default) but using XT1 as the reference clock.
+ * DCO stabilized by FLL (as default), using REFO as the reference clock until XT1 is good.
  * SMCLK will be used for HSB Uart, ACLK for Hart Uart and system timers
  *
+ * The function doesn't wait for the crystal: the firmware runs from REFO/DCO at once and the
+ * system tick polls XT1 and switches ACLK and the FLL reference over when it runs fault free.
+ *
  * 12/11/12
  * - FLL is enabled at Power up. After XT1 starts up, we disable FLL and leave DCO without compensation
  *    (this is a temp solution since our Hart HW has silicon rev. E with the UCS10 errata)
@@ -142,18 +260,22 @@ void initClock(void)
   //  ==> set the internal Caps as necessary UCSCTL6 |= XCAP_x
   //
   //  Setup DCO frequency by the FLL frequency multiplier FLLN and loop divider FLLD
-  //  After stabilization: DCOCLK = (32768/1 ) * ( 1 * (31+1)) = 1,048,576 Hz
-  //  UCSCTL2 = FLLD__1 |       //  FLLD=0  divide-feedback-by-1 ?? default is 1 and still div-by-1
-  //            0x001F;         //  FLLN=31 divide feedback by 31+1
+  //  After stabilization: DCOCLKDIV = (32768/1 ) * (31+1) = 1,048,576 Hz
   //  ===> UCSCTL2 = 0x101F is the default as TI example: 0x101F -MH 11/19/12
+  //  clockBurst() raises the loop divider to 8 so DCOCLK = 8 * DCOCLKDIV = 8,388,608 Hz: SMCLK stays
+  //  on DCOCLKDIV and MCLK is moved to DCOCLK, clockIdle() goes back to this setting
 
   //  Set FLL clock reference and its divider FLLREFDIV
-  UCSCTL3 = SELREF_0  |     //  SELREF = 0  FLL reference is XT1 = 32768 Hz, XT1 should start from here
+  UCSCTL3 = SELREF_2  |     //  SELREF = 2  FLL reference is REFO = 32768 Hz, moved to XT1 once it is stable
             FLLREFDIV__1;   //  FLLREFDIV=0 FLL reference div-by-1
 
+  //  Idle setting, lowest DCOx, MODx: the FLL takes it from there
+  setDco(CLOCK_IDLE_DCORSEL, CLOCK_IDLE_FLLD, 0x0000);
+  burstDco = 0;
+
   // Select the system clocks (same as TI example, default 0x0044) as Some favor DCOCLKDIV over DCOCLK (less jitter)
-  //  ACLK = XT1CLK, SMCLK = DCOCLKDIV, MCLK  = DCOCLKDIV
-  UCSCTL4 =   SELA_0 |      //  ACLK  = XT1CLK  =   32.768Khz external crystal
+  //  ACLK = REFOCLK, SMCLK = DCOCLKDIV, MCLK  = DCOCLKDIV
+  UCSCTL4 =   SELA_2 |      //  ACLK  = REFOCLK =   32.768Khz internal, XT1CLK once the crystal is stable
               SELS_4 |      //  SMCLK = DCOCLKDIV=  1,048,576   as TI Example (default) MH -11/19/12
               SELM_4;       //  MCLK  = DCOCLKDIV=  1,048,576   as TI Example (default) MH -11/19/12
 
@@ -163,18 +285,19 @@ void initClock(void)
             DIVS_0  |       //  SMCLK /1
             DIVM_0;         //  MCLK /1
 
-  //  Loop until XT1 & DCO stabilize.
-  //  Clearing fault generated by XT1 allows the FLL to switch from REFO to XT1 again, until XT1 exceeds fault level
-  //  We stay in this loop for ~800mS, (maximum startup time is 500mS: 3V, 32Khz,XTS=0,XT1DRIVE=3,CLeff=12pF).
-  //  After clearing OFIFG fault, we wait 10mS before testing the bit
-  //
-  WORD u=0;
+  //  Wait for the FLL to bring the DCO off its lowest tap (no DCO fault), the lock is refined while
+  //  the firmware runs. SMCLK is not used before initUart()
   do
   {
-    UCSCTL7 &= ~(XT1LFOFFG | DCOFFG);       //  Clear XT1 and DCO fault flags
-    SFRIFG1 &= ~OFIFG;                      //  Clear fault flags
-    __delay_cycles(10000);                  //  10mS @1Mhz - this is a delay before asking for Flasg status
-  } while (u++ < 80 || (SFRIFG1&OFIFG) );   //  Force to test oscillator fault flag for at least 800mS
+    UCSCTL7 &= ~DCOFFG;
+  } while (UCSCTL7 & DCOFFG);
+  clockInBurst = FALSE;
+  //  No wait for XT1 here (maximum startup time is 500mS: 3V, 32Khz,XTS=0,XT1DRIVE=3,CLeff=12pF),
+  //  the system tick calls pollXt1Startup() until the crystal is good
+  xt1Running = FALSE;
+  xt1StableTicks =0;
+  UCSCTL7 &= ~(XT1LFOFFG | DCOFFG);         //  Clear XT1 and DCO fault flags
+  SFRIFG1 &= ~OFIFG;                        //  Clear fault flags
   //
 #ifdef MONITOR_ACLK
   // Monitor Clocks: ACLK --> P1.0
@@ -201,6 +324,62 @@ void initClock(void)
 
 }
 
+/*!
+ * \fn  pollXt1Startup(void)
+ * \brief  Switches ACLK and the FLL reference from REFO to XT1 once the crystal is stable
+ *
+ * Called every system tick until XT1 runs. The XT1 fault flag is cleared at every call, the crystal
+ * is declared good after XT1_STABLE_TICKS consecutive ticks without the flag coming back.
+ *
+ * \return TRUE at the call that switches the clocks over (the caller re-initializes the Hart Uart),
+ *         FALSE otherwise
+ */
+BOOLEAN pollXt1Startup(void)
+{
+  if(xt1Running)
+    return FALSE;
+  if(UCSCTL7 & XT1LFOFFG)
+    xt1StableTicks =0;                      //  Still starting (or failed again), start over
+  else if(++xt1StableTicks >= XT1_STABLE_TICKS)
+  {
+    UCSCTL3 = SELREF_0 | FLLREFDIV__1;      //  FLL reference is XT1
+    UCSCTL4 = (UCSCTL4 & ~SELA_7) | SELA_0; //  ACLK  = XT1CLK, SMCLK and MCLK unchanged
+    xt1Running = TRUE;
+  }
+  UCSCTL7 &= ~(XT1LFOFFG | DCOFFG);         //  Clear XT1 and DCO fault flags
+  SFRIFG1 &= ~OFIFG;
+  return xt1Running;
+}
+
+/*!
+ * \fn  bootTimeMs(void)
+ * \brief  Returns the mS elapsed since reset, for the boot phase timestamps
+ *
+ * The Cmd 9 time stamp gives the whole ticks, TB0R the fraction of the running one (and a tick
+ * the main loop hasn't taken yet is added). Time before initTimers() is not counted.
+ */
+unsigned long bootTimeMs(void)
+{
+  unsigned long ms = dataTimeStamp + (unsigned long)TB0R * SYSTEM_TICK_MS / (SYSTEM_TICK_TPRESET +1);
+  if(IS_SYSTEM_EVENT(evTimerTick))
+    ms += SYSTEM_TICK_MS;
+  return ms;
+}
+
+/*!
+ * \fn  markBootTime(unsigned long *pStamp)
+ * \brief  Records the present boot time in the indicated bootTimes member, only the first time
+ *         (a phase reached within the first mS is recorded as 1)
+ */
+void markBootTime(unsigned long *pStamp)
+{
+  if(*pStamp == 0)
+  {
+    unsigned long ms = bootTimeMs();
+    *pStamp = ms ? ms : 1;
+  }
+}
+
 /*!
  * 	\fn  initTimers()
  * 	Configure the msp430 timers as follows:
@@ -232,7 +411,7 @@ initTimers()
   HART_RCV_REPLY_TIMER_CTL =	TASSEL_1	|				// Clock Source = ACLK
   														ID_3 |						// /8
   														TACLR;						//	Clear
-  HART_RCV_REPLY_TIMER_CCR = 	REPLY_TIMER_PRESET;// CCR0
+  HART_RCV_REPLY_TIMER_CCR = 	REPLY_TIMER_MIN_PRESET;// CCR0
   HART_RCV_REPLY_TIMER_CCTL =	CCIE;							// Enable CCR0 interrupt
 
 
@@ -313,8 +492,8 @@ void initHardware(void)
   PMMCTL0 = PMMPW | pmmReg;
   //
   //
-  // Set VCore
-  INIT_set_Vcore(PMMCOREV_0);
+  // Set VCore to the idle level, clockBurst() raises it for the burst
+  INIT_set_Vcore(CLOCK_IDLE_VCORE);
   //
   initTimers();
 
@@ -421,6 +600,11 @@ __interrupt void gapTimerISR(void)
   //SETB(TP_PORTOUT, TP3_MASK);             // Indicate an Gap Error and leave pin there
   if(!bHartRecvFrameCompleted)              // We time-out but hartReceiver() has ACK and waiting to Reply
     SET_SYSTEM_EVENT(evHartRcvGapTimeout);
+  if(hartUart.bRxSkip)                      // A skipped frame (other device) is over, hunt for the next master frame
+  {
+    hartUart.nRxSkipPreambles = 0;
+    hartUart.bRxHunt = TRUE;
+  }
 
 	// Stop the timer (Only one shot)
 	HART_RCV_GAP_TIMER_CTL  &= ~MC_3;     // This makes MC_0 = stop counting
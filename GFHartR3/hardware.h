@@ -84,12 +84,41 @@
 //  undefine for production code
 #define TRAP_INTERRUPTS
 
+//
+//  Check every response builder write against the end of the Hart response buffer
+//  and trap an overflow. Debug only, undefine for production code
+#define RESP_BOUNDS_CHECK
+
 // 	Timers clock source are ACLK/8 = 32768/8 = 4096hz
 //	Reload value is (mS -1)*4.096
 //		8, 508, 8188 40956u      	Tick aprox 2mS, 125mS, 2 Sec, 10Sec
 #define SYSTEM_TICK_TPRESET	508
 #define SYSTEM_TICK_MS  125
 #define NUMBER_OF_MS_IN_24_HOURS  86400000
+//  XT1 must run this many system ticks without a fault before it drives ACLK
+#define XT1_STABLE_TICKS  2
+
+/*!
+ *  Clock manager
+ *
+ *  DCOCLKDIV (SMCLK, idle MCLK) = 1,048,576 Hz in both settings, only the DCO and Vcore change:
+ *  - idle:  DCOCLK = 2 x DCOCLKDIV (the TI default loop divider), Vcore level 0
+ *  - burst: DCOCLK = 8 x DCOCLKDIV = 8.4MHz drives MCLK, it needs Vcore level 1 (level 0 is good up to 8MHz)
+ *  The burst to idle ratio is the MCLK speed up, used for the Cmd 223 energy estimate
+ */
+#define CLOCK_FLLN            0x001F      /* FLLN=31 DCOCLKDIV = (31+1) x 32768 */
+#define CLOCK_IDLE_FLLD       FLLD__2
+#define CLOCK_IDLE_DCORSEL    DCORSEL_2   /* 0.32 to 7.38MHz */
+#define CLOCK_IDLE_VCORE      0
+#define CLOCK_BURST_FLLD      FLLD__8
+#define CLOCK_BURST_DCORSEL   DCORSEL_4   /* 1.3 to 28.2MHz, same tap is ~4x the idle range */
+#define CLOCK_BURST_VCORE     1
+#define CLOCK_BURST_RATIO     8
+//  Active mode supply current, datasheet typical at 3V (not measured on this board), for the energy estimate
+#define CLOCK_IDLE_ACTIVE_UA  360         /* 1MHz, PMMCOREV 0 */
+#define CLOCK_BURST_ACTIVE_UA 2650        /* 8MHz, PMMCOREV 1 */
+//  System timer clock (ACLK/8), the unit of stClockStats.burstCounts
+#define CLOCK_STATS_COUNTS_PER_SEC  4096
 //  Minimum time to wait between Flash writes (other conditions apply)
 //  Time is in mS 0 to 65000
 #define FLASH_WRITE_MS  2000  /*  Change from 4000 to 2000 since less chance to catch a write */
@@ -113,13 +142,16 @@
  *  - Start   when receiver reaches LRC (we are going to reply to all complete messages, some may not be to us)
  *  - Stop    When the Reply event is taken
  *  - Event   hartFrameRcvd should be true
+ *  The reply is built right at the LRC. The timer runs REPLY_TIMER_MIN_PRESET periods (minimum turnaround)
+ *  and is restarted while the master carrier is still detected, for up to REPLY_TIMER_PRESET counts in total
  */
 #define GAP_TIMER_PRESET  82      /* 2 chars + 10% = 2.2* 9.1666 ~ 20mS  or 82 counts THIS IS PRODUCTION SETTING */
 //  Follows test and comments
 //#define GAP_TIMER_PRESET  75    /* 18mS ~ 75 tested w 50mS~201 and hyperterminal    */  (== ORIGINAL VALUE)
 //#define GAP_TIMER_PRESET  56    /* 13.5mS (1.5 chars) accelerate fault probability  */  (PROBLM found, kickHartRecTimer to ISR)
 //#define GAP_TIMER_PRESET  38      /* 38~10 mS (1.1 chars) test functionality, (FUNCTIONALITY TESTED)  with 39 (9.5) takes a long time to fail*/
-#define REPLY_TIMER_PRESET 53     /* 14mS ~ 53, tested w 100mS~406 and hyperterminal */
+#define REPLY_TIMER_PRESET 53     /* 14mS ~ 53, tested w 100mS~406 and hyperterminal - now the longest hold for carrier off */
+#define REPLY_TIMER_MIN_PRESET 10 /* 2.4mS ~ 3 bit times: master stop bit plus modem carrier decay */
 /*!
  *  High Speed Bus timer
  *  This timer measures the start of a Hsb message $H and times out to receive next command
@@ -199,7 +231,31 @@
 
 //  Promote to Global as it is seen by driverUart 12/26/12
 #define HART_PREAMBLE       0xFF
+//  Frame type bits of a Hart delimiter, seen by the Rx isr while it skips frames for other devices
+#define HART_FRAME_TYPE_MASK  0x07
+#define HART_FRAME_STX        0x02    //!< Master to slave, BACK/ACK frames come from other slaves
+#define HART_SKIP_PREAMBLES   5       //!< Preambles handed to the receiver ahead of a master frame found by the skip
+
+/*!
+ *  Boot phase timestamps, mS since reset (0 = not reached yet)
+ *
+ *  Read with Cmd 223 to track the start up time from one firmware release to the next
+ */
+typedef struct
+{
+  unsigned long clockOk;            //!<  XT1 drives ACLK, Hart Uart re-initialized on it
+  unsigned long hartRxEnabled;      //!<  Hart receiver listening
+  unsigned long firstReply;         //!<  First Hart reply sent
+} stBootTimes;
 
+/*!
+ *  Clock manager accounting, read with Cmd 223
+ */
+typedef struct
+{
+  unsigned long bursts;             //!<  Number of MCLK bursts
+  unsigned long burstCounts;        //!<  Total time spent in bursts, ACLK/8 counts (244uS)
+} stClockStats;
 
 /*************************************************************************
   *   $GLOBAL PROTOTYPES
@@ -208,12 +264,21 @@ void INIT_set_Vcore(unsigned char);
 void INIT_SVS_supervisor(void);
 
 void initHardware(void);            //!< Initialize Peripherals for the Hart Application
+BOOLEAN pollXt1Startup(void);       //!< Switch ACLK to XT1 when the crystal is stable
+unsigned long bootTimeMs(void);     //!< mS since reset
+void markBootTime(unsigned long *pStamp);   //!< Timestamp a boot phase once
+void clockBurst(void);              //!< MCLK to DCOCLK for a burst of work
+void clockIdle(void);               //!< MCLK back to DCOCLKDIV before sleeping
+unsigned long clockChargeUc(BOOLEAN atIdleClock);  //!< Estimated charge of the bursts, uC
 //void stop_oscillator();             //!< Stops the CPU clock and go to sleep mode
 
 /*************************************************************************
   *   $GLOBAL VARIABLES
 *************************************************************************/
 extern volatile WORD SistemTick125mS;
+extern BOOLEAN xt1Running;          //!<  XT1 drives ACLK and the FLL, REFO did until then
+extern stBootTimes bootTimes;
+extern stClockStats clockStats;
 //HICCUP
 extern unsigned char currentMsgSent;
 /*!
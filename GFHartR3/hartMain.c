@@ -59,6 +59,8 @@
 void initSystem(void);
 void hsbErrorHandler(void);
 void pulseTp4(BYTE errCode);
+static void buildHartReply(void);
+static void speculateHartReply(void);
 //==============================================================================
 //  GLOBAL DATA
 //==============================================================================
@@ -95,6 +97,13 @@ volatile WORD hsbWAtchDog;
 unsigned long int flashWriteCount=0;
 unsigned long int dataTimeStamp=0;
 
+//==============================================================================
+//  LOCAL DATA
+//==============================================================================
+static BOOLEAN hartReplyPending = FALSE;  //!<  A reply has been built at the LRC and waits for the line to be free
+static BOOLEAN hartReplyDeferred = FALSE; //!<  A reply that is sure to go is built behind its preambles at reply time
+static BYTE hartReplyHoldPolls;           //!<  Reply timer periods the pending reply has waited
+
 //==============================================================================
 // FUNCTIONS
 //==============================================================================
@@ -105,23 +114,18 @@ unsigned long int dataTimeStamp=0;
 /*!
  *  initialize local data structure for the first time, or if the NV memory is ever corrupted.
  *
- *  If the NV memory is corrupt, copy the factory structure into ram, then copy the RAM to the FLASH
+ *  If the NV memory is corrupt, copy the factory structure into ram, the next flash sync commits it
  */
 void initializeLocalData (void)
 {
-  int numSegsToErase;
   // Clear the local structure
-  memset(&startUpDataLocalNv, 0, sizeof(HART_STARTUP_DATA_NONVOLATILE));
+  memset(&hartDevice.nv, 0, sizeof(HART_STARTUP_DATA_NONVOLATILE));
   // Now copy the factory image into RAM
-  memcpy(&startUpDataLocalNv, &startUpDataFactoryNv, sizeof(HART_STARTUP_DATA_NONVOLATILE));
+  memcpy(&hartDevice.nv, &startUpDataFactoryNv, sizeof(HART_STARTUP_DATA_NONVOLATILE));
   // Now copy in the NV unique device ID
   copyNvDeviceIdToRam();
-  // erase the segment of FLASH so it can be reprogrammed
-  numSegsToErase = calcNumSegments (sizeof(HART_STARTUP_DATA_NONVOLATILE));
-  eraseMainSegment(VALID_SEGMENT_1, (numSegsToErase*MAIN_SEGMENT_SIZE));
-  // Copy the local data into NV memory
-  copyMemToMainFlash (VALID_SEGMENT_1, ((unsigned char *)&startUpDataLocalNv),
-    sizeof(HART_STARTUP_DATA_NONVOLATILE));
+  // The factory record is committed by the first flash sync, boot does not write flash
+  markNvDirty(NV_DIRTY_ALL);
 }
 
 
@@ -129,14 +133,13 @@ void initStartUpData()
 {
   // Load up the volatile startup data
   // Clear the local structure
-  memset(&startUpDataLocalV, 0, sizeof(HART_STARTUP_DATA_VOLATILE));
+  memset(&hartDevice.v, 0, sizeof(HART_STARTUP_DATA_VOLATILE));
   // Now copy the factory image into RAM
-  memcpy(&startUpDataLocalV, &startUpDataFactoryV, sizeof(HART_STARTUP_DATA_VOLATILE));
+  memcpy(&hartDevice.v, &startUpDataFactoryV, sizeof(HART_STARTUP_DATA_VOLATILE));
   // Load up the nonvolatile startup data
-  // Load the startup data from NV memory
-  syncToRam(VALID_SEGMENT_1, ((unsigned char *)&startUpDataLocalNv), sizeof(HART_STARTUP_DATA_NONVOLATILE));
-  // If the local data structure has bad values, initialize them
-  if (GF_MFR_ID != startUpDataLocalNv.ManufacturerIdCode)
+  // Load the configuration record from NV memory, an older layout is migrated
+  // If there is no usable record, initialize it
+  if (NV_LOAD_BLANK == loadNvRecord())
   {
     initializeLocalData();
   }
@@ -145,10 +148,13 @@ void initStartUpData()
     // Make sure we have the correct Device ID in any case
     verifyDeviceId();
   }
+  // The receiver address comes from the loaded record
+  refreshHartAddress(&hartCtx);
+  // The reported status starts from the config changed masters
+  loadStatusFromNv();
   // Set the COLD START bit for primary & secondary
-  setPrimaryStatusBits(FD_STATUS_COLD_START);
-  setSecondaryStatusBits(FD_STATUS_COLD_START);
-  ++startUpDataLocalV.errorCounter[8];
+  setStatusBits(STATUS_BOTH, FD_STATUS_COLD_START);
+  ++hartDevice.v.errorCounter[8];
 }
 
 
@@ -167,7 +173,8 @@ void initSystem(void)
   // Hart Starts First
   hartUart.hTxInter.enable();
   hartUart.hRxInter.enable();
-  initHartRxSm();           // Init Global part, static vars are initialized at first call
+  markBootTime(&bootTimes.hartRxEnabled);
+  initHartRxSm(&hartCtx);   // Init Global part, static vars are initialized at first call
 
   //	High Speed Bus initialization - RX is enabled some time after OR few Hart transactions
   initUart(&hsbUart);		        // Initialize High Speed Bus Uart @19200bps, 7,o,1
@@ -186,6 +193,8 @@ void initSystem(void)
   // MH:  I am trying to collect all initializations in a single function
   //      and also to understand the interface, keeping high level here
   initStartUpData();
+  // Serve Hart with the last database the 9900 validated until it sends one
+  restoreCachedDb();
 
 }
 
@@ -217,6 +226,7 @@ tEvent waitForEvent()
   	 */
   	_no_operation();					// Just a Breakpoint
   	//CLEARB(TP_PORTOUT, TP2_MASK);   // LPM indicate going to sleep
+  	clockIdle();              // Race to idle: the burst (if any) ends before sleeping
 #ifdef LOW_POWERMODE_ENABLED
   	if(!hsbActivitySlot)      // Real power save is done when no HSB activity,
   	{
@@ -244,6 +254,59 @@ tEvent waitForEvent()
   return evNull;	                // Never happens, unless unregistered event. Returning NULL is safer (I think)
 }
 
+/*!
+ *  Builds the reply to a complete Hart frame as soon as its LRC is received
+ *
+ *  The response is left in the buffer with hartReplyPending set, evHartRcvReplyTimer sends it once the
+ *  minimum turnaround is over and the master carrier is off. A frame that needs no reply (not for us,
+ *  or invalid) re-arms the receiver at once.
+ */
+static void buildHartReply(void)
+{
+  hartCtx.bCommandReady = FALSE;
+  //  A response built ahead of the LRC is good if the frame completed without errors
+  if (hartCtx.bReplySpeculated)
+  {
+    hartCtx.bReplySpeculated = FALSE;
+    if (hartCtx.bFrameRcvd && !hartCtx.bLrcError && !hartCtx.bParityErr && !hartCtx.bOverrunErr)
+    {
+      numMsgProcessed++;
+      retryStore(&hartCtx, TRUE);     // A read from this master ends its retry window
+      hartReplyPending = TRUE;
+      hartReplyHoldPolls =0;
+      return;
+    }
+  }
+  clockBurst();
+  // Initialize the response buffer
+  initRespBuffer(&hartCtx);
+  // Process the HART command
+  if (processHartCommand(&hartCtx)  ) //  && !doNotRespond)    // note that doNotRespond is always FALSE as we don;t support CMD_42
+  {
+    hartReplyPending = TRUE;
+    hartReplyHoldPolls =0;
+  }
+  else
+  { // This command was not for this address or invalid
+    // Get ready to start another frame
+    initHartRxSm(&hartCtx); //MH: TODO: Look for side effects on Globals
+  }
+}
+
+/*!
+ *  Builds the reply to a read-only command while the LRC is still being received
+ *
+ *  The response goes to the response buffer (free, the previous reply is already in the Tx fifo).
+ *  buildHartReply() takes it as is when the LRC checks, or builds the response again otherwise.
+ */
+static void speculateHartReply(void)
+{
+  hartCtx.bDataComplete = FALSE;
+  clockBurst();
+  initRespBuffer(&hartCtx);
+  hartCtx.bReplySpeculated = speculateHartCommand(&hartCtx);
+}
+
 /*1
  * pulseTp4()
  * This function sends a pulse to TP4, duration of pulse is errorCode x 100uS
@@ -317,25 +380,31 @@ void clock_patch()
 
 }
 /*!
- *    This routine synchronizes the startUpDataLocalNv with flash
- *    If conditions met: updateNvRam, flashWriteTimer and the HSB flashWriteEnable flag is set
- *    the local StartUpdata is synch with flash
+ *    This routine synchronizes the hartDevice.nv with flash
+ *    If conditions met: updateNvRam (or dbCacheDirty), flashWriteTimer and the HSB flashWriteEnable flag is set
+ *    the local StartUpdata (or the 9900 database cache) is synch with flash
  */
 void pollSyncNvRam()
 {
 
-  if (  updateNvRam && flashWriteTimer >= (FLASH_WRITE_MS/SYSTEM_TICK_MS) && updateNvRam  &&   // Leave 2 secs between continuous writes
+  if (  (updateNvRam || hsbCtx.dbCacheDirty) && flashWriteTimer >= (FLASH_WRITE_MS/SYSTEM_TICK_MS) &&   // Leave 2 secs between continuous writes
       flashWriteEnable)    // This condition tells that HSB is not receiving or transmitting
   {
 
 #ifndef DISABLE_INTERNAL_FLASH_WRITE
     //
     flashWriteTimer =0;
-    updateNvRam = FALSE;
     ++flashWriteCount;
-    // To take real advantage of skip Hsb response, syncNvRam() should return TRUE if a real flash (erase, write) is performed
-    // bBlockThisHsbResponse =syncNvRam();
-    syncNvRam();
+    // One flash job per call, the NV record first
+    if (updateNvRam)
+    {
+      updateNvRam = FALSE;
+      // To take real advantage of skip Hsb response, syncNvRam() should return TRUE if a real flash (erase, write) is performed
+      // bBlockThisHsbResponse =syncNvRam();
+      syncNvRam();
+    }
+    else
+      syncDbCache();
 #endif
   }
 
@@ -348,8 +417,9 @@ void main()
 {
   volatile unsigned int i;
   volatile WORD hartBeatTick;
-  BOOLEAN   hartCommStarted;              //!<  The flag is set to FALSE when stopHartComm() to indicate that Hart has been stopped,
-                                          //  every system tick is polled to reestablished when Database is Ok again
+  WORD nvScrubTick =0;                    //!<  Ticks since the last NV record scrub
+  BOOLEAN   hartCommStarted;              //!<  The flag is set to FALSE when the 9900 link times out (Hart drops to the identity stage),
+                                          //  every system tick is polled to resend the current mode when Database is Ok again
 
   volatile BOOLEAN bBlockThisHsbResponse = FALSE;       // Block response if Flash enter the narrow door
 
@@ -393,7 +463,7 @@ void main()
   i=0;
   CLEARB(TP_PORTOUT, TP1_MASK);     // Indicate we are running
   tEvent systemEvent;
-  initHartRxSm();                   // Init Global part, static are intialized at first call
+  initHartRxSm(&hartCtx);           // Init Global part, static are intialized at first call
   volatile BYTE bLastRxChar;
   //  Following LOCs are the prerequisites to run using same original sw
   hartCommStarted = TRUE;           // All pre-requisites ready to start communcation with HART
@@ -426,6 +496,7 @@ void main()
   	  {
   	    //  Main loop is too slow for a single HSB. Received data is prepared under ISR
   	    SETB(TP_PORTOUT, TP2_MASK);     // HSB message 3) Send Data to TX buffer
+  	    clockBurst();
   	    Process9900Command(); // Returns TRUE if valid command
   	    hsbNoActivityTimer =0;
   	    //      hsbErrorHandler(4,TP4_MASK);   // Error code 4= Malformed command
@@ -441,9 +512,27 @@ void main()
   	    //SETB(TP_PORTOUT, TP1_MASK);
   	    // ++nBytesHartRx;       // Count every received char at Hart (loop back doesn't generate and event)
   	    // Just test we are receiving a 475 Frame
-  	    hartReceiver(getwUart(&hartUart));
+  	    hartReceiver(&hartCtx, getwUart(&hartUart));
   	    //CLEARB(TP_PORTOUT, TP1_MASK);
   	  }
+  	  //  Read-only commands are executed as soon as the last data byte is in,
+  	  //  the rest when the LRC arrives (no wait for the reply timer)
+  	  if (hartCtx.bDataComplete && hartCtx.bCommandReady)
+  	    speculateHartReply();
+  	  if (hartCtx.bCommandReady && bHartRecvFrameCompleted)
+  	  {
+  	    //  A reply sure to go is built while its preambles are on the line (see openHartFrame())
+  	    if (!hartCtx.bReplySpeculated)
+  	      initRespBuffer(&hartCtx);
+  	    if (!hartCtx.bReplySpeculated && isHartReplyCertain(&hartCtx))
+  	    {
+  	      hartCtx.bCommandReady = FALSE;
+  	      hartReplyDeferred = TRUE;
+  	      hartReplyHoldPolls =0;
+  	    }
+  	    else
+  	      buildHartReply();
+  	  }
   	  break;
 
   	case evHartRcvGapTimeout:
@@ -452,39 +541,55 @@ void main()
   	  // This is an Error: Hart master transmitter exceeds maximum Gap time
   	  //Astro-Med ===>
   	  //  SETB(TP_PORTOUT, TP3_MASK);             // Indicate an GAP timer Error
-  	  if(hartFrameRcvd ==FALSE)                   // Cancel current Hart Command Message, prepare to Rx a new one
-  	    initHartRxSm();
+  	  if(hartCtx.bFrameRcvd ==FALSE)              // Cancel current Hart Command Message, prepare to Rx a new one
+  	    initHartRxSm(&hartCtx);
   	  HartErrRegister |= GAP_TIMER_EXPIRED;   // Record the Fault
   	  //  Lets do some Debug This generates an event in AstroMed
   	  pulseTp4(2);
   	  break;
 
   	case evHartRcvReplyTimer:
-  	  // Process the frame (same as original project)
   	  //SETB(TP_PORTOUT, TP2_MASK);     // Indicate Start of response
-  	  if (commandReadyToProcess)
+  	  if (hartCtx.bCommandReady)        // Not built yet (receiver events still queued)
+  	    buildHartReply();
+  	  if (hartReplyPending || hartReplyDeferred)
   	  {
-  	    // clear the flag
-  	    commandReadyToProcess = FALSE;
-  	    // Initialize the response buffer
-  	    initRespBuffer();
-  	    // Process the HART command
-
-  	    if (processHartCommand()  ) //  && !doNotRespond)    // note that doNotRespond is always FALSE as we don;t support CMD_42
+  	    //  Minimum turnaround is over, key the modem as soon as the master carrier drops
+  	    //  (REPLY_TIMER_PRESET is the longest we hold the reply)
+  	    if (checkCarrierDetect() &&
+  	        ++hartReplyHoldPolls < REPLY_TIMER_PRESET / REPLY_TIMER_MIN_PRESET)
   	    {
-  	      // see recycle #4
-
-  	      // recycle #7
-  	      sendHartFrame();
-  	      _no_operation();    // Debug number of Rx
-
-  	      // recycle #5
+  	      startReplyTimerEvent();
+  	      break;
   	    }
-  	    else
-  	    { // This command was not for this address or invalid
-  	      // Get ready to start another frame
-  	      initHartRxSm(); //MH: TODO: Look for side effects on Globals
+  	  }
+  	  if (hartReplyDeferred)
+  	  {
+  	    //  Preambles first, the command executes while they go out. The frame is checked again
+  	    //  with the conditions processHartCommand() answers on: characters received since the LRC
+  	    //  may have reset the receiver, and preambles must not go out for a reply that won't follow
+  	    hartReplyDeferred = FALSE;
+  	    if (isHartReplyCertain(&hartCtx))
+  	    {
+  	      openHartFrame();
+  	      buildHartReply();
+  	      if (!hartReplyPending)
+  	        closeHartFrame();     // Shouldn't happen: the reply was certain
   	    }
+  	    else
+  	      buildHartReply();
+  	  }
+  	  if (hartReplyPending)
+  	  {
+  	    hartReplyPending = FALSE;
+  	    // see recycle #4
+
+  	    // recycle #7
+  	    sendHartFrame(&hartCtx);
+  	    markBootTime(&bootTimes.firstReply);
+  	    _no_operation();    // Debug number of Rx
+
+  	    // recycle #5
   	  }
   	  // No more need to stopReplyTimerEvent(); as is one shot
   	  //CLEARB(TP_PORTOUT, TP2_MASK);     // Indicate END of response (CPU processing)
@@ -500,7 +605,7 @@ void main()
   	    break;  // We allow only ONE system event per Hart frame complete
   	  }
   	  //  MH  = 1/24/13 Logic to Set the hostActive: Any complete message sets the host indicator
-  	  hostActive = TRUE;
+  	  hsbCtx.hostActive = TRUE;
   	  hostActiveCounter =0; // Keep resting the time-out counter
 
 
@@ -511,7 +616,7 @@ void main()
   	  //
   	  //  1/18/13 Hart Test ULA038a - If we don't have a Hart Master with cyclic message, we need
   	  //  to syncNvRam() under another event  user case where there is no  any other
-  	  if(updateNvRam)
+  	  if(updateNvRam || hsbCtx.dbCacheDirty)
   	    pollSyncNvRam();
 
   	  hartBeatTick =0;  // Indicate the presence of a Hart Master Frame
@@ -522,9 +627,12 @@ void main()
   	//                                                                                            //
   	case evTimerTick:               // System timer event - Get here every 125mS
 
+  	  drTick();                       //  Age the delayed responses
+  	  retryTick();                    //  and the retry cache
+
   	  //  MH Logic to reset hostActive bit 1/24/13
   	  if( hostActiveCounter < HOST_ACTIVE_TIMEOUT && ++hostActiveCounter == HOST_ACTIVE_TIMEOUT)
-  	      hostActive = FALSE;
+  	      hsbCtx.hostActive = FALSE;
 
 
 #ifdef FORCE_FLASH_WRITE
@@ -532,9 +640,15 @@ void main()
 #endif
   	  //  1/18/13 Hart Test ULA038a -
   	  //  If we don't have a Hart Master with cyclic messages, syncNvRam() with a timed event
-  	  if(updateNvRam  &&
+  	  if((updateNvRam || hsbCtx.dbCacheDirty)  &&
   	      ++hartBeatTick > HART_CONFIG_CHANGE_SYNC_TICKS )   // MH- For now just 1.5 secs after last Hart message that intends to change memory
   	    pollSyncNvRam();
+  	  // Re-verify the NV record while the HSB is idle
+  	  if(++nvScrubTick >= NV_SCRUB_TICKS && !updateNvRam && flashWriteEnable)
+  	  {
+  	    nvScrubTick =0;
+  	    scrubNvRecord();
+  	  }
 
   	    //  TICKS TIMERS
   	  if (NUMBER_OF_MS_IN_24_HOURS <= (dataTimeStamp +=SYSTEM_TICK_MS) )  //  dataTime stamp (mS) and rolled every 24 Hrs / Hart CMD_9
@@ -542,8 +656,21 @@ void main()
   	  ++flashWriteTimer;                                  //  Flash write stress protection
   	  SistemTick125mS =0; // Assumes no task takes more than 125mS w/o CPU attention
 
+  	  //  XT1 start up: once stable it drives ACLK, re-derive the Hart baud rate from it
+  	  //  while the receiver is idle (the Uart reset drops the interrupt enables)
+  	  if(!xt1Running)
+  	  {
+  	    if(!hartUart.bTxMode && isRxEmpty(&hartUart) && !hartCtx.bCommandReady && !hartReplyPending && !hartReplyDeferred &&
+  	        !(HART_RCV_GAP_TIMER_CTL & MC_3) && pollXt1Startup())   // Gap timer stopped: no frame coming in
+  	    {
+  	      hartUart.initUcsi();
+  	      hartUart.hTxInter.enable();
+  	      hartUart.hRxInter.enable();
+  	      markBootTime(&bootTimes.clockOk);
+  	    }
+  	  }
   	  //  Check for Oscillator Flag
-  	  if(SFRIFG1&OFIFG)
+  	  else if(SFRIFG1&OFIFG)
   		do
   		{
   		  UCSCTL7 &= ~(XT1LFOFFG | XT2OFFG| DCOFFG);       //  Clear XT1 and DCO fault flags
@@ -558,45 +685,42 @@ void main()
 #endif
 
   		//
-  		//  Stop HART communication after 4 Sec (MAX_9900_TIMEOUT) with no 9900 communication
+  		//  Back to the identity stage after 4 Sec (MAX_9900_TIMEOUT) with no 9900 communication
   		//  (only POWER-UP sequence, not sure if this needs to be checked every certain time)
-  		//  stopHartComm()
+  		//  stopHartComm() used to disable the Hart RX here, now the receiver stays on and only
+  		//  identity commands are answered until the 9900 data is valid again
   		if ( !comm9900started && ++comm9900counter > MAX_9900_TIMEOUT)  // ==> DEBUG LOW POWER MODE 0)  //// HART_ALONE_LPM, original code:
   		{
   		  comm9900counter = 0;
-  		  //  Flags affected by stopHartComm(), original function also disabled Hart with HART_IE &= ~UCRXIE;
-  		  //  If we are in the middle of a transmission, we just wait until TxFifo empties by itself
-  		  //  hartUart.hTxDriver.disable(); can ABORT current, but no specs
-  		  hartUart.hRxInter.disable();  // Disable RX interrupts
+  		  startupStage = stageIdentity;
   		  hartCommStarted = FALSE;
   		  databaseOk = FALSE;
   		  updateMsgRcvd = FALSE;
   		}
   		///
   		//  This code was part of loop forever and was polled every scan, let's poll it every 125mS for now
-      //  Make sure the 9900 database and updates are occurring so that we can begin HART communications
-      if ((!hartCommStarted) && updateMsgRcvd && databaseOk)
+      //  Once the 9900 database and updates are occurring, every command is answered.
+      //  Re-evaluated every tick: a database invalidated later on (bad chunk, abandoned load)
+      //  drops the module back to identity commands until a good one is loaded
+      if (!databaseUsable())
+        startupStage = stageIdentity;
+      else if (stageIdentity == startupStage && updateMsgRcvd)
+        startupStage = stageOperational;
+      if ((!hartCommStarted) && updateMsgRcvd && databaseUsable())
       {
-        // Need more intelligent trap compiler is removing === while(1);   // TRAP  HART
-        //  The very first thing sis to enable interrupts and try to Flush RxFifo at End, as we may get
-        //  bogus interrupts while the UART was disabled and Hart master sending data
-        hartUart.hRxInter.enable();   // Start listening to Hart modem == We need to Flush RxFIFO at the end
-        //
         hartCommStarted = TRUE;
         // Send the initial current mode based upon what came out of FLASH
-        if (CURRENT_MODE_DISABLE == startUpDataLocalNv.currentMode)
+        if (CURRENT_MODE_DISABLE == hartDevice.nv.currentMode)
         {
           // Tell the 9900 to go to fixed current mode at 4 mA
           setFixedCurrentMode(4.0);
-          setPrimaryStatusBits(FD_STATUS_PV_ANALOG_FIXED);
-          setSecondaryStatusBits(FD_STATUS_PV_ANALOG_FIXED);
+          setStatusBits(STATUS_BOTH, FD_STATUS_PV_ANALOG_FIXED);
         }
         else
         {
           // Tell the 9900 to go to loop reporting current mode
           setFixedCurrentMode(0.0);
-          clrPrimaryStatusBits(FD_STATUS_PV_ANALOG_FIXED);
-          clrSecondaryStatusBits(FD_STATUS_PV_ANALOG_FIXED);
+          clrStatusBits(STATUS_BOTH, FD_STATUS_PV_ANALOG_FIXED);
         }
 #if 0
         // ======  HART is working properly - about 24hrs ====
@@ -42,6 +42,7 @@
 //==============================================================================
 #include <msp430f5528.h>
 #include <string.h>
+#include <stddef.h>
 #include "hardware.h"
 #include "protocols.h"
 #include "utilities_r3.h"
@@ -59,9 +60,17 @@
 //  GLOBAL DATA
 //==============================================================================
 unsigned char updateNvRam;      //!< A flag so NV ram is only updated in the main loop
+unsigned char nvDirtyFields;    //!< NV_DIRTY_xxx fields changed since the last flash sync
 //==============================================================================
 //  LOCAL DATA
 //==============================================================================
+// The NV record slots, and the one holding the newest good record
+static unsigned char * const nvSlot[NV_SLOT_COUNT] = { NV_SLOT_A, NV_SLOT_B };
+static unsigned char nvActiveSlot = NV_SLOT_NONE;
+// The CRC of hartDevice.nv, recalculated only after a field write
+static unsigned int nvRamCrc;
+static BOOLEAN nvRamCrcValid = FALSE;
+#define nvSlotRecord(slot)  ((const HART_STARTUP_DATA_NONVOLATILE *)nvSlot[slot])
 
 //==============================================================================
 // FUNCTIONS
@@ -91,16 +100,17 @@ const unsigned char * pNvDevId = NV_DEVICE_ID_LOCATION;
 
 
 // The startup data
-HART_STARTUP_DATA_NONVOLATILE startUpDataLocalNv;
-HART_STARTUP_DATA_VOLATILE startUpDataLocalV;
+stHartDevice hartDevice;
 
 const HART_STARTUP_DATA_NONVOLATILE startUpDataFactoryNv =
 {
 	//"+GF+ Signet 9900\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0",		 	// Name
 	//FLOW_TYPE, 					// default sensor
 	//FALSE,						// from primary
-	0,							// primary status
-	0,							// secondary status
+	NV_RECORD_MARKER,			// record marker
+	NV_RECORD_VERSION,			// record version
+	0,							// record sequence
+	0,							// config changed masters
 	//EXPANDED_DEV_TYPE,			// expanded device type
 	//XMIT_PREAMBLE_BYTES,		// min M -> S preambles
 	//HART_MAJ_REV,				// HART rev
@@ -129,8 +139,10 @@ const HART_STARTUP_DATA_NONVOLATILE startUpDataFactoryNv =
 	//{0,0,0,0,0,0},				// Device Specific Status
 	//0,							// Device Op Mode Status
 	//0,							// Std Status 0
- 	CURRENT_MODE_ENABLE  //,		// Current Mode
+ 	CURRENT_MODE_ENABLE,		// Current Mode
  	//{0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0}		// Error Counts
+ 	{XMIT_PREAMBLE_BYTES, XMIT_PREAMBLE_BYTES},	// response preambles, primary and secondary master
+ 	0							// record CRC, set by sealNvRecord()
  };
 
 const HART_STARTUP_DATA_VOLATILE startUpDataFactoryV =
@@ -138,8 +150,8 @@ const HART_STARTUP_DATA_VOLATILE startUpDataFactoryV =
 	"+GF+ Signet 9900\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0",		 	// Name
 	FLOW_TYPE, 					// default sensor
 	FALSE,						// from primary
-	//0,							// primary status
-	//0,							// secondary status
+	0,							// primary status
+	0,							// secondary status
 	EXPANDED_DEV_TYPE,			// expanded device type
 	XMIT_PREAMBLE_BYTES,		// min M -> S preambles
 	HART_MAJ_REV,				// HART rev
@@ -149,7 +161,6 @@ const HART_STARTUP_DATA_VOLATILE startUpDataFactoryV =
 	SIGNAL_CODE,				// physical signal code
 	FLAGS,						// flags
 	//{0x00, 0x00, 0x01},			// default device ID
-	XMIT_PREAMBLE_BYTES,		// min S -> M preambles
 	MAX_DEV_VARS,				// Maximum device variables
 	//CURRENT_CONFIG_CNT,			// configuration change counter
 	EXT_FLD_STATUS,				// extended field device status
@@ -174,204 +185,445 @@ const HART_STARTUP_DATA_VOLATILE startUpDataFactoryV =
 
 void incrementConfigCount(void)
 {
-	startUpDataLocalNv.configChangeCount++;
-	// Set up to write RAM to FLASH
-	updateNvRam = TRUE;					
-}
-
-void setPrimaryMasterChg(void)
-{
-	startUpDataLocalNv.Primary_status |= FD_STATUS_CONFIG_CHANGED;
+	hartDevice.nv.configChangeCount++;
 	// Set up to write RAM to FLASH
-	updateNvRam = TRUE;					
+	markNvDirty(NV_DIRTY_CONFIG_CNT);
 }
 
-void setSecondaryMasterChg(void)
+///////////////////////////////////////////////////////////////////////////////////////////
+//
+// Function Name: markNvDirty()
+//
+// Description:
+//
+// Records which fields of hartDevice.nv changed and requests a flash sync
+//
+// Parameters: 
+//     unsigned char fields - NV_DIRTY_xxx mask
+//
+// Return Type: void
+//
+///////////////////////////////////////////////////////////////////////////////////////////
+void markNvDirty(unsigned char fields)
 {
-	startUpDataLocalNv.Secondary_status |= FD_STATUS_CONFIG_CHANGED;
+	nvDirtyFields |= fields;
+	nvRamCrcValid = FALSE;
+	// The receiver matches against a precomputed address
+	if (fields & (NV_DIRTY_LOOP | NV_DIRTY_DEVICE_ID))
+		refreshHartAddress(&hartCtx);
 	// Set up to write RAM to FLASH
-	updateNvRam = TRUE;					
+	updateNvRam = TRUE;
 }
 
-void clrPrimaryMasterChg(void)
+///////////////////////////////////////////////////////////////////////////////////////////
+//
+// Function Name: storeStatus()
+//
+// Description:
+//
+// Applies a set/clear to one master's field device status
+//
+// Parameters: 
+//     unsigned char master - STATUS_PRIMARY or STATUS_SECONDARY
+//     unsigned char * pLive - the status byte reported to the master
+//     unsigned char setBits, clrBits - the bits to set and clear
+//
+// Return Type: void
+//
+// Implementation notes:
+//		Nothing is written when the status does not change. Only Config Changed
+//		reaches the NV record, as the master's bit in configChangedMasters, and
+//		only a change in it marks NV dirty
+//
+///////////////////////////////////////////////////////////////////////////////////////////
+static void storeStatus(unsigned char master, unsigned char * pLive, unsigned char setBits, unsigned char clrBits)
 {
-	startUpDataLocalNv.Primary_status &= ~FD_STATUS_CONFIG_CHANGED;
-	// Set up to write RAM to FLASH
-	updateNvRam = TRUE;					
-}
+	unsigned char status = (*pLive & ~clrBits) | setBits;
+	unsigned char changedMasters = hartDevice.nv.configChangedMasters;
 
-void clrSecondaryMasterChg(void)
-{
-	startUpDataLocalNv.Secondary_status &= ~FD_STATUS_CONFIG_CHANGED;
-	// Set up to write RAM to FLASH
-	updateNvRam = TRUE;					
+	if (status == *pLive)
+	{
+		return;
+	}
+	*pLive = status;
+	changedMasters = (status & FD_STATUS_CONFIG_CHANGED) ? (changedMasters | master) : (changedMasters & ~master);
+	if (changedMasters != hartDevice.nv.configChangedMasters)
+	{
+		hartDevice.nv.configChangedMasters = changedMasters;
+		markNvDirty(NV_DIRTY_STATUS);
+	}
 }
 
-void setPrimaryStatusBits(unsigned char bits)
+///////////////////////////////////////////////////////////////////////////////////////////
+//
+// Function Name: updateStatusBits()
+//
+// Description:
+//
+// The status manager: sets and clears field device status bits for one or both masters
+//
+// Parameters: 
+//     unsigned char masters - STATUS_PRIMARY, STATUS_SECONDARY, STATUS_BOTH or STATUS_REQUESTER
+//     unsigned char setBits - FD_STATUS_xxx bits to set
+//     unsigned char clrBits - FD_STATUS_xxx bits to clear
+//
+// Return Type: void
+//
+///////////////////////////////////////////////////////////////////////////////////////////
+void updateStatusBits(unsigned char masters, unsigned char setBits, unsigned char clrBits)
 {
-	startUpDataLocalNv.Primary_status |= bits;
-	// Set up to write RAM to FLASH
-	updateNvRam = TRUE;					
+	if (masters & STATUS_PRIMARY)
+	{
+		storeStatus(STATUS_PRIMARY, &hartDevice.v.Primary_status, setBits, clrBits);
+	}
+	if (masters & STATUS_SECONDARY)
+	{
+		storeStatus(STATUS_SECONDARY, &hartDevice.v.Secondary_status, setBits, clrBits);
+	}
 }
 
-void setSecondaryStatusBits(unsigned char bits)
+///////////////////////////////////////////////////////////////////////////////////////////
+//
+// Function Name: loadStatusFromNv()
+//
+// Description:
+//
+// Starts the reported status from the config changed masters in the NV record
+//
+// Parameters: void
+//
+// Return Type: void
+//
+///////////////////////////////////////////////////////////////////////////////////////////
+void loadStatusFromNv(void)
 {
-	startUpDataLocalNv.Secondary_status |= bits;
-	// Set up to write RAM to FLASH
-	updateNvRam = TRUE;					
+	hartDevice.v.Primary_status =
+		(hartDevice.nv.configChangedMasters & STATUS_PRIMARY) ? FD_STATUS_CONFIG_CHANGED : 0;
+	hartDevice.v.Secondary_status =
+		(hartDevice.nv.configChangedMasters & STATUS_SECONDARY) ? FD_STATUS_CONFIG_CHANGED : 0;
 }
 
-void clrPrimaryStatusBits(unsigned char bits)
+///////////////////////////////////////////////////////////////////////////////////////////
+//
+// Function Name: isNvRecordValid()
+//
+// Description:
+//
+// Checks the marker, version and CRC of an NV configuration record
+//
+// Parameters: 
+//     const HART_STARTUP_DATA_NONVOLATILE * pRecord - the record, in flash or RAM
+//
+// Return Type: BOOLEAN
+//
+// Implementation notes:
+//		A version 1 record is also good: it is the current layout cut at respPreambles,
+//		where its CRC sits (the offset is even, there is no padding before it)
+//
+///////////////////////////////////////////////////////////////////////////////////////////
+static BOOLEAN isNvRecordValid(const HART_STARTUP_DATA_NONVOLATILE * pRecord)
 {
-	startUpDataLocalNv.Primary_status &= ~bits;
-	// Set up to write RAM to FLASH
-	updateNvRam = TRUE;					
+	int crcOffset;
+	if (NV_RECORD_MARKER != pRecord->recordMarker)
+	{
+		return FALSE;
+	}
+	if (NV_RECORD_VERSION == pRecord->recordVersion)
+	{
+		crcOffset = offsetof(HART_STARTUP_DATA_NONVOLATILE, recordCrc);
+	}
+	else if (NV_RECORD_VERSION_1 == pRecord->recordVersion)
+	{
+		crcOffset = offsetof(HART_STARTUP_DATA_NONVOLATILE, respPreambles);
+	}
+	else
+	{
+		return FALSE;
+	}
+	return (*(const unsigned int *)((const unsigned char *)pRecord + crcOffset) ==
+		calcCrc16((const unsigned char *)pRecord, crcOffset)) ? TRUE : FALSE;
 }
 
-void clrSecondaryStatusBits(unsigned char bits)
+///////////////////////////////////////////////////////////////////////////////////////////
+//
+// Function Name: migrateNvRecordV0()
+//
+// Description:
+//
+// Converts a version 0 image (the layout before the versioned record) into hartDevice.nv
+//
+// Parameters: 
+//     const HART_STARTUP_DATA_NV_V0 * pOld - the old image
+//
+// Return Type: void
+//
+// Implementation notes:
+//		Of the old status bytes only Config Changed is kept, the other bits are rebuilt
+//		at run time
+//
+///////////////////////////////////////////////////////////////////////////////////////////
+static void migrateNvRecordV0(const HART_STARTUP_DATA_NV_V0 * pOld)
 {
-	startUpDataLocalNv.Secondary_status &= ~bits;
-	// Set up to write RAM to FLASH
-	updateNvRam = TRUE;					
+	memcpy(&hartDevice.nv, &startUpDataFactoryNv, sizeof(HART_STARTUP_DATA_NONVOLATILE));
+	hartDevice.nv.configChangedMasters =
+		((pOld->Primary_status & FD_STATUS_CONFIG_CHANGED) ? STATUS_PRIMARY : 0) |
+		((pOld->Secondary_status & FD_STATUS_CONFIG_CHANGED) ? STATUS_SECONDARY : 0);
+	memcpy(hartDevice.nv.DeviceID, pOld->DeviceID, DEVICE_ID_SIZE);
+	hartDevice.nv.configChangeCount = pOld->configChangeCount;
+	hartDevice.nv.ManufacturerIdCode = pOld->ManufacturerIdCode;
+	memcpy(hartDevice.nv.LongTag, pOld->LongTag, LONG_TAG_SIZE);
+	memcpy(hartDevice.nv.TagName, pOld->TagName, SHORT_TAG_SIZE);
+	memcpy(hartDevice.nv.Descriptor, pOld->Descriptor, DESCRIPTOR_SIZE);
+	memcpy(hartDevice.nv.Date, pOld->Date, DATE_SIZE);
+	hartDevice.nv.PollingAddress = pOld->PollingAddress;
+	memcpy(hartDevice.nv.FinalAssy, pOld->FinalAssy, FINAL_ASSY_SIZE);
+	memcpy(hartDevice.nv.HARTmsg, pOld->HARTmsg, HART_MSG_SIZE);
+	hartDevice.nv.currentMode = pOld->currentMode;
 }
 
-void syncNvRam(void)
+///////////////////////////////////////////////////////////////////////////////////////////
+//
+// Function Name: ramRecordCrc()
+//
+// Description:
+//
+// Returns the CRC of hartDevice.nv as it would be sealed now
+//
+// Parameters: void
+//
+// Return Type: unsigned int
+//
+// Implementation notes:
+//		The CRC is kept from one call to the next and only recalculated after
+//		markNvDirty(), so with no field write it costs nothing
+//
+///////////////////////////////////////////////////////////////////////////////////////////
+static unsigned int ramRecordCrc(void)
 {
-	// Set busy flag
-	deviceBusyFlag = TRUE;
-	syncToFlash(VALID_SEGMENT_1, ((unsigned char *)&startUpDataLocalNv), 
-		sizeof(HART_STARTUP_DATA_NONVOLATILE));
-	// clear busy flag
-	deviceBusyFlag = FALSE;
+	if (!nvRamCrcValid)
+	{
+		nvRamCrc = calcCrc16((const unsigned char *)&hartDevice.nv,
+			offsetof(HART_STARTUP_DATA_NONVOLATILE, recordCrc));
+		nvRamCrcValid = TRUE;
+	}
+	return nvRamCrc;
 }
 
-void setPrimaryMoreAvailable(void)
+///////////////////////////////////////////////////////////////////////////////////////////
+//
+// Function Name: isSequenceNewer()
+//
+// Description:
+//
+// Tells if record sequence a was committed after b, allowing for the counter wrap
+//
+// Parameters: 
+//     unsigned int a, b - the record sequences
+//
+// Return Type: BOOLEAN
+//
+///////////////////////////////////////////////////////////////////////////////////////////
+static BOOLEAN isSequenceNewer(unsigned int a, unsigned int b)
 {
-	startUpDataLocalNv.Primary_status |= FD_STATUS_MORE_STATUS_AVAIL;
-	// Set up to write RAM to FLASH
-	updateNvRam = TRUE;					
+	return ((int)(a - b) > 0) ? TRUE : FALSE;
 }
 
-void setSecondaryMoreAvailable(void)
+///////////////////////////////////////////////////////////////////////////////////////////
+//
+// Function Name: loadNvRecord()
+//
+// Description:
+//
+// Loads hartDevice.nv from the newest good NV configuration record
+//
+// Parameters: void
+//
+// Return Type: int - NV_LOAD_OK, NV_LOAD_MIGRATED or NV_LOAD_BLANK
+//
+// Implementation notes:
+//		Both slots are checked in one pass and nothing is written to flash here. 
+//		A migrated image is only marked dirty, the converted record is committed by
+//		the regular flash sync to slot B, so the old image in slot A survives until
+//		then. A current record with a bad CRC is not taken for an old image.
+//		A version 1 record is loaded the same way, the fields it lacks at factory values.
+//
+///////////////////////////////////////////////////////////////////////////////////////////
+int loadNvRecord(void)
 {
-	startUpDataLocalNv.Secondary_status |= FD_STATUS_MORE_STATUS_AVAIL;
-	// Set up to write RAM to FLASH
-	updateNvRam = TRUE;					
-}
+	const HART_STARTUP_DATA_NV_V0 * pOld = (const HART_STARTUP_DATA_NV_V0 *)NV_SLOT_A;
+	unsigned char slot;
 
-void clrPrimaryMoreAvailable(void)
-{
-	startUpDataLocalNv.Primary_status &= ~FD_STATUS_MORE_STATUS_AVAIL;
-	// Set up to write RAM to FLASH
-	updateNvRam = TRUE;					
+	nvActiveSlot = NV_SLOT_NONE;
+	for (slot = 0; slot < NV_SLOT_COUNT; ++slot)
+	{
+		if (isNvRecordValid(nvSlotRecord(slot)) && (NV_SLOT_NONE == nvActiveSlot ||
+			isSequenceNewer(nvSlotRecord(slot)->recordSequence, nvSlotRecord(nvActiveSlot)->recordSequence)))
+		{
+			nvActiveSlot = slot;
+		}
+	}
+	if (NV_SLOT_NONE != nvActiveSlot && NV_RECORD_VERSION_1 == nvSlotRecord(nvActiveSlot)->recordVersion)
+	{
+		// The fields added since version 1 take their factory values
+		memcpy(&hartDevice.nv, &startUpDataFactoryNv, sizeof(HART_STARTUP_DATA_NONVOLATILE));
+		syncToRam(nvSlot[nvActiveSlot], ((unsigned char *)&hartDevice.nv),
+			offsetof(HART_STARTUP_DATA_NONVOLATILE, respPreambles));
+		markNvDirty(NV_DIRTY_ALL);
+		return NV_LOAD_MIGRATED;
+	}
+	if (NV_SLOT_NONE != nvActiveSlot)
+	{
+		syncToRam(nvSlot[nvActiveSlot], ((unsigned char *)&hartDevice.nv), sizeof(HART_STARTUP_DATA_NONVOLATILE));
+		nvRamCrc = hartDevice.nv.recordCrc;
+		nvRamCrcValid = TRUE;
+		return NV_LOAD_OK;
+	}
+	if (NV_RECORD_MARKER != nvSlotRecord(0)->recordMarker && GF_MFR_ID == pOld->ManufacturerIdCode)
+	{
+		migrateNvRecordV0(pOld);
+		markNvDirty(NV_DIRTY_ALL);
+		return NV_LOAD_MIGRATED;
+	}
+	return NV_LOAD_BLANK;
 }
 
-void clrSecondaryMoreAvailable(void)
+///////////////////////////////////////////////////////////////////////////////////////////
+//
+// Function Name: sealNvRecord()
+//
+// Description:
+//
+// Stamps hartDevice.nv with the current marker, version and CRC
+//
+// Parameters: void
+//
+// Return Type: void
+//
+// Implementation notes:
+//		Must be called right before every write of hartDevice.nv to flash
+//
+///////////////////////////////////////////////////////////////////////////////////////////
+static void sealNvRecord(void)
 {
-	startUpDataLocalNv.Secondary_status &= ~FD_STATUS_MORE_STATUS_AVAIL;
-	// Set up to write RAM to FLASH
-	updateNvRam = TRUE;					
+	hartDevice.nv.recordMarker = NV_RECORD_MARKER;
+	hartDevice.nv.recordVersion = NV_RECORD_VERSION;
+	nvRamCrcValid = FALSE;
+	hartDevice.nv.recordCrc = ramRecordCrc();
 }
 
-
-
-// Utilities to copy ints and floats into the response buffer
 ///////////////////////////////////////////////////////////////////////////////////////////
 //
-// Function Name: copyLongToRespBuf()
+// Function Name: commitNvRecord()
 //
 // Description:
 //
-// Copies a long int value into the response buffer
+// Writes hartDevice.nv to the slot not holding the newest record
 //
-// Parameters: 
-//     long - the  number to copy
+// Parameters: void
 //
-// Return Type: void
+// Return Type: BOOLEAN - TRUE if the new record is in flash and verified
 //
 // Implementation notes:
-//		The function increases respBufferSize appropriately
-// 
+//		The commit is atomic: the CRC is the last member, so the new record only
+//		validates once its last byte is programmed. Until then, and whenever the
+//		write fails, the other slot still holds the previous record.
 //
-/////////////////////////////////////////////////////////////////////////////////////////// 
-void copyLongToRespBuf(long iVal)
+///////////////////////////////////////////////////////////////////////////////////////////
+static BOOLEAN commitNvRecord(void)
 {
-	U_LONG_INT temp;
-	
-	temp.i = iVal;
-	// Copy in the number in backwards
-	szHartResp[respBufferSize] = temp.b[3];   
-	++respBufferSize;							
-	szHartResp[respBufferSize] = temp.b[2];   
-	++respBufferSize;							
-	szHartResp[respBufferSize] = temp.b[1];   
-	++respBufferSize;							
-	szHartResp[respBufferSize] = temp.b[0];   
-	++respBufferSize;							
+	unsigned char slot = (0 == nvActiveSlot || NV_SLOT_NONE == nvActiveSlot) ? 1 : 0;
+	int numSegsToErase = calcNumSegments(sizeof(HART_STARTUP_DATA_NONVOLATILE));
+
+	++hartDevice.nv.recordSequence;
+	sealNvRecord();
+	eraseMainSegment(nvSlot[slot], (numSegsToErase*MAIN_SEGMENT_SIZE));
+	copyMemToMainFlash(nvSlot[slot], ((unsigned char *)&hartDevice.nv), 
+		sizeof(HART_STARTUP_DATA_NONVOLATILE));
+	if (!verifyFlashContents(nvSlot[slot], ((unsigned char *)&hartDevice.nv), 
+		sizeof(HART_STARTUP_DATA_NONVOLATILE)))
+	{
+		return FALSE;
+	}
+	nvActiveSlot = slot;
+	return TRUE;
 }
 
 ///////////////////////////////////////////////////////////////////////////////////////////
 //
-// Function Name: copyIntToRespBuf()
+// Function Name: syncNvRam()
 //
 // Description:
 //
-// Copies a short int value into the response buffer
+// Commits the configuration to flash if it differs from the newest record
 //
-// Parameters: 
-//     int - the int number to copy
+// Parameters: void
 //
 // Return Type: void
 //
 // Implementation notes:
-//		The function increases respBufferSize appropriately
-// 
+//		The RAM CRC is compared with the CRC stored in the newest record, a difference
+//		means a commit without looking at the data. Only a match (a field rewritten with
+//		the value it had) is confirmed byte by byte.
+//		With no field marked by markNvDirty() since the last good sync there is
+//		nothing to commit, and neither the CRC nor the flash is looked at.
+//		A failed commit leaves the fields dirty, so the next sync tries again
 //
-/////////////////////////////////////////////////////////////////////////////////////////// 
-void copyIntToRespBuf(int iVal)
+///////////////////////////////////////////////////////////////////////////////////////////
+void syncNvRam(void)
 {
-	U_SHORT_INT temp;
-	
-	temp.i = iVal;
-	// Copy in the number in backwards
-	szHartResp[respBufferSize] = temp.b[1];   
-	++respBufferSize;							
-	szHartResp[respBufferSize] = temp.b[0];   
-	++respBufferSize;							
+	if (!nvDirtyFields)
+	{
+		return;
+	}
+	// Set busy flag
+	deviceBusyFlag = TRUE;
+	if (NV_SLOT_NONE != nvActiveSlot && ramRecordCrc() == nvSlotRecord(nvActiveSlot)->recordCrc &&
+		verifyFlashContents(nvSlot[nvActiveSlot], ((unsigned char *)&hartDevice.nv), 
+			offsetof(HART_STARTUP_DATA_NONVOLATILE, recordCrc)))
+	{
+		nvDirtyFields = 0;
+	}
+	else if (commitNvRecord())
+	{
+		nvDirtyFields = 0;
+		// A good commit cures a defect found by the scrubber
+		hartDevice.v.StandardStatus0 &= ~SS0_NV_MEM_DEFECT;
+	}
+	else
+	{
+		hartDevice.v.StandardStatus0 |= SS0_NV_MEM_DEFECT;
+		updateNvRam = TRUE;
+	}
+	// clear busy flag
+	deviceBusyFlag = FALSE;
 }
 
 ///////////////////////////////////////////////////////////////////////////////////////////
 //
-// Function Name: copyFloatToRespBuf()
+// Function Name: scrubNvRecord()
 //
 // Description:
 //
-// Copies a floating point value into the response buffer
+// Re-verifies the CRC of the newest NV record in flash
 //
-// Parameters: 
-//     float - the floating point number to copy
+// Parameters: void
 //
 // Return Type: void
 //
 // Implementation notes:
-//		The function increases respBufferSize appropriately
-// 
+//		Called from the main loop in idle slots. A bad record raises SS0_NV_MEM_DEFECT
+//		and marks the whole configuration dirty, so the good RAM copy is committed to
+//		the other slot
 //
-/////////////////////////////////////////////////////////////////////////////////////////// 
-void copyFloatToRespBuf(float fVal)
+///////////////////////////////////////////////////////////////////////////////////////////
+void scrubNvRecord(void)
 {
-	U_LONG_FLOAT temp;
-	
-	temp.fVal = fVal;
-	// Copy in the number in backwards
-	szHartResp[respBufferSize] = temp.b[3];   
-	++respBufferSize;							
-	szHartResp[respBufferSize] = temp.b[2];   
-	++respBufferSize;							
-	szHartResp[respBufferSize] = temp.b[1];   
-	++respBufferSize;							
-	szHartResp[respBufferSize] = temp.b[0];   
-	++respBufferSize;							
+	if (NV_SLOT_NONE == nvActiveSlot || isNvRecordValid(nvSlotRecord(nvActiveSlot)))
+	{
+		return;
+	}
+	hartDevice.v.StandardStatus0 |= SS0_NV_MEM_DEFECT;
+	markNvDirty(NV_DIRTY_ALL);
 }
 
 ///////////////////////////////////////////////////////////////////////////////////////////
@@ -447,7 +699,7 @@ int decodeBufferInt(unsigned char * pBuffer)
 /////////////////////////////////////////////////////////////////////////////////////////// 
 void UpdateSensorType(void)
 {
-	startUpDataLocalV.defaultSensorType = u9900Database.db.MEASUREMENT_TYPE;
+	hartDevice.v.defaultSensorType = hsbCtx.database.db.MEASUREMENT_TYPE;
 }
 
 ///////////////////////////////////////////////////////////////////////////////////////////
@@ -476,7 +728,7 @@ void copyNvDeviceIdToRam(void)
 	// Only copy if the FLASH is NOT erased
 	if (memcmp(pNvDevId, erasedValue, DEVICE_ID_SIZE))
 	{
-		memcpy(startUpDataLocalNv.DeviceID, pNvDevId, DEVICE_ID_SIZE);
+		memcpy(hartDevice.nv.DeviceID, pNvDevId, DEVICE_ID_SIZE);
 	}
 }
 
@@ -535,7 +787,6 @@ int copyDeviceIdToFlash(unsigned char * pDeviceId)
 /////////////////////////////////////////////////////////////////////////////////////////// 
 void verifyDeviceId(void)
 {
-	int numSegsToErase;
 	// Make sure the FLASH device ID is programmed before proceeding
 	// Define the erased FLASH pattern
 	//unsigned char erasedValue[DEVICE_ID_SIZE] = {0xFF, 0xFF, 0xFF}; //MH Initialization is wrong
@@ -546,17 +797,12 @@ void verifyDeviceId(void)
 	{
 		// Now check to see if what is in FLASH and RAM are identical. Do nothing if 
 		// they're the same.
-		if (memcmp(pNvDevId, startUpDataLocalNv.DeviceID, DEVICE_ID_SIZE))
+		if (memcmp(pNvDevId, hartDevice.nv.DeviceID, DEVICE_ID_SIZE))
 		{
 			// Copy the correct ID into RAM
 			copyNvDeviceIdToRam();
-			// Now make sure it is sync'd up:
-			// erase the segment of FLASH so it can be reprogrammed
-			numSegsToErase = calcNumSegments (sizeof(HART_STARTUP_DATA_NONVOLATILE));
-			eraseMainSegment(VALID_SEGMENT_1, (numSegsToErase*MAIN_SEGMENT_SIZE));
-			// Copy the local data into NV memory
-			copyMemToMainFlash (VALID_SEGMENT_1, ((unsigned char *)&startUpDataLocalNv), 
-				sizeof(HART_STARTUP_DATA_NONVOLATILE));
+			// The record is committed by the next flash sync
+			markNvDirty(NV_DIRTY_DEVICE_ID);
 		}
 	}
 }
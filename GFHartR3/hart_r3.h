@@ -149,6 +149,10 @@
 #define INVALID_SPAN            29
 #define CMD_RESP_TRUNCATED      30
 #define HART_DEVICE_BUSY        32
+#define DR_INITIATE             33      // Delayed response initiated
+#define DR_RUNNING              34      // Delayed response running
+#define DR_DEAD                 35      // Delayed response dead
+#define DR_CONFLICT             36      // Delayed response conflict
 
 // Current Modes (command 6
 #define CURRENT_MODE_DISABLE    0
@@ -169,12 +173,49 @@
 #define FD_STATUS_PV_ANALOG_SATURATED   0x04
 #define FD_STATUS_SV_OUT_OF_LIMITS      0x02
 #define FD_STATUS_PV_OUT_OF_LIMITS      0x01
+
+// Status manager master selection
+#define STATUS_PRIMARY                  0x01
+#define STATUS_SECONDARY                0x02
+#define STATUS_BOTH                     (STATUS_PRIMARY | STATUS_SECONDARY)
+#define STATUS_REQUESTER                ((hartDevice.v.fromPrimary) ? STATUS_PRIMARY : STATUS_SECONDARY)
+#define setStatusBits(masters, bits)    updateStatusBits((masters), (bits), 0)
+#define clrStatusBits(masters, bits)    updateStatusBits((masters), 0, (bits))
+
+// hartDevice.nv fields changed since the last flash sync
+#define NV_DIRTY_STATUS                 0x01    // config changed masters
+#define NV_DIRTY_CONFIG_CNT             0x02    // configuration change counter
+#define NV_DIRTY_LOOP                   0x04    // polling address, loop current mode
+#define NV_DIRTY_IDENT                  0x08    // tags, descriptor, date, message, final assembly
+#define NV_DIRTY_DEVICE_ID              0x10    // device ID
+#define NV_DIRTY_PREAMBLES              0x20    // response preambles
+#define NV_DIRTY_ALL                    0xFF
+
+// The NV configuration record
+#define NV_RECORD_MARKER                0xA5    // An unlikely first status byte for a version 0 image
+#define NV_RECORD_VERSION               2
+#define NV_RECORD_VERSION_1             1       // no response preambles, loaded and committed again as the current version
+// The record is kept in two slots, a commit always goes to the one not holding the newest record
+#define NV_SLOT_COUNT                   2
+#define NV_SLOT_A                       VALID_SEGMENT_1     // also where a version 0 image is found
+#define NV_SLOT_B                       VALID_SEGMENT_2
+#define NV_SLOT_NONE                    0xFF
+
+// loadNvRecord() results
+#define NV_LOAD_OK                      0       // the record in flash is good
+#define NV_LOAD_MIGRATED                1       // an older layout was converted, it is committed at the next sync
+#define NV_LOAD_BLANK                   2       // nothing usable in flash, the factory image is needed
 /*!
  *  Added user test case:
  *  If no Hart Master sending cyclical frames we need to generate a timed event
  *  to synchronize NV-ram. Define is in 125mS ticks
  */
 #define HART_CONFIG_CHANGE_SYNC_TICKS  12
+/*!
+ *  The NV record in flash is re-verified every NV_SCRUB_TICKS (125mS ticks),
+ *  when the High Speed Bus is idle and no sync is pending
+ */
+#define NV_SCRUB_TICKS                 80
 /*!
  *  hostActive bit sent to 9900 needs to be:
  *  0   Hart Master is not present
@@ -270,8 +311,8 @@ typedef struct stHartStartupV   // HART 7 compliant
     unsigned char myName [NAME_SIZE];
     unsigned char defaultSensorType;
     int fromPrimary;
-    //unsigned char Primary_status;
-    //unsigned char Secondary_status;
+    unsigned char Primary_status;               // reported status, FD_STATUS_PERSISTENT_BITS are also kept in NV
+    unsigned char Secondary_status;
     // The following members are used for command 0
     unsigned int expandedDevType;
     unsigned char minPreamblesM2S;
@@ -282,7 +323,7 @@ typedef struct stHartStartupV   // HART 7 compliant
     unsigned char physSignalCode;  // 3 bits only
     unsigned char flags;
     //unsigned char DeviceID [DEVICE_ID_SIZE];
-    unsigned char minPreamblesS2M;
+    // S -> M preambles are per master in nv.respPreambles (Cmd 59)
     unsigned char maxNumDevVars;
     //unsigned int configChangeCount;  // Must be changed every revision!!
     unsigned char extendFieldDevStatus;
@@ -332,18 +373,22 @@ typedef struct stHartStartupV   // HART 7 compliant
 /*!
  * The non-volatile section of local startup data
  *
- * This is the portion of local data that is loaded from flash.
- * Modifications are stored as necessary
+ * This is the portion of local data that is loaded from flash: the device configuration only,
+ * the field device status lives in hartDevice.v. The record starts with a marker and
+ * a layout version and ends with a CRC16 of everything before it, so the loader can tell a
+ * good record from a blank, corrupt or older one. Modifications are stored as necessary
  *
  */
 typedef struct stHartStartupNV   // HART 7 compliant
 {
     // The first member must be an unsigned char
+    unsigned char recordMarker;                 // NV_RECORD_MARKER
+    unsigned char recordVersion;                // NV_RECORD_VERSION
+    unsigned int recordSequence;                // Incremented by every commit, the newest slot wins
     //unsigned char myName [NAME_SIZE];
     //unsigned char defaultSensorType;
     //int fromPrimary;
-    unsigned char Primary_status;
-    unsigned char Secondary_status;
+    unsigned char configChangedMasters;         // STATUS_PRIMARY/SECONDARY masters that have not reset Config Changed
     // The following members are used for command 0
     //unsigned int expandedDevType;
     //unsigned char minPreamblesM2S;
@@ -378,8 +423,35 @@ typedef struct stHartStartupNV   // HART 7 compliant
     unsigned char currentMode;
     /////////////////////////////////////////////
     //unsigned int errorCounter[19];
+    // Version 2: a version 1 record ends here, with its CRC
+    unsigned char respPreambles[2];             // Response preambles (Cmd 59) for the primary [0] and secondary [1] master
+    unsigned int recordCrc;                     // Must be the last member
 } HART_STARTUP_DATA_NONVOLATILE;
 
+/*!
+ * The layout of VALID_SEGMENT_1 before the versioned record (version 0)
+ *
+ * Kept only to migrate an image written by older firmware. It has no marker, and carries
+ * the whole status of both masters where the record now keeps the config changed masters.
+ *
+ */
+typedef struct stHartStartupNvV0
+{
+    unsigned char Primary_status;
+    unsigned char Secondary_status;
+    unsigned char DeviceID [DEVICE_ID_SIZE];
+    unsigned int configChangeCount;
+    unsigned int ManufacturerIdCode;
+    unsigned char LongTag [LONG_TAG_SIZE];
+    unsigned char TagName [SHORT_TAG_SIZE];
+    unsigned char Descriptor [DESCRIPTOR_SIZE];
+    unsigned char Date[DATE_SIZE];
+    unsigned char PollingAddress;
+    unsigned char FinalAssy [FINAL_ASSY_SIZE];
+    unsigned char HARTmsg [HART_MSG_SIZE];
+    unsigned char currentMode;
+} HART_STARTUP_DATA_NV_V0;
+
 /*!
  *  Long-Float utility unions
  */
@@ -412,18 +484,11 @@ typedef union uLongByte
   *   $GLOBAL PROTOTYPES
 *************************************************************************/
 void incrementConfigCount(void);
-void setPrimaryMasterChg(void);
-void setSecondaryMasterChg(void);
-void clrPrimaryMasterChg(void);
-void clrSecondaryMasterChg(void);
-void setPrimaryMoreAvailable(void);
-void setSecondaryMoreAvailable(void);
-void clrPrimaryMoreAvailable(void);
-void clrSecondaryMoreAvailable(void);
-void setPrimaryStatusBits(unsigned char);
-void setSecondaryStatusBits(unsigned char);
-void clrPrimaryStatusBits(unsigned char);
-void clrSecondaryStatusBits(unsigned char);
+void markNvDirty(unsigned char);
+void updateStatusBits(unsigned char, unsigned char, unsigned char);
+void loadStatusFromNv(void);
+int loadNvRecord(void);
+void scrubNvRecord(void);
 void syncNvRam(void);
 
 
@@ -433,10 +498,7 @@ void copyNvDeviceIdToRam(void);
 int copyDeviceIdToFlash(unsigned char *);
 void verifyDeviceId(void);
 
-// Utilities to copy ints and floats into the response buffer
-void copyIntToRespBuf(int);
-void copyLongToRespBuf(long);
-void copyFloatToRespBuf(float);
+// Utilities to decode ints and floats from the command buffer
 float decodeBufferFloat(unsigned char *);
 int decodeBufferInt(unsigned char *);
 //
@@ -446,6 +508,7 @@ void UpdateSensorType(void);
   *   $GLOBAL VARIABLES
 *************************************************************************/
 extern unsigned char updateNvRam;           // A flag so NV ram is only updated in the main loop
+extern unsigned char nvDirtyFields;         // NV_DIRTY_xxx fields changed since the last flash sync
 // Process variables
 extern float PVvalue;
 extern float SVvalue;
@@ -453,9 +516,20 @@ extern float ma4_20;
 extern float savedLoopCurrent;
 extern float reportingLoopCurrent;
 
-extern HART_STARTUP_DATA_NONVOLATILE startUpDataLocalNv;
+/*!
+ * Hart device context
+ *
+ * The identity and status of one Hart slave: the image kept in flash and its volatile companion.
+ * There is a single instance, hartDevice, accessed by the usual names below.
+ */
+typedef struct
+{
+  HART_STARTUP_DATA_NONVOLATILE nv;         //!< Startup data synchronized to flash
+  HART_STARTUP_DATA_VOLATILE v;             //!< Startup data kept in RAM only
+} stHartDevice;
+
+extern stHartDevice hartDevice;
 extern const HART_STARTUP_DATA_NONVOLATILE startUpDataFactoryNv;
-extern HART_STARTUP_DATA_VOLATILE startUpDataLocalV;
 extern const HART_STARTUP_DATA_VOLATILE startUpDataFactoryV;
 
 extern const unsigned char * pNvDevId;
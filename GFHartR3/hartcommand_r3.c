@@ -12,59 +12,81 @@
  */
 
 #include <msp430f5528.h>
+#include <string.h>
 #include "define.h"
 #include "hardware.h"
 #include "protocols.h"
 #include "hart_r3.h"
 #include "common_h_cmd_r3.h"
+#include "utilities_r3.h"
+#include "main9900_r3.h"
 
 
 #include "hartcommand_r3.h"
 
-// Did we get a broadcast address?
-int rcvBroadcastAddr = FALSE;
-extern HART_STARTUP_DATA_VOLATILE startUpDataLocalV;
+// Where the startup is, see tStartupStage
+tStartupStage startupStage = stageIdentity;
+
+// Delayed response slot states
+#define drSlotFree      0
+#define drSlotRunning   1
+#define drSlotDone      2
+
+//! Delayed response slots, [0] for the primary master, [1] for the secondary
+static stDrSlot drSlots[2];
+
+//! Retry cache, [0] for the primary master, [1] for the secondary
+static stRetrySlot retrySlots[2];
+
+static unsigned char retryReplay(stHartContext *pCtx);
 
 
 /*!
  * \function    processHartCommand()
  * \brief       Process the HART command, generate the response.
  *
- *    Isr and Drivers store Hart command message in a global buffer szHartCommadn[]. This function
+ *    Isr and Drivers store Hart command message in the link context (pCtx->cmd[]). This function
  *    process the command (by creating a response) or prepares a error response
+ *    The command handlers themselves reach the single context, hartCtx, through the protocols.h names
+ *    Keep isHartReplyCertain() in step with the FALSE returns here: it opens the Tx stream ahead
  *
  */
-unsigned char processHartCommand (void)
+unsigned char processHartCommand (stHartContext *pCtx)
 {
 	unsigned char rtnVal = FALSE;
 	// Make sure the CD interrupt is off so no new messages can be received
 	numMsgProcessed++;
-	if (hartFrameRcvd)
+	if (pCtx->bFrameRcvd)
 	{
 		// Verify that the number of data bytes received is <= expected byte count
-		if (expectedByteCnt > hartDataCount)
+		if (pCtx->byteCount > pCtx->dataCount)
 		{
 			return rtnVal;
 		} 
 		// Only proceed if the address is valid
-		if (addressValid)
+		if (pCtx->bAddressValid)
 		{
 			// If there is a short frame and the command is NOT 0, return
-			if (!longAddressFlag &&(HART_CMD_0 != hartCommand))
+			if (!pCtx->bLongAddr &&(HART_CMD_0 != pCtx->cmdNumber))
 			{
 				return rtnVal;
 			}
-			if (rcvLrcError || parityErr || overrunErr)
+			if (pCtx->bLrcError || pCtx->bParityErr || pCtx->bOverrunErr)
 			{
 				executeCommErr ();
 				rtnVal = TRUE;
 			}
+			else if (retryReplay(pCtx))
+			{
+				// A retry of a write this master did not hear the reply to: same response, no side effects
+				rtnVal = TRUE;
+			}
 			else
 			{
 				// Make sure I have a short address before processing cmd 0
-				if (!longAddressFlag)
+				if (!pCtx->bLongAddr)
 				{
-					if (HART_CMD_0 == hartCommand)
+					if (HART_CMD_0 == pCtx->cmdNumber)
 					{
 						executeCmd0();
 						rtnVal = TRUE;
@@ -72,15 +94,15 @@ unsigned char processHartCommand (void)
 				}
 				else
 				{
-					if (rcvBroadcastAddr)
+					if (pCtx->bBroadcastAddr)
 					{
-						if (HART_CMD_11 == hartCommand)
+						if (HART_CMD_11 == pCtx->cmdNumber)
 						{
 							executeCmd11();
 							rtnVal = (badTagFlag) ? FALSE : TRUE;
 							badTagFlag = FALSE;
 						}
-						else if (HART_CMD_21 == hartCommand)
+						else if (HART_CMD_21 == pCtx->cmdNumber)
 						{
 							executeCmd21();
 							rtnVal = (badTagFlag) ? FALSE : TRUE;
@@ -99,6 +121,7 @@ unsigned char processHartCommand (void)
 						badTagFlag = FALSE;
 					}
 				}
+				retryStore(pCtx, rtnVal);
 			}
 		}
 		else
@@ -113,6 +136,83 @@ unsigned char processHartCommand (void)
 	return rtnVal;
 }
 
+/*!
+ * \function    isHartReplyCertain()
+ * \brief       Tells if the complete frame will be answered, whatever the command does
+ *
+ *    Frames for another device, short frames other than command 0 and the tag commands 11 and 21
+ *    (silent on a tag mismatch) may get no reply. Call after initRespBuffer(), and again right
+ *    before the reply is built (see evHartRcvReplyTimer), the receiver state may have changed
+ */
+unsigned char isHartReplyCertain (stHartContext *pCtx)
+{
+	if (!pCtx->bFrameRcvd || !pCtx->bAddressValid || pCtx->bBroadcastAddr || pCtx->byteCount > pCtx->dataCount)
+	{
+		return FALSE;
+	}
+	if (!pCtx->bLongAddr)
+	{
+		return (HART_CMD_0 == pCtx->cmdNumber) ? TRUE : FALSE;
+	}
+	return (HART_CMD_11 != pCtx->cmdNumber && HART_CMD_21 != pCtx->cmdNumber) ? TRUE : FALSE;
+}
+
+/*!
+ * \function    speculateHartCommand()
+ * \brief       Builds the response of a read-only command while its LRC is still on the line
+ *
+ *    Called when the last data byte is in, after initRespBuffer(). Only commands that change nothing
+ *    are executed, so the response can simply be dropped if the LRC then fails. The caller commits it
+ *    (and counts the message) when the frame completes without errors.
+ *    Commands 1, 2 and 3 start or pick up a delayed response while the 9900 updates are delayed,
+ *    so they are only speculated when updateDelay is clear
+ *    Returns TRUE if a response was built
+ */
+unsigned char speculateHartCommand (stHartContext *pCtx)
+{
+	if (!pCtx->bAddressValid || pCtx->bBroadcastAddr || pCtx->bParityErr || pCtx->bOverrunErr)
+	{
+		return FALSE;
+	}
+	switch(pCtx->cmdNumber)
+	{
+	case HART_CMD_0:
+		if (!pCtx->bLongAddr)
+		{
+			executeCmd0();
+			return TRUE;
+		}
+		break;
+	case HART_CMD_1:
+	case HART_CMD_2:
+	case HART_CMD_3:
+		if (updateDelay)
+		{
+			return FALSE;
+		}
+		break;
+	case HART_CMD_7:
+	case HART_CMD_8:
+	case HART_CMD_9:
+	case HART_CMD_12:
+	case HART_CMD_13:
+	case HART_CMD_14:
+	case HART_CMD_15:
+	case HART_CMD_16:
+	case HART_CMD_20:
+		break;
+	default:
+		return FALSE;
+	}
+	// Short frames only carry command 0
+	if (!pCtx->bLongAddr)
+	{
+		return FALSE;
+	}
+	executeCommand();
+	return TRUE;
+}
+
 ///////////////////////////////////////////////////////////////////////////////////////////
 //
 // Function Name: executeCommand()
@@ -128,14 +228,30 @@ unsigned char processHartCommand (void)
 //
 // Implementation notes:
 //		This function steers the command to the correct handler based upon the 
-//      sensor type
+//      sensor type. In the identity stage, only commands 0, 11, 13, 20 and 21
+//      get through, the others are answered Device Busy
 //
 /////////////////////////////////////////////////////////////////////////////////////////// 
 void executeCommand(void)
 {
+	if (stageIdentity == startupStage)
+	{
+		switch(hartCtx.cmdNumber)
+		{
+		case HART_CMD_0:
+		case HART_CMD_11:
+		case HART_CMD_13:
+		case HART_CMD_20:
+		case HART_CMD_21:
+			break;
+		default:
+			common_tx_error(HART_DEVICE_BUSY);
+			return;
+		}
+	}
 	// First, check to see if the command is a common command. If not,
 	// then select the specific sensor handler
-	switch(hartCommand)
+	switch(hartCtx.cmdNumber)
 	{
 	case HART_CMD_0:
 		common_cmd_0();
@@ -246,6 +362,9 @@ void executeCommand(void)
 	case HART_CMD_58:
 		common_cmd_58();
 		break;	
+	case HART_CMD_59:
+		common_cmd_59();
+		break;	
 	case HART_CMD_110:
 		common_cmd_110();
 		break;	
@@ -261,12 +380,15 @@ void executeCommand(void)
 	case HART_CMD_222:
 		mfr_cmd_222();
 		break;	
+	case HART_CMD_223:
+		mfr_cmd_223();
+		break;	
 
 	// If it is not a common command, select the
 	// handler based upon the sensor type	
 	default:	
 #ifdef USE_MULTIPLE_SENSOR_COMMANDS	
-		switch(startUpDataLocalV.defaultSensorType)
+		switch(hartDevice.v.defaultSensorType)
 		{
 		case CONDUCTIVITY_TYPE:
 			executeConductivityCommand();
@@ -565,4 +687,338 @@ void executeCommErr(void)
 	common_tx_comm_error();
 }
 
+///////////////////////////////////////////////////////////////////////////////////////////
+//
+// Function Name: drMatches()
+//
+// Description:
+//
+// Checks if the request being processed is the one held in a delayed response slot
+//
+// Parameters: stDrSlot * - the slot
+//
+// Return Type: int - TRUE if command and data are the same
+//
+// Implementation notes:
+//
+// The request data starts after the byte count, at hartCtx.cmd[hartCtx.respSize+1]
+//
+/////////////////////////////////////////////////////////////////////////////////////////// 
+static int drMatches(stDrSlot *pSlot)
+{
+	unsigned char count = (hartCtx.dataCount > DR_MAX_DATA) ? DR_MAX_DATA : hartCtx.dataCount;
+
+	return (pSlot->command == hartCtx.cmdNumber && pSlot->dataCount == count &&
+		!memcmp(pSlot->data, &hartCtx.cmd[hartCtx.respSize+1], count)) ? TRUE : FALSE;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////
+//
+// Function Name: drLookup()
+//
+// Description:
+//
+// Look up the request being processed in the delayed response slots
+//
+// Parameters: unsigned char * - the response code to send for drPending and drCompleted
+//
+// Return Type: tDrStatus
+//
+// Implementation notes:
+//
+// A master retrying its delayed request gets DR_RUNNING, then the outcome once done.
+// A different request from a master with a running DR, or a loop request while the
+// other master has one running, gets DR_CONFLICT. A finished DR that the master did not
+// pick up is dropped when it sends something else
+//
+/////////////////////////////////////////////////////////////////////////////////////////// 
+tDrStatus drLookup(unsigned char *pRespCode)
+{
+	stDrSlot *pSlot = &drSlots[(hartDevice.v.fromPrimary) ? 0 : 1];
+	stDrSlot *pOther = &drSlots[(hartDevice.v.fromPrimary) ? 1 : 0];
+
+	if (drSlotFree != pSlot->state)
+	{
+		if (drMatches(pSlot))
+		{
+			if (drSlotRunning == pSlot->state)
+			{
+				*pRespCode = DR_RUNNING;
+				return drPending;
+			}
+			*pRespCode = pSlot->result;
+			pSlot->state = drSlotFree;
+			return drCompleted;
+		}
+		if (drSlotRunning == pSlot->state)
+		{
+			*pRespCode = DR_CONFLICT;
+			return drPending;
+		}
+		pSlot->state = drSlotFree;
+	}
+	// Only one loop request at a time
+	if (drSlotRunning == pOther->state && pOther->bLoopRequest &&
+		(HART_CMD_40 == hartCtx.cmdNumber || HART_CMD_45 == hartCtx.cmdNumber || HART_CMD_46 == hartCtx.cmdNumber))
+	{
+		*pRespCode = DR_CONFLICT;
+		return drPending;
+	}
+	*pRespCode = RESP_SUCCESS;
+	return drNew;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////
+//
+// Function Name: drInitiate()
+//
+// Description:
+//
+// Starts a delayed response for the request being processed
+//
+// Parameters: unsigned char - TRUE if it completes with a 9900 loop request, FALSE if it
+//                             completes with the next 9900 update
+//
+// Return Type: unsigned char - the response code to send, DR_INITIATE
+//
+// Implementation notes:
+//
+// drLookup() returned drNew, so the master's slot is free
+//
+/////////////////////////////////////////////////////////////////////////////////////////// 
+unsigned char drInitiate(unsigned char bLoopRequest)
+{
+	stDrSlot *pSlot = &drSlots[(hartDevice.v.fromPrimary) ? 0 : 1];
+
+	pSlot->command = hartCtx.cmdNumber;
+	pSlot->dataCount = (hartCtx.dataCount > DR_MAX_DATA) ? DR_MAX_DATA : hartCtx.dataCount;
+	memcpy(pSlot->data, &hartCtx.cmd[hartCtx.respSize+1], pSlot->dataCount);
+	pSlot->bLoopRequest = bLoopRequest;
+	pSlot->ticks = 0;
+	pSlot->state = drSlotRunning;
+	return DR_INITIATE;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////
+//
+// Function Name: drComplete()
+//
+// Description:
+//
+// Ends the running delayed responses of one kind, called from the 9900 side
+//
+// Parameters: unsigned char - TRUE for loop requests, FALSE for the ones waiting an update
+//             unsigned char - the outcome, RESP_SUCCESS or an error response code
+//
+// Return Type: void
+//
+// Implementation notes:
+//
+// 
+//
+/////////////////////////////////////////////////////////////////////////////////////////// 
+void drComplete(unsigned char bLoopRequest, unsigned char result)
+{
+	int i;
+
+	for (i = 0; i < 2; ++i)
+	{
+		if (drSlotRunning == drSlots[i].state && bLoopRequest == drSlots[i].bLoopRequest)
+		{
+			drSlots[i].result = result;
+			drSlots[i].state = drSlotDone;
+		}
+	}
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////
+//
+// Function Name: drTick()
+//
+// Description:
+//
+// Ages the running delayed responses, called every system tick
+//
+// Parameters: void
+//
+// Return Type: void
+//
+// Implementation notes:
+//
+// A DR the 9900 never confirms ends as DR_DEAD after DR_TIMEOUT_TICKS
+//
+/////////////////////////////////////////////////////////////////////////////////////////// 
+void drTick(void)
+{
+	int i;
+
+	for (i = 0; i < 2; ++i)
+	{
+		if (drSlotRunning == drSlots[i].state && ++drSlots[i].ticks >= DR_TIMEOUT_TICKS)
+		{
+			drSlots[i].result = DR_DEAD;
+			drSlots[i].state = drSlotDone;
+		}
+	}
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////
+//
+// Function Name: isRetryCommand()
+//
+// Description:
+//
+// Tells if the command being processed is a write whose retries are answered from cache
+//
+// Parameters: stHartContext * - the Hart link with the received command
+//
+// Return Type: unsigned char - TRUE for commands 6, 17, 18, 19, 22, 40, 45 and 46
+//
+/////////////////////////////////////////////////////////////////////////////////////////// 
+static unsigned char isRetryCommand(stHartContext *pCtx)
+{
+	switch (pCtx->cmdNumber)
+	{
+	case HART_CMD_6:
+	case HART_CMD_17:
+	case HART_CMD_18:
+	case HART_CMD_19:
+	case HART_CMD_22:
+	case HART_CMD_40:
+	case HART_CMD_45:
+	case HART_CMD_46:
+		return TRUE;
+	default:
+		return FALSE;
+	}
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////
+//
+// Function Name: retryReplay()
+//
+// Description:
+//
+// Answers an identical retry of the master's last write from the retry cache
+//
+// Parameters: stHartContext * - the Hart link with the received command
+//
+// Return Type: unsigned char - TRUE if the cached response is in the response buffer
+//
+// Implementation notes:
+//
+// Called after initRespBuffer(), so hartCtx.respSize is the byte count position in both
+// the request and the response. The request must match the cached one byte for byte.
+// The status byte of the cached response is refreshed, the device status may have
+// changed since. A frame that is not a retry drops the master's entry, retryStore() refills it
+//
+/////////////////////////////////////////////////////////////////////////////////////////// 
+static unsigned char retryReplay(stHartContext *pCtx)
+{
+	stRetrySlot *pSlot = &retrySlots[(hartDevice.v.fromPrimary) ? 0 : 1];
+	unsigned int reqSize = pCtx->respSize + 1 + pCtx->dataCount;
+	// Long frames only: byte count, response code, then the status byte
+	unsigned int statusIdx = 1 + LONG_ADDR_SIZE + 1 + 2;
+
+	if (!pSlot->bValid)
+	{
+		return FALSE;
+	}
+	pSlot->bValid = FALSE;
+	if (!pCtx->bLongAddr || pCtx->bBroadcastAddr || pSlot->command != pCtx->cmdNumber ||
+		pSlot->reqSize != reqSize || memcmp(pSlot->req, pCtx->cmd, reqSize))
+	{
+		return FALSE;
+	}
+	// The master may retry again
+	pSlot->bValid = TRUE;
+	memcpy(pCtx->resp, pSlot->resp, pSlot->respSize);
+	pCtx->respSize = pSlot->respSize;
+	pCtx->resp[statusIdx] = (hartDevice.v.fromPrimary) ?
+		hartDevice.v.Primary_status : hartDevice.v.Secondary_status;
+	return TRUE;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////
+//
+// Function Name: retryStore()
+//
+// Description:
+//
+// Keeps the request just executed and its response for a retry of the same master
+//
+// Parameters: stHartContext * - the Hart link with the request and its response
+//             unsigned char - TRUE if the request got a response
+//
+// Return Type: void
+//
+// Implementation notes:
+//
+// Only the listed writes with a final response are kept: Device Busy and the delayed
+// response codes but DR_DEAD tell the master to ask again, so those retries execute.
+// A write from one master drops the other master's entry, its response may be stale.
+// Also called for a speculated reply, which does not go through processHartCommand()
+//
+/////////////////////////////////////////////////////////////////////////////////////////// 
+void retryStore(stHartContext *pCtx, unsigned char bReplied)
+{
+	unsigned char master = (hartDevice.v.fromPrimary) ? 0 : 1;
+	stRetrySlot *pSlot = &retrySlots[master];
+	// Long frames only: delimiter, unique address and command, in the request and in the response
+	unsigned int hdrSize = 1 + LONG_ADDR_SIZE + 1;
+	unsigned int reqSize = hdrSize + 1 + pCtx->dataCount;
+	unsigned char respCode;
+
+	pSlot->bValid = FALSE;
+	if (!bReplied || !pCtx->bLongAddr || pCtx->bBroadcastAddr || !isRetryCommand(pCtx) ||
+		reqSize > RETRY_MAX_REQ || pCtx->respSize > RETRY_MAX_RESP || pCtx->respSize <= hdrSize + 2)
+	{
+		return;
+	}
+	retrySlots[1 - master].bValid = FALSE;
+	// Response code, after the byte count
+	respCode = pCtx->resp[hdrSize + 1];
+	if (HART_DEVICE_BUSY == respCode || DR_INITIATE == respCode ||
+		DR_RUNNING == respCode || DR_CONFLICT == respCode)
+	{
+		return;
+	}
+	pSlot->command = pCtx->cmdNumber;
+	pSlot->reqSize = reqSize;
+	memcpy(pSlot->req, pCtx->cmd, reqSize);
+	pSlot->respSize = pCtx->respSize;
+	memcpy(pSlot->resp, pCtx->resp, pCtx->respSize);
+	pSlot->ticks = 0;
+	pSlot->bValid = TRUE;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////
+//
+// Function Name: retryTick()
+//
+// Description:
+//
+// Ages the retry cache, called every system tick
+//
+// Parameters: void
+//
+// Return Type: void
+//
+// Implementation notes:
+//
+// After RETRY_CACHE_TICKS the same frame is a new request and executes again
+//
+/////////////////////////////////////////////////////////////////////////////////////////// 
+void retryTick(void)
+{
+	int i;
+
+	for (i = 0; i < 2; ++i)
+	{
+		if (retrySlots[i].bValid && ++retrySlots[i].ticks >= RETRY_CACHE_TICKS)
+		{
+			retrySlots[i].bValid = FALSE;
+		}
+	}
+}
 
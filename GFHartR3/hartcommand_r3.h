@@ -75,6 +75,7 @@
 #define HART_CMD_54		54
 #define HART_CMD_57		57
 #define HART_CMD_58		58
+#define HART_CMD_59		59
 #define HART_CMD_110	110
 #define HART_CMD_128	128
 #define HART_CMD_129	129
@@ -98,9 +99,72 @@
 #define HART_CMD_220	220
 #define HART_CMD_221	221
 #define HART_CMD_222	222
+#define HART_CMD_223	223
 
-unsigned char processHartCommand (void);
+// Delayed responses
+#define DR_MAX_DATA       4                         // Request data bytes kept to match a retry
+#define DR_TIMEOUT_TICKS  (8000 / SYSTEM_TICK_MS)   // A running DR is declared dead after 8 secs
+
+// Retry cache
+#define RETRY_MAX_REQ     40                        // Largest cached request (command 22 needs 40 bytes)
+#define RETRY_MAX_RESP    48                        // Largest cached response (command 22 needs 42 bytes)
+#define RETRY_CACHE_TICKS (2000 / SYSTEM_TICK_MS)   // A master retry comes within 2 secs
+
+/*!
+ *  Startup stage, set by the main loop
+ *
+ *  Hart listens from power up. Until the 9900 link is up and its data valid, only the
+ *  identity and tag commands, served from NV data, are answered; the rest get Device Busy
+ */
+typedef enum
+{
+  stageIdentity = 0,  //!< No valid 9900 data yet (power up, or the 9900 went silent)
+  stageOperational    //!< Every command is answered
+} tStartupStage;
+
+/*!
+ *  Outcome of looking up a request in the delayed response slots
+ */
+typedef enum
+{
+  drNew,              //!< Not a retry of a delayed request, execute it
+  drPending,          //!< Reply with the returned code (DR_RUNNING or DR_CONFLICT)
+  drCompleted         //!< The delayed request finished, reply with the returned code
+} tDrStatus;
+
+/*!
+ *  A delayed response slot, one for each master
+ */
+typedef struct
+{
+  unsigned char state;                    //!< drSlotFree, drSlotRunning or drSlotDone
+  unsigned char command;                  //!< The delayed command
+  unsigned char bLoopRequest;             //!< TRUE: waits for a 9900 loop request, FALSE: for a fresh update
+  unsigned char dataCount;                //!< Request data kept in data[]
+  unsigned char data[DR_MAX_DATA];
+  unsigned char result;                   //!< Response code once done
+  unsigned int  ticks;                    //!< Time running, in system ticks
+} stDrSlot;
+
+/*!
+ *  A retry cache entry, one for each master: the last write request and its encoded response
+ */
+typedef struct
+{
+  unsigned char bValid;                   //!< The entry can answer a retry
+  unsigned char command;                  //!< The cached command
+  unsigned int  reqSize;                  //!< Bytes in req[], delimiter to last data byte
+  unsigned char req[RETRY_MAX_REQ];       //!< The request, a retry must match it byte for byte
+  unsigned char respSize;                 //!< Bytes in resp[], delimiter to last data byte (no LRC)
+  unsigned char resp[RETRY_MAX_RESP];
+  unsigned int  ticks;                    //!< Age, in system ticks
+} stRetrySlot;
+
+unsigned char processHartCommand (stHartContext *pCtx);
+unsigned char speculateHartCommand (stHartContext *pCtx);
+unsigned char isHartReplyCertain (stHartContext *pCtx);
 void executeCommand(void);
+extern tStartupStage startupStage;
 
 #ifdef USE_MULTIPLE_SENSOR_COMMANDS	
 // Prototypes of individual sensor command handlers
@@ -119,4 +183,11 @@ void executeCmd21(void);
 void executeTxErr(unsigned char);
 void executeCommErr(void);
 
+tDrStatus drLookup(unsigned char *);
+unsigned char drInitiate(unsigned char);
+void drComplete(unsigned char, unsigned char);
+void drTick(void);
+void retryStore(stHartContext *, unsigned char);
+void retryTick(void);
+
 #endif /*HARTCOMMAND_H_*/
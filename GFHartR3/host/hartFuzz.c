@@ -0,0 +1,355 @@
+/*!
+ *  \file   hartFuzz.c
+ *  \brief  Host fuzz driver for the Hart receiver and the 9900 database load ($HD)
+ *
+ *  Runs the firmware parsers on the host under AddressSanitizer/UBSan (see Makefile, make fuzz).
+ *  Each input is one test case, its first byte selects the target:
+ *  - even: Hart link. The rest are (status, character) pairs given to hartReceiver() as the main
+ *    loop does; a frame for this device goes through initRespBuffer() and processHartCommand()
+ *  - odd:  9900 link. The rest follows "$HD" in the command buffer and Process9900Command()
+ *    decodes it
+ *
+ *  With no file arguments the driver makes its own inputs: frames for this device and $HD chunks,
+ *  with random damage. File arguments are run as inputs instead (e.g. to replay a crash).
+ *  Built with -DHOST_LIBFUZZER it is a libFuzzer target (clang -fsanitize=fuzzer).
+ *
+ *  Besides the sanitizers, the driver checks that a reply fits the response buffer and that a
+ *  database load writes nothing but the database and its load progress.
+ *
+ *  Created on: Oct 19, 2026
+ */
+#include <msp430f5528.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include "define.h"
+#include "hardware.h"
+#include "driverUart.h"
+#include "fifo.h"
+#include "protocols.h"
+#include "hart_r3.h"
+#include "main9900_r3.h"
+#include "hartcommand_r3.h"
+
+/*************************************************************************
+  *   $DEFINES
+*************************************************************************/
+#define MAX_CASE_SIZE       1024          //!< Longest input the driver builds or reads
+#define DEFAULT_CASES       1000000L      //!< Generated cases when -n is not given
+#define CASE_HART           0x00          //!< First byte: even selects the Hart link
+#define CASE_9900           0x01          //!< odd, the 9900 link
+#define STATUS_ERROR_MARK   0xF0          //!< A status byte with these bits set carries a receive error
+
+// Part of hsbCtx that a database load must not write
+#define HSB_RX_FIRST        offsetof(stHsbContext, rxMsgInProgress)
+#define HSB_RX_END          offsetof(stHsbContext, resp)
+
+/*************************************************************************
+  *   $LOCAL DATA
+*************************************************************************/
+static unsigned long prngState = 1;       //!< xorshift state of the case generator
+static const WORD rxErrors[4] = { UCPE, UCFE, UCOE, UCBRK };
+
+/*************************************************************************
+  *   $FUNCTIONS
+*************************************************************************/
+/*!
+ *  \fn     prng()
+ *  \brief  32-bit xorshift, the generated cases only depend on the seed
+ */
+static unsigned long prng(void)
+{
+  prngState ^= prngState << 13;
+  prngState ^= prngState >> 17;
+  prngState ^= prngState << 5;
+  return prngState & 0xFFFFFFFFUL;
+}
+
+/*!
+ *  \fn     fail()
+ *  \brief  Reports a broken invariant and aborts, so the sanitizer/libFuzzer keeps the input
+ */
+static void fail(const char *what)
+{
+  fprintf(stderr, "hartFuzz: %s\n", what);
+  abort();
+}
+
+/*!
+ *  \fn     drainTx()
+ *  \brief  Drops what the firmware queued for transmission (there is no Tx isr on the host)
+ */
+static void drainTx(stUart *pUart)
+{
+  resetFifo(&pUart->txFifo, pUart->fifoTxAlloc);
+  pUart->bUsciTxBufEmpty = TRUE;
+  pUart->bTxMode = FALSE;
+}
+
+/*!
+ *  \fn     checkReply()
+ *  \brief  The byte count of a built reply must keep sendHartFrame() inside the response buffer
+ */
+static void checkReply(void)
+{
+  WORD nTotal = (hartCtx.resp[0] & LONG_ADDR_MASK) ?
+      (hartCtx.resp[LONG_COUNT_OFFSET] + LONG_COUNT_OFFSET) :
+      (hartCtx.resp[SHORT_COUNT_OFFSET] + SHORT_COUNT_OFFSET);
+  if (nTotal >= MAX_HART_XMIT_BUF_SIZE || hartCtx.respSize > MAX_HART_XMIT_BUF_SIZE)
+    fail("reply overruns the response buffer");
+}
+
+/*!
+ *  \fn     replyToFrame()
+ *  \brief  What buildHartReply() does in the main loop, the reply is checked instead of sent
+ */
+static void replyToFrame(void)
+{
+  hartCtx.bCommandReady = FALSE;
+  if (hartCtx.bReplySpeculated)
+  {
+    hartCtx.bReplySpeculated = FALSE;
+    if (hartCtx.bFrameRcvd && !hartCtx.bLrcError && !hartCtx.bParityErr && !hartCtx.bOverrunErr)
+    {
+      checkReply();
+      initHartRxSm(&hartCtx);
+      return;
+    }
+  }
+  initRespBuffer(&hartCtx);
+  if (processHartCommand(&hartCtx))
+    checkReply();
+  initHartRxSm(&hartCtx);
+}
+
+/*!
+ *  \fn     runHartCase()
+ *  \brief  Feeds (status, character) pairs to the receiver, with the main loop event handling
+ */
+static void runHartCase(const BYTE *pData, size_t size)
+{
+  size_t i;
+
+  initHartRxSm(&hartCtx);
+  hartUart.bRxSkip = FALSE;
+  for (i = 0; i + 1 < size; i += 2)
+  {
+    WORD status = ((pData[i] & STATUS_ERROR_MARK) == STATUS_ERROR_MARK) ? rxErrors[pData[i] & 3] : 0;
+    hartReceiver(&hartCtx, (status << 8) | pData[i + 1]);
+    if (hartCtx.bDataComplete && hartCtx.bCommandReady)
+    {
+      hartCtx.bDataComplete = FALSE;
+      initRespBuffer(&hartCtx);
+      hartCtx.bReplySpeculated = speculateHartCommand(&hartCtx);
+      if (hartCtx.bReplySpeculated)
+        checkReply();
+    }
+    if (hartCtx.bCommandReady && bHartRecvFrameCompleted)
+      replyToFrame();
+    drainTx(&hartUart);
+    drainTx(&hsbUart);
+  }
+  // The gap timer ends a frame cut short
+  if (hartCtx.bCommandReady)
+    replyToFrame();
+  drainTx(&hartUart);
+  drainTx(&hsbUart);
+}
+
+/*!
+ *  \fn     run9900Case()
+ *  \brief  Puts "$HD" and the input in the 9900 command buffer and decodes it
+ */
+static void run9900Case(const BYTE *pData, size_t size)
+{
+  static BYTE rxSide[HSB_RX_END - HSB_RX_FIRST];
+
+  memset(hsbCtx.cmd, 0, MAX_9900_CMD_SIZE);
+  hsbCtx.cmd[CMD_ATTN_IDX] = ATTENTION;
+  hsbCtx.cmd[CMD_ADDR_IDX] = HART_ADDRESS;
+  hsbCtx.cmd[CMD_CMD_IDX] = HART_DB_LOAD;
+  if (size > MAX_9900_CMD_SIZE - CMD_1ST_SEP_IDX)
+    size = MAX_9900_CMD_SIZE - CMD_1ST_SEP_IDX;
+  memcpy(hsbCtx.cmd + CMD_1ST_SEP_IDX, pData, size);
+
+  memcpy(rxSide, (BYTE *)&hsbCtx + HSB_RX_FIRST, sizeof(rxSide));
+  Process9900Command();
+  if (memcmp(rxSide, (BYTE *)&hsbCtx + HSB_RX_FIRST, sizeof(rxSide)))
+    fail("database load wrote past the database");
+  if (hsbCtx.dbLoad.bytesCovered > sizeof(DATABASE_9900))
+    fail("database load counts more bytes than the database has");
+  drainTx(&hsbUart);
+}
+
+/*!
+ *  \fn     runCase()
+ *  \brief  One test case, the first byte selects the target
+ */
+static void runCase(const BYTE *pData, size_t size)
+{
+  if (!size)
+    return;
+  if (pData[0] & CASE_9900)
+    run9900Case(pData + 1, size - 1);
+  else
+    runHartCase(pData + 1, size - 1);
+}
+
+/*!
+ *  \fn     putRx()
+ *  \brief  Appends one received character to a Hart case, now and then with a receive error
+ */
+static size_t putRx(BYTE *pCase, size_t n, BYTE ch)
+{
+  pCase[n++] = (0 == prng() % 64) ? (STATUS_ERROR_MARK | (BYTE)(prng() & 3)) : 0;
+  pCase[n++] = ch;
+  return n;
+}
+
+/*!
+ *  \fn     makeHartCase()
+ *  \brief  Builds a master frame, mostly for this device, then damages it at random
+ */
+static size_t makeHartCase(BYTE *pCase)
+{
+  BYTE frame[1 + LONG_ADDR_SIZE + 1 + 1 + 255 + 1];
+  size_t n = 0, len = 0, i;
+  BYTE lrc = 0, count;
+  BOOLEAN bLong = (prng() % 4) ? TRUE : FALSE;
+  unsigned long pick = prng() % 8;
+
+  frame[len++] = bLong ? (HART_FRAME_STX | LONG_ADDR_MASK) : HART_FRAME_STX;
+  if (!bLong)
+    frame[len++] = (pick < 6) ? (hartCtx.pollAddr | (BYTE)(prng() & (PRIMARY_MASTER | BURST_MODE_BIT))) : (BYTE)prng();
+  else
+    for (i = 0; i < LONG_ADDR_SIZE; ++i)
+    {
+      BYTE b = (pick < 5) ? hartCtx.uniqueAddr[i] : (pick < 7) ? 0 : (BYTE)prng();
+      if (0 == i)
+        b |= (BYTE)(prng() & PRIMARY_MASTER);
+      frame[len++] = b;
+    }
+  frame[len++] = (prng() % 4) ? (BYTE)(prng() % 64) : (BYTE)prng();     // mostly universal/common commands
+  count = (prng() % 16) ? (BYTE)(prng() % 40) : (BYTE)prng();
+  frame[len++] = count;
+  for (i = 0; i < count; ++i)
+    frame[len++] = (BYTE)prng();
+  for (i = 0; i < len; ++i)
+    lrc ^= frame[i];
+  frame[len++] = lrc;
+  // Damage: a flipped byte, a cut frame
+  if (0 == prng() % 4)
+    frame[prng() % len] ^= (BYTE)(1 << (prng() % 8));
+  if (0 == prng() % 8)
+    len = prng() % len;
+
+  pCase[n++] = CASE_HART;
+  for (i = 2 + prng() % 5; i; --i)
+    n = putRx(pCase, n, HART_PREAMBLE);
+  for (i = 0; i < len; ++i)
+    n = putRx(pCase, n, frame[i]);
+  if (0 == prng() % 4)
+    n = putRx(pCase, n, (BYTE)prng());    // an extra character after the LRC
+  return n;
+}
+
+/*!
+ *  \fn     makeDbCase()
+ *  \brief  Builds a $HD chunk ",SS,CC,T,<hex>" with random offset, count and damage
+ */
+static size_t makeDbCase(BYTE *pCase)
+{
+  static const char hex[] = "0123456789ABCDEF";
+  size_t n = 0, i;
+  BYTE start = (BYTE)prng(), count = (BYTE)(prng() % (DB_MAX_BYTES_PER_MSG + 4));
+
+  if (prng() % 2)
+    start %= sizeof(DATABASE_9900);
+  pCase[n++] = CASE_9900;
+  pCase[n++] = ',';
+  pCase[n++] = hex[start >> 4];
+  pCase[n++] = hex[start & 15];
+  pCase[n++] = ',';
+  pCase[n++] = hex[count >> 4];
+  pCase[n++] = hex[count & 15];
+  pCase[n++] = ',';
+  pCase[n++] = (prng() % 4) ? DB_EXPECT_MORE_DATA : DB_LAST_MESSAGE;
+  pCase[n++] = ',';
+  for (i = 0; i < 2u * count && n < MAX_CASE_SIZE; ++i)
+    pCase[n++] = hex[prng() & 15];
+  if (0 == prng() % 4)
+    pCase[1 + prng() % (n - 1)] = (BYTE)prng();
+  return n;
+}
+
+/*!
+ *  \fn     initHost()
+ *  \brief  The part of initSystem()/initStartUpData() the parsers depend on
+ */
+static void initHost(void)
+{
+  initUart(&hartUart);
+  initUart(&hsbUart);
+  refreshHartAddress(&hartCtx);
+  initHartRxSm(&hartCtx);
+}
+
+#ifdef HOST_LIBFUZZER
+int LLVMFuzzerTestOneInput(const unsigned char *pData, size_t size)
+{
+  static BOOLEAN bInit = FALSE;
+  if (!bInit)
+  {
+    initHost();
+    bInit = TRUE;
+  }
+  runCase(pData, size);
+  return 0;
+}
+#else
+/*!
+ *  \fn     main()
+ *  \brief  hartFuzz [-n cases] [-s seed] [case files...]
+ */
+int main(int argc, char *argv[])
+{
+  static BYTE buf[MAX_CASE_SIZE];
+  long nCases = DEFAULT_CASES, i;
+  int arg = 1, nFiles = 0;
+
+  for (; arg + 1 < argc && '-' == argv[arg][0]; arg += 2)
+  {
+    if (0 == strcmp(argv[arg], "-n"))
+      nCases = atol(argv[arg + 1]);
+    else if (0 == strcmp(argv[arg], "-s"))
+      prngState = strtoul(argv[arg + 1], NULL, 0) | 1;
+    else
+      break;
+  }
+  initHost();
+  for (; arg < argc; ++arg, ++nFiles)
+  {
+    FILE *f = fopen(argv[arg], "rb");
+    size_t size;
+    if (!f)
+    {
+      perror(argv[arg]);
+      return 2;
+    }
+    size = fread(buf, 1, sizeof(buf), f);
+    fclose(f);
+    runCase(buf, size);
+  }
+  if (nFiles)
+  {
+    printf("hartFuzz: %d case files passed\n", nFiles);
+    return 0;
+  }
+  for (i = 0; i < nCases; ++i)
+    runCase(buf, (prng() % 2) ? makeHartCase(buf) : makeDbCase(buf));
+  printf("hartFuzz: %ld generated cases passed, %lu Hart commands processed, %lu frames with errors\n",
+         nCases, numMsgProcessed, errMsgCounter);
+  return 0;
+}
+#endif
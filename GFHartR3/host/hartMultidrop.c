@@ -0,0 +1,564 @@
+/*!
+ *  \file   hartMultidrop.c
+ *  \brief  Host multidrop simulator: up to 63 Hart modules and a primary master on one segment
+ *
+ *  Every simulated module has its own Hart link context (receiver state and frame buffers), its own
+ *  device record (stHartDevice: polling address, device ID, tags, status), its own Hart Uart state
+ *  and its own gap and reply timers. The firmware keeps one of each, so a module is swapped into
+ *  hartCtx/hartDevice/hartUart and the timer registers while its code runs. The rest of the firmware
+ *  state (9900 database, retry cache, delayed response slots) is shared by all the modules.
+ *
+ *  The medium is half duplex. What one station sends, every other station receives: each character
+ *  goes through the module Rx isr (hartSerialIsr(), skip mode included) and the ones it queues go to
+ *  hartReceiver(), as evHartRxChar does. A module replies once the master carrier is off, after the
+ *  minimum turnaround: its reply timer isr fires, sendHartFrame() queues the reply and the Tx isr
+ *  puts it on the line, each character looped back to the Rx isr (the last one ends the Tx mode).
+ *  Modules that reply to the same frame start together and collide: the master gets the overlapping
+ *  characters with framing errors. A silent frame costs the master its RT1 time-out. Between
+ *  transactions the line is idle, so every running gap timer expires (gapTimerISR()).
+ *
+ *  Not covered, the host has no equivalent:
+ *  - the main loop dispatch itself (static in hartMain.c): the reply is built here with
+ *    initRespBuffer() and processHartCommand(), as buildHartReply() does. The early reply of
+ *    read-only commands (speculateHartReply()) and the preamble stream opened before the command
+ *    executes (openHartFrame() on a deferred reply) are not exercised
+ *  - carrier detect: the modem CD line is not modelled, a module never holds its reply for a master
+ *    that is still keyed
+ *  - burst mode and burst arbitration: the firmware does not publish
+ *
+ *  Scenarios, each checked against the expected responders. Address matching uses
+ *  hartAddressMatch(); for commands 11 and 21 the tag must match too:
+ *  - polling scan, command 0 on addresses 0..63
+ *  - command 13 to each unique address found
+ *  - broadcast commands 11 and 21 with each module's tag, and with an unknown tag
+ *  - two modules on the same polling address (collision)
+ *
+ *  It prints the frames, replies, time-outs and wire time of each scenario (1200 bps, 11 bit
+ *  characters), i.e. the scan rate a master gets on the segment, and the host CPU time per frame.
+ *
+ *    hartMultidrop [-n modules]      (1..63, default 63), exit code 1 if a check fails
+ *
+ *  Created on: Oct 19, 2026
+ */
+#include <msp430f5528.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "define.h"
+#include "hardware.h"
+#include "driverUart.h"
+#include "protocols.h"
+#include "hart_r3.h"
+#include "hartcommand_r3.h"
+#define main firmwareMain                           // As fw_hartMain.o is built
+#include "hartMain.h"
+#undef main
+
+/*************************************************************************
+  *   $DEFINES
+*************************************************************************/
+#define MAX_MODULES         63
+#define MAX_POLL_ADDR       63
+#define WIRE_SIZE           (MAX_RESP_PREAMBLES + MAX_HART_XMIT_BUF_SIZE + 1)
+#define MASTER_PREAMBLES    5
+#define FRAME_ACK           0x06            //!< Slave to master delimiter
+#define CHAR_MS             (11 * 1000.0 / 1200)  //!< Start, 8 data, parity and stop bits at 1200 bps
+#define TURNAROUND_MS       2.4             //!< REPLY_TIMER_MIN_PRESET
+#define RT1_CHARS           33              //!< Primary master wait for a reply that does not come
+#define NO_REPLY            -1
+#define COLLISION           -2
+
+// Command 0 reply data: response code, status, then 254, the expanded device type at 1 and the device ID at 9
+#define CMD0_DEV_TYPE_IDX   (2 + 1)
+#define CMD0_DEVICE_ID_IDX  (2 + 9)
+
+// The interrupt routines are plain functions on the host (no prototype in the firmware headers)
+void hartSerialIsr(void);
+void gapTimerISR(void);
+void slaveReplyTimerISR(void);
+
+/*************************************************************************
+  *   $TYPES
+*************************************************************************/
+/*!
+ *  Characters on the line, each with the receive status in the high byte
+ */
+typedef struct
+{
+  WORD n;
+  WORD ch[WIRE_SIZE];
+} stWire;
+
+/*!
+ *  One simulated Hart module
+ */
+typedef struct
+{
+  stHartContext ctx;                  //!< Its Hart link
+  stHartDevice device;                //!< Its identity and status
+  stUart uart;                        //!< Its Hart Uart: Rx skip/hunt, Tx mode
+  WORD gapTimerCtl;                   //!< Its gap timer (HART_RCV_GAP_TIMER_CTL)
+  WORD replyTimerCtl;                 //!< Its reply timer (HART_RCV_REPLY_TIMER_CTL)
+  BOOLEAN bFrameCompleted;            //!< Its bHartRecvFrameCompleted
+  BOOLEAN bReplyPending;              //!< A reply is built, for the reply timer to send
+  stWire reply;                       //!< The reply on the line, n == 0 if none
+} stModule;
+
+/*!
+ *  Line statistics of one scenario
+ */
+typedef struct
+{
+  unsigned long frames, replies, timeouts, collisions;
+  double wireMs;
+} stLineStats;
+
+/*************************************************************************
+  *   $LOCAL DATA
+*************************************************************************/
+static stModule modules[MAX_MODULES];
+static int nModules = MAX_MODULES;
+static stLineStats line;              //!< The scenario being run
+static unsigned long nFailures;
+static unsigned long nFramesTotal;
+
+/*************************************************************************
+  *   $FUNCTIONS
+*************************************************************************/
+/*!
+ *  \fn     check()
+ *  \brief  Counts a failed expectation
+ */
+static void check(BOOLEAN bOk, const char *pWhat, int index)
+{
+  if (!bOk)
+  {
+    printf("  FAIL: %s (%d)\n", pWhat, index);
+    ++nFailures;
+  }
+}
+
+/*!
+ *  \fn     enterModule()
+ *  \brief  Makes a module the firmware single instance
+ */
+static void enterModule(stModule *pMod)
+{
+  memcpy(&hartCtx, &pMod->ctx, sizeof(hartCtx));
+  memcpy(&hartDevice, &pMod->device, sizeof(hartDevice));
+  memcpy(&hartUart, &pMod->uart, sizeof(hartUart));
+  HART_RCV_GAP_TIMER_CTL = pMod->gapTimerCtl;
+  HART_RCV_REPLY_TIMER_CTL = pMod->replyTimerCtl;
+  bHartRecvFrameCompleted = pMod->bFrameCompleted;
+  sEvents[0] = 0;
+}
+
+/*!
+ *  \fn     leaveModule()
+ *  \brief  Keeps what the firmware changed in the module
+ */
+static void leaveModule(stModule *pMod)
+{
+  memcpy(&pMod->ctx, &hartCtx, sizeof(hartCtx));
+  memcpy(&pMod->device, &hartDevice, sizeof(hartDevice));
+  memcpy(&pMod->uart, &hartUart, sizeof(hartUart));
+  pMod->gapTimerCtl = HART_RCV_GAP_TIMER_CTL;
+  pMod->replyTimerCtl = HART_RCV_REPLY_TIMER_CTL;
+  pMod->bFrameCompleted = bHartRecvFrameCompleted;
+}
+
+/*!
+ *  \fn     rxIsr()
+ *  \brief  One character (receive status in the high byte) into the entered module Rx isr
+ */
+static void rxIsr(WORD ch)
+{
+  UCA1STAT = ch >> 8;
+  UCA1RXBUF = ch & 0xFF;
+  UCA1IV = 2;
+  hartSerialIsr();
+}
+
+/*!
+ *  \fn     moduleHear()
+ *  \brief  A module receives the line; at the end of a frame for it, it builds its reply
+ *
+ *  What the isr queues goes to the receiver as evHartRxChar does. The reply is built as
+ *  buildHartReply() does: initRespBuffer() and processHartCommand()
+ */
+static void moduleHear(stModule *pMod, const stWire *pW)
+{
+  WORD i;
+
+  enterModule(pMod);
+  for (i = 0; i < pW->n; ++i)
+  {
+    rxIsr(pW->ch[i]);
+    while (!isRxEmpty(&hartUart))
+      hartReceiver(&hartCtx, getwUart(&hartUart));
+  }
+  if (hartCtx.bCommandReady && bHartRecvFrameCompleted)
+  {
+    hartCtx.bCommandReady = FALSE;
+    initRespBuffer(&hartCtx);
+    if (processHartCommand(&hartCtx))
+      pMod->bReplyPending = TRUE;
+    else
+      initHartRxSm(&hartCtx);
+  }
+  leaveModule(pMod);
+}
+
+/*!
+ *  \fn     moduleReply()
+ *  \brief  The module reply timer expires: a built reply goes out through sendHartFrame() and the Tx isr
+ *
+ *  The Tx isr runs each time the USCI takes a character, the loopback of the previous one comes in
+ *  after it. Once the Tx fifo is empty, the loopback of the last character ends the Tx mode.
+ */
+static void moduleReply(stModule *pMod)
+{
+  stWire *pW = &pMod->reply;
+  BYTE last;
+
+  enterModule(pMod);
+  pW->n = 0;
+  if (HART_RCV_REPLY_TIMER_CTL & MC_3)
+    slaveReplyTimerISR();
+  if (pMod->bReplyPending)
+  {
+    check(IS_SYSTEM_EVENT(evHartRcvReplyTimer) ? TRUE : FALSE, "reply timer running for a reply", pMod - modules);
+    pMod->bReplyPending = FALSE;
+    sendHartFrame(&hartCtx);
+    pW->ch[pW->n++] = last = UCA1TXBUF;
+    for (;;)
+    {
+      UCA1IV = 4;
+      hartSerialIsr();
+      if (hartUart.bUsciTxBufEmpty)
+        break;
+      rxIsr(last);
+      pW->ch[pW->n++] = last = UCA1TXBUF;
+    }
+    rxIsr(last);
+    check(!hartUart.bTxMode && IS_SYSTEM_EVENT(evHartTransactionDone), "Tx mode ended by the last loopback",
+          pMod - modules);
+  }
+  leaveModule(pMod);
+}
+
+/*!
+ *  \fn     lineIdle()
+ *  \brief  The line goes quiet: every running gap timer expires, with the evHartRcvGapTimeout handling
+ */
+static void lineIdle(void)
+{
+  int i;
+
+  for (i = 0; i < nModules; ++i)
+  {
+    enterModule(&modules[i]);
+    if (HART_RCV_GAP_TIMER_CTL & MC_3)
+      gapTimerISR();
+    if (IS_SYSTEM_EVENT(evHartRcvGapTimeout) && !bHartRecvFrameCompleted && !hartCtx.bFrameRcvd)
+      initHartRxSm(&hartCtx);
+    leaveModule(&modules[i]);
+  }
+}
+
+/*!
+ *  \fn     putRequest()
+ *  \brief  Builds a primary master frame
+ */
+static void putRequest(stWire *pW, BOOLEAN bLong, const BYTE *pAddr, BYTE cmd, const BYTE *pData, BYTE count)
+{
+  BYTE lrc, i, b;
+  WORD start;
+
+  pW->n = 0;
+  for (i = 0; i < MASTER_PREAMBLES; ++i)
+    pW->ch[pW->n++] = HART_PREAMBLE;
+  start = pW->n;
+  pW->ch[pW->n++] = bLong ? (HART_FRAME_STX | LONG_ADDR_MASK) : HART_FRAME_STX;
+  for (i = 0; i < (bLong ? LONG_ADDR_SIZE : SHORT_ADDR_SIZE); ++i)
+    pW->ch[pW->n++] = (0 == i) ? (pAddr[0] | PRIMARY_MASTER) : pAddr[i];
+  pW->ch[pW->n++] = cmd;
+  pW->ch[pW->n++] = count;
+  for (i = 0; i < count; ++i)
+    pW->ch[pW->n++] = pData[i];
+  for (lrc = 0; start < pW->n; ++start)
+  {
+    b = (BYTE)pW->ch[start];
+    lrc ^= b;
+  }
+  pW->ch[pW->n++] = lrc;
+}
+
+/*!
+ *  \fn     decodeReply()
+ *  \brief  The master side: a reply with no receive error, the right delimiter, address and LRC
+ *  \return the number of data bytes (response code and status included), or -1
+ */
+static int decodeReply(const stWire *pW, BOOLEAN bLong, const BYTE *pAddr, BYTE cmd, BYTE *pData)
+{
+  WORD i = 0, nAddr = bLong ? LONG_ADDR_SIZE : SHORT_ADDR_SIZE, k;
+  BYTE lrc, count;
+
+  for (k = 0; k < pW->n; ++k)
+    if (pW->ch[k] >> 8)
+      return -1;
+  while (i < pW->n && HART_PREAMBLE == pW->ch[i])
+    ++i;
+  if (i + 1 + nAddr + 2 + 1 > pW->n || pW->ch[i] != (FRAME_ACK | (bLong ? LONG_ADDR_MASK : 0)))
+    return -1;
+  lrc = (BYTE)pW->ch[i++];
+  for (k = 0; k < nAddr; ++k, ++i)
+  {
+    BYTE expect = (0 == k) ? (pAddr[0] | PRIMARY_MASTER) : pAddr[k];
+    if (pW->ch[i] != expect)
+      return -1;
+    lrc ^= (BYTE)pW->ch[i];
+  }
+  if (pW->ch[i] != cmd)
+    return -1;
+  lrc ^= (BYTE)pW->ch[i++];
+  count = (BYTE)pW->ch[i];
+  lrc ^= (BYTE)pW->ch[i++];
+  if (i + count + 1 != pW->n)
+    return -1;
+  for (k = 0; k < count; ++k, ++i)
+  {
+    pData[k] = (BYTE)pW->ch[i];
+    lrc ^= pData[k];
+  }
+  return (lrc == pW->ch[i]) ? count : -1;
+}
+
+/*!
+ *  \fn     isExpected()
+ *  \brief  Tells if a module should reply to a frame
+ */
+static BOOLEAN isExpected(const stModule *pMod, BOOLEAN bLong, const BYTE *pAddr, BYTE cmd, const BYTE *pData, BYTE count)
+{
+  BYTE addr[LONG_ADDR_SIZE];
+  tAddrMatch match;
+
+  memcpy(addr, pAddr, bLong ? LONG_ADDR_SIZE : SHORT_ADDR_SIZE);
+  addr[0] |= PRIMARY_MASTER;
+  match = hartAddressMatch(addr, bLong, pMod->ctx.pollAddr, pMod->ctx.uniqueAddr);
+  if (addrNoMatch == match)
+    return FALSE;
+  if (!bLong)
+    return (HART_CMD_0 == cmd) ? TRUE : FALSE;
+  if (HART_CMD_11 == cmd)
+    return (count >= SHORT_TAG_SIZE && !memcmp(pData, pMod->device.nv.TagName, SHORT_TAG_SIZE)) ? TRUE : FALSE;
+  if (HART_CMD_21 == cmd)
+    return (count >= LONG_TAG_SIZE && !memcmp(pData, pMod->device.nv.LongTag, LONG_TAG_SIZE)) ? TRUE : FALSE;
+  return (addrMatchUnique == match) ? TRUE : FALSE;
+}
+
+/*!
+ *  \fn     transact()
+ *  \brief  One master request on the segment and whatever comes back
+ *  \return the index of the module that replied, NO_REPLY or COLLISION. A good reply is decoded
+ *          into pReply, *pCount gets its data byte count
+ */
+static int transact(BOOLEAN bLong, const BYTE *pAddr, BYTE cmd, const BYTE *pData, BYTE count,
+                    BYTE *pReply, int *pCount)
+{
+  static stWire request, onLine;
+  int i, k, nReplies = 0, first = NO_REPLY;
+
+  putRequest(&request, bLong, pAddr, cmd, pData, count);
+  ++line.frames;
+  ++nFramesTotal;
+  line.wireMs += request.n * CHAR_MS;
+  for (i = 0; i < nModules; ++i)
+    moduleHear(&modules[i], &request);
+
+  // Carrier off: the modules with a reply key up together
+  for (i = 0; i < nModules; ++i)
+    moduleReply(&modules[i]);
+  onLine.n = 0;
+  for (i = 0; i < nModules; ++i)
+  {
+    const stWire *pW = &modules[i].reply;
+    BOOLEAN bExpected = isExpected(&modules[i], bLong, pAddr, cmd, pData, count);
+    if (bExpected != (pW->n ? TRUE : FALSE))
+    {
+      printf("  FAIL: module %d (poll %u) %s command %u\n", i, modules[i].ctx.pollAddr,
+             pW->n ? "replied to" : "did not reply to", cmd);
+      ++nFailures;
+    }
+    if (!pW->n)
+      continue;
+    if (nReplies++)
+    {
+      for (k = 0; k < pW->n; ++k)
+        onLine.ch[k] = (k < onLine.n) ? (((onLine.ch[k] ^ pW->ch[k]) & 0xFF) | (UCFE << 8)) : pW->ch[k];
+      if (pW->n > onLine.n)
+        onLine.n = pW->n;
+    }
+    else
+    {
+      memcpy(&onLine, pW, sizeof(onLine));
+      first = i;
+    }
+  }
+  if (!nReplies)
+  {
+    ++line.timeouts;
+    line.wireMs += RT1_CHARS * CHAR_MS;
+    lineIdle();
+    return NO_REPLY;
+  }
+  line.wireMs += TURNAROUND_MS + onLine.n * CHAR_MS;
+  // Every other module hears the reply, and ignores it
+  for (i = 0; i < nModules; ++i)
+    if (!modules[i].reply.n)
+      moduleHear(&modules[i], &onLine);
+  lineIdle();
+  *pCount = decodeReply(&onLine, bLong, pAddr, cmd, pReply);
+  if (nReplies > 1 || *pCount < 0)
+  {
+    ++line.collisions;
+    return COLLISION;
+  }
+  ++line.replies;
+  return first;
+}
+
+/*!
+ *  \fn     report()
+ *  \brief  Prints and clears the line statistics of a scenario
+ */
+static void report(const char *pName)
+{
+  printf("%-34s %5lu frames %5lu replies %4lu time-outs %3lu collisions %8.2f s",
+         pName, line.frames, line.replies, line.timeouts, line.collisions, line.wireMs / 1000);
+  if (line.replies)
+    printf("  %6.2f replies/s", line.replies * 1000.0 / line.wireMs);
+  printf("\n");
+  memset(&line, 0, sizeof(line));
+}
+
+/*!
+ *  \fn     initModule()
+ *  \brief  A module with the factory image, polling address i + 1 and its own device ID and tags
+ */
+static void initModule(int i)
+{
+  stModule *pMod = &modules[i];
+
+  memset(pMod, 0, sizeof(*pMod));
+  memcpy(&pMod->device.nv, &startUpDataFactoryNv, sizeof(pMod->device.nv));
+  memcpy(&pMod->device.v, &startUpDataFactoryV, sizeof(pMod->device.v));
+  pMod->device.nv.PollingAddress = (BYTE)(i + 1);
+  pMod->device.nv.DeviceID[0] = 0x5A;
+  pMod->device.nv.DeviceID[1] = (BYTE)(i >> 8);
+  pMod->device.nv.DeviceID[2] = (BYTE)(i + 1);
+  memcpy(pMod->device.nv.TagName, "TAG ", 4);
+  pMod->device.nv.TagName[4] = (BYTE)('0' + (i + 1) / 10);
+  pMod->device.nv.TagName[5] = (BYTE)('0' + (i + 1) % 10);
+  memset(pMod->device.nv.LongTag, ' ', LONG_TAG_SIZE);
+  memcpy(pMod->device.nv.LongTag, "LOOP 7 ANALYZER ", 16);
+  pMod->device.nv.LongTag[16] = (BYTE)('0' + (i + 1) / 10);
+  pMod->device.nv.LongTag[17] = (BYTE)('0' + (i + 1) % 10);
+  memcpy(&pMod->uart, &hartUart, sizeof(pMod->uart));
+  enterModule(pMod);
+  refreshHartAddress(&hartCtx);
+  initHartRxSm(&hartCtx);
+  leaveModule(pMod);
+}
+
+/*!
+ *  \fn     main()
+ */
+int main(int argc, char *argv[])
+{
+  static BYTE uniqueAddr[MAX_POLL_ADDR + 1][LONG_ADDR_SIZE];
+  static BOOLEAN bFound[MAX_POLL_ADDR + 1];
+  BYTE reply[256], addr[LONG_ADDR_SIZE], tag[LONG_TAG_SIZE];
+  BYTE broadcast[LONG_ADDR_SIZE] = { 0, 0, 0, 0, 0 };
+  int i, k, who, count, nFound = 0;
+  clock_t cpuStart = clock();
+
+  if (argc == 3 && 0 == strcmp(argv[1], "-n"))
+    nModules = atoi(argv[2]);
+  if (nModules < 1 || nModules > MAX_MODULES)
+  {
+    fprintf(stderr, "usage: hartMultidrop [-n modules], 1..%d modules\n", MAX_MODULES);
+    return 2;
+  }
+  initUart(&hartUart);
+  for (i = 0; i < nModules; ++i)
+    initModule(i);
+  printf("%d modules on the segment, polling addresses 1..%d\n", nModules, nModules);
+
+  // Polling scan with command 0, the reply gives the unique address
+  for (i = 0; i <= MAX_POLL_ADDR; ++i)
+  {
+    addr[0] = (BYTE)i;
+    who = transact(FALSE, addr, HART_CMD_0, NULL, 0, reply, &count);
+    if (who < 0)
+      continue;
+    check(count >= CMD0_DEVICE_ID_IDX + DEVICE_ID_SIZE, "short command 0 reply", i);
+    uniqueAddr[i][0] = reply[CMD0_DEV_TYPE_IDX] & (EXT_DEV_TYPE_ADDR_MASK >> 8);
+    uniqueAddr[i][1] = reply[CMD0_DEV_TYPE_IDX + 1];
+    memcpy(&uniqueAddr[i][2], &reply[CMD0_DEVICE_ID_IDX], DEVICE_ID_SIZE);
+    check(!memcmp(uniqueAddr[i], modules[who].ctx.uniqueAddr, LONG_ADDR_SIZE), "unique address from command 0", i);
+    bFound[i] = TRUE;
+    ++nFound;
+  }
+  check(nFound == nModules, "modules found by the polling scan", nFound);
+  report("polling scan, command 0");
+
+  // Command 13 to each unique address
+  for (i = 0; i <= MAX_POLL_ADDR; ++i)
+    if (bFound[i])
+    {
+      who = transact(TRUE, uniqueAddr[i], HART_CMD_13, NULL, 0, reply, &count);
+      check(who >= 0 && modules[who].ctx.pollAddr == i, "command 13 to a unique address", i);
+    }
+  report("command 13, unique addresses");
+
+  // Find by tag: broadcast address, only the module with the tag replies
+  for (i = 0; i < nModules; ++i)
+  {
+    who = transact(TRUE, broadcast, HART_CMD_11, modules[i].device.nv.TagName, SHORT_TAG_SIZE, reply, &count);
+    check(who == i, "command 11 with a module tag", i);
+  }
+  memcpy(tag, "NOBODY", SHORT_TAG_SIZE);
+  who = transact(TRUE, broadcast, HART_CMD_11, tag, SHORT_TAG_SIZE, reply, &count);
+  check(NO_REPLY == who, "command 11 with an unknown tag", 0);
+  report("broadcast command 11, by tag");
+
+  for (i = 0; i < nModules; ++i)
+  {
+    who = transact(TRUE, broadcast, HART_CMD_21, modules[i].device.nv.LongTag, LONG_TAG_SIZE, reply, &count);
+    check(who == i, "command 21 with a module long tag", i);
+  }
+  memset(tag, '?', LONG_TAG_SIZE);
+  who = transact(TRUE, broadcast, HART_CMD_21, tag, LONG_TAG_SIZE, reply, &count);
+  check(NO_REPLY == who, "command 21 with an unknown long tag", 0);
+  report("broadcast command 21, by long tag");
+
+  // Two modules on one polling address: both reply, the master gets garbage
+  if (nModules >= 2)
+  {
+    k = modules[0].ctx.pollAddr;
+    enterModule(&modules[1]);
+    hartDevice.nv.PollingAddress = (BYTE)k;
+    refreshHartAddress(&hartCtx);
+    leaveModule(&modules[1]);
+    addr[0] = (BYTE)k;
+    who = transact(FALSE, addr, HART_CMD_0, NULL, 0, reply, &count);
+    check(COLLISION == who, "two modules on one polling address", k);
+    report("duplicate polling address");
+  }
+
+  printf("%lu frames, %.1f us host CPU per frame, %lu failures\n", nFramesTotal,
+         (clock() - cpuStart) * 1e6 / CLOCKS_PER_SEC / nFramesTotal, nFailures);
+  return nFailures ? 1 : 0;
+}
@@ -0,0 +1,653 @@
+/*!
+ *  \file   hartUnit.c
+ *  \brief  Host unit tests of the firmware modules (see Makefile, make test)
+ *
+ *  Each test is a function of the table at the end, run in order on the same firmware state.
+ *  A failed CHECK() prints its location and the run goes on; the exit code is 1 if any failed.
+ *
+ *    hartUnit [test name...]         runs the named tests, all of them by default
+ *
+ *  Created on: Oct 19, 2026
+ */
+#include <msp430f5528.h>
+#include <stdio.h>
+#include <string.h>
+#include "define.h"
+#include "hardware.h"
+#include "driverUart.h"
+#include "protocols.h"
+#include "hart_r3.h"
+#include "main9900_r3.h"
+#include "common_h_cmd_r3.h"
+#include "hartcommand_r3.h"
+#include "utilities_r3.h"
+#include "fifo.h"
+#define main firmwareMain                           // As fw_hartMain.o is built
+#include "hartMain.h"
+#undef main
+
+/*************************************************************************
+  *   $DEFINES
+*************************************************************************/
+#define CHECK(cond)         check((cond) ? TRUE : FALSE, #cond, __LINE__)
+#define MASTER_PREAMBLES    5
+// Long frame request: delimiter, address, command and byte count come before the data
+#define REQ_DATA_IDX        (1 + LONG_ADDR_SIZE + 2)
+// and in the response the response code, then the status byte
+#define RESP_STATUS_IDX     (1 + LONG_ADDR_SIZE + 3)
+
+/*************************************************************************
+  *   $TYPES
+*************************************************************************/
+typedef struct
+{
+  const char *pName;
+  void (*run)(void);
+} stUnitTest;
+
+// The interrupt routines are plain functions on the host (no prototype in the firmware headers)
+void hartSerialIsr(void);
+void gapTimerISR(void);
+
+/*************************************************************************
+  *   $LOCAL DATA
+*************************************************************************/
+static unsigned long nChecks, nFailures;
+
+/*************************************************************************
+  *   $FUNCTIONS
+*************************************************************************/
+/*!
+ *  \fn     check()
+ *  \brief  Counts a check, prints it if it failed
+ */
+static void check(BOOLEAN bOk, const char *pWhat, int line)
+{
+  ++nChecks;
+  if (!bOk)
+  {
+    printf("  FAIL line %d: %s\n", line, pWhat);
+    ++nFailures;
+  }
+}
+
+/*!
+ *  \fn     testQ16()
+ *  \brief  Q16.16 arithmetic and the float order key are 32-bit, also on a 64-bit host
+ */
+static void testQ16(void)
+{
+  q16 q;
+
+  CHECK(sizeof(q16) == 4);
+  CHECK(q16Div(1L << 16, 2L << 16) == 32768);
+  CHECK(q16Div(-(1L << 16), 2L << 16) == -32768);
+  CHECK(q16Div(Q16_ONE, 0) == Q16_MAX);
+  CHECK(q16PercentRange(20L << 16, 4L << 16, 12L << 16) == (50L << 16));
+  CHECK(q16PercentRange(20L << 16, 4L << 16, 4L << 16) == 0);
+  CHECK(floatOrderKey(-1.0f) < 0);
+  CHECK(floatOrderKey(-2.0f) < floatOrderKey(-1.0f));
+  CHECK(floatOrderKey(-0.0f) == floatOrderKey(0.0f));
+  CHECK(floatOrderKey(1.0f) > floatOrderKey(0.5f));
+  CHECK(floatToQ16(-1.5f, &q) && q == -(3L << 15));
+  CHECK(!floatToQ16(16384.0f, &q));
+  CHECK(q16ToFloat(-(3L << 15)) == -1.5f);
+}
+
+/*!
+ *  \fn     testPercentRange()
+ *  \brief  A narrow range keeps the float percent of range, a normal one runs in Q16.16
+ */
+static void testPercentRange(void)
+{
+  float expected;
+
+  hsbCtx.database.db.LOOP_SET_HIGH_LIMIT.floatVal = 4.0005f;
+  hsbCtx.database.db.LOOP_SET_LOW_LIMIT.floatVal = 4.0f;
+  PVvalue = 4.0001f;
+  refreshPvDerived();
+  expected = CalculatePercentRange(4.0005f, 4.0f, 4.0001f);
+  CHECK(pvDerived.pvPercentRange == expected);
+
+  hsbCtx.database.db.LOOP_SET_HIGH_LIMIT.floatVal = 20.0f;
+  hsbCtx.database.db.LOOP_SET_LOW_LIMIT.floatVal = 4.0f;
+  PVvalue = 12.0f;
+  refreshPvDerived();
+  CHECK(pvDerived.pvPercentRange == 50.0f);
+  CHECK(0 == pvDerived.limitStatus);
+}
+
+/*!
+ *  \fn     testTrimPoint()
+ *  \brief  Only exactly 4 mA marks the loop as set to its minimum
+ */
+static void testTrimPoint(void)
+{
+  CHECK(RESP_SUCCESS == setFixedCurrentMode(4.000005f));
+  CHECK(FALSE == setToMinValue);
+  CHECK(RESP_SUCCESS == setFixedCurrentMode(4.0f));
+  CHECK(TRUE == setToMinValue);
+  CHECK(RESP_SUCCESS == setFixedCurrentMode(19.999995f));
+  CHECK(FALSE == setToMaxValue);
+}
+
+/*!
+ *  \fn     testClockCharge()
+ *  \brief  The Cmd 223 energy estimate prices the burst time at the burst and at the idle clock
+ */
+static void testClockCharge(void)
+{
+  stClockStats saved = clockStats;
+
+  clockStats.burstCounts = 10UL * CLOCK_STATS_COUNTS_PER_SEC + CLOCK_STATS_COUNTS_PER_SEC / 2;
+  CHECK(clockChargeUc(FALSE) == 10UL * CLOCK_BURST_ACTIVE_UA + CLOCK_BURST_ACTIVE_UA / 2);
+  CHECK(clockChargeUc(TRUE) == 105UL * CLOCK_IDLE_ACTIVE_UA * CLOCK_BURST_RATIO / 10);
+  CHECK(clockChargeUc(FALSE) < clockChargeUc(TRUE));
+  clockStats = saved;
+}
+
+/*!
+ *  \fn     put9900Update()
+ *  \brief  Hands an update message ("$HU,<PV>,<SV>,<mA>,<var>,<comm>[,<caps>]\r") to the 9900 side
+ */
+static void put9900Update(const char *pCaps)
+{
+  BYTE *pCmd = hsbCtx.cmd;
+
+  memset(pCmd, 0, MAX_9900_CMD_SIZE);
+  pCmd[CMD_ATTN_IDX] = ATTENTION;
+  pCmd[CMD_ADDR_IDX] = HART_ADDRESS;
+  pCmd[CMD_CMD_IDX] = HART_UPDATE;
+  pCmd[CMD_1ST_SEP_IDX] = HART_SEPARATOR;
+  convertFloatToAscii(12.0f, pCmd + UPDATE_PV_START_INDEX);
+  pCmd[UPDATE_SV_START_INDEX - 1] = HART_SEPARATOR;
+  convertFloatToAscii(25.0f, pCmd + UPDATE_SV_START_INDEX);
+  pCmd[UPDATE_MA4_20_START_INDEX - 1] = HART_SEPARATOR;
+  convertFloatToAscii(12.0f, pCmd + UPDATE_MA4_20_START_INDEX);
+  pCmd[UPDATE_VAR_STATUS_INDEX - 1] = HART_SEPARATOR;
+  pCmd[UPDATE_VAR_STATUS_INDEX] = UPDATE_STATUS_GOOD;
+  pCmd[UPDATE_COMM_STATUS_INDEX - 1] = HART_SEPARATOR;
+  pCmd[UPDATE_COMM_STATUS_INDEX] = POLL_LAST_REQ_GOOD;
+  if (pCaps)
+  {
+    pCmd[UPDATE_CAPS_SEP_INDEX] = HART_SEPARATOR;
+    pCmd[UPDATE_CAPS_INDEX] = (BYTE)pCaps[0];
+    pCmd[UPDATE_CAPS_INDEX + 1] = HART_MSG_END;
+  }
+  else
+  {
+    pCmd[UPDATE_CAPS_SEP_INDEX] = HART_MSG_END;
+  }
+  Process9900Command();
+  resetFifo(&hsbUart.txFifo, hsbUart.fifoTxAlloc);
+}
+
+/*!
+ *  \fn     testHsbBatch()
+ *  \brief  Two requests go out in one response only to a 9900 that reports CAPS_BATCH_REQUESTS
+ */
+static void testHsbBatch(void)
+{
+  int i;
+
+  comm9900started = TRUE;
+  // Hand out what is pending (the power up save & restart)
+  for (i = 0; i < MAX_9900_REQUESTS; ++i)
+    put9900Update(NULL);
+  CHECK(RESP_REQ_NO_REQ == hsbCtx.resp[RSP_REQ_IDX]);
+
+  CHECK(queue9900Request(RESP_REQ_CHANGE_4MA_POINT, 4.0f));
+  CHECK(queue9900Request(RESP_REQ_CHANGE_20MA_POINT, 20.0f));
+  CHECK(queue9900Request(RESP_REQ_CHANGE_4MA_POINT, 3.0f));
+  // Older 9900: one request per response
+  put9900Update(NULL);
+  CHECK(FALSE == hsbCtx.batchCapable);
+  CHECK(RESP_REQ_CHANGE_4MA_POINT == hsbCtx.resp[RSP_REQ_IDX]);
+  CHECK(HART_MSG_END == hsbCtx.resp[RSP_STATUS_IDX + 1 + 9]);
+  // A 9900 that takes batches: the other two in one response
+  put9900Update("1");
+  CHECK(TRUE == hsbCtx.batchCapable);
+  CHECK(RESP_REQ_CHANGE_20MA_POINT == hsbCtx.resp[RSP_REQ_IDX]);
+  CHECK(HART_SEPARATOR == hsbCtx.resp[RSP_STATUS_IDX + 1 + 9]);
+  CHECK(RESP_REQ_CHANGE_4MA_POINT == hsbCtx.resp[RSP_STATUS_IDX + 1 + 9 + 1]);
+  CHECK(HART_MSG_END == hsbCtx.resp[RSP_STATUS_IDX + 1 + 9 + 11]);
+  // An invalid capabilities character counts as none
+  put9900Update("x");
+  CHECK(FALSE == hsbCtx.batchCapable);
+}
+
+/*!
+ *  \fn     put9900Chunk()
+ *  \brief  Hands a database load message ("$HD,<start>,<count>,<status>,<hex data>\r") to the 9900 side
+ *  \return TRUE if it was ACKed
+ */
+static BOOLEAN put9900Chunk(BYTE start, BYTE count, BYTE status, const char *pHex)
+{
+  BYTE *pCmd = hsbCtx.cmd;
+  size_t n = strlen(pHex);
+
+  memset(pCmd, 0, MAX_9900_CMD_SIZE);
+  pCmd[CMD_ATTN_IDX] = ATTENTION;
+  pCmd[CMD_ADDR_IDX] = HART_ADDRESS;
+  pCmd[CMD_CMD_IDX] = HART_DB_LOAD;
+  pCmd[CMD_1ST_SEP_IDX] = HART_SEPARATOR;
+  BytesToHexAscii(&start, pCmd + DB_ADDR_START_IDX, 1);
+  pCmd[DB_BYTE_COUNT_IDX - 1] = HART_SEPARATOR;
+  BytesToHexAscii(&count, pCmd + DB_BYTE_COUNT_IDX, 1);
+  pCmd[DB_STATUS_IDX - 1] = HART_SEPARATOR;
+  pCmd[DB_STATUS_IDX] = status;
+  pCmd[DB_FIRST_DATA_IDX - 1] = HART_SEPARATOR;
+  memcpy(pCmd + DB_FIRST_DATA_IDX, pHex, n);
+  pCmd[DB_FIRST_DATA_IDX + n] = HART_MSG_END;
+  Process9900Command();
+  resetFifo(&hsbUart.txFifo, hsbUart.fifoTxAlloc);
+  return (HART_ACK == hsbCtx.resp[RSP_REQ_IDX]) ? TRUE : FALSE;
+}
+
+/*!
+ *  \fn     testDbBadChunk()
+ *  \brief  A chunk with bad hex changes nothing in the database and is not a repeat afterwards
+ */
+static void testDbBadChunk(void)
+{
+  DATABASE_9900 before;
+
+  CHECK(put9900Chunk(0, 4, DB_EXPECT_MORE_DATA, "003E3436"));
+  memcpy(&before, &hsbCtx.database.db, sizeof(before));
+  // Same place and size as the previous chunk, the bad digit is in its last byte
+  CHECK(!put9900Chunk(0, 4, DB_EXPECT_MORE_DATA, "1111111G"));
+  CHECK(0 == memcmp(&before, &hsbCtx.database.db, sizeof(before)));
+  CHECK(FALSE == hsbCtx.dbLoad.inProgress);
+  // Sent again it opens a new load, it does not land in the closed one as a repeat
+  CHECK(put9900Chunk(0, 4, DB_EXPECT_MORE_DATA, "003E3436"));
+  CHECK(TRUE == hsbCtx.dbLoad.inProgress);
+  CHECK(4 == hsbCtx.dbLoad.bytesCovered);
+}
+
+/*!
+ *  \fn     testCrc16()
+ *  \brief  The software CRC gives the CRC16 module result (CRCDI, "123456789" -> 0x89F6)
+ */
+static void testCrc16(void)
+{
+  CHECK(0x89F6 == calcCrc16((const unsigned char *)"123456789", 9));
+  CHECK(0xFFFF == calcCrc16((const unsigned char *)"", 0));
+}
+
+/*!
+ *  \fn     testNvSlots()
+ *  \brief  A corrupted NV slot raises SS0_NV_MEM_DEFECT, the other slot keeps the configuration
+ */
+static void testNvSlots(void)
+{
+  HART_STARTUP_DATA_NONVOLATILE *pSlotA = (HART_STARTUP_DATA_NONVOLATILE *)NV_SLOT_A;
+  BYTE image[2 * MAIN_SEGMENT_SIZE];
+
+  memset(NV_SLOT_A, 0xFF, 2 * MAIN_SEGMENT_SIZE);
+  CHECK(NV_LOAD_BLANK == loadNvRecord());
+  memcpy(&hartDevice.nv, &startUpDataFactoryNv, sizeof(hartDevice.nv));
+  hartDevice.v.StandardStatus0 = 0;
+  // First commit to slot B, the next one to slot A
+  hartDevice.nv.PollingAddress = 1;
+  markNvDirty(NV_DIRTY_ALL);
+  syncNvRam();
+  hartDevice.nv.PollingAddress = 2;
+  markNvDirty(NV_DIRTY_ALL);
+  syncNvRam();
+  CHECK(2 == pSlotA->PollingAddress);
+  CHECK(!(hartDevice.v.StandardStatus0 & SS0_NV_MEM_DEFECT));
+
+  // The scrubber finds the newest record bad, the next sync rewrites it in the other slot
+  pSlotA->Descriptor[0] ^= 0x01;
+  updateNvRam = FALSE;
+  scrubNvRecord();
+  CHECK(hartDevice.v.StandardStatus0 & SS0_NV_MEM_DEFECT);
+  CHECK(TRUE == updateNvRam);
+  syncNvRam();
+  CHECK(!(hartDevice.v.StandardStatus0 & SS0_NV_MEM_DEFECT));
+  CHECK(NV_LOAD_OK == loadNvRecord());
+  CHECK(2 == hartDevice.nv.PollingAddress);
+
+  // Only fields marked with markNvDirty() are committed, a sync with none marked leaves the flash alone
+  CHECK(0 == nvDirtyFields);
+  memcpy(image, NV_SLOT_A, sizeof(image));
+  hartDevice.nv.Descriptor[0] ^= 0x01;
+  syncNvRam();
+  CHECK(0 == memcmp(image, NV_SLOT_A, sizeof(image)));
+  hartDevice.nv.Descriptor[0] ^= 0x01;
+
+  // Power up with the newest slot bad: the previous record is loaded from the other one
+  hartDevice.nv.PollingAddress = 3;
+  markNvDirty(NV_DIRTY_ALL);
+  syncNvRam();
+  CHECK(3 == pSlotA->PollingAddress);
+  pSlotA->recordCrc ^= 0x8000;
+  CHECK(NV_LOAD_OK == loadNvRecord());
+  CHECK(2 == hartDevice.nv.PollingAddress);
+}
+
+/*!
+ *  \fn     makeDbImage()
+ *  \brief  A 9900 database: the factory one with its checksum
+ */
+static void makeDbImage(U_DATABASE_9900 *pImage)
+{
+  WORD sum = 0, i;
+
+  memcpy(&pImage->db, &factory9900db, sizeof(DATABASE_9900));
+  for (i = 0; i < DB_CHECKSUM_OFFSET; ++i)
+    sum += pImage->bytes[i];
+  pImage->db.checksum = sum;
+}
+
+/*!
+ *  \fn     putDbRange()
+ *  \brief  Sends bytes of a database image as one $HD chunk, with an optional ",<crc>" after the data
+ */
+static BOOLEAN putDbRange(const BYTE *pImage, BYTE start, BYTE count, BYTE status, const BYTE *pCrc)
+{
+  char hex[2 * DB_MAX_BYTES_PER_MSG + DB_CRC_FIELD_SIZE + 1];
+
+  BytesToHexAscii(pImage + start, (BYTE *)hex, count);
+  hex[2 * count] = '\0';
+  if (pCrc)
+  {
+    hex[2 * count] = HART_SEPARATOR;
+    BytesToHexAscii(pCrc, (BYTE *)hex + 2 * count + 1, 2);
+    hex[2 * count + DB_CRC_FIELD_SIZE] = '\0';
+  }
+  return put9900Chunk(start, count, status, hex);
+}
+
+/*!
+ *  \fn     putFullDb()
+ *  \brief  Sends a whole database image as a full load
+ */
+static void putFullDb(const U_DATABASE_9900 *pImage)
+{
+  BYTE start, count;
+
+  for (start = 0; start < sizeof(DATABASE_9900); start += count)
+  {
+    count = (sizeof(DATABASE_9900) - start > DB_MAX_BYTES_PER_MSG) ?
+        DB_MAX_BYTES_PER_MSG : (BYTE)(sizeof(DATABASE_9900) - start);
+    CHECK(putDbRange(pImage->bytes, start, count,
+                     (start + count < sizeof(DATABASE_9900)) ? DB_EXPECT_MORE_DATA : DB_LAST_MESSAGE, NULL));
+  }
+}
+
+/*!
+ *  \fn     testDbLoadAfterRange()
+ *  \brief  A database load after a range change is summed from the bytes actually held
+ */
+static void testDbLoadAfterRange(void)
+{
+  U_DATABASE_9900 image;
+
+  makeDbImage(&image);
+  // As setBothRangeVals() does, outside of any load
+  hsbCtx.database.db.LOOP_SET_HIGH_LIMIT.floatVal = 123.0f;
+  putFullDb(&image);
+  CHECK(TRUE == databaseOk);
+}
+
+/*!
+ *  \fn     testDbDeltaCrc()
+ *  \brief  A delta load is only taken when the result has the CRC the 9900 sent
+ */
+static void testDbDeltaCrc(void)
+{
+  U_DATABASE_9900 image, swapped;
+  BYTE crc[2], start;
+  int16u crcValue;
+
+  makeDbImage(&image);
+  putFullDb(&image);
+  CHECK(TRUE == databaseOk);
+  crcValue = calcCrc16(image.bytes, sizeof(DATABASE_9900));
+  crc[0] = (BYTE)(crcValue >> 8);
+  crc[1] = (BYTE)crcValue;
+
+  // A delta that swaps two serial number digits keeps the sum, the CRC catches it
+  memcpy(&swapped, &image, sizeof(swapped));
+  swapped.db.SERIAL_NUMBER[2] = image.db.SERIAL_NUMBER[3];
+  swapped.db.SERIAL_NUMBER[3] = image.db.SERIAL_NUMBER[2];
+  CHECK(swapped.db.SERIAL_NUMBER[2] != image.db.SERIAL_NUMBER[2]);
+  start = (BYTE)((BYTE *)&image.db.SERIAL_NUMBER[2] - image.bytes);
+  Process9900DatabaseQuery();
+  CHECK(!putDbRange(swapped.bytes, start, 2, DB_LAST_MESSAGE, crc));
+  CHECK(FALSE == databaseOk);
+  CHECK(hsbCtx.dbLoad.runningSum == hsbCtx.database.db.checksum);
+
+  // The right bytes with the same CRC are taken
+  Process9900DatabaseQuery();
+  CHECK(putDbRange(image.bytes, start, 2, DB_LAST_MESSAGE, crc));
+  CHECK(TRUE == databaseOk);
+  // The closing chunk of a delta load without its CRC is refused
+  Process9900DatabaseQuery();
+  CHECK(!putDbRange(image.bytes, start, 2, DB_LAST_MESSAGE, NULL));
+  CHECK(FALSE == databaseOk);
+  resetFifo(&hsbUart.txFifo, hsbUart.fifoTxAlloc);
+}
+
+/*!
+ *  \fn     makeHartRequest()
+ *  \brief  Builds a primary master long frame to this device, delimiter to the last data byte
+ *  \return the frame size
+ */
+static unsigned makeHartRequest(BYTE *pFrame, BYTE cmd, const BYTE *pData, BYTE count)
+{
+  unsigned n = 0, i;
+
+  pFrame[n++] = HART_FRAME_STX | LONG_ADDR_MASK;
+  for (i = 0; i < LONG_ADDR_SIZE; ++i)
+    pFrame[n++] = (0 == i) ? (hartCtx.uniqueAddr[0] | PRIMARY_MASTER) : hartCtx.uniqueAddr[i];
+  pFrame[n++] = cmd;
+  pFrame[n++] = count;
+  if (count)
+    memcpy(pFrame + n, pData, count);
+  return n + count;
+}
+
+/*!
+ *  \fn     putHartFrame()
+ *  \brief  Hands a frame (preambles and LRC added) to the receiver and builds the reply as the main loop does
+ *  \return TRUE if there is a reply in the response buffer
+ */
+static BOOLEAN putHartFrame(const BYTE *pFrame, unsigned n)
+{
+  BOOLEAN bReplied = FALSE;
+  BYTE lrc = 0;
+  unsigned i;
+
+  initHartRxSm(&hartCtx);
+  for (i = 0; i < MASTER_PREAMBLES; ++i)
+    hartReceiver(&hartCtx, HART_PREAMBLE);
+  for (i = 0; i < n; ++i)
+  {
+    lrc ^= pFrame[i];
+    hartReceiver(&hartCtx, pFrame[i]);
+  }
+  hartReceiver(&hartCtx, lrc);
+  if (hartCtx.bCommandReady)
+  {
+    hartCtx.bCommandReady = FALSE;
+    initRespBuffer(&hartCtx);
+    bReplied = processHartCommand(&hartCtx);
+  }
+  initHartRxSm(&hartCtx);
+  resetFifo(&hartUart.txFifo, hartUart.fifoTxAlloc);
+  resetFifo(&hsbUart.txFifo, hsbUart.fifoTxAlloc);
+  return bReplied;
+}
+
+/*!
+ *  \fn     testRetryCache()
+ *  \brief  A write retry is replayed with the current status, a different request with the same CRC executes
+ */
+static void testRetryCache(void)
+{
+  tStartupStage savedStage = startupStage;
+  BYTE data[TAG_DESCRIPTOR_DATE_SIZE];
+  BYTE frameA[REQ_DATA_IDX + TAG_DESCRIPTOR_DATE_SIZE], frameB[sizeof(frameA)];
+  unsigned n, i;
+  int16u crcA;
+
+  startupStage = stageOperational;
+  for (i = 0; i < sizeof(data); ++i)
+    data[i] = (BYTE)(0x41 + i);
+  n = makeHartRequest(frameA, HART_CMD_18, data, sizeof(data));
+  CHECK(putHartFrame(frameA, n));
+  CHECK(0 == memcmp(&hartDevice.nv.TagName, data, sizeof(data)));
+  CHECK(hartCtx.resp[RESP_STATUS_IDX] & FD_STATUS_CONFIG_CHANGED);
+
+  // The retry gets the cached response, with the status as it is now
+  clrStatusBits(STATUS_BOTH, FD_STATUS_CONFIG_CHANGED);
+  CHECK(putHartFrame(frameA, n));
+  CHECK(hartCtx.resp[RESP_STATUS_IDX] == hartDevice.v.Primary_status);
+  CHECK(!(hartCtx.resp[RESP_STATUS_IDX] & FD_STATUS_CONFIG_CHANGED));
+
+  // Another tag, two descriptor bytes chosen so the request has the same size and CRC16
+  crcA = calcCrc16(frameA, n);
+  memcpy(frameB, frameA, n);
+  frameB[REQ_DATA_IDX] ^= 0x01;
+  for (i = 0; i <= 0xFFFF; ++i)
+  {
+    frameB[REQ_DATA_IDX + 16] = (BYTE)(i >> 8);
+    frameB[REQ_DATA_IDX + 17] = (BYTE)i;
+    if (calcCrc16(frameB, n) == crcA)
+      break;
+  }
+  CHECK(i <= 0xFFFF);
+  CHECK(putHartFrame(frameB, n));
+  CHECK(0 == memcmp(&hartDevice.nv.TagName, frameB + REQ_DATA_IDX, sizeof(data)));
+  startupStage = savedStage;
+}
+
+/*!
+ *  \fn     isrFrame()
+ *  \brief  Puts a frame (preambles and LRC added) through the Hart Rx isr, one USCI character at a time
+ *
+ *  The main loop takes each character the isr queues, as evHartRxChar does
+ */
+static void isrFrame(const BYTE *pFrame, unsigned n)
+{
+  BYTE lrc = 0, ch;
+  unsigned i;
+
+  for (i = 0; i < MASTER_PREAMBLES + n + 1; ++i)
+  {
+    ch = (i < MASTER_PREAMBLES) ? HART_PREAMBLE : (i < MASTER_PREAMBLES + n) ? pFrame[i - MASTER_PREAMBLES] : lrc;
+    if (i >= MASTER_PREAMBLES && i < MASTER_PREAMBLES + n)
+      lrc ^= ch;
+    UCA1STAT = 0;
+    UCA1RXBUF = ch;
+    UCA1IV = 2;
+    hartSerialIsr();
+    while (!isRxEmpty(&hartUart))
+      hartReceiver(&hartCtx, getwUart(&hartUart));
+  }
+}
+
+/*!
+ *  \fn     isrGap()
+ *  \brief  The line goes quiet: the gap timer isr, then its evHartRcvGapTimeout handling in the main loop
+ */
+static void isrGap(void)
+{
+  gapTimerISR();
+  if (IS_SYSTEM_EVENT(evHartRcvGapTimeout))
+  {
+    CLEAR_SYSTEM_EVENT(evHartRcvGapTimeout);
+    if (!bHartRecvFrameCompleted && !hartCtx.bFrameRcvd)
+      initHartRxSm(&hartCtx);
+  }
+}
+
+/*!
+ *  \fn     testIsrSkipHunt()
+ *  \brief  A frame for another device is dropped at the isr, the master frame right after it is received
+ *
+ *  Once, with the master frame for us right after the foreign one, and once with the other slave's
+ *  reply in between
+ */
+static void testIsrSkipHunt(void)
+{
+  BYTE foreign[REQ_DATA_IDX], ours[REQ_DATA_IDX], reply[REQ_DATA_IDX + 2];
+  unsigned n, pass;
+
+  n = makeHartRequest(ours, HART_CMD_1, NULL, 0);
+  memcpy(foreign, ours, n);
+  foreign[LONG_ADDR_SIZE] ^= 0x55;                  // Another device ID
+  memcpy(reply, foreign, n);
+  reply[0] = 0x06 | LONG_ADDR_MASK;                  // ACK, slave to master
+  reply[REQ_DATA_IDX - 1] = 2;                      // Response code and status
+  reply[REQ_DATA_IDX] = 0;
+  reply[REQ_DATA_IDX + 1] = 0;
+
+  for (pass = 0; pass < 2; ++pass)
+  {
+    initHartRxSm(&hartCtx);
+    hartUart.bRxSkip = FALSE;
+    hartUart.bRxHunt = FALSE;
+    bHartRecvFrameCompleted = FALSE;
+    isrFrame(foreign, n);
+    CHECK(hartUart.bRxSkip);
+    CHECK(!hartCtx.bCommandReady);
+    isrGap();
+    if (pass)
+    {
+      isrFrame(reply, sizeof(reply));
+      CHECK(hartUart.bRxSkip);
+      isrGap();
+    }
+    isrFrame(ours, n);
+    CHECK(!hartUart.bRxSkip);
+    CHECK(hartCtx.bCommandReady && hartCtx.bFrameRcvd && !hartCtx.bLrcError);
+    CHECK(HART_CMD_1 == hartCtx.cmd[1 + LONG_ADDR_SIZE]);
+    isrGap();
+  }
+  initHartRxSm(&hartCtx);
+}
+
+static const stUnitTest tests[] =
+{
+  { "q16",          testQ16 },
+  { "percentRange", testPercentRange },
+  { "trimPoint",    testTrimPoint },
+  { "clockCharge",  testClockCharge },
+  { "hsbBatch",     testHsbBatch },
+  { "dbBadChunk",   testDbBadChunk },
+  { "crc16",        testCrc16 },
+  { "nvSlots",      testNvSlots },
+  { "dbAfterRange", testDbLoadAfterRange },
+  { "dbDeltaCrc",   testDbDeltaCrc },
+  { "retryCache",   testRetryCache },
+  { "isrSkipHunt",  testIsrSkipHunt },
+};
+
+/*!
+ *  \fn     main()
+ */
+int main(int argc, char *argv[])
+{
+  unsigned i;
+  int arg;
+
+  initUart(&hartUart);
+  initUart(&hsbUart);
+  refreshHartAddress(&hartCtx);
+  initHartRxSm(&hartCtx);
+  for (i = 0; i < sizeof(tests) / sizeof(tests[0]); ++i)
+  {
+    unsigned long before = nFailures;
+    for (arg = 1; arg < argc && strcmp(argv[arg], tests[i].pName); ++arg)
+      ;
+    if (argc > 1 && arg == argc)
+      continue;
+    tests[i].run();
+    printf("%-16s %s\n", tests[i].pName, (before == nFailures) ? "ok" : "FAILED");
+  }
+  printf("hartUnit: %lu checks, %lu failures\n", nChecks, nFailures);
+  return nFailures ? 1 : 0;
+}
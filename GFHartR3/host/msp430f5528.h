@@ -0,0 +1,227 @@
+/*!
+ *  \file   msp430f5528.h
+ *  \brief  Host stand-in for the TI device header, used by the host test drivers only
+ *
+ *  The firmware sources include <msp430f5528.h>. The host Makefile puts this directory first on
+ *  the include path, so the same sources build with gcc: every peripheral register is a plain
+ *  variable (defined in msp430regs.c), the intrinsics do nothing and the interrupt routines are
+ *  ordinary functions.
+ *
+ *  The USCI status and interrupt bits carry the device values, the Hart receiver decodes them.
+ *  The other bit masks only have to compile; the drivers never run the clock or PMM code.
+ *  The information memory and the DB cache segment are RAM arrays (HOST_INFO_FLASH and
+ *  HOST_BANK_FLASH, utilities_r3.h places the segments there), written as plain memory: a
+ *  segment erase does not set it to 0xFF. The CRC module is not modelled, the Makefile
+ *  defines CRC16_SOFTWARE.
+ *
+ *  Created on: Oct 19, 2026
+ */
+#ifndef HOST_MSP430F5528_H_
+#define HOST_MSP430F5528_H_
+
+/*************************************************************************
+  *   $INTRINSICS
+*************************************************************************/
+#define __interrupt
+#define _no_operation()               ((void)0)
+#define __no_operation()              ((void)0)
+#define _disable_interrupt()          ((void)0)
+#define _enable_interrupt()           ((void)0)
+#define _disable_interrupts()         ((void)0)
+#define _enable_interrupts()          ((void)0)
+#define __disable_interrupt()         ((void)0)
+#define __enable_interrupt()          ((void)0)
+#define __get_interrupt_state()       ((unsigned short)0)
+#define __set_interrupt_state(s)      ((void)(s))
+#define __delay_cycles(x)             ((void)(x))
+#define _delay_cycles(x)              ((void)(x))
+#define __bis_SR_register(x)          ((void)(x))
+#define __bic_SR_register(x)          ((void)(x))
+#define _bic_SR_register_on_exit(x)   ((void)(x))
+#define __bic_SR_register_on_exit(x)  ((void)(x))
+#define __get_SR_register()           0
+#define __even_in_range(a,b)          (a)
+
+/*************************************************************************
+  *   $REGISTERS
+*************************************************************************/
+#ifndef HOST_REG
+#define HOST_REG(r)   extern volatile unsigned int r
+#endif
+// Watchdog, ports
+HOST_REG(WDTCTL);
+HOST_REG(P1IN);  HOST_REG(P1OUT); HOST_REG(P1DIR); HOST_REG(P1SEL); HOST_REG(P1DS);
+HOST_REG(P1IES); HOST_REG(P1IFG); HOST_REG(P1IE);  HOST_REG(P1REN);
+HOST_REG(P2DIR); HOST_REG(P2SEL); HOST_REG(P3SEL);
+HOST_REG(P4SEL); HOST_REG(P4DIR); HOST_REG(P4OUT); HOST_REG(P4DS);
+HOST_REG(P5OUT); HOST_REG(P5DIR); HOST_REG(P5SEL); HOST_REG(P5REN);
+// USCI A0 (High Speed Bus) and A1 (Hart)
+HOST_REG(UCA0CTL1); HOST_REG(UCA0CTL0); HOST_REG(UCA0BR0); HOST_REG(UCA0BR1); HOST_REG(UCA0MCTL);
+HOST_REG(UCA0IE);   HOST_REG(UCA0STAT); HOST_REG(UCA0TXBUF); HOST_REG(UCA0RXBUF); HOST_REG(UCA0IV);
+HOST_REG(UCA0IFG);
+HOST_REG(UCA1CTL1); HOST_REG(UCA1CTL0); HOST_REG(UCA1BR0); HOST_REG(UCA1BR1); HOST_REG(UCA1MCTL);
+HOST_REG(UCA1IE);   HOST_REG(UCA1STAT); HOST_REG(UCA1TXBUF); HOST_REG(UCA1RXBUF); HOST_REG(UCA1IV);
+HOST_REG(UCA1IFG);
+// Timers
+HOST_REG(TA0R); HOST_REG(TA0CTL); HOST_REG(TA0CCR0); HOST_REG(TA0CCTL0); HOST_REG(TA0CCR1); HOST_REG(TA0CCTL1);
+HOST_REG(TA1R); HOST_REG(TA1CTL); HOST_REG(TA1CCR0); HOST_REG(TA1CCTL0); HOST_REG(TA1CCR1); HOST_REG(TA1CCTL1);
+HOST_REG(TA2R); HOST_REG(TA2CTL); HOST_REG(TA2CCR0); HOST_REG(TA2CCTL0); HOST_REG(TA2CCR1); HOST_REG(TA2CCTL1);
+HOST_REG(TB0R); HOST_REG(TBCTL); HOST_REG(TBCCR0); HOST_REG(TBCCTL0);
+// Clock, power, special functions
+HOST_REG(UCSCTL0); HOST_REG(UCSCTL1); HOST_REG(UCSCTL2); HOST_REG(UCSCTL3); HOST_REG(UCSCTL4);
+HOST_REG(UCSCTL5); HOST_REG(UCSCTL6); HOST_REG(UCSCTL7); HOST_REG(UCSCTL8);
+HOST_REG(SFRIFG1); HOST_REG(SFRIE1);
+HOST_REG(PMMCTL0); HOST_REG(PMMCTL0_H); HOST_REG(PMMCTL0_L); HOST_REG(SVSMHCTL); HOST_REG(SVSMLCTL);
+HOST_REG(PMMIFG);
+HOST_REG(USBKEYPID); HOST_REG(USBPWRCTL);
+HOST_REG(SYSRSTIV); HOST_REG(SYSUNIV); HOST_REG(SYSSNIV);
+// Flash controller, CRC module
+HOST_REG(FCTL1); HOST_REG(FCTL3);
+HOST_REG(CRCINIRES); HOST_REG(CRCDI); HOST_REG(CRCDIRB); HOST_REG(CRCRESR);
+#ifndef HOST_REG_DEFINE
+extern volatile unsigned char CRCDI_L;
+#endif
+
+// Information memory (4 segments at 0x1800) and the DB cache main segment
+#define HOST_INFO_FLASH_SIZE  512
+#define HOST_BANK_FLASH_SIZE  512
+extern unsigned char hostInfoFlash[HOST_INFO_FLASH_SIZE];
+extern unsigned char hostBankFlash[HOST_BANK_FLASH_SIZE];
+#define HOST_INFO_FLASH       hostInfoFlash
+#define HOST_BANK_FLASH       hostBankFlash
+
+/*************************************************************************
+  *   $BITS
+*************************************************************************/
+#define BIT0      (0x0001)
+#define BIT1      (0x0002)
+#define BIT2      (0x0004)
+#define BIT3      (0x0008)
+#define BIT4      (0x0010)
+#define BIT5      (0x0020)
+#define BIT6      (0x0040)
+#define BIT7      (0x0080)
+
+// USCI (device values)
+#define UCSWRST   (0x01)
+#define UCRXEIE   (0x20)
+#define UCSSEL_1  (0x40)
+#define UCSSEL_2  (0x80)
+#define UCPEN     (0x80)
+#define UCPAR     (0x40)
+#define UC7BIT    (0x10)
+#define UCOS16    (0x01)
+#define UCBRS0    (0x02)
+#define UCBRS_2   (0x04)
+#define UCBRF_6   (0x60)
+#define UCBUSY    (0x01)
+#define UCRXERR   (0x04)
+#define UCBRK     (0x08)
+#define UCPE      (0x10)
+#define UCOE      (0x20)
+#define UCFE      (0x40)
+#define UCLISTEN  (0x80)
+#define UCRXIE    (0x01)
+#define UCTXIE    (0x02)
+#define UCRXIFG   (0x01)
+#define UCTXIFG   (0x02)
+
+// Timers
+#define TACLR     (0x0004)
+#define MC_1      (0x0010)
+#define MC_2      (0x0020)
+#define MC_3      (0x0030)
+#define ID_3      (0x00C0)
+#define TASSEL_1  (0x0100)
+#define TBCLR     (0x0004)
+#define TBSSEL_1  (0x0100)
+#define CCIFG     (0x0001)
+#define CCIE      (0x0010)
+#define CAP       (0x0100)
+#define SCS       (0x0800)
+#define CCIS_0    (0x0000)
+#define CM_1      (0x4000)
+#define CM_2      (0x8000)
+
+// Clock system
+#define XT1OFF        (0x0001)
+#define XCAP0_L       (0x0004)
+#define XCAP1_L       (0x0008)
+#define XT1DRIVE0     (0x0040)
+#define XT1DRIVE1     (0x0080)
+#define XT1DRIVE_0    (0x0000)
+#define XT1DRIVE_3    (0x00C0)
+#define XT2OFF        (0x0100)
+#define DCOFFG        (0x0001)
+#define XT1LFOFFG     (0x0002)
+#define XT2OFFG       (0x0008)
+#define SELREF_0      (0x0000)
+#define SELREF_2      (0x0020)
+#define FLLREFDIV__1  (0x0000)
+#define SELM_3        (0x0003)
+#define SELM_4        (0x0004)
+#define SELM_7        (0x0007)
+#define SELS_3        (0x0030)
+#define SELS_4        (0x0040)
+#define SELA_0        (0x0000)
+#define SELA_2        (0x0200)
+#define SELA_7        (0x0700)
+#define DIVM_0        (0x0000)
+#define DIVS_0        (0x0000)
+#define DIVA_0        (0x0000)
+#define DIVPA_0       (0x0000)
+#define DCORSEL_0     (0x0000)
+#define DCORSEL_1     (0x0010)
+#define DCORSEL_2     (0x0020)
+#define DCORSEL_3     (0x0030)
+#define DCORSEL_4     (0x0040)
+#define DCORSEL_5     (0x0050)
+#define FLLD_0        (0x0000)
+#define FLLD_1        (0x1000)
+#define FLLD__1       (0x0000)
+#define FLLD__2       (0x1000)
+#define FLLD__8       (0x3000)
+#define OFIFG         (0x0002)
+#define OFIE          (0x0002)
+
+// Power management
+#define PMMCOREV0     (0x0001)
+#define PMMCOREV_0    (0x0000)
+#define PMMCOREV_1    (0x0001)
+#define PMMCOREV_2    (0x0002)
+#define PMMCOREV_3    (0x0003)
+#define PMMPW         (0xA500)
+#define SVSMLDLYIFG   (0x0001)
+#define SVMLIFG       (0x0002)
+#define SVMLVLRIFG    (0x0004)
+#define SVSMLRRL0     (0x0001)
+#define SVSMLRRL_3    (0x0003)
+#define SVSLRVL0      (0x0200)
+#define SVMLE         (0x0010)
+#define SVSLE         (0x0400)
+#define SVSMHRRL0     (0x0001)
+#define SVSHRVL0      (0x0200)
+#define SVMHE         (0x0010)
+#define SVSHE         (0x0400)
+#define SLDOEN        (0x0100)
+#define VUSBEN        (0x0800)
+
+// Watchdog, flash, status register
+#define WDTPW         (0x5A00)
+#define WDTHOLD       (0x0080)
+#define WDTSSEL_1     (0x0020)
+#define WDTCNTCL      (0x0008)
+#define WDTIS_4       (0x0004)
+#define FWKEY         (0xA500)
+#define ERASE         (0x0002)
+#define WRT           (0x0040)
+#define BUSY          (0x0001)
+#define LOCK          (0x0010)
+#define WAIT          (0x0100)      // One of the FWKEY bits: FCTL3 reads back as written, the flash is always ready
+#define GIE           (0x0008)
+#define SCG0          (0x0040)
+#define SCG0_BIT      (0x0040)
+#define LPM0_bits     (0x0010)
+#define LPM3_bits     (0x00D0)
+
+#endif /* HOST_MSP430F5528_H_ */
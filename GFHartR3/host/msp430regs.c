@@ -0,0 +1,13 @@
+/*!
+ *  \file   msp430regs.c
+ *  \brief  Storage for the peripheral registers and the data flash of the host build, see msp430f5528.h
+ *
+ *  Created on: Oct 19, 2026
+ */
+#define HOST_REG_DEFINE
+#define HOST_REG(r)   volatile unsigned int r
+#include <msp430f5528.h>
+
+volatile unsigned char CRCDI_L;
+unsigned char hostInfoFlash[HOST_INFO_FLASH_SIZE];
+unsigned char hostBankFlash[HOST_BANK_FLASH_SIZE];
@@ -28,7 +28,8 @@ MEMORY
     INFOB                   : origin = 0x1900, length = 0x0080
     INFOC                   : origin = 0x1880, length = 0x0080
     INFOD                   : origin = 0x1800, length = 0x0080
-    FLASH                   : origin = 0x4400, length = 0xBB80
+    DBCACHE                 : origin = 0x4400, length = 0x0200  /* 9900 database cache, one main flash segment */
+    FLASH                   : origin = 0x4600, length = 0xB980
     FLASH2                  : origin = 0x10000,length = 0x14400
     INT00                   : origin = 0xFF80, length = 0x0002
     INT01                   : origin = 0xFF82, length = 0x0002
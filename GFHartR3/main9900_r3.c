@@ -16,11 +16,15 @@
 ///////////////////////////////////////////////////////////////////////////////////////////
 #include <msp430f5528.h>
 #include <string.h>
+#include <stddef.h>
 #include "hardware.h"
 #include "hart_r3.h"
 #include "main9900_r3.h"
 #include "driverUart.h"
 #include "protocols.h"
+#include "hartcommand_r3.h"
+#include "common_h_cmd_r3.h"
+#include "utilities_r3.h"
 ///////////////////////////////////////////////////////////////////////////////////////////
 //  LOCAL DEFINES
 ///////////////////////////////////////////////////////////////////////////////////////////
@@ -33,10 +37,39 @@
 //  GLOBAL DATA
 ///////////////////////////////////////////////////////////////////////////////////////////
 
-U_DATABASE_9900 u9900Database;          //!< 9900 Database
-BOOLEAN hostActive = FALSE;             //!< Flag indicating that we have a host actively communicating
+stHsbContext hsbCtx;                    //!< 9900 Database, HSB buffers and receiver, hostActive flag
 BOOLEAN comm9900started = FALSE;
 
+/*!
+ * Hex-ASCII decode table
+ *
+ * The nibble value of '0'..'9' and 'A'..'F', any other character maps to HEX_INVALID
+ * so the validation is folded into the lookup
+ */
+#define BAD HEX_INVALID
+const int8u hexDecodeTable[256] =
+{
+	BAD, BAD, BAD, BAD, BAD, BAD, BAD, BAD, BAD, BAD, BAD, BAD, BAD, BAD, BAD, BAD,	// 0x00
+	BAD, BAD, BAD, BAD, BAD, BAD, BAD, BAD, BAD, BAD, BAD, BAD, BAD, BAD, BAD, BAD,	// 0x10
+	BAD, BAD, BAD, BAD, BAD, BAD, BAD, BAD, BAD, BAD, BAD, BAD, BAD, BAD, BAD, BAD,	// 0x20
+	0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, BAD, BAD, BAD, BAD, BAD, BAD,	// 0x30
+	BAD, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E, 0x0F, BAD, BAD, BAD, BAD, BAD, BAD, BAD, BAD, BAD,	// 0x40
+	BAD, BAD, BAD, BAD, BAD, BAD, BAD, BAD, BAD, BAD, BAD, BAD, BAD, BAD, BAD, BAD,	// 0x50
+	BAD, BAD, BAD, BAD, BAD, BAD, BAD, BAD, BAD, BAD, BAD, BAD, BAD, BAD, BAD, BAD,	// 0x60
+	BAD, BAD, BAD, BAD, BAD, BAD, BAD, BAD, BAD, BAD, BAD, BAD, BAD, BAD, BAD, BAD,	// 0x70
+	BAD, BAD, BAD, BAD, BAD, BAD, BAD, BAD, BAD, BAD, BAD, BAD, BAD, BAD, BAD, BAD,	// 0x80
+	BAD, BAD, BAD, BAD, BAD, BAD, BAD, BAD, BAD, BAD, BAD, BAD, BAD, BAD, BAD, BAD,	// 0x90
+	BAD, BAD, BAD, BAD, BAD, BAD, BAD, BAD, BAD, BAD, BAD, BAD, BAD, BAD, BAD, BAD,	// 0xA0
+	BAD, BAD, BAD, BAD, BAD, BAD, BAD, BAD, BAD, BAD, BAD, BAD, BAD, BAD, BAD, BAD,	// 0xB0
+	BAD, BAD, BAD, BAD, BAD, BAD, BAD, BAD, BAD, BAD, BAD, BAD, BAD, BAD, BAD, BAD,	// 0xC0
+	BAD, BAD, BAD, BAD, BAD, BAD, BAD, BAD, BAD, BAD, BAD, BAD, BAD, BAD, BAD, BAD,	// 0xD0
+	BAD, BAD, BAD, BAD, BAD, BAD, BAD, BAD, BAD, BAD, BAD, BAD, BAD, BAD, BAD, BAD,	// 0xE0
+	BAD, BAD, BAD, BAD, BAD, BAD, BAD, BAD, BAD, BAD, BAD, BAD, BAD, BAD, BAD, BAD	// 0xF0
+};
+#undef BAD
+//! Hex-ASCII encode table, uppercase as the 9900 expects
+const int8u hexEncodeTable[16] = { '0','1','2','3','4','5','6','7','8','9','A','B','C','D','E','F' };
+
 BOOLEAN updateMsgRcvd = FALSE;      //!< Flag indicating an update message has been received from the 9900 and HART communications can begin
 BOOLEAN databaseOk  = FALSE;        //!< Database loaded OK flag
 
@@ -64,27 +97,23 @@ int8u varStatus = UPDATE_STATUS_GOOD;
 // RE-ARRANGING CODE BELLOW
 
 
-// Buffer for the commands from the 9900
-unsigned char sz9900CmdBuffer [MAX_9900_CMD_SIZE];
-// Buffer for the response to the 9900
-unsigned char sz9900RespBuffer [MAX_9900_RESP_SIZE];
-// the size of the response
-volatile unsigned int responseSize = 0;       // This is a critical variable 12/21/12
+// The 9900 command/response buffers and the response size (a critical variable 12/21/12) live in hsbCtx
 
 // Transmitted character counter
 unsigned int numMainXmitChars = 0;
 // If the update is delayed, set this flag
 int8u updateDelay = FALSE;
-// A request is made by the HART master
-int8u request = RESP_REQ_SAVE_AND_RESTART_LOOP;
-// There is usually a value for a request
-float requestValue = 0.0;
-float rangeRequestUpper = 0.0;
+/*!
+ *  HART --> 9900 request queue
+ *
+ *  Requests made by the HART masters wait here until a Poll or Update response hands them
+ *  to the 9900, oldest first. Power up starts with a save & restart request.
+ */
+static st9900Request reqQueue[MAX_9900_REQUESTS] = { { RESP_REQ_SAVE_AND_RESTART_LOOP, 0.0 } };
+static int8u reqHead = 0;               //!< Oldest pending request
+static int8u reqCount = 1;              //!< Number of pending requests
 // Loop mode is either operational, fixed 4, or fixed 20
 int8u loopMode = LOOP_OPERATIONAL;
-// We have to queue requests for responses 1 and 3 
-int8u queueResp1 = FALSE;
-int8u queueResp3 = FALSE;
 // If we go to constant current mode, we need to see whether a save
 // is required when the loop goes operational again
 int8u saveRequested = FALSE;
@@ -103,6 +132,8 @@ unsigned char transmitMode = FALSE;
 unsigned int modeUpdateCount = 0;
 // Device Variable Status for PV. initialize to BAD, constant
 unsigned char PVvariableStatus = VAR_STATUS_BAD | LIM_STATUS_CONST;
+// PV derived values, refreshed by refreshPvDerived()
+stPvDerived pvDerived;
 // The timer for signaling HART is update messages don't occur
 unsigned long UpdateMsgTimeout = 0;
 
@@ -157,14 +188,14 @@ BOOLEAN Process9900Command(void)
 	// First, make sure the command is for the HART modem.
 	// First character must be an ATTENTION character, followed 
 	// by the HART_COMMAND character. If not, then return.
-	if ((ATTENTION != sz9900CmdBuffer[CMD_ATTN_IDX]) || 
-		(HART_ADDRESS != sz9900CmdBuffer[CMD_ADDR_IDX]))
+	if ((ATTENTION != hsbCtx.cmd[CMD_ATTN_IDX]) || 
+		(HART_ADDRESS != hsbCtx.cmd[CMD_ADDR_IDX]))
 	{
 		// either it isn't a command or it's not for the HART module
 		return FALSE;
 	}
 	// The command type is the 3rd character in the command
-	switch (sz9900CmdBuffer[CMD_CMD_IDX])
+	switch (hsbCtx.cmd[CMD_CMD_IDX])
 	{
 	case HART_POLL:
 		Process9900Poll();
@@ -177,16 +208,15 @@ BOOLEAN Process9900Command(void)
 		{
 			// reset the update reminder count
 			modeUpdateCount = 0;
-			if (databaseOk)
+			if (databaseUsable())
 			{
 				// Now check the flash to make sure the current mode is
 				// set correctly
-				if (CURRENT_MODE_DISABLE == startUpDataLocalNv.currentMode)
+				if (CURRENT_MODE_DISABLE == hartDevice.nv.currentMode)
 				{
 					// Tell the 9900 to go to fixed current mode at 4 mA
 					setFixedCurrentMode(4.0);
-					setPrimaryStatusBits(FD_STATUS_PV_ANALOG_FIXED);
-					setSecondaryStatusBits(FD_STATUS_PV_ANALOG_FIXED);
+					setStatusBits(STATUS_BOTH, FD_STATUS_PV_ANALOG_FIXED);
 					currentMsgSent = FIXED_CURRENT_MESSAGE_SENT;
 				}
 				else // NOT in multidrop mode
@@ -197,8 +227,7 @@ BOOLEAN Process9900Command(void)
 					{
 						// Tell the 9900 to go to loop reporting current mode
 						setFixedCurrentMode(0.0);
-						clrPrimaryStatusBits(FD_STATUS_PV_ANALOG_FIXED);
-						clrSecondaryStatusBits(FD_STATUS_PV_ANALOG_FIXED);
+						clrStatusBits(STATUS_BOTH, FD_STATUS_PV_ANALOG_FIXED);
 						currentMsgSent = LOOP_CURRENT_MESSAGE_SENT;
 					}
 					else
@@ -206,8 +235,7 @@ BOOLEAN Process9900Command(void)
 						// Tell the 9900 to go to fixed current mode at 
 						// the last requested command value
 						setFixedCurrentMode(lastRequestedCurrentValue);
-						setPrimaryStatusBits(FD_STATUS_PV_ANALOG_FIXED);
-						setSecondaryStatusBits(FD_STATUS_PV_ANALOG_FIXED);
+						setStatusBits(STATUS_BOTH, FD_STATUS_PV_ANALOG_FIXED);
 					}
 				}
 				// Set the 9900 comm flag true so that the timeout will not occur
@@ -221,6 +249,9 @@ BOOLEAN Process9900Command(void)
 	case HART_DB_LOAD:
 		Process9900DatabaseLoad();
 		break;
+	case HART_DB_QUERY:
+		Process9900DatabaseQuery();
+		break;
 	default:
 		// We have no idea what the message is, but it has a <CR>, so NACK it
 		Nack9900Msg();
@@ -229,6 +260,138 @@ BOOLEAN Process9900Command(void)
 	return TRUE;
 }
 
+///////////////////////////////////////////////////////////////////////////////////////////
+//
+// Function Name: queue9900Request()
+//
+// Description:
+//
+//     Queues a loop request for the 9900
+//
+// Parameters:
+//     int8u request - one of RESP_REQ_xx
+//     float value - the value sent with the request
+//
+// Return Type: BOOLEAN - TRUE if queued, FALSE if the queue is full
+//
+// Implementation notes:
+//
+//     A request with the same code as the last pending one replaces it (e.g. a later
+//     set-fixed replaces an earlier one). Only the tail is coalesced so the order of
+//     different requests (range, then save & restart) is kept
+//
+/////////////////////////////////////////////////////////////////////////////////////////// 
+BOOLEAN queue9900Request(int8u request, float value)
+{
+	st9900Request *pTail;
+
+	if (reqCount)
+	{
+		pTail = &reqQueue[(reqHead + reqCount - 1) % MAX_9900_REQUESTS];
+		if (pTail->request == request)
+		{
+			pTail->value = value;
+			return TRUE;
+		}
+	}
+	if (MAX_9900_REQUESTS == reqCount)
+	{
+		return FALSE;
+	}
+	pTail = &reqQueue[(reqHead + reqCount) % MAX_9900_REQUESTS];
+	pTail->request = request;
+	pTail->value = value;
+	++reqCount;
+	return TRUE;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////
+//
+// Function Name: is9900QueueFree()
+//
+// Description:
+//
+//     Tells if a sequence of loop requests fits in the 9900 request queue
+//
+// Parameters:
+//     int8u count - the number of requests to queue
+//
+// Return Type: BOOLEAN - TRUE if all of them can be queued
+//
+// Implementation notes:
+//
+//     Coalescing is not counted on, so a TRUE is sure. Call before changing the local DB,
+//     so a request that cannot reach the 9900 changes nothing
+//
+/////////////////////////////////////////////////////////////////////////////////////////// 
+static BOOLEAN is9900QueueFree(int8u count)
+{
+	return (MAX_9900_REQUESTS - reqCount >= count) ? TRUE : FALSE;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////
+//
+// Function Name: build9900Response()
+//
+// Description:
+//
+//     Builds the Poll/Update response, "H,<req>,<status>[,<value>[,<req>,<value>]]\r"
+//
+// Parameters: int8u status - the host status, one of RESP_xx
+//
+// Return Type: void.
+//
+// Implementation notes:
+//
+//     The 9900 gets the oldest pending request, with its value. A 9900 that reported
+//     CAPS_BATCH_REQUESTS in its last update gets up to MAX_9900_BATCH_REQUESTS requests,
+//     each extra one as ",<req>,<value>". Sent requests are dequeued
+//
+/////////////////////////////////////////////////////////////////////////////////////////// 
+static void build9900Response(int8u status)
+{
+	int8u maxRequests = (hsbCtx.batchCapable) ? MAX_9900_BATCH_REQUESTS : 1;
+	int8u numSent = 0;
+	st9900Request *pReq;
+
+	hsbCtx.respSize = 0;
+	hsbCtx.resp[RSP_ADDR_IDX] = HART_ADDRESS;
+	++hsbCtx.respSize;
+	hsbCtx.resp[RSP_ADDR_IDX+1] = HART_SEPARATOR;
+	++hsbCtx.respSize;
+	hsbCtx.resp[RSP_REQ_IDX] = (reqCount) ? reqQueue[reqHead].request : RESP_REQ_NO_REQ;
+	++hsbCtx.respSize;
+	hsbCtx.resp[RSP_REQ_IDX+1] = HART_SEPARATOR;
+	++hsbCtx.respSize;
+	hsbCtx.resp[RSP_STATUS_IDX] = status;
+	++hsbCtx.respSize;
+	while (reqCount && numSent < maxRequests)
+	{
+		pReq = &reqQueue[reqHead];
+		// The first request code is in the header, the rest precede their value
+		if (numSent)
+		{
+			hsbCtx.resp[hsbCtx.respSize] = HART_SEPARATOR;
+			++hsbCtx.respSize;
+			hsbCtx.resp[hsbCtx.respSize] = pReq->request;
+			++hsbCtx.respSize;
+		}
+		// Put in the separator
+		hsbCtx.resp[hsbCtx.respSize] = HART_SEPARATOR;
+		++hsbCtx.respSize;
+		// Send the value
+		convertFloatToAscii(pReq->value, &(hsbCtx.resp[hsbCtx.respSize]));
+		hsbCtx.respSize += 8;
+		// Done with this one
+		reqHead = (reqHead + 1) % MAX_9900_REQUESTS;
+		--reqCount;
+		++numSent;
+	}
+	// Carriage return
+	hsbCtx.resp[hsbCtx.respSize] = HART_MSG_END;
+	++hsbCtx.respSize;
+}
+
 ///////////////////////////////////////////////////////////////////////////////////////////
 //
 // Function Name: Process9900Poll()
@@ -249,14 +412,14 @@ BOOLEAN Process9900Command(void)
 void Process9900Poll(void)
 {
 	// Set the response size to 0 to start
-	responseSize = 0;
+	hsbCtx.respSize = 0;
 	// capture the last comm status
-	lastCommStatus = sz9900CmdBuffer[CMD_FIRST_DATA];
+	lastCommStatus = hsbCtx.cmd[CMD_FIRST_DATA];
 	// determine the status to reply with
 	int8u status;
 	if (databaseOk)
 	{
-		if (hostActive)
+		if (hsbCtx.hostActive)
 		{
 			if (hostError)
 			{
@@ -276,52 +439,8 @@ void Process9900Poll(void)
 	{
 		status = RESP_NO_OR_BAD_DB;
 	}
-	// Build the poll response
-	sz9900RespBuffer[RSP_ADDR_IDX] = HART_ADDRESS;
-	++responseSize;
-	sz9900RespBuffer[RSP_ADDR_IDX+1] = HART_SEPARATOR;
-	++responseSize;
-	sz9900RespBuffer[RSP_REQ_IDX] = request;
-	++responseSize;
-	sz9900RespBuffer[RSP_REQ_IDX+1] = HART_SEPARATOR;
-	++responseSize;
-	sz9900RespBuffer[RSP_STATUS_IDX] = status;
-	++responseSize;
-	if (RESP_REQ_NO_REQ == request)
-	{
-		sz9900RespBuffer[RSP_STATUS_IDX+1] = HART_MSG_END;
-		++responseSize;
-	}
-	else
-	{
-		// Put in the separator
-		sz9900RespBuffer[responseSize] = HART_SEPARATOR;
-		++responseSize;
-		// Send the value back
-		convertFloatToAscii(requestValue, &(sz9900RespBuffer[responseSize]));
-		responseSize += 8;
-		// Carriage return
-		sz9900RespBuffer[responseSize] = HART_MSG_END;
-		++responseSize;
-		// Now, reset the request to none, 1, or 3
-		if (queueResp1)
-		{
-			queueResp1 = FALSE;
-			request = RESP_REQ_SAVE_AND_RESTART_LOOP;
-			requestValue = 0.0;
-		}
-		else if (queueResp3)
-		{
-			queueResp3 = FALSE;
-			queueResp1 = TRUE;
-			request = RESP_REQ_CHANGE_20MA_POINT;
-			requestValue = rangeRequestUpper;
-		}
-		else
-		{
-			request = RESP_REQ_NO_REQ;
-		}
-	}
+	// Build the response, handing the pending requests to the 9900
+	build9900Response(status);
 	// Signal that a loop change request has been sent
 	if (TRUE == updateInProgress)
 	{
@@ -350,109 +469,86 @@ void Process9900Poll(void)
 /////////////////////////////////////////////////////////////////////////////////////////// 
 void Process9900Update(void)
 {
-	fp32 tempVal;
-	int index;
-	int success;
-	int8u tempChar;
-	responseSize = 0;
-	// Work through the message, upadating everything
-	// grab the PV as bytes
-	for (index = 0; index < 4; ++index)
-	{
-		success = HexAsciiToByte(sz9900CmdBuffer+UPDATE_PV_START_INDEX + (2*index), &tempChar);
-		if (success)
-		{
-			tempVal.byteVal[index] = tempChar;
-		}
-		else
-		{
-			// respond with a NACK
-			Nack9900Msg();
-			// no sense going further, return
-			return;
-		}
-	}
-	// If we're here, it means we picked up the PV, so write the new value
-	PVvalue = tempVal.floatVal;
-	// the next 4 bytes are the secondary value, which may or may not be real.
-	for (index = 0; index < 4; ++index)
+	float newPV, newSV, newLoop;
+	int8u caps;
+	hsbCtx.respSize = 0;
+	// Work through the message, upadating everything. Decode the PV, SV and loop
+	// current first, so nothing is written unless the three values are good
+	if (!HexAsciiToFloat(hsbCtx.cmd+UPDATE_PV_START_INDEX, &newPV) ||
+		// the next 4 bytes are the secondary value, which may or may not be real.
+		!HexAsciiToFloat(hsbCtx.cmd+UPDATE_SV_START_INDEX, &newSV) ||
+		// the next 4 bytes are the loop current value.
+		!HexAsciiToFloat(hsbCtx.cmd+UPDATE_MA4_20_START_INDEX, &newLoop))
 	{
-		success = HexAsciiToByte(sz9900CmdBuffer+UPDATE_SV_START_INDEX + (2*index), &tempChar);
-		if (success)
-		{
-			tempVal.byteVal[index] = tempChar;
-		}
-		else
-		{
-			// respond with a NACK
-			Nack9900Msg();
-			// no sense going further, return
-			return;
-		}
-	}
-	// If we're here, it means we picked up the SV, so write the new value
-	SVvalue = tempVal.floatVal;
-	// the next 4 bytes are the loop current value.
-	for (index = 0; index < 4; ++index)
-	{
-		success = HexAsciiToByte(sz9900CmdBuffer+UPDATE_MA4_20_START_INDEX + (2*index), &tempChar);
-		if (success)
-		{
-			tempVal.byteVal[index] = tempChar;
-		}
-		else
-		{
-			// respond with a NACK
-			Nack9900Msg();
-			// no sense going further, return
-			return;
-		}
+		// respond with a NACK
+		Nack9900Msg();
+		// no sense going further, return
+		return;
 	}
-	// If we're here, it means we picked up the loop current, so write the new value
-	ma4_20 = tempVal.floatVal;
+	// If we're here, it means we picked up all three, so write the new values
+	PVvalue = newPV;
+	SVvalue = newSV;
+	ma4_20 = newLoop;
 	// Now the var status
-	varStatus = sz9900CmdBuffer[UPDATE_VAR_STATUS_INDEX];
+	varStatus = hsbCtx.cmd[UPDATE_VAR_STATUS_INDEX];
 	// Per +GF+, set the "PV out of range" bit when the status is anything other
 	// than good from the 9900
 	if (UPDATE_STATUS_GOOD == varStatus)
 	{
-		clrPrimaryStatusBits(FD_STATUS_PV_OUT_OF_LIMITS);
-		clrSecondaryStatusBits(FD_STATUS_PV_OUT_OF_LIMITS);
-		startUpDataLocalV.StandardStatus0 &= ~SS0_HARDWARE_PROBLEM;
+		clrStatusBits(STATUS_BOTH, FD_STATUS_PV_OUT_OF_LIMITS);
+		hartDevice.v.StandardStatus0 &= ~SS0_HARDWARE_PROBLEM;
 		if (varStatus != lastVarStatus)
 		{ 
-			clrPrimaryMoreAvailable();
-			clrSecondaryMoreAvailable();
+			clrStatusBits(STATUS_BOTH, FD_STATUS_MORE_STATUS_AVAIL);
 		}
 	}
 	else
 	{
-		setPrimaryStatusBits(FD_STATUS_PV_OUT_OF_LIMITS);
-		setSecondaryStatusBits(FD_STATUS_PV_OUT_OF_LIMITS);
-		startUpDataLocalV.StandardStatus0 |= SS0_HARDWARE_PROBLEM;
+		setStatusBits(STATUS_BOTH, FD_STATUS_PV_OUT_OF_LIMITS);
+		hartDevice.v.StandardStatus0 |= SS0_HARDWARE_PROBLEM;
 		if (varStatus != lastVarStatus)
 		{ 
-			setPrimaryMoreAvailable();
-			setSecondaryMoreAvailable();
+			setStatusBits(STATUS_BOTH, FD_STATUS_MORE_STATUS_AVAIL);
 		}
 	}
 	// Save the var status for the next update
 	lastVarStatus = varStatus;
 	// Now save the comm status
-	lastCommStatus = sz9900CmdBuffer[UPDATE_COMM_STATUS_INDEX];
+	lastCommStatus = hsbCtx.cmd[UPDATE_COMM_STATUS_INDEX];
+	// A 9900 that can take batched requests says so after the comm status, an older one ends
+	// the message there and keeps getting one request per response
+	caps = (HART_SEPARATOR == hsbCtx.cmd[UPDATE_CAPS_SEP_INDEX]) ?
+		hexDecodeTable[hsbCtx.cmd[UPDATE_CAPS_INDEX]] : 0;
+	hsbCtx.batchCapable = (!(caps & 0xF0) && (caps & CAPS_BATCH_REQUESTS)) ? TRUE : FALSE;
 	// If we're here, we can build a normal response
 	// determine the status to reply with
-	// If both update flags are set, clear them
-	if ((TRUE == updateInProgress) && (TRUE == updateRequestSent) && 
-		(POLL_LAST_REQ_GOOD == lastCommStatus))
+	// If both update flags are set and every queued request went out, clear them
+	// and end the delayed responses waiting on the loop
+	if ((TRUE == updateInProgress) && (TRUE == updateRequestSent) && !reqCount)
+	{
+		if (POLL_LAST_REQ_GOOD == lastCommStatus)
+		{
+			updateRequestSent = FALSE;
+			updateInProgress = FALSE;
+			drComplete(TRUE, RESP_SUCCESS);
+		}
+		else if (POLL_LAST_REQ_BAD == lastCommStatus)
+		{
+			// The 9900 refused it: report the measured loop current again
+			updateRequestSent = FALSE;
+			updateInProgress = FALSE;
+			drComplete(TRUE, DR_DEAD);
+		}
+	}
+	// Fresh values, end the delayed reads
+	if (!updateDelay)
 	{
-		updateRequestSent = FALSE;
-		updateInProgress = FALSE;
+		drComplete(FALSE, RESP_SUCCESS);
 	}
 	int8u status;
 	if (databaseOk)
 	{
-		if (hostActive)
+		if (hsbCtx.hostActive)
 		{
 			if (hostError)
 			{
@@ -472,63 +568,193 @@ void Process9900Update(void)
 	{
 		status = RESP_NO_OR_BAD_DB;
 	}
-	// Build the update response
-	sz9900RespBuffer[RSP_ADDR_IDX] = HART_ADDRESS;
-	++responseSize;
-	sz9900RespBuffer[RSP_ADDR_IDX+1] = HART_SEPARATOR;
-	++responseSize;
-	sz9900RespBuffer[RSP_REQ_IDX] = request;
-	++responseSize;
-	sz9900RespBuffer[RSP_REQ_IDX+1] = HART_SEPARATOR;
-	++responseSize;
-	sz9900RespBuffer[RSP_STATUS_IDX] = status;
-	++responseSize;
-	if (RESP_REQ_NO_REQ == request)
+	// Build the response, handing the pending requests to the 9900
+	build9900Response(status);
+	// Signal that a loop change request has been sent
+	if (TRUE == updateInProgress)
 	{
-		sz9900RespBuffer[RSP_STATUS_IDX+1] = HART_MSG_END;
-		++responseSize;
+		updateRequestSent = TRUE;
 	}
-	else
+	// Load the transmit buffer & send
+	startMainXmit();	
+	// Set the flag TRUE so HART communications can begin
+	updateMsgRcvd = TRUE;
+	// Calculate the status for HART
+	updatePVstatus();
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////
+//
+// Function Name: dbLoadSum()
+//
+// Description:
+//
+//     Sums database bytes, leaving out the checksum field
+//
+// Parameters: int8u start - the first byte
+//             int8u count - the number of bytes
+//
+// Return Type: int16u - the sum.
+//
+/////////////////////////////////////////////////////////////////////////////////////////// 
+static int16u dbLoadSum(int8u start, int8u count)
+{
+	int16u sum = 0;
+	int8u end = (start + count > DB_CHECKSUM_OFFSET) ? DB_CHECKSUM_OFFSET : start + count;
+
+	for (; start < end; ++start)
 	{
-		// Put in the request
-		sz9900RespBuffer[responseSize] = HART_SEPARATOR;
-		++responseSize;
-		// Send the value back
-		convertFloatToAscii(requestValue, &(sz9900RespBuffer[responseSize]));
-		responseSize += 8;
-		// Carriage return
-		sz9900RespBuffer[responseSize] = HART_MSG_END;
-		++responseSize;
-		// Now, reset the request to none, 1, or 3
-		if (queueResp1)
-		{
-			queueResp1 = FALSE;
-			request = RESP_REQ_SAVE_AND_RESTART_LOOP;
-			requestValue = 0.0;
-		}
-		else if (queueResp3)
+		sum += hsbCtx.database.bytes[start];
+	}
+	return sum;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////
+//
+// Function Name: dbLoadOpen()
+//
+// Description:
+//
+//     Opens a new database load, nothing received yet
+//
+// Parameters: BOOLEAN delta - TRUE for a delta load
+//
+// Return Type: void.
+//
+// Implementation notes:
+//
+//     The sum starts over from the held bytes: the range commands write the database
+//     without going through a load
+//
+/////////////////////////////////////////////////////////////////////////////////////////// 
+static void dbLoadOpen(BOOLEAN delta)
+{
+	stDbLoad *pLoad = &hsbCtx.dbLoad;
+
+	pLoad->runningSum = dbLoadSum(0, DB_CHECKSUM_OFFSET);
+	memset(pLoad->coverage, 0, DB_COVERAGE_BYTES);
+	pLoad->bytesCovered = 0;
+	pLoad->inProgress = TRUE;
+	pLoad->delta = delta;
+	pLoad->lastCount = 0xFF;	// No chunk can repeat this one
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////
+//
+// Function Name: dbLoadChunk()
+//
+// Description:
+//
+//     Decodes one $HD chunk into the database and accounts for it in the load progress
+//
+// Parameters: int8u start - offset of the chunk in the database
+//             int8u count - the number of bytes, already checked to fit
+//
+// Return Type: int - TRUE if the chunk was taken, FALSE if it overlaps the bytes already
+//             received or is not valid hex.
+//
+// Implementation notes:
+//
+// A chunk with no load open opens a full load, and so does a chunk at offset 0 in a full
+// load. A repeat of the previous chunk (the 9900 missed our ACK) simply replaces it.
+// The old bytes of the chunk leave the sum before the new ones are added.
+// The chunk is decoded aside and only copied when all of it is valid hex, so the Hart
+// commands never see a partial chunk. A bad chunk closes the load and is no previous chunk
+// a repeat could match: the 9900 must start over
+//
+/////////////////////////////////////////////////////////////////////////////////////////// 
+static int dbLoadChunk(int8u start, int8u count)
+{
+	stDbLoad *pLoad = &hsbCtx.dbLoad;
+	BOOLEAN repeat = (start == pLoad->lastStart && count == pLoad->lastCount);
+	int8u chunk[DB_MAX_BYTES_PER_MSG];
+	int8u idx;
+
+	if (!repeat)
+	{
+		if (!pLoad->inProgress || (0 == start && !pLoad->delta))
 		{
-			queueResp3 = FALSE;
-			queueResp1 = TRUE;
-			request = RESP_REQ_CHANGE_20MA_POINT;
-			requestValue = rangeRequestUpper;
+			dbLoadOpen(FALSE);
 		}
-		else
+		for (idx = start; idx < start + count; ++idx)
 		{
-			request = RESP_REQ_NO_REQ;
+			if (pLoad->coverage[idx >> 3] & (1 << (idx & 7)))
+			{
+				return FALSE;
+			}
 		}
 	}
-	// Signal that a loop change request has been sent
-	if (TRUE == updateInProgress)
+	if (!HexAsciiToBytes(hsbCtx.cmd+DB_FIRST_DATA_IDX, chunk, count))
 	{
-		updateRequestSent = TRUE;
+		pLoad->inProgress = FALSE;
+		pLoad->lastCount = 0xFF;
+		return FALSE;
 	}
+	// From here on the held database is no longer the cached one
+	hsbCtx.dbProvisional = FALSE;
+	pLoad->runningSum -= dbLoadSum(start, count);
+	memcpy(&hsbCtx.database.bytes[start], chunk, count);
+	pLoad->runningSum += dbLoadSum(start, count);
+	if (!repeat)
+	{
+		for (idx = start; idx < start + count; ++idx)
+		{
+			pLoad->coverage[idx >> 3] |= (1 << (idx & 7));
+		}
+		pLoad->bytesCovered += count;
+	}
+	pLoad->lastStart = start;
+	pLoad->lastCount = count;
+	return TRUE;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////
+//
+// Function Name: Process9900DatabaseQuery()
+//
+// Description:
+//
+//     Reports the database the module holds and opens a delta load, sends response 
+//
+// Parameters: void
+//
+// Return Type: void.
+//
+// Implementation notes:
+//
+// The 9900 compares the checksum and CRC with its own database. When they match it
+// only sends the DB_LAST_MESSAGE chunk, with no data, to confirm the held database,
+// otherwise the ranges that differ. The CRC is calcCrc16() over the whole database,
+// checksum included. The DB_LAST_MESSAGE chunk of the delta load ends with the CRC of
+// the 9900 database, the load is only taken if the held database then has the same
+//
+/////////////////////////////////////////////////////////////////////////////////////////// 
+void Process9900DatabaseQuery(void)
+{
+	int16u crc = calcCrc16(hsbCtx.database.bytes, sizeof(DATABASE_9900));
+	int8u field[2];
+
+	dbLoadOpen(TRUE);
+	hsbCtx.respSize = 0;
+	hsbCtx.resp[hsbCtx.respSize++] = HART_ADDRESS;
+	hsbCtx.resp[hsbCtx.respSize++] = HART_SEPARATOR;
+	hsbCtx.resp[hsbCtx.respSize++] = HART_DB_INFO;
+	hsbCtx.resp[hsbCtx.respSize++] = HART_SEPARATOR;
+	hsbCtx.resp[hsbCtx.respSize++] = (hsbCtx.dbLoad.runningSum == hsbCtx.database.db.checksum) ? 
+		DB_HELD_VALID : DB_HELD_INVALID;
+	hsbCtx.resp[hsbCtx.respSize++] = HART_SEPARATOR;
+	field[0] = (int8u)(hsbCtx.database.db.checksum >> 8);
+	field[1] = (int8u)hsbCtx.database.db.checksum;
+	BytesToHexAscii(field, &hsbCtx.resp[hsbCtx.respSize], 2);
+	hsbCtx.respSize += 4;
+	hsbCtx.resp[hsbCtx.respSize++] = HART_SEPARATOR;
+	field[0] = (int8u)(crc >> 8);
+	field[1] = (int8u)crc;
+	BytesToHexAscii(field, &hsbCtx.resp[hsbCtx.respSize], 2);
+	hsbCtx.respSize += 4;
+	hsbCtx.resp[hsbCtx.respSize++] = HART_MSG_END;
 	// Load the transmit buffer & send
 	startMainXmit();	
-	// Set the flag TRUE so HART communications can begin
-	updateMsgRcvd = TRUE;
-	// Calculate the status for HART
-	updatePVstatus();
 }
 
 ///////////////////////////////////////////////////////////////////////////////////////////
@@ -551,15 +777,16 @@ void Process9900Update(void)
 void Process9900DatabaseLoad(void)
 {
 	int success;
-	int8u index;
 	int8u numDbBytesSent;
 	int8u startAddress;
-	int8u currentData;
 	int8u msgStatus;
+	BOOLEAN deltaCommit;
+	int8u crcField[2];
+	int8u * pCrcField;
 	
 	// Process the request to load the database
 	// Grab the starting offset into the DB
-	success = HexAsciiToByte((sz9900CmdBuffer+DB_ADDR_START_IDX), &startAddress);
+	success = HexAsciiToByte((hsbCtx.cmd+DB_ADDR_START_IDX), &startAddress);
 	if (!success)
 	{
 		// Set the flag to indicate there's a DB problem
@@ -570,7 +797,7 @@ void Process9900DatabaseLoad(void)
 		return;
 	}
 	// grab the number of bytes being transmitted
-	success = HexAsciiToByte((sz9900CmdBuffer+DB_BYTE_COUNT_IDX), &numDbBytesSent);
+	success = HexAsciiToByte((hsbCtx.cmd+DB_BYTE_COUNT_IDX), &numDbBytesSent);
 	if (!success)
 	{
 		// Set the flag to indicate there's a DB problem
@@ -580,8 +807,19 @@ void Process9900DatabaseLoad(void)
 		// no sense going further, return
 		return;
 	}
+	// The chunk must fit in the command buffer and land inside the database
+	if (numDbBytesSent > DB_MAX_BYTES_PER_MSG ||
+	    (unsigned int)startAddress + numDbBytesSent > sizeof(DATABASE_9900))
+	{
+		// Set the flag to indicate there's a DB problem
+		databaseOk = FALSE;
+		// respond with a NACK
+		Nack9900Msg();
+		// no sense going further, return
+		return;
+	}
 	// Now pull off the status - is this the last message?
-	msgStatus = sz9900CmdBuffer[DB_STATUS_IDX];
+	msgStatus = hsbCtx.cmd[DB_STATUS_IDX];
 	// Check to make sure the status is valid, bail if it isn't
 	if (!((DB_EXPECT_MORE_DATA == msgStatus) || (DB_LAST_MESSAGE == msgStatus)))
 	{
@@ -592,11 +830,13 @@ void Process9900DatabaseLoad(void)
 		// no sense going further, return
 		return;
 	}
-	// Now convert the data, one character pair at a time
-	for (index = 0; index < numDbBytesSent; ++index)
+	// The last chunk of a delta load must bring the CRC of the 9900 database after its data
+	deltaCommit = (DB_LAST_MESSAGE == msgStatus) && hsbCtx.dbLoad.inProgress && hsbCtx.dbLoad.delta;
+	if (deltaCommit)
 	{
-		success = HexAsciiToByte((sz9900CmdBuffer+DB_FIRST_DATA_IDX+(2*index)), &currentData);
-		if (!success)
+		pCrcField = hsbCtx.cmd + DB_FIRST_DATA_IDX + 2 * numDbBytesSent;
+		if (numDbBytesSent > DB_MAX_BYTES_DELTA_LAST || HART_SEPARATOR != *pCrcField ||
+			!HexAsciiToBytes(pCrcField + 1, crcField, 2))
 		{
 			// Set the flag to indicate there's a DB problem
 			databaseOk = FALSE;
@@ -605,16 +845,34 @@ void Process9900DatabaseLoad(void)
 			// no sense going further, return
 			return;
 		}
-		// write to the DB
-		u9900Database.bytes[startAddress+index] = currentData;
+	}
+	// Now convert the data, the whole chunk goes into the DB
+	success = dbLoadChunk(startAddress, numDbBytesSent);
+	if (!success)
+	{
+		// Set the flag to indicate there's a DB problem
+		databaseOk = FALSE;
+		// respond with a NACK
+		Nack9900Msg();
+		// no sense going further, return
+		return;
 	}
 	if (DB_LAST_MESSAGE == msgStatus)
 	{
-		// Compare the calculated checksum to the downloaded checksum
-		if (Calc9900DbChecksum() == u9900Database.db.checksum)
+		// A full load must have brought the whole database, a delta load must end with the
+		// CRC of the 9900 database, and the sum must match the downloaded checksum
+		hsbCtx.dbLoad.inProgress = FALSE;
+		if ((deltaCommit ? (calcCrc16(hsbCtx.database.bytes, sizeof(DATABASE_9900)) ==
+				(((int16u)crcField[0] << 8) | crcField[1])) :
+			 (sizeof(DATABASE_9900) == hsbCtx.dbLoad.bytesCovered)) &&
+		    hsbCtx.dbLoad.runningSum == hsbCtx.database.db.checksum)
 		{
 			// Set the flag to indicate we're good
 			databaseOk = TRUE;
+			// Keep it for the next power up
+			hsbCtx.dbCacheDirty = TRUE;
+			// New range
+			refreshPvDerived();
 			// Respond with and ACK
 			Ack9900Msg();
 			// Now update the default sensor type
@@ -655,16 +913,16 @@ void Process9900DatabaseLoad(void)
 /////////////////////////////////////////////////////////////////////////////////////////// 
 void Nack9900Msg(void)
 {
-	responseSize = 0;
+	hsbCtx.respSize = 0;
 	// Build the NACK response
-	sz9900RespBuffer[RSP_ADDR_IDX] = HART_ADDRESS;
-	++responseSize;
-	sz9900RespBuffer[RSP_ADDR_IDX+1] = HART_SEPARATOR;
-	++responseSize;
-	sz9900RespBuffer[RSP_REQ_IDX] = HART_NACK;
-	++responseSize;
-	sz9900RespBuffer[ACK_NACK_CR_IDX] = HART_MSG_END;
-	++responseSize;
+	hsbCtx.resp[RSP_ADDR_IDX] = HART_ADDRESS;
+	++hsbCtx.respSize;
+	hsbCtx.resp[RSP_ADDR_IDX+1] = HART_SEPARATOR;
+	++hsbCtx.respSize;
+	hsbCtx.resp[RSP_REQ_IDX] = HART_NACK;
+	++hsbCtx.respSize;
+	hsbCtx.resp[ACK_NACK_CR_IDX] = HART_MSG_END;
+	++hsbCtx.respSize;
 	// Load the transmit buffer & send
 	startMainXmit();	
 }
@@ -688,49 +946,20 @@ void Nack9900Msg(void)
 /////////////////////////////////////////////////////////////////////////////////////////// 
 void Ack9900Msg(void)
 {
-	responseSize = 0;
+	hsbCtx.respSize = 0;
 	// Build the ACK response
-	sz9900RespBuffer[RSP_ADDR_IDX] = HART_ADDRESS;
-	++responseSize;
-	sz9900RespBuffer[RSP_ADDR_IDX+1] = HART_SEPARATOR;
-	++responseSize;
-	sz9900RespBuffer[RSP_REQ_IDX] = HART_ACK;
-	++responseSize;
-	sz9900RespBuffer[ACK_NACK_CR_IDX] = HART_MSG_END;
-	++responseSize;
+	hsbCtx.resp[RSP_ADDR_IDX] = HART_ADDRESS;
+	++hsbCtx.respSize;
+	hsbCtx.resp[RSP_ADDR_IDX+1] = HART_SEPARATOR;
+	++hsbCtx.respSize;
+	hsbCtx.resp[RSP_REQ_IDX] = HART_ACK;
+	++hsbCtx.respSize;
+	hsbCtx.resp[ACK_NACK_CR_IDX] = HART_MSG_END;
+	++hsbCtx.respSize;
 	// Load the transmit buffer & send
 	startMainXmit();	
 }
 
-///////////////////////////////////////////////////////////////////////////////////////////
-//
-// Function Name: Calc9900DbChecksum()
-//
-// Description:
-//
-//     Calculates the checksum on the 9900 database 
-//
-// Parameters: void
-//
-// Return Type: int16u - the calculated checksum.
-//
-// Implementation notes:
-//
-// 
-//
-/////////////////////////////////////////////////////////////////////////////////////////// 
-int16u Calc9900DbChecksum(void)
-{
-	int index;
-	int16u calcChksum = 0;
-	// Now just add up all the bytes, except the checksum at the end
-	for (index = 0; index < sizeof(DATABASE_9900)-2; ++index)
-	{ 
-		calcChksum += (int16u)(u9900Database.bytes[index]);
-	}
-	return calcChksum;
-}
-
 /******************************************************
  * 
  * A0 (Main) UART Functions
@@ -764,12 +993,12 @@ void startMainXmit (void)
 {
   // Make sure we actually have something to transmit
   // 12/17/2012 MH- Validate MAX size
-	if (0 == responseSize || responseSize > MAX_9900_RESP_SIZE)
+	if (0 == hsbCtx.respSize || hsbCtx.respSize > MAX_9900_RESP_SIZE)
 	{ 
 		return;
 	}
-	BYTE *pChar= sz9900RespBuffer;
-	while(responseSize--)
+	BYTE *pChar= hsbCtx.resp;
+	while(hsbCtx.respSize--)
     putcUart(*pChar++, &hsbUart);
 }
 
@@ -797,7 +1026,47 @@ void resetForNew9900Message(void)
 	// Make sure the flags are clear
 	// make sure the characters can be received
   //==> TODO any side effect? enableMainRcvIntr();
-	responseSize = 0;
+	hsbCtx.respSize = 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////
+//
+// Function Name: checkLoopLimits()
+//
+// Description:
+//
+// 		Range check of a requested loop current, in Q16.16
+//
+// Parameters: float - the requested current, mA
+//			   q16 - lowest accepted value
+//			   q16 - highest accepted value
+//			   q16 * - the requested current in Q16.16, valid when RESP_SUCCESS is returned
+//
+// Return Type: unsigned char:
+//						0 = RESP_SUCCESS,
+//						3 = PASSED_PARM_TOO_LARGE
+//						4 = PASSED_PARM_TOO_SMALL
+//
+// Implementation notes:
+//		A value floatToQ16() cannot take (huge, infinite or NaN) is out of range anyway, its
+//		sign tells which way
+//
+/////////////////////////////////////////////////////////////////////////////////////////// 
+static unsigned char checkLoopLimits(float level, q16 qMin, q16 qMax, q16 * pQLevel)
+{
+	if (!floatToQ16(level, pQLevel))
+	{
+		return (floatOrderKey(level) < 0) ? PASSED_PARM_TOO_SMALL : PASSED_PARM_TOO_LARGE;
+	}
+	if (*pQLevel > qMax)
+	{
+		return PASSED_PARM_TOO_LARGE;
+	}
+	if (*pQLevel < qMin)
+	{
+		return PASSED_PARM_TOO_SMALL;
+	}
+	return RESP_SUCCESS;
 }
 
 
@@ -815,6 +1084,7 @@ void resetForNew9900Message(void)
 //						0 = RESP_SUCCESS,
 //						3 = PASSED_PARM_TOO_LARGE
 //						4 = PASSED_PARM_TOO_SMALL
+//						32 = HART_DEVICE_BUSY, the 9900 request queue is full
 //
 // Implementation notes:
 // 
@@ -823,8 +1093,9 @@ void resetForNew9900Message(void)
 unsigned char setFixedCurrentMode(float cmdValue)
 {
 	unsigned char resp = RESP_SUCCESS;
+	q16 qValue;
 	// if we are here, we are in the correct loop mode, so see if we can adjust
-	if (0.00 == cmdValue)
+	if (0 == floatOrderKey(cmdValue))
 	{
 #if 0
 	  MH- Using different HSB control 11/27/12
@@ -834,10 +1105,12 @@ unsigned char setFixedCurrentMode(float cmdValue)
 #endif
 
 		// the request is 7 to leave the fixed current state
+		if (!queue9900Request((FALSE == saveRequested) ? RESP_REQ_CHANGE_RESUME_NO_SAVE : RESP_REQ_SAVE_AND_RESTART_LOOP, cmdValue))
+		{
+			return HART_DEVICE_BUSY;
+		}
 		loopMode = LOOP_OPERATIONAL;
-		request = (FALSE == saveRequested) ? RESP_REQ_CHANGE_RESUME_NO_SAVE : RESP_REQ_SAVE_AND_RESTART_LOOP;
 		saveRequested = FALSE;  
-		requestValue = cmdValue;
 		// Clear the trim flags
 		setToMinValue = FALSE;
 		setToMaxValue = FALSE;
@@ -854,14 +1127,7 @@ unsigned char setFixedCurrentMode(float cmdValue)
 	else
 	{
 		// limit check first
-		if (cmdValue < ADJ_4MA_LIMIT_MIN)
-		{ 
-			resp = PASSED_PARM_TOO_SMALL;
-		}
-		if (cmdValue > ADJ_20MA_LIMIT_MAX)
-		{ 
-			resp = PASSED_PARM_TOO_LARGE;
-		}
+		resp = checkLoopLimits(cmdValue, Q16_CONST(ADJ_4MA_LIMIT_MIN), Q16_CONST(ADJ_20MA_LIMIT_MAX), &qValue);
 		// store the value and mode
 		if (!resp)
 		{
@@ -870,11 +1136,14 @@ unsigned char setFixedCurrentMode(float cmdValue)
 		  disableMainRcvIntr();
 			disableMainTxIntr();
 #endif
+			if (!queue9900Request(RESP_REQ_CHANGE_SET_FIXED, cmdValue))
+			{
+				return HART_DEVICE_BUSY;
+			}
 			loopMode = LOOP_FIXED_CURRENT;
-			requestValue = cmdValue;
-			request = RESP_REQ_CHANGE_SET_FIXED;
-			setToMinValue = (4.0 == cmdValue) ? TRUE : FALSE;
-			setToMaxValue = (20.0 == cmdValue) ? TRUE : FALSE;
+			// Exact, a value within the Q16.16 rounding of 4 or 20 mA is not the trim point
+			setToMinValue = (floatOrderKey(cmdValue) == floatOrderKey(4.0f)) ? TRUE : FALSE;
+			setToMaxValue = (floatOrderKey(cmdValue) == floatOrderKey(20.0f)) ? TRUE : FALSE;
 #if 0
 			MH- Different HSB control 11/27/12
 			// re-enable the interrupts
@@ -904,6 +1173,7 @@ unsigned char setFixedCurrentMode(float cmdValue)
 //						3 = PASSED_PARM_TOO_LARGE
 //						4 = PASSED_PARM_TOO_SMALL
 //						9 = INCORRECT_LOOP_MODE,
+//						32 = HART_DEVICE_BUSY, the 9900 request queue is full
 //
 // Implementation notes:
 // 
@@ -912,20 +1182,14 @@ unsigned char setFixedCurrentMode(float cmdValue)
 unsigned char trimLoopCurrentZero(float level)
 {
 	unsigned char resp = (LOOP_OPERATIONAL == loopMode) ? INCORRECT_LOOP_MODE : RESP_SUCCESS;
+	q16 qLevel;
 	// If the mode is wrong, just bail now
 	if (resp)
 	{
 		return resp;
 	}
 	// Now verify the request is in limits
-	if (level > ADJ_4MA_LIMIT_MAX)
-	{
-		resp = PASSED_PARM_TOO_LARGE;
-	}
-	else if (level < ADJ_4MA_LIMIT_MIN)
-	{
-		resp = PASSED_PARM_TOO_SMALL;
-	}
+	resp = checkLoopLimits(level, Q16_CONST(ADJ_4MA_LIMIT_MIN), Q16_CONST(ADJ_4MA_LIMIT_MAX), &qLevel);
 	if (!resp)
 	{
 #if 0
@@ -934,8 +1198,10 @@ unsigned char trimLoopCurrentZero(float level)
 		disableMainTxIntr();
 #endif
 		// We are OK so make the request to the 9900
-		requestValue = level;
-		request = RESP_REQ_CHANGE_4MA_ADJ;
+		if (!queue9900Request(RESP_REQ_CHANGE_4MA_ADJ, level))
+		{
+			return HART_DEVICE_BUSY;
+		}
 		// Queue the request to save & restart the loop
 		saveRequested = TRUE;
 #if 0
@@ -966,6 +1232,7 @@ unsigned char trimLoopCurrentZero(float level)
 //						3 = PASSED_PARM_TOO_LARGE
 //						4 = PASSED_PARM_TOO_SMALL
 //						9 = INCORRECT_LOOP_MODE,
+//						32 = HART_DEVICE_BUSY, the 9900 request queue is full
 //
 // Implementation notes:
 // 
@@ -974,20 +1241,14 @@ unsigned char trimLoopCurrentZero(float level)
 unsigned char trimLoopCurrentGain(float level)
 {
 	unsigned char resp = (LOOP_OPERATIONAL == loopMode) ? INCORRECT_LOOP_MODE : RESP_SUCCESS;
+	q16 qLevel;
 	// If the mode is wrong, just bail now
 	if (resp)
 	{
 		return resp;
 	}
 	// Now verify the request is in limits
-	if (level > ADJ_20MA_LIMIT_MAX)
-	{
-		resp = PASSED_PARM_TOO_LARGE;
-	}
-	else if (level < ADJ_20MA_LIMIT_MIN)
-	{
-		resp = PASSED_PARM_TOO_SMALL;
-	}
+	resp = checkLoopLimits(level, Q16_CONST(ADJ_20MA_LIMIT_MIN), Q16_CONST(ADJ_20MA_LIMIT_MAX), &qLevel);
 	if (!resp)
 	{
 #if 0
@@ -996,8 +1257,10 @@ unsigned char trimLoopCurrentGain(float level)
 		disableMainTxIntr();
 #endif
 		// We are OK so make the request to the 9900
-		requestValue = level;
-		request = RESP_REQ_CHANGE_20MA_ADJ;
+		if (!queue9900Request(RESP_REQ_CHANGE_20MA_ADJ, level))
+		{
+			return HART_DEVICE_BUSY;
+		}
 		// Queue the request to save & restart the loop
 		saveRequested = TRUE;
 #if 0
@@ -1022,14 +1285,19 @@ unsigned char trimLoopCurrentGain(float level)
 //
 // Parameters: void
 //
-// Return Type: void
+// Return Type: unsigned char - RESP_SUCCESS, or HART_DEVICE_BUSY if the requests don't fit
 //
 // Implementation notes:
 // 
 //
 /////////////////////////////////////////////////////////////////////////////////////////// 
-void setUpperRangeVal(void)
+unsigned char setUpperRangeVal(void)
 {
+	// Nothing changes unless the 9900 gets it
+	if (!is9900QueueFree(2))
+	{
+		return HART_DEVICE_BUSY;
+	}
 #if 0
     MH- Using different HSB control 11/27/12// Shut off the 9900 interrupts
 	disableMainRcvIntr();
@@ -1037,12 +1305,11 @@ void setUpperRangeVal(void)
 #endif
 	// Update the local DB with the requested values so 
 	// the modem can respond quickly
-	u9900Database.db.LOOP_SET_HIGH_LIMIT.floatVal = PVvalue;
-	// The present PV is the request value
-	requestValue = PVvalue;
-	request = RESP_REQ_CHANGE_20MA_POINT;
-	// Queue the request for response 1
-	queueResp1 = TRUE;
+	hsbCtx.database.db.LOOP_SET_HIGH_LIMIT.floatVal = PVvalue;
+	refreshPvDerived();
+	// The present PV is the request value, followed by a save & restart
+	queue9900Request(RESP_REQ_CHANGE_20MA_POINT, PVvalue);
+	queue9900Request(RESP_REQ_SAVE_AND_RESTART_LOOP, 0.0);
 #if 0
 	MH- Different HSB control 11/27/12
 	// re-enable the interrupts
@@ -1052,7 +1319,7 @@ void setUpperRangeVal(void)
 	}
 	enableMainRcvIntr();
 #endif
-
+	return RESP_SUCCESS;
 }
 
 ///////////////////////////////////////////////////////////////////////////////////////////
@@ -1064,14 +1331,19 @@ void setUpperRangeVal(void)
 //
 // Parameters: void
 //
-// Return Type: void
+// Return Type: unsigned char - RESP_SUCCESS, or HART_DEVICE_BUSY if the requests don't fit
 //
 // Implementation notes:
 // 
 //
 /////////////////////////////////////////////////////////////////////////////////////////// 
-void setLowerRangeVal(void)
+unsigned char setLowerRangeVal(void)
 {
+	// Nothing changes unless the 9900 gets it
+	if (!is9900QueueFree(2))
+	{
+		return HART_DEVICE_BUSY;
+	}
 #if 0
     MH- Using different HSB control 11/27/12// Shut off the 9900 interrupts
 	disableMainRcvIntr();
@@ -1079,12 +1351,11 @@ void setLowerRangeVal(void)
 #endif
 	// Update the local DB with the requested value so 
 	// the modem can respond quickly
-	u9900Database.db.LOOP_SET_LOW_LIMIT.floatVal = PVvalue;
-	// The present PV is the request value
-	requestValue = PVvalue;
-	request = RESP_REQ_CHANGE_4MA_POINT;
-	// Queue the request for response 1
-	queueResp1 = TRUE;
+	hsbCtx.database.db.LOOP_SET_LOW_LIMIT.floatVal = PVvalue;
+	refreshPvDerived();
+	// The present PV is the request value, followed by a save & restart
+	queue9900Request(RESP_REQ_CHANGE_4MA_POINT, PVvalue);
+	queue9900Request(RESP_REQ_SAVE_AND_RESTART_LOOP, 0.0);
 #if 0
 	MH- Different HSB control 11/27/12
 	// re-enable the interrupts
@@ -1094,7 +1365,7 @@ void setLowerRangeVal(void)
 	}
 	enableMainRcvIntr();
 #endif
-
+	return RESP_SUCCESS;
 }
 
 ///////////////////////////////////////////////////////////////////////////////////////////
@@ -1107,14 +1378,19 @@ void setLowerRangeVal(void)
 // Parameters: float - upper range value
 //			   float - lower range value 
 //
-// Return Type: void
+// Return Type: unsigned char - RESP_SUCCESS, or HART_DEVICE_BUSY if the requests don't fit
 //
 // Implementation notes:
 // 
 //
 /////////////////////////////////////////////////////////////////////////////////////////// 
-void setBothRangeVals(float upper, float lower)
+unsigned char setBothRangeVals(float upper, float lower)
 {
+	// Nothing changes unless the 9900 gets it
+	if (!is9900QueueFree(3))
+	{
+		return HART_DEVICE_BUSY;
+	}
 #if 0
     MH- Using different HSB control 11/27/12// Shut off the 9900 interrupts
 	disableMainRcvIntr();
@@ -1122,14 +1398,13 @@ void setBothRangeVals(float upper, float lower)
 #endif
 	// Update the local DB with the requested values so 
 	// the modem can respond quickly
-	u9900Database.db.LOOP_SET_HIGH_LIMIT.floatVal = upper;
-	u9900Database.db.LOOP_SET_LOW_LIMIT.floatVal = lower;
-	// The present PV is the request value
-	requestValue = lower;
-	request = RESP_REQ_CHANGE_4MA_POINT;
-	// Queue the request for response 3
-	rangeRequestUpper = upper;
-	queueResp3 = TRUE;
+	hsbCtx.database.db.LOOP_SET_HIGH_LIMIT.floatVal = upper;
+	hsbCtx.database.db.LOOP_SET_LOW_LIMIT.floatVal = lower;
+	refreshPvDerived();
+	// Request the lower, then the upper, followed by a save & restart
+	queue9900Request(RESP_REQ_CHANGE_4MA_POINT, lower);
+	queue9900Request(RESP_REQ_CHANGE_20MA_POINT, upper);
+	queue9900Request(RESP_REQ_SAVE_AND_RESTART_LOOP, 0.0);
 #if 0
 	MH- Different HSB control 11/27/12
 	// re-enable the interrupts
@@ -1139,6 +1414,7 @@ void setBothRangeVals(float upper, float lower)
 	}
 	enableMainRcvIntr();
 #endif
+	return RESP_SUCCESS;
 }
 
 ///////////////////////////////////////////////////////////////////////////////////////////
@@ -1162,12 +1438,92 @@ void convertFloatToAscii(float value, unsigned char * respBuffer)
 	fp32 val;
 	
 	val.floatVal = value;
-	int count;
-	
-	for (count = 0; count < 4; ++count)
+	BytesToHexAscii(val.byteVal, respBuffer, sizeof(val.byteVal));
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////
+//
+// Function Name: HexAsciiToBytes()
+//
+// Description:
+//		converts a string of hex-ASCII pairs into bytes
+//
+// Parameters: const int8u * - the input string, 2 chars per byte
+//			   int8u * - the output bytes
+//			   int8u - the number of bytes to convert
+//
+// Return Type: int - TRUE if all the pairs were valid hex, FALSE otherwise
+//
+// Implementation notes:
+//		Invalid characters are OR-ed into a single flag and tested once at the end.
+//		The output is written even when the input is bad, callers NACK in that case
+//
+/////////////////////////////////////////////////////////////////////////////////////////// 
+int HexAsciiToBytes(const int8u *inString, int8u *outBytes, int8u count)
+{
+	int8u hi, lo;
+	int8u invalid = 0;
+
+	while (count--)
 	{
-		ByteToHexAscii(val.byteVal[count], respBuffer+(2*count));
+		hi = hexDecodeTable[*inString++];
+		lo = hexDecodeTable[*inString++];
+		invalid |= hi | lo;
+		*outBytes++ = (hi << 4) | lo;
 	}
+	return (invalid & 0xF0) ? FALSE : TRUE;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////
+//
+// Function Name: BytesToHexAscii()
+//
+// Description:
+//		converts bytes into a string of hex-ASCII pairs (no terminator)
+//
+// Parameters: const int8u * - the input bytes
+//			   int8u * - the output string, 2 chars per byte
+//			   int8u - the number of bytes to convert
+//
+// Return Type: void
+//
+// Implementation notes:
+// 
+//
+/////////////////////////////////////////////////////////////////////////////////////////// 
+void BytesToHexAscii(const int8u *inBytes, int8u *outString, int8u count)
+{
+	while (count--)
+	{
+		*outString++ = hexEncodeTable[*inBytes >> 4];
+		*outString++ = hexEncodeTable[*inBytes++ & 0x0F];
+	}
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////
+//
+// Function Name: HexAsciiToFloat()
+//
+// Description:
+//		converts an eight-byte ASCII string (little-endian) into a float
+//
+// Parameters: const int8u * - the 8-byte input string
+//			   float * - the result, left untouched if the string is not valid hex
+//
+// Return Type: int - TRUE if the input was valid, FALSE otherwise
+//
+// Implementation notes:
+// 
+//
+/////////////////////////////////////////////////////////////////////////////////////////// 
+int HexAsciiToFloat(const int8u *inString, float *outValue)
+{
+	fp32 val;
+
+	if (!HexAsciiToBytes(inString, val.byteVal, sizeof(val.byteVal)))
+		return FALSE;
+	*outValue = val.floatVal;
+	return TRUE;
 }
 
 ///////////////////////////////////////////////////////////////////////////////////////////
@@ -1189,8 +1545,86 @@ void convertFloatToAscii(float value, unsigned char * respBuffer)
 /////////////////////////////////////////////////////////////////////////////////////////// 
 void copy9900factoryDb(void)
 {
-	memcpy(&u9900Database, &factory9900db, sizeof(DATABASE_9900));
+	memcpy(&hsbCtx.database, &factory9900db, sizeof(DATABASE_9900));
+	hsbCtx.dbLoad.runningSum = dbLoadSum(0, DB_CHECKSUM_OFFSET);
+	hsbCtx.dbLoad.inProgress = FALSE;
+	refreshPvDerived();
+}
+///////////////////////////////////////////////////////////////////////////////////////////
+//
+// Function Name: restoreCachedDb()
+//
+// Description:
+//
+// Replaces the factory database with the cached one, if the cache is good
+//
+// Parameters: void
+//
+// Return Type: BOOLEAN - TRUE if the database was restored.
+//
+// Implementation notes:
+//
+// The restored database is provisional: Hart is served with it right away, and
+// databaseOk stays FALSE so the 9900 still confirms (query) or replaces (load) it
+//
+/////////////////////////////////////////////////////////////////////////////////////////// 
+BOOLEAN restoreCachedDb(void)
+{
+	const stDbCache *pCache = (const stDbCache *)DB_CACHE_SEGMENT;
+
+	if (DB_CACHE_MARKER != pCache->marker ||
+		pCache->crc != calcCrc16((const unsigned char *)pCache, offsetof(stDbCache, crc)))
+	{
+		return FALSE;
+	}
+	memcpy(&hsbCtx.database, &pCache->database, sizeof(DATABASE_9900));
+	hsbCtx.dbLoad.runningSum = dbLoadSum(0, DB_CHECKSUM_OFFSET);
+	if (hsbCtx.dbLoad.runningSum != hsbCtx.database.db.checksum)
+	{
+		copy9900factoryDb();
+		return FALSE;
+	}
+	hsbCtx.dbProvisional = TRUE;
+	refreshPvDerived();
+	UpdateSensorType();
+	return TRUE;
 }
+
+///////////////////////////////////////////////////////////////////////////////////////////
+//
+// Function Name: syncDbCache()
+//
+// Description:
+//
+// Writes the database to the cache, if it differs from what is cached
+//
+// Parameters: void
+//
+// Return Type: void.
+//
+// Implementation notes:
+//
+// Called from the main loop when flash writes are allowed. A write cut by a power loss
+// leaves a bad CRC, and the next power up simply starts from the factory database
+//
+/////////////////////////////////////////////////////////////////////////////////////////// 
+void syncDbCache(void)
+{
+	stDbCache cache;
+
+	hsbCtx.dbCacheDirty = FALSE;
+	cache.marker = DB_CACHE_MARKER;
+	cache.reserved = 0;
+	memcpy(&cache.database, &hsbCtx.database, sizeof(DATABASE_9900));
+	cache.crc = calcCrc16((const unsigned char *)&cache, offsetof(stDbCache, crc));
+	if (verifyFlashContents(DB_CACHE_SEGMENT, (unsigned char *)&cache, sizeof(stDbCache)))
+	{
+		return;
+	}
+	eraseBankSegment(DB_CACHE_SEGMENT);
+	copyMemToMainFlash(DB_CACHE_SEGMENT, (unsigned char *)&cache, sizeof(stDbCache));
+}
+
 #if 0
 ///////////////////////////////////////////////////////////////////////////////////////////
 //
@@ -1237,6 +1671,8 @@ void killMainTransmit(void)
 /////////////////////////////////////////////////////////////////////////////////////////// 
 void updatePVstatus(void)
 {
+	// PV, loop current or limits may have changed
+	refreshPvDerived();
 	// Decide the PV status based upon the value of the variable status
 	switch(varStatus)
 	{
@@ -1245,15 +1681,7 @@ void updatePVstatus(void)
 		break;
 	case UPDATE_STATUS_CHECK_SENSOR_BAD_VALUE:
 		// Check to see where the limits are
-		PVvariableStatus = VAR_STATUS_BAD;
-		if (PVvalue >= u9900Database.db.LOOP_SET_HIGH_LIMIT.floatVal)
-		{
-			PVvariableStatus |= LIM_STATUS_HIGH;
-		}
-		if (PVvalue <= u9900Database.db.LOOP_SET_LOW_LIMIT.floatVal)
-		{
-			PVvariableStatus |= LIM_STATUS_LOW;
-		}
+		PVvariableStatus = VAR_STATUS_BAD | pvDerived.limitStatus;
 		break;
 	case UPDATE_STATUS_SENSOR_NOT_PRESENT:
 	case UPDATE_STATUS_SENSOR_UNDEFINED:
@@ -1266,24 +1694,20 @@ void updatePVstatus(void)
 	// than good from the 9900
 	if (UPDATE_STATUS_GOOD == varStatus)
 	{
-		clrPrimaryStatusBits(FD_STATUS_PV_OUT_OF_LIMITS);
-		clrSecondaryStatusBits(FD_STATUS_PV_OUT_OF_LIMITS);
-		startUpDataLocalV.StandardStatus0 &= ~SS0_HARDWARE_PROBLEM;
+		clrStatusBits(STATUS_BOTH, FD_STATUS_PV_OUT_OF_LIMITS);
+		hartDevice.v.StandardStatus0 &= ~SS0_HARDWARE_PROBLEM;
 		if (varStatus != lastVarStatus)
 		{ 
-			clrPrimaryMoreAvailable();
-			clrSecondaryMoreAvailable();
+			clrStatusBits(STATUS_BOTH, FD_STATUS_MORE_STATUS_AVAIL);
 		}
 	}
 	else
 	{
-		setPrimaryStatusBits(FD_STATUS_PV_OUT_OF_LIMITS);
-		setSecondaryStatusBits(FD_STATUS_PV_OUT_OF_LIMITS);
-		startUpDataLocalV.StandardStatus0 |= SS0_HARDWARE_PROBLEM;
+		setStatusBits(STATUS_BOTH, FD_STATUS_PV_OUT_OF_LIMITS);
+		hartDevice.v.StandardStatus0 |= SS0_HARDWARE_PROBLEM;
 		if (varStatus != lastVarStatus)
 		{ 
-			setPrimaryMoreAvailable();
-			setSecondaryMoreAvailable();
+			setStatusBits(STATUS_BOTH, FD_STATUS_MORE_STATUS_AVAIL);
 		}
 	}
 	// Save the var status for the next update
@@ -1292,3 +1716,53 @@ void updatePVstatus(void)
 	UpdateMsgTimeout = 0;
 }
 
+///////////////////////////////////////////////////////////////////////////////////////////
+//
+// Function Name: refreshPvDerived()
+//
+// Description:
+//
+// Computes the values the Hart replies derive from PV, the loop current and the range
+//
+// Parameters: void
+//
+// Return Type: void.
+//
+// Implementation notes:
+//
+// Called when an update, a range change or a loop request lands. The math runs here
+// once instead of in every command 2, 3 and 9 reply, in Q16.16 unless the range is too wide
+// or narrower than Q16_PERCENT_MIN_SPAN
+//
+/////////////////////////////////////////////////////////////////////////////////////////// 
+void refreshPvDerived(void)
+{
+	float upper = hsbCtx.database.db.LOOP_SET_HIGH_LIMIT.floatVal;
+	float lower = hsbCtx.database.db.LOOP_SET_LOW_LIMIT.floatVal;
+	q16 qUpper, qLower, qPv;
+	SLWORD pvKey = floatOrderKey(PVvalue);
+
+	pvDerived.loopCurrent = (TRUE == updateInProgress) ? reportingLoopCurrent : ma4_20;
+	// Fixed point when the range fits Q16.16, the soft-float formula for the wide and the narrow
+	// ranges
+	if (floatToQ16(upper, &qUpper) && floatToQ16(lower, &qLower) && floatToQ16(PVvalue, &qPv)
+		&& ((qUpper - qLower >= Q16_PERCENT_MIN_SPAN) || (qLower - qUpper >= Q16_PERCENT_MIN_SPAN)))
+	{
+		pvDerived.pvPercentRange = q16ToFloat(q16PercentRange(qUpper, qLower, qPv));
+	}
+	else
+	{
+		pvDerived.pvPercentRange = CalculatePercentRange(upper, lower, PVvalue);
+	}
+	// The limit bits compare the IEEE754 bit patterns as integers, exact over any range
+	pvDerived.limitStatus = 0;
+	if (pvKey >= floatOrderKey(upper))
+	{
+		pvDerived.limitStatus |= LIM_STATUS_HIGH;
+	}
+	if (pvKey <= floatOrderKey(lower))
+	{
+		pvDerived.limitStatus |= LIM_STATUS_LOW;
+	}
+}
+
@@ -28,7 +28,9 @@
 ///////////////////////////////////////////////////////////////////////////////////////////
 // 
 #define MAX_9900_CMD_SIZE 67              /* 9900 command, max 67 bytes*/
-#define MAX_9900_RESP_SIZE 15             /* 9900 response, max size 15 byte*/
+#define MAX_9900_REQUESTS 8               /* Pending HART --> 9900 loop requests */
+#define MAX_9900_BATCH_REQUESTS 2         /* Requests in one batched response */
+#define MAX_9900_RESP_SIZE (15 + 11 * (MAX_9900_BATCH_REQUESTS - 1))  /* 9900 response, 15 bytes + 11 per batched request (",r,vvvvvvvv") */
 #define SENSOR_UPDATE_TIME  150           /* Sensor update rate from the 9900 can be as fast as once every 150 mS*/
 #define MAXIMUM_UPDATE_INTERVAL 10000     /* According to John at GF, the maximum update gap should be less than 10 secs*/
 
@@ -77,12 +79,96 @@ typedef union u9900database
   DATABASE_9900 db;
 } U_DATABASE_9900;
 
+/*!
+ *  PV derived values
+ *
+ *  Computed once when a 9900 update, a range change or a loop request lands, so the
+ *  Hart reply handlers only copy them. The HSB commands and the Hart replies both run
+ *  in the main loop, so a reply never sees a half refreshed set
+ */
+typedef struct
+{
+  float loopCurrent;                              //!< Loop current to report, the requested one while an update is in progress
+  float pvPercentRange;                           //!< PV as a percent of the range
+  unsigned char limitStatus;                      //!< LIM_STATUS_HIGH/LOW of PV against the range
+} stPvDerived;
+
+/*!
+ *  9900 database load progress
+ *
+ *  The sum of the held database follows every $HD chunk and the received bytes are marked, so
+ *  the last message is validated without going over the whole database again.
+ *  A full load must cover the whole database. A delta load, opened by a $HQ query, only sends
+ *  the ranges that differ from what the module reported. Its last chunk carries the CRC of the
+ *  9900 database, the result must match it as well as the sum
+ */
+#define DB_CHECKSUM_OFFSET  (sizeof(DATABASE_9900) - sizeof(int16u))  /* The checksum is not part of the sum */
+#define DB_COVERAGE_BYTES   ((sizeof(DATABASE_9900) + 7) / 8)
+typedef struct
+{
+  int16u runningSum;                              //!< Sum of the database as held now
+  WORD bytesCovered;                              //!< Number of database bytes received in this load
+  BOOLEAN inProgress;                             //!< A load is open, the DB_LAST_MESSAGE chunk closes it
+  BOOLEAN delta;                                  //!< The open load is a delta load
+  int8u lastStart;                                //!< The previous chunk, a repeat of it is accepted
+  int8u lastCount;
+  int8u coverage[DB_COVERAGE_BYTES];              //!< One bit per database byte received in this load
+} stDbLoad;
+
+/*!
+ *  9900 database cache
+ *
+ *  The last database validated by the 9900, kept in DB_CACHE_SEGMENT and restored at power up
+ */
+#define DB_CACHE_MARKER     0x5A
+typedef struct
+{
+  int8u marker;                                   //!< DB_CACHE_MARKER
+  int8u reserved;
+  DATABASE_9900 database;                         //!< The database image
+  int16u crc;                                     //!< CRC16 of the members above
+} stDbCache;
+
+/*!
+ *  A loop request from HART to the 9900, waiting in the request queue
+ */
+typedef struct
+{
+  int8u request;                                  //!< One of RESP_REQ_xx
+  float value;                                    //!< Value sent with the request
+} st9900Request;
+
+/*!
+ *  High Speed Bus context
+ *
+ *  The 9900 side of the module: the database, the command/response buffers and the receiver
+ *  state of hsbSerialIsr() (formerly statics). Members touched by the ISR are volatile.
+ *  There is a single instance, hsbCtx, the legacy global names are aliases of its members
+ */
+typedef struct
+{
+  U_DATABASE_9900 database;                       //!< 9900 Database
+  stDbLoad dbLoad;                                //!< Progress of the database load
+  BOOLEAN dbProvisional;                          //!< The database came from the cache, the 9900 has not confirmed it yet
+  BOOLEAN dbCacheDirty;                           //!< A validated database waits to be cached
+  BOOLEAN hostActive;                             //!< We have a host actively communicating
+  BOOLEAN batchCapable;                           //!< The last update said the 9900 takes batched requests
+  volatile BOOLEAN rxMsgInProgress;               //!< A $H message is being received
+  volatile BYTE rxLastChar;                       //!< Previous char, to detect the $H signature
+  volatile WORD rxIdx;                            //!< Index of the next char in cmd[]
+  unsigned char cmd[MAX_9900_CMD_SIZE];           //!< Buffer for the commands from the 9900
+  unsigned char resp[MAX_9900_RESP_SIZE];         //!< Buffer for the response to the 9900
+  volatile unsigned int respSize;                 //!< the size of the response
+} stHsbContext;
+
 // HART <--> 9900 special characters
 #define ATTENTION       '$'
 #define HART_ADDRESS    'H'
 #define HART_UPDATE     'U'
 #define HART_POLL       'P'
 #define HART_DB_LOAD    'D'
+#define HART_DB_QUERY   'Q'               /* What database do you hold? Opens a delta load */
+#define HART_DB_INFO    'q'               /* Response to HART_DB_QUERY */
 #define HART_ACK        'a'
 #define HART_NACK       'n'
 #define HART_MSG_END    '\r'
@@ -148,6 +234,10 @@ typedef union u9900database
 #define UPDATE_MA4_20_START_INDEX UPDATE_SV_START_INDEX+9     /* SV=8 bytes + separator */
 #define UPDATE_VAR_STATUS_INDEX   UPDATE_MA4_20_START_INDEX+9 /* MA=8 bytes + separator */
 #define UPDATE_COMM_STATUS_INDEX  UPDATE_VAR_STATUS_INDEX+2   
+#define UPDATE_CAPS_SEP_INDEX     UPDATE_COMM_STATUS_INDEX+1  /* A separator here if the capabilities follow */
+#define UPDATE_CAPS_INDEX         UPDATE_COMM_STATUS_INDEX+2  /* Capabilities, 1 hex char, older 9900s end at the comm status */
+// 9900 capabilities
+#define CAPS_BATCH_REQUESTS       0x01                        /* Takes up to MAX_9900_BATCH_REQUESTS requests per response */
 
 // Database Load message status
 #define DB_EXPECT_MORE_DATA '0'
@@ -158,6 +248,13 @@ typedef union u9900database
 #define DB_BYTE_COUNT_IDX   DB_ADDR_START_IDX+3   /* 2 bytes + separator              */
 #define DB_STATUS_IDX       DB_BYTE_COUNT_IDX+3   /* 2 bytes + separator              */
 #define DB_FIRST_DATA_IDX   DB_STATUS_IDX+2       /* 1 byte + separator               */
+// HART_DB_INFO response, "H,q,<held>,<checksum>,<crc>\r", both as 4 hex chars MSB first
+#define DB_HELD_INVALID     '0'
+#define DB_HELD_VALID       '1'         /* The held database matches its checksum */
+#define DB_MAX_BYTES_PER_MSG  ((MAX_9900_CMD_SIZE - (DB_FIRST_DATA_IDX)) / 2)  /* Hex pairs that fit in the command buffer */
+// The last chunk of a delta load ends with ",<crc>", the CRC as in HART_DB_INFO
+#define DB_CRC_FIELD_SIZE     5
+#define DB_MAX_BYTES_DELTA_LAST ((MAX_9900_CMD_SIZE - 1 - (DB_FIRST_DATA_IDX) - DB_CRC_FIELD_SIZE) / 2)
 
 // Message constants
 #define MIN_9900_CMD_SIZE 6   /* The poll message is at least 6 characters  */
@@ -188,9 +285,9 @@ BOOLEAN Process9900Command(void);
 void Process9900Poll(void);
 void Process9900Update(void);
 void Process9900DatabaseLoad(void);
+void Process9900DatabaseQuery(void);
 void Nack9900Msg(void);
 void Ack9900Msg(void);
-int16u Calc9900DbChecksum(void);
 
 // Main UART Prototypes
 
@@ -203,12 +300,19 @@ void startMainXmit (void);
 // Trim loop current
 unsigned char trimLoopCurrentZero(float);
 unsigned char trimLoopCurrentGain(float);
-void setUpperRangeVal(void);
-void setLowerRangeVal(void);
-void setBothRangeVals(float upper, float lower);
+unsigned char setUpperRangeVal(void);
+unsigned char setLowerRangeVal(void);
+unsigned char setBothRangeVals(float upper, float lower);
 void convertFloatToAscii(float, unsigned char *);
+BOOLEAN queue9900Request(int8u, float);
+int HexAsciiToBytes(const int8u *, int8u *, int8u);
+void BytesToHexAscii(const int8u *, int8u *, int8u);
+int HexAsciiToFloat(const int8u *, float *);
 void copy9900factoryDb(void);
+BOOLEAN restoreCachedDb(void);
+void syncDbCache(void);
 void updatePVstatus(void);
+void refreshPvDerived(void);
 
 // Utility to set fixed current mode
 unsigned char setFixedCurrentMode(float);
@@ -226,8 +330,7 @@ unsigned char setFixedCurrentMode(float);
  */
 extern unsigned int modeUpdateCount;
 extern unsigned long UpdateMsgTimeout;    /* According to John at GF, the maximum update gap should be less than 10 secs*/
-extern unsigned char sz9900CmdBuffer [MAX_9900_CMD_SIZE];   /*  Buffer for the commands from the 9900 */
-extern unsigned char sz9900RespBuffer [MAX_9900_RESP_SIZE]; /*  Buffer for the response to the 9900      */
+extern stHsbContext hsbCtx;
 
 //
 // flags to make sure that the loop value does not get reported if an update is in progress
@@ -236,10 +339,15 @@ extern unsigned char updateRequestSent;
 extern int8u loopMode;
 
 extern unsigned char PVvariableStatus;        /*  Device Variable Status for PV */
+extern stPvDerived pvDerived;                 /*  PV values derived at update time */
 
-// exported database
-extern U_DATABASE_9900 u9900Database;
+// The database can be served to Hart: loaded by the 9900, or restored from the cache
+#define databaseUsable()  (databaseOk || hsbCtx.dbProvisional)
 extern const DATABASE_9900 factory9900db;
+// Hex-ASCII codec tables, an invalid character decodes with the high nibble set
+#define HEX_INVALID 0xFF
+extern const int8u hexDecodeTable[256];
+extern const int8u hexEncodeTable[16];
 extern int8u updateDelay;
 
 // Trim command flags
@@ -250,7 +358,6 @@ extern BOOLEAN comm9900started;     //!<  This is an inherited Global Variable t
                                     //  - Is set TRUE when the first Update from 9900 command is received,
                                     //  - after is set,
 
-extern BOOLEAN hostActive;          /*  Do we have a host actively communicating? */
 extern BOOLEAN updateMsgRcvd;       /* A flag that indicates that an update message has been received from the 9900 */
 extern BOOLEAN databaseOk;          /* database loaded OK flag                    */
 
@@ -258,35 +365,6 @@ extern BOOLEAN databaseOk;          /* database loaded OK flag
 //    $INLINE FUNCTIONS
 ///////////////////////////////////////////////////////////////////////////////////////////
 
-///////////////////////////////////////////////////////////////////////////////////////////
-//
-// Function Name: CalculateDatabaseChecksum()
-//
-// Description:
-//
-//    Calculates the checksum of the 9900 database.
-//
-// Parameters: void
-//
-//
-// Return Type: int16u - the calculated chaecksum.
-//
-// Implementation notes:
-//
-//
-/////////////////////////////////////////////////////////////////////////////////////////// 
-inline int16u CalculateDatabaseChecksum(void)
-{
-  int iIdx;
-  int16u calcCkSum = 0;
-
-  for (iIdx = 0; iIdx < sizeof(DATABASE_9900); ++iIdx)
-  {
-    calcCkSum += u9900Database.bytes[iIdx];
-  }
-  return calcCkSum;
-}
-
 ///////////////////////////////////////////////////////////////////////////////////////////
 //
 // Function Name: HexAsciiToByte()
@@ -303,35 +381,19 @@ inline int16u CalculateDatabaseChecksum(void)
 //
 // Implementation notes:
 //
+//    Both characters go through hexDecodeTable[], an invalid character (only uppercase
+//    alpha is valid) has the high nibble set, so one test validates the pair
 //
 /////////////////////////////////////////////////////////////////////////////////////////// 
 inline int HexAsciiToByte (int8u* inString, int8u* outByte)
 {
-  int Success = FALSE;
-
-  // Deal with the high nibble first
-  int8u temp = inString[0];
-  // If the character is NOT a valid hex character, bail. Only uppercase alpha is valid
-  if ((temp < '0') || (temp > 'F') || ((temp > '9') && (temp < 'A')))
-  {
-    return Success;
-  }
-  // it's valid, so convert it
-  temp = (temp > 0x39) ? ((temp - 7) - 0x30) : (temp - 0x30);
-  // shift to make room for the low nibble
-  *outByte = (temp << 4);
-  temp = inString[1];
-  // If the character is NOT a valid hex character, bail. Only uppercase alpha is valid
-  if ((temp < '0') || (temp > 'F') || ((temp > '9') && (temp < 'A')))
-  {
-    return Success;
-  }
-  // it's valid, so convert it
-  temp = (temp > 0x39) ? ((temp - 7) - 0x30) : (temp - 0x30);
-  *outByte += temp;
-  //. We succeeded, so return success
-  Success = TRUE;
-  return Success;
+  int8u hi = hexDecodeTable[inString[0]];
+  int8u lo = hexDecodeTable[inString[1]];
+
+  if ((hi | lo) & 0xF0)
+    return FALSE;
+  *outByte = (hi << 4) | lo;
+  return TRUE;
 }
 
 ///////////////////////////////////////////////////////////////////////////////////////////
@@ -350,19 +412,14 @@ inline int HexAsciiToByte (int8u* inString, int8u* outByte)
 //
 // Implementation notes:
 //
-//    outString MUST point to a two-byte buffer
+//    outString MUST point to a two-byte buffer. Written a byte at a time, as the
+//    buffer may start at an odd address
 //
 /////////////////////////////////////////////////////////////////////////////////////////// 
 inline void ByteToHexAscii (int8u inByte, int8u * outString)
 {
-  // Convert the high nibble
-  int8u temp = (inByte >> 4) | 0x30;
-  temp = (temp > 0x39) ? (temp + 7) : temp;
-  *outString = temp;
-  // convert the low nibble
-  temp = (inByte & 0x0F) | 0x30;
-  temp = (temp > 0x39) ? (temp + 7) : temp;
-  *(outString+1) = temp;
+  outString[0] = hexEncodeTable[inByte >> 4];
+  outString[1] = hexEncodeTable[inByte & 0x0F];
 }
 
 #endif /*MAIN9900_H_*/
@@ -26,9 +26,6 @@
 //  LOCAL DEFINES
 //==============================================================================
 // Other size definitions
-#define MAX_HART_XMIT_BUF_SIZE 267
-#define MAX_RCV_BYTE_COUNT 267
-#define MAX_HART_DATA_SIZE 255
 
 // Defines
 
@@ -40,13 +37,8 @@
 #define STX 0x02
 #define ACK 0x06
 
-#define LONG_ADDR_MASK 0x80
 #define FRAME_MASK 0x07
 #define EXP_FRAME_MASK  0x60
-#define LONG_ADDR_SIZE 5
-#define SHORT_ADDR_SIZE 1
-#define LONG_COUNT_OFFSET 7
-#define SHORT_COUNT_OFFSET 3
 
 
 
@@ -56,57 +48,31 @@
 //==============================================================================
 //  LOCAL PROTOTYPES.
 //==============================================================================
-static int isAddressValid(void);
+static int isAddressValid(stHartContext *pCtx);
 //==============================================================================
 //  GLOBAL DATA
 //==============================================================================
 ///
 /// command information
 ///
-unsigned char hartCommand = 0xff;
-unsigned char addressValid = FALSE;
-unsigned char hartFrameRcvd;                //!< Flag is set after a successfully Lrc and address is for us
-WORD hartDataCount;                         //!< The number of data field bytes
-BYTE expectedByteCnt;                       //!< The received byte count, to know when we're done
-int longAddressFlag = FALSE;              //!< long address flag
-unsigned char addressStartIdx = 0;        //!< address byte index
-int commandReadyToProcess = FALSE;        //!< Is the command ready to process?
-
 unsigned long errMsgCounter = 0;          //!< Message Counters
 unsigned long numMsgProcessed = 0;
 unsigned long numMsgReadyToProcess = 0;
 unsigned long numMsgUnableToProcess = 0;
 
-// Parity & overrun error flags
-int parityErr;
-int overrunErr;
-int rcvLrcError;                            //!< Did the LRC compute OK
-
-unsigned int respBufferSize;                //!< size of the response buffer
 
 unsigned int HartErrRegister = NO_HART_ERRORS;  //!< The HART error register
 unsigned int respXmitIndex = 0;             //!< The index of the next response byte to transmit
 float lastRequestedCurrentValue = 0.0;      //!< The last commanded current value from command 40 is here
-int checkCarrierDetect (void);              //!< other system prototypes
 
 unsigned long xmtMsgCounter = 0;            //!< MH: counts Hart messages at some point in SM
-unsigned char szHartResp [MAX_HART_XMIT_BUF_SIZE];  //!< start w/preambles
-unsigned char szHartCmd [MAX_RCV_BYTE_COUNT];       //!< Rcvd message buffer (start w/addr byte)
+stHartContext hartCtx;                      //!< The Hart link: receiver state and frame buffers (initHartRxSm() at start up)
 
 //==============================================================================
 //  LOCAL DATA
 //==============================================================================
 
 // detect compile error static unsigned char * pRespBuffer = NULL;       //!< Pointer to the response buffer
-/*!
- * Flag to indicate that Hart receiver state machine should be initiated
- *
- * This flag is set to reset the Hart Receiver State Machine to init state. Initialization
- * happens at next state call.
- *
- */
-static BOOLEAN  bInitHartSm = FALSE;
-
 
 
 //==============================================================================
@@ -153,49 +119,50 @@ unsigned int ErrReport[15] = {0,0,0,0,0,0,0,0,0,0,0,0,0,0,0};
 
 /*!
  * \fn    initHartRxSm()
+ * \param pCtx       the Hart link context
  *
- * This function perform the global init of Hart Receiver state machine. Ideally this
- * functionshould be implemented inside the state function, but the spread of globals
- * makes this very hard
+ * This function perform the frame init of Hart Receiver state machine. Ideally this
+ * functionshould be implemented inside the state function, but the command layer
+ * also re-arms the receiver (commands 11 and 21, no reply)
  *
  * Implementation notes:
- * Here the global variables that were used by previous state machine are reset.
+ * Here the decoded frame members of the context that were used by previous frame are reset.
  * Other variables are initalized internally in the internal init state.
  * The signal bInitHartSm is set to perform the remainder initialization inside
  * the function, which is performed when the new character event is captured at main loop
  *
  * This function partially replaces prepareToRxFrame(), rest is done at its context
  */
-void initHartRxSm(void)
+void initHartRxSm(stHartContext *pCtx)
 {
   // Hart Reception Results - Start reply
-  hartFrameRcvd = FALSE;
-  commandReadyToProcess = FALSE;
+  pCtx->bFrameRcvd = FALSE;
+  pCtx->bCommandReady = FALSE;
   //  Status Report
   //  hostActive = FALSE; //MH logic moved to main loop with a timeout 1/24/12
   // Used in processHartCommand(), executeCommand()
-  hartCommand = 0xfe;               // Make the command invalid
+  pCtx->cmdNumber = 0xfe;           // Make the command invalid
 
   // Hart Error or Status Register
   HartErrRegister = RCV_BAD_LRC;    // Clear the HART error register, except for the assumed LRC error
 
   // Used to calculate the Address in Hart Command message -
-  addressStartIdx = 0;          // hart.c::isAddressValid()
-  longAddressFlag = FALSE;
-  addressValid = FALSE;         // hartCommand.c::processHartCommand ()
+  pCtx->addrStartIdx = 0;     // hart.c::isAddressValid()
+  pCtx->bLongAddr = FALSE;
+  pCtx->bAddressValid = FALSE;  // hartCommand.c::processHartCommand ()
 
   // Data section of command message. First member is used everywhere
-  hartDataCount = 0;            //!< The number of data field bytes
-  expectedByteCnt = 0;          //!< The received byte count, to know when we're done
+  pCtx->dataCount = 0;          //!< The number of data field bytes
+  pCtx->byteCount = 0;          //!< The received byte count, to know when we're done
 
 
   // Sttus of current Cmd Message - used on processHartCommand()
-  rcvLrcError = TRUE;         // Assume an error until the LRC is OK
-  overrunErr = FALSE;
-  parityErr = FALSE;
+  pCtx->bLrcError = TRUE;       // Assume an error until the LRC is OK
+  pCtx->bOverrunErr = FALSE;
+  pCtx->bParityErr = FALSE;
 
   // Signal the Hart Receiver State MAchine to do the rest
-  bInitHartSm = TRUE;
+  pCtx->bInitSm = TRUE;
 
 
 }
@@ -204,6 +171,7 @@ void initHartRxSm(void)
 /*!
  * 	hartReceiver()
  * 	Implement the Hart Receiver state machine
+ * 	\param pCtx       the Hart link context
  * 	\param data       Receiver character (lo byte) and its status (Hi byte)
  *
  * 	\returns 	the result of the hart building
@@ -222,10 +190,10 @@ void initHartRxSm(void)
  * 	 ValidFrame will transition to
  * 	 Done and Error will end
  */
-void hartReceiver(WORD data)   //===> BOOLEAN HartReceiverSm() Called every time a HartRxChar event is detected
+void hartReceiver(stHartContext *pCtx, WORD data)   //===> BOOLEAN HartReceiverSm() Called every time a HartRxChar event is detected
 {
-  /// HART receive state machine
-  typedef enum
+  /// HART receive state machine, the state is kept in pCtx->rcvState
+  enum
   {
     eRcvInit,                 //!<  Set the initial counters and pointer in position
     //  Follwoing states are the same as described in Documentation
@@ -236,31 +204,23 @@ void hartReceiver(WORD data)   //===> BOOLEAN HartReceiverSm() Called every time
     eRcvData,
     eRcvLrc,
     eRcvXtra
-  } eRcvState;
+  };
   unsigned char nextByte;
   unsigned char statusReg;
-
-  // Here come the list of Statics
-  static BYTE expectedAddrByteCnt;              //!< the number of address bytes expected
-  static eRcvState ePresentRcvState = eRcvSom;
-
-  static BYTE calcLrc;
-  static unsigned char rcvAddrCount;            //!< The number of address bytes received
-  static unsigned char rcvByteCount;            //!< The total number of received bytes, starting with the SOM
-  static WORD preambleByteCount;                //!< the number of preamble bytes received
-  static unsigned char totalRcvByteCount;
+  unsigned short intState;
 
   // Hart Receiver State Machine Initialization - perform before increment error counters
-  if(bInitHartSm ) // Init is a pseudo state -> eRcvSom
+  if(pCtx->bInitSm ) // Init is a pseudo state -> eRcvSom
   {
-    bInitHartSm = FALSE;  // Initialization done
-    // locals
-    expectedByteCnt = calcLrc = rcvByteCount = rcvAddrCount = totalRcvByteCount = 0;
-    preambleByteCount = 0;
+    pCtx->bInitSm = FALSE;  // Initialization done
+    // context
+    pCtx->byteCount = pCtx->calcLrc = pCtx->rcvByteCount = pCtx->rcvAddrCount = pCtx->totalRcvByteCount = 0;
+    pCtx->preambleByteCount = 0;
+    pCtx->bDataComplete = pCtx->bReplySpeculated = FALSE;
     //pRespBuffer = szHartResp;     // Set the transmit pointer back to the beginning of the buffer
     //  stop (if running) the Reply timer (made one shot on 12/26/12 )
 
-    ePresentRcvState = eRcvSom;   // Set the state machine to look for the start of message
+    pCtx->rcvState = eRcvSom;   // Set the state machine to look for the start of message
   }
   //  Process Received Character
   nextByte = data;            //  !MH:--> HART_RXBUF;
@@ -284,21 +244,21 @@ void hartReceiver(WORD data)   //===> BOOLEAN HartReceiverSm() Called every time
   {
     HartErrRegister |= RCV_FRAMING_ERROR;
     ++ErrReport[2];
-    ++startUpDataLocalV.errorCounter[0];
+    ++hartDevice.v.errorCounter[0];
   }
   //  OE: Buffer overrun (previous rx overwritten)
   if (statusReg & UCOE)
   {
     // if we're still receiving preamble bytes, just clear the OE flag otherwise, bail on the reception
-    if (eRcvSom != ePresentRcvState)
+    if (eRcvSom != pCtx->rcvState)
     {
-      overrunErr = TRUE;
+      pCtx->bOverrunErr = TRUE;
       HartErrRegister |= BUFFER_OVERFLOW;
       ++ErrReport[3];
-      ++startUpDataLocalV.errorCounter[2];
+      ++hartDevice.v.errorCounter[2];
     }
     else
-      ++startUpDataLocalV.errorCounter[14];
+      ++hartDevice.v.errorCounter[14];
 
   }
   //  PE: Parity Error
@@ -306,25 +266,25 @@ void hartReceiver(WORD data)   //===> BOOLEAN HartReceiverSm() Called every time
   {
     //  if the parity error occurs after the command byte, we will respond with a tx error message.
     //  Otherwise, just ignore the message
-    parityErr = TRUE;
+    pCtx->bParityErr = TRUE;
     HartErrRegister |= RCV_PARITY_ERROR;
     ++ErrReport[4];
-    ++startUpDataLocalV.errorCounter[1];
+    ++hartDevice.v.errorCounter[1];
   }
   // increment the total byte count
-  totalRcvByteCount++;
+  pCtx->totalRcvByteCount++;
   // The receive state machine: What we do depends on the current state
-  switch (ePresentRcvState)
+  switch (pCtx->rcvState)
   {
   case eRcvSom:
     // A parity or framing error here is fatal, so check
     if ((statusReg & UCPE) || (statusReg & UCFE))
     {
-      ++startUpDataLocalV.errorCounter[10];
+      ++hartDevice.v.errorCounter[10];
       // We are not going to respond, so we will wait until the next message starts
 
       // 1) prepareToRxFrame();
-      initHartRxSm();
+      initHartRxSm(pCtx);
       return;
     }
     // is it a preamble character?
@@ -332,17 +292,17 @@ void hartReceiver(WORD data)   //===> BOOLEAN HartReceiverSm() Called every time
     {
       //intrDcd = TRUE;
       // increment the preamble byte count
-      ++preambleByteCount;
+      ++pCtx->preambleByteCount;
       // Check for too many preamble characters
-      if (MAX_PREAMBLE_BYTES < preambleByteCount)
+      if (MAX_PREAMBLE_BYTES < pCtx->preambleByteCount)
       {
         // Set the HART error register
         HartErrRegister |= EXCESS_PREAMBLE;
         // Set the state machine to Idle, because we're not processing any more bytes on this frame - TO BE VERIFIED
         //  2) prepareToRxFrame();
-        initHartRxSm();
+        initHartRxSm(pCtx);
         ++ErrReport[5];
-        ++startUpDataLocalV.errorCounter[4];
+        ++hartDevice.v.errorCounter[4];
       }
       // Do not store the character
       return;
@@ -350,25 +310,25 @@ void hartReceiver(WORD data)   //===> BOOLEAN HartReceiverSm() Called every time
     else
     if (STX == (nextByte & (FRAME_MASK | EXP_FRAME_MASK)))
     {
-      if (MIN_PREAMBLE_BYTES > preambleByteCount)
+      if (MIN_PREAMBLE_BYTES > pCtx->preambleByteCount)
       {
         // Set the HART error register
         HartErrRegister |= INSUFFICIENT_PREAMBLE;
         // If we haven't seen enough preamble bytes, we are not going to respond at all, so set the state machine to idle
         //  3)prepareToRxFrame();
-        initHartRxSm();
+        initHartRxSm(pCtx);
         errMsgCounter++;
         ++ErrReport[6];
-        ++startUpDataLocalV.errorCounter[3];
+        ++hartDevice.v.errorCounter[3];
         return;  // If < 2 preambles, do nothing & return
       }
       // How many address bytes to expect?
-      expectedAddrByteCnt = (nextByte & LONG_ADDR_MASK) ? LONG_ADDR_SIZE : SHORT_ADDR_SIZE;
-      addressStartIdx = rcvByteCount+1; // the first address byte is the next character
+      pCtx->expectedAddrByteCnt = (nextByte & LONG_ADDR_MASK) ? LONG_ADDR_SIZE : SHORT_ADDR_SIZE;
+      pCtx->addrStartIdx = pCtx->rcvByteCount+1; // the first address byte is the next character
       // is this a long address?
-      longAddressFlag = (nextByte & LONG_ADDR_MASK) ? TRUE : FALSE;
+      pCtx->bLongAddr = (nextByte & LONG_ADDR_MASK) ? TRUE : FALSE;
       // change the state
-      ePresentRcvState = eRcvAddr;
+      pCtx->rcvState = eRcvAddr;
 
       // Start Checking time between chars as a valid frame has started
       bHartRecvFrameCompleted= FALSE;        // Clear the event blocking
@@ -383,10 +343,10 @@ void hartReceiver(WORD data)   //===> BOOLEAN HartReceiverSm() Called every time
       // Increment the error counters
       ++ErrReport[7];
       errMsgCounter++;
-      ++startUpDataLocalV.errorCounter[5];
+      ++hartDevice.v.errorCounter[5];
       // Something's wrong. Just set the preamble count back to zero and start over after recording the error diagnostics
       //  4) prepareToRxFrame();
-      initHartRxSm();
+      initHartRxSm(pCtx);
       return;
     }
     break;
@@ -396,38 +356,50 @@ void hartReceiver(WORD data)   //===> BOOLEAN HartReceiverSm() Called every time
     {
       // We are not going to respond, so we will wait until the next message starts
       // 5) prepareToRxFrame();
-      initHartRxSm();
-      ++startUpDataLocalV.errorCounter[11];
+      initHartRxSm(pCtx);
+      ++hartDevice.v.errorCounter[11];
       return;
     }
-    // increment the count of the address bytes rcvd
-    ++rcvAddrCount;
-    if (rcvAddrCount == expectedAddrByteCnt)
+    // increment the count of the address bytes rcvd, it stays past expected on a frame for other device
+    if (pCtx->rcvAddrCount <= pCtx->expectedAddrByteCnt)
+      ++pCtx->rcvAddrCount;
+    if (pCtx->rcvAddrCount == pCtx->expectedAddrByteCnt)
     {
       // Store the last byte of the address here to
       // make sure that isAddressValid() will work correctly. Do NOT
       // increment rcvByteCount!!
-      szHartCmd[rcvByteCount] = nextByte;
+      pCtx->cmd[pCtx->rcvByteCount] = nextByte;
       // Check to see if the address is for us. If not, start
       // looking for the beginning of the next message
-      addressValid = isAddressValid();
-      if (!addressValid)
+      pCtx->bAddressValid = isAddressValid(pCtx);
+      if (!pCtx->bAddressValid)
       {
         ++ErrReport[13];
-        ++startUpDataLocalV.errorCounter[15];
+        ++hartDevice.v.errorCounter[15];
         // x) prepareToRxFrame(); - BMD removed. Do not start to look for a new frame until the current one is completely done
         // MH: Agree with BMD
+        // The rest of the frame, and the other slave's reply, are dropped at the Hart isr: no main
+        // loop wake up per byte. The skip ends at the next master (STX) frame, see hartSerialIsr().
+        // Not started if the gap timer has already expired (frame over)
+        intState = __get_interrupt_state();
+        __disable_interrupt();
+        if (HART_RCV_GAP_TIMER_CTL & MC_3)
+        {
+          hartUart.bRxHunt = FALSE;
+          hartUart.bRxSkip = TRUE;
+        }
+        __set_interrupt_state(intState);
         return;
       }
       // we're done with address, move to command
-      ePresentRcvState = eRcvCmd;
+      pCtx->rcvState = eRcvCmd;
     }
     break;
   case eRcvCmd:
     // ready to receive byte count
-    ePresentRcvState = eRcvByteCount;
+    pCtx->rcvState = eRcvByteCount;
     // signal that the command byte has been received, and we have to process the command
-    commandReadyToProcess = TRUE;
+    pCtx->bCommandReady = TRUE;
     numMsgReadyToProcess++;
     // Now that we have to respond, set the error register. We'll clear it later if all is OK
     HartErrRegister |= RCV_BAD_LRC;
@@ -436,64 +408,62 @@ void hartReceiver(WORD data)   //===> BOOLEAN HartReceiverSm() Called every time
     // A parity, overrun or framing error here is fatal, so check
     if ((statusReg & UCPE) || (statusReg & UCFE) || (statusReg & UCOE))
     {
-      ++startUpDataLocalV.errorCounter[12];
+      ++hartDevice.v.errorCounter[12];
       // We are not going to respond, so we will wait until the next message starts
       // 6) prepareToRxFrame();
-      initHartRxSm();
+      initHartRxSm(pCtx);
       return;
     }
-    expectedByteCnt = nextByte;
-    if (expectedByteCnt > MAX_HART_DATA_SIZE) //MH This never happens, as left value is byte and right is 255
+    // Any count fits in the command buffer (see MAX_RCV_BYTE_COUNT)
+    pCtx->byteCount = nextByte;
+    if (0 == pCtx->byteCount)
     {
-      HartErrRegister |= RCV_BAD_BYTE_COUNT;
-      // 7) prepareToRxFrame();
-      initHartRxSm();
-      ++ErrReport[8];
-      errMsgCounter++;
-      ++startUpDataLocalV.errorCounter[7];
+      pCtx->rcvState = eRcvLrc;
+      pCtx->bDataComplete = TRUE;
     }
     else
-      if (0 == expectedByteCnt)
-        ePresentRcvState = eRcvLrc;
-      else
-      {
-        hartDataCount = 0;
-        ePresentRcvState = eRcvData;
-      }
+    {
+      pCtx->dataCount = 0;
+      pCtx->rcvState = eRcvData;
+    }
     break;
   case eRcvData:
-    ++hartDataCount;
+    ++pCtx->dataCount;
     // Are we done?
-    if (hartDataCount == expectedByteCnt)
-      ePresentRcvState = eRcvLrc;
+    if (pCtx->dataCount == pCtx->byteCount)
+    {
+      pCtx->rcvState = eRcvLrc;
+      pCtx->bDataComplete = TRUE;
+    }
     break;
   case eRcvLrc:
     bHartRecvFrameCompleted = TRUE; // ACK - Gap timer must be ignored
+    pCtx->bDataComplete = FALSE;    // Too late to speculate
 
     // 12/26/12 We couldn't move the start of Reply timer in ISR, we keep it Here, reply will have some latency
     startReplyTimerEvent();
 
-    if (calcLrc == nextByte)
+    if (pCtx->calcLrc == nextByte)
     {
       HartErrRegister &= ~RCV_BAD_LRC;  // Clear the bad CRC error
-      rcvLrcError = FALSE;              // process the command
+      pCtx->bLrcError = FALSE;          // process the command
     }
     else
     {
-      rcvLrcError = TRUE;
+      pCtx->bLrcError = TRUE;
       HartErrRegister |= RCV_BAD_LRC;
       ++ErrReport[9];
-      ++startUpDataLocalV.errorCounter[6];
+      ++hartDevice.v.errorCounter[6];
     }
     // If the address is for us, pick up extra characters
     // If the message isn't for us, start looking for a new message asap
-    if (addressValid)
+    if (pCtx->bAddressValid)
     {
-      hartFrameRcvd = TRUE;
-      ePresentRcvState = eRcvXtra;
+      pCtx->bFrameRcvd = TRUE;
+      pCtx->rcvState = eRcvXtra;
     }
     else      // 8) prepareToRxFrame();
-      initHartRxSm();
+      initHartRxSm(pCtx);
     break;
   case eRcvXtra:
     //==TOGGLEB(TP_PORTOUT, TP2_MASK);    // Provisional see the xtra chars in scope
@@ -506,17 +476,17 @@ void hartReceiver(WORD data)   //===> BOOLEAN HartReceiverSm() Called every time
   default:
     ++ErrReport[10];
     // 9) prepareToRxFrame();   // Get ready for the next message
-    initHartRxSm();
+    initHartRxSm(pCtx);
     return;               // Do not store the character
   }
   // Here we build the Hart Command Buffer & calc LRC - Not idle, or msg cancelled
-  if (MAX_RCV_BYTE_COUNT > rcvByteCount)  // Make sure we don't overrun the buffer
+  if (MAX_RCV_BYTE_COUNT > pCtx->rcvByteCount)  // Make sure we don't overrun the buffer
   {
     ++ErrReport[11];
-    szHartCmd[rcvByteCount] = nextByte;
-    ++rcvByteCount;
+    pCtx->cmd[pCtx->rcvByteCount] = nextByte;
+    ++pCtx->rcvByteCount;
   }
-  calcLrc ^= nextByte;  // calculateLrc(nextByte);
+  pCtx->calcLrc ^= nextByte;  // calculateLrc(nextByte);
   ++ErrReport[12];
 }
 
@@ -550,6 +520,48 @@ int checkCarrierDetect (void)
     return rtnVal;
 }
 
+/*!
+ *  \fn     hartAddressMatch()
+ *  \brief  Decide if a received address field belongs to a given slave identity
+ *
+ *  \param  pAddr            points to the first address byte of the frame (burst bit already masked)
+ *  \param  bLongAddr        TRUE if the frame uses a 5-byte unique address
+ *  \param  pollingAddress   the slave polling address (short frames)
+ *  \param  pUniqueAddr      the slave 5-byte unique address (long frames), see refreshHartAddress()
+ *  \return one of #tAddrMatch
+ *
+ *  The function has no side effects and only looks at its arguments, so the same frame can be
+ *  matched against any number of device identities (e.g. several modules sharing one multidrop segment).
+ *  HART 7 compliant
+ */
+tAddrMatch hartAddressMatch(const BYTE *pAddr, BOOLEAN bLongAddr, BYTE pollingAddress,
+                            const BYTE *pUniqueAddr)
+{
+  int index;
+
+  if (!bLongAddr)   // short Polling address for Cmd0?
+    return ((pAddr[0] & POLL_ADDR_MASK) == pollingAddress) ? addrMatchUnique : addrNoMatch;
+
+  // Unique address: the first byte without the master and burst bits, the rest as they are
+  // (most frames on a multidrop loop differ in the device ID, so the loop usually ends early)
+  if ((pAddr[0] & POLL_ADDR_MASK) == pUniqueAddr[0])
+  {
+    for (index = 1; index < LONG_ADDR_SIZE && pAddr[index] == pUniqueAddr[index]; ++index)
+      ;
+    if (LONG_ADDR_SIZE == index)
+      return addrMatchUnique;
+  }
+  // If the address is not a unique address for me, look for the broadcast address
+  // Check the first byte separately, since it may have the primary master bit set.
+  if (0 != (pAddr[0] & ~PRIMARY_MASTER))
+    return addrNoMatch;
+  // the rest of the bytes are 0 if this is a broadcast address
+  for (index = 1; index < LONG_ADDR_SIZE; ++index)
+    if (0 != pAddr[index])
+      return addrNoMatch;
+  return addrMatchBroadcast;
+}
+
 ///////////////////////////////////////////////////////////////////////////////////////////
 //
 // Function Name: isAddressValid()
@@ -561,82 +573,45 @@ int checkCarrierDetect (void)
 // met, FALSE otherwise
 //
 // Parameters:
-//     unsigned char * pCommand:  pointer to the HART command to check the address of.
+//     stHartContext *pCtx:  the Hart link holding the received address
 //
-// Return Type: unsigned int.
+// Return Type: int.
 //
 // Implementation notes:
-//
-//
+//    The match itself is done by hartAddressMatch() against this module's identity,
+//    here we only capture the master type and the broadcast flag for the command layer
 //
 ///////////////////////////////////////////////////////////////////////////////////////////
-// HART 7 compliant
-static int isAddressValid(void)
+static int isAddressValid(stHartContext *pCtx)
 {
-  union
-  {
-    unsigned int i;
-    unsigned char b[2];
-  } myDevId;
-  int index;
-  // Mask the Primary bit out of the poll address
-  unsigned char pollAddress = szHartCmd[addressStartIdx] & ~(PRIMARY_MASTER | BURST_MODE_BIT);
+  tAddrMatch match;
   // Now capture if it is from the primary or secondary master
-  startUpDataLocalV.fromPrimary = (szHartCmd[addressStartIdx] & PRIMARY_MASTER) ? TRUE : FALSE;
-  int isValid = FALSE;
-
-  // Set the broadcast flag to FALSE
-  rcvBroadcastAddr = FALSE;
+  hartDevice.v.fromPrimary = (pCtx->cmd[pCtx->addrStartIdx] & PRIMARY_MASTER) ? TRUE : FALSE;
   // Remove the Burst mode bit
-  szHartCmd[addressStartIdx] &= ~BURST_MODE_BIT;
-  if (longAddressFlag)
-  {
-    // We only need to compare to the lower 14 bits
-    myDevId.i = startUpDataLocalV.expandedDevType & EXT_DEV_TYPE_ADDR_MASK;
-    // Now XOR out the recieved address for each
-    myDevId.b[1] ^= szHartCmd[addressStartIdx] & POLL_ADDR_MASK;
-    myDevId.b[0] ^= szHartCmd[addressStartIdx+1];
-    // If the ID is 0, check for a unique address
-    if (!myDevId.i)
-    {
-      // Now compare the last 3 bytes of address
-      if (!(memcmp(&szHartCmd[addressStartIdx+2], &startUpDataLocalNv.DeviceID, 3)))
-      {
-        isValid = TRUE;
-      }
-    }
-    // If the address is not a unique address for me,
-    // look for the broadcast address
-    if (!isValid)
-    {
-      // Check to see if it is a broadcast. We have to check the first byte
-      // separately, since it may have the primary master bit set.
-      // Mask out the primary master bit of the first byte
-      if (0 != (szHartCmd[addressStartIdx] & ~PRIMARY_MASTER))
-      {
-        return isValid;
-      }
-      // Now check the following 4 bytes
-      for (index = 1; index < LONG_ADDR_SIZE; ++index)
-      {
-        // the rest of the bytes are 0 if this is a broadcast address
-        if(0 != szHartCmd[addressStartIdx+index])
-        {
-          return isValid;
-        }
-      }
-      rcvBroadcastAddr = TRUE;
-      isValid = TRUE;
-    }
-  }
-  else  // short Polling address for Cmd0?
-  {
-    if (startUpDataLocalNv.PollingAddress == pollAddress)
-    {
-      isValid = TRUE;
-    }
-  }
-  return isValid;
+  pCtx->cmd[pCtx->addrStartIdx] &= ~BURST_MODE_BIT;
+
+  match = hartAddressMatch(&pCtx->cmd[pCtx->addrStartIdx], pCtx->bLongAddr, pCtx->pollAddr, pCtx->uniqueAddr);
+  // Set the broadcast flag
+  pCtx->bBroadcastAddr = (addrMatchBroadcast == match) ? TRUE : FALSE;
+  return (addrNoMatch != match) ? TRUE : FALSE;
+}
+
+/*!
+ *  \fn     refreshHartAddress()
+ *  \brief  Precompute this slave polling and unique addresses from the database
+ *  \param  pCtx     the Hart link context that receives the identity
+ *
+ *  The unique address is the expanded device type (lower 14 bits) followed by the device ID.
+ *  Called at start up and whenever the polling address or the device ID change (see markNvDirty()),
+ *  so the receiver compares the address field byte by byte with no per-frame arithmetic
+ */
+void refreshHartAddress(stHartContext *pCtx)
+{
+  WORD devType = hartDevice.v.expandedDevType & EXT_DEV_TYPE_ADDR_MASK;
+  pCtx->pollAddr = hartDevice.nv.PollingAddress & POLL_ADDR_MASK;
+  pCtx->uniqueAddr[0] = (BYTE)(devType >> 8);
+  pCtx->uniqueAddr[1] = (BYTE)devType;
+  memcpy(&pCtx->uniqueAddr[2], hartDevice.nv.DeviceID, DEVICE_ID_SIZE);
 }
 
 
@@ -648,7 +623,8 @@ static int isAddressValid(void)
 //
 // Set up the initial response buffer
 //
-// Parameters: void
+// Parameters:
+//     stHartContext *pCtx:  the Hart link, with the received command
 //
 // Return Type: void.
 //
@@ -657,24 +633,24 @@ static int isAddressValid(void)
 //      captures some information used in later procesing
 //
 ///////////////////////////////////////////////////////////////////////////////////////////
-void initRespBuffer(void)
+void initRespBuffer(stHartContext *pCtx)
 {
   int i, addrSize;
 
   // Delimiter - Mask out expansion bytes & physical layer type bits
-  szHartResp[0] = ACK | (szHartCmd[0] & (STX | LONG_ADDR_MASK));
+  pCtx->resp[0] = ACK | (pCtx->cmd[0] & (STX | LONG_ADDR_MASK));
   // Copy Address field
-  addrSize = (szHartCmd[0] & LONG_ADDR_MASK) ? LONG_ADDR_SIZE : SHORT_ADDR_SIZE;
+  addrSize = (pCtx->cmd[0] & LONG_ADDR_MASK) ? LONG_ADDR_SIZE : SHORT_ADDR_SIZE;
   for (i = 1; i <= addrSize; ++i)
   {
-    szHartResp[i] = szHartCmd[i];
+    pCtx->resp[i] = pCtx->cmd[i];
   }
   // Now remove the burst mode bit
-  szHartResp[1] &= ~BURST_MODE_BIT;
+  pCtx->resp[1] &= ~BURST_MODE_BIT;
   // Command byte
-  hartCommand = szHartResp[i] = szHartCmd[i];
+  pCtx->cmdNumber = pCtx->resp[i] = pCtx->cmd[i];
   // set frame offset for building the command to the next position
-  respBufferSize = i + 1;
+  pCtx->respSize = i + 1;
 }
 #if 0
 ///////////////////////////////////////////////////////////////////////////////////////////
@@ -700,6 +676,35 @@ void initRespBuffer(void)
 }
 #endif
 
+/*!
+ *  \fn     openHartFrame()
+ *  \brief  Keys the modem and starts the preamble train before the response is built
+ *  \return the number of preambles queued
+ *
+ *  The Tx stream is left open: if the command handler is still writing the response when the
+ *  preambles run out, the Tx isr keeps sending preambles until sendHartFrame() appends the body.
+ *  closeHartFrame() ends a stream that gets no body.
+ */
+WORD openHartFrame(void)
+{
+  WORD i;
+  //  Command 59 count of the master being answered
+  WORD nPreambles = hartDevice.nv.respPreambles[(hartDevice.v.fromPrimary) ? 0 : 1];
+  hartUart.bTxStreamOpen = TRUE;
+  for(i=0; i < nPreambles; ++i)
+    putcUart(HART_PREAMBLE, &hartUart);// write the character to Hart outstream
+  return nPreambles;
+}
+
+/*!
+ *  \fn     closeHartFrame()
+ *  \brief  Ends an open Tx stream without a body: the queued preambles go out and the modem is released
+ */
+void closeHartFrame(void)
+{
+  hartUart.bTxStreamOpen = FALSE;
+}
+
 ///////////////////////////////////////////////////////////////////////////////////////////
 //
 // Function Name: sendHartFrame()
@@ -708,7 +713,8 @@ void initRespBuffer(void)
 //
 // Starts the transmit of the completed response
 //
-// Parameters: void
+// Parameters:
+//     stHartContext *pCtx:  the Hart link, with the response to send
 //
 // Return Type:  Number of bytes sent to output stream
 //
@@ -717,35 +723,32 @@ void initRespBuffer(void)
 //
 //
 ///////////////////////////////////////////////////////////////////////////////////////////
-WORD sendHartFrame (void)
+WORD sendHartFrame (stHartContext *pCtx)
 {
 
-  WORD i;
+  WORD i, nPreambles =0;
   volatile BYTE calcLrc =0;
   _no_operation();	// debug point
-  //  Send preambles
-  for(i=0; i < XMIT_PREAMBLE_BYTES; ++i)
-    putcUart(HART_PREAMBLE, &hartUart);// write the character to Hart outstream
+  //  Send preambles, unless openHartFrame() has them on the line already
+  if(!hartUart.bTxStreamOpen)
+    nPreambles = openHartFrame();
 
   // Send the response buffer
-  WORD nTotal = (szHartResp[0] & LONG_ADDR_MASK) ?    \
-      (szHartResp[LONG_COUNT_OFFSET] + LONG_COUNT_OFFSET) :   \
-      (szHartResp[SHORT_COUNT_OFFSET] + SHORT_COUNT_OFFSET);
+  WORD nTotal = (pCtx->resp[0] & LONG_ADDR_MASK) ?    \
+      (pCtx->resp[LONG_COUNT_OFFSET] + LONG_COUNT_OFFSET) :   \
+      (pCtx->resp[SHORT_COUNT_OFFSET] + SHORT_COUNT_OFFSET);
   for(i=0; i<= nTotal; ++i)	// nTotal+1 iterations because need to include nData byte itself
   {
-    calcLrc ^= szHartResp[i];              // Calculate the LRC
-    putcUart(szHartResp[i], &hartUart);    // Transmit the character
+    calcLrc ^= pCtx->resp[i];              // Calculate the LRC
+    putcUart(pCtx->resp[i], &hartUart);    // Transmit the character
+    hartUart.bTxStreamOpen = FALSE;        // The body is in the fifo, no more fill preambles
   }
   // Send calculated Lrc
   putcUart(calcLrc, &hartUart);
   // count the transmitted message
   xmtMsgCounter++;
   // Clear the appropriate cold start bit
-  if (startUpDataLocalV.fromPrimary)
-
-    clrPrimaryStatusBits(FD_STATUS_COLD_START);
-  else
-    clrSecondaryStatusBits(FD_STATUS_COLD_START);
+  clrStatusBits(STATUS_REQUESTER, FD_STATUS_COLD_START);
 
   //  12/6/12 No commands to RESET Hart module are supported
 #if 0
@@ -757,8 +760,8 @@ WORD sendHartFrame (void)
 
   // Get ready for next frame
   // 10) prepareToRxFrame();
-  initHartRxSm();
-  return nTotal +2 + XMIT_PREAMBLE_BYTES; //  Frame total size = Frame + 1 + LRC + Preambles
+  initHartRxSm(pCtx);
+  return nTotal +2 + nPreambles;         //  Frame total size = Frame + 1 + LRC + Preambles (0 if already streaming)
 }
 
 
@@ -10,15 +10,104 @@
 /*************************************************************************
   *   $INCLUDES
 *************************************************************************/
+#include <string.h>
+#include "hardware.h"
 #include "hart_r3.h"
 /*************************************************************************
   *   $DEFINES
 *************************************************************************/
-#define XMIT_PREAMBLE_BYTES 8
+#define XMIT_PREAMBLE_BYTES 8      // Factory number of response preambles
+#define MIN_RESP_PREAMBLES  5      // Command 59 limits
+#define MAX_RESP_PREAMBLES  20
 
+// Hart frame buffer sizes
+#define MAX_HART_XMIT_BUF_SIZE 267
+#define MAX_RCV_BYTE_COUNT 267
+
+// Address field sizes
+#define LONG_ADDR_SIZE 5
+#define SHORT_ADDR_SIZE 1
+
+// Frame layout: the delimiter tells the address size, the byte count follows the command
+#define LONG_ADDR_MASK 0x80
+#define LONG_COUNT_OFFSET 7
+#define SHORT_COUNT_OFFSET 3
+
+// The receiver takes any byte count: the longest frame (delimiter, long address, command,
+// byte count, 255 data bytes and the LRC) must fit in the command buffer
+#if MAX_RCV_BYTE_COUNT < (1 + LONG_ADDR_SIZE + 1 + 1 + 255 + 1)
+  #error MAX_RCV_BYTE_COUNT can not hold a long frame with 255 data bytes
+#endif
+
+
+/*!
+ * Result of matching a received address field against a slave identity
+ */
+typedef enum
+{
+  addrNoMatch = 0,          //!< Frame is for another device
+  addrMatchUnique,          //!< Polling address (short frame) or unique address (long frame) matches
+  addrMatchBroadcast        //!< Long frame with the all-zero broadcast address
+} tAddrMatch;
+
+/*!
+ * Hart link context
+ *
+ * Everything a Hart slave needs to receive a frame and build its reply: the receiver state machine
+ * variables (formerly statics in hartReceiver()), the decoded frame and the command/response buffers.
+ * The firmware has a single instance, hartCtx, so the accesses resolve to fixed addresses exactly as
+ * the former globals did. The protocol layer and the command dispatch (processHartCommand() and its
+ * companions) receive a pointer to the context; the individual command handlers reach the same
+ * instance through the names defined below.
+ */
+typedef struct
+{
+  // Hart receiver state machine
+  BOOLEAN bInitSm;                            //!< Reset the receiver at next character
+  BYTE rcvState;                              //!< Present state of the receiver
+  BYTE expectedAddrByteCnt;                   //!< the number of address bytes expected
+  BYTE calcLrc;                               //!< LRC of the received bytes
+  unsigned char rcvAddrCount;                 //!< The number of address bytes received
+  WORD rcvByteCount;                          //!< The total number of received bytes, starting with the SOM
+  WORD totalRcvByteCount;
+  WORD preambleByteCount;                     //!< the number of preamble bytes received
+  BOOLEAN bDataComplete;                      //!< All data bytes are in, only the LRC is missing
+  BOOLEAN bReplySpeculated;                   //!< The response to this frame was built before its LRC
+  // Decoded frame, for the command layer
+  BYTE cmdNumber;                             //!< The received command number (0xfe while there is none)
+  BYTE byteCount;                             //!< The received byte count, to know when we're done
+  WORD dataCount;                             //!< The number of data field bytes
+  BYTE addrStartIdx;                          //!< Index of the first address byte in cmd[]
+  BOOLEAN bLongAddr;                          //!< The frame has a 5-byte unique address
+  BOOLEAN bAddressValid;                      //!< The address is ours or the broadcast address
+  BOOLEAN bBroadcastAddr;                     //!< The address is the broadcast address
+  BOOLEAN bFrameRcvd;                         //!< The LRC is in and the address is for us
+  BOOLEAN bCommandReady;                      //!< The command byte is in, a reply is due
+  BOOLEAN bLrcError;                          //!< The LRC did not compute OK (assumed until it does)
+  BOOLEAN bParityErr;                         //!< A character of the frame had a parity error
+  BOOLEAN bOverrunErr;                        //!< A character of the frame was lost to an overrun
+  // This slave identity, precomputed by refreshHartAddress() when the configuration changes
+  BYTE pollAddr;                              //!< Polling address (short frames)
+  BYTE uniqueAddr[LONG_ADDR_SIZE];            //!< Unique address (long frames), master and burst bits clear
+  // Frame buffers
+  unsigned int respSize;                      //!< size of the response buffer
+  unsigned char cmd[MAX_RCV_BYTE_COUNT];      //!< Rcvd message buffer (start w/addr byte)
+  unsigned char resp[MAX_HART_XMIT_BUF_SIZE]; //!< Response buffer (start w/delimiter)
+} stHartContext;
+
+/*!
+ * Response builder cursor
+ *
+ * A command handler opens a cursor with respOpen(), appends the reply fields with the put_xxx()
+ * inlines and commits them with respClose(). The write position lives in the local cursor rather
+ * than in hartCtx.respSize, so the compiler keeps it in a register for the whole reply.
+ * Multi-byte fields go out big-endian (MSB first), as Hart requires.
+ */
+typedef struct
+{
+  unsigned char *pNext;                       //!< Where the next byte is written
+} stRespCursor;
 
-// 9900 response, max size 15 bytes
-#define MAX_9900_RESP_SIZE 15
 
 
 
@@ -26,11 +115,17 @@
   *   $GLOBAL PROTOTYPES
 *************************************************************************/
 // HART Frame Handlers
-void hartReceiver(WORD data);
-WORD sendHartFrame (void);
+void hartReceiver(stHartContext *pCtx, WORD data);
+WORD sendHartFrame (stHartContext *pCtx);
+WORD openHartFrame(void);
+void closeHartFrame(void);
 //
-void initHartRxSm(void);
-void initRespBuffer(void);
+void initHartRxSm(stHartContext *pCtx);
+void initRespBuffer(stHartContext *pCtx);
+int checkCarrierDetect (void);              //!< TRUE while the modem detects a carrier
+tAddrMatch hartAddressMatch(const BYTE *pAddr, BOOLEAN bLongAddr, BYTE pollingAddress,
+                            const BYTE *pUniqueAddr);
+void refreshHartAddress(stHartContext *pCtx);
 //void rtsRcv(void);
 
 /*************************************************************************
@@ -39,11 +134,8 @@ void initRespBuffer(void);
 //  Utilities
 extern unsigned long int flashWriteCount;
 
-// exported HART timer variables
-extern unsigned char szHartCmd [];        // The HART Command buffer
-extern unsigned char szHartResp [];       // The HART response buffer
-extern unsigned int respBufferSize;         // The size of the response buffer
-extern int rcvBroadcastAddr;                // broadcas error received flag
+// The Hart link context
+extern stHartContext hartCtx;
 
 extern unsigned long int dataTimeStamp;     // Timer added for command 9  (type corrected 12/5/12 )
 extern float lastRequestedCurrentValue;     // The laast commanded current from command 40
@@ -57,28 +149,6 @@ extern unsigned long numMsgReadyToProcess;
 extern unsigned char lastCharRcvd;  //!<    Last character pulled from Hart UART fifo
 extern unsigned char command;       //!<    MH: Hart received command informaiton
 
-// long address flag
-extern int longAddressFlag;
-// address byte index
-extern unsigned char addressStartIdx;
-/*!
- * Indicates a valid command frame has been received
- *
- * This flag is set in the main loop, when the Hart Rx state machine finds that
- * the LRC is correct and a valid address for this module
- */
-extern unsigned char hartFrameRcvd;
-extern unsigned char addressValid;
-extern int parityErr;
-extern int overrunErr;
-extern int rcvLrcError;                     // Received LRC error flag
-extern WORD hartDataCount;                  //!< The number of data field bytes
-extern BYTE expectedByteCnt;                //!< The received byte count, to know when we're done
-
-// Command ready for processing flag
-extern int commandReadyToProcess;
-extern unsigned char hartCommand;
-
 // flags to make sure that the loop value does not
 // get reported if an update is in progress
 extern unsigned char updateRequestSent;
@@ -95,6 +165,102 @@ extern unsigned int HartErrRegister;
 /*************************************************************************
   *   $INLINE FUNCTIONS
 *************************************************************************/
+/*!
+ * \fn respCheck
+ * Traps a write of n bytes that would run past the end of the response buffer (debug only)
+ */
+inline void respCheck(const stRespCursor *pRc, WORD n)
+{
+#ifdef RESP_BOUNDS_CHECK
+  if (pRc->pNext + n > hartCtx.resp + MAX_HART_XMIT_BUF_SIZE)
+  {
+    while(1);
+  }
+#endif
+}
+
+/*!
+ * \fn respOpen
+ * Returns a cursor positioned after what is already in the response buffer (the frame header)
+ */
+inline stRespCursor respOpen(void)
+{
+  stRespCursor rc;
+  rc.pNext = hartCtx.resp + hartCtx.respSize;
+  return rc;
+}
+
+/*!
+ * \fn respClose
+ * Commits the bytes written through the cursor to hartCtx.respSize
+ */
+inline void respClose(const stRespCursor *pRc)
+{
+  hartCtx.respSize = pRc->pNext - hartCtx.resp;
+}
+
+/*!
+ * \fn put_u8
+ * Appends one byte
+ */
+inline void put_u8(stRespCursor *pRc, BYTE value)
+{
+  respCheck(pRc, 1);
+  *pRc->pNext++ = value;
+}
+
+/*!
+ * \fn put_u16be
+ * Appends a 16 bit value, MSB first
+ */
+inline void put_u16be(stRespCursor *pRc, WORD value)
+{
+  respCheck(pRc, 2);
+  pRc->pNext[0] = (BYTE)(value >> 8);
+  pRc->pNext[1] = (BYTE)value;
+  pRc->pNext += 2;
+}
+
+/*!
+ * \fn put_u32be
+ * Appends a 32 bit value, MSB first
+ */
+inline void put_u32be(stRespCursor *pRc, unsigned long value)
+{
+  respCheck(pRc, 4);
+  pRc->pNext[0] = (BYTE)(value >> 24);
+  pRc->pNext[1] = (BYTE)(value >> 16);
+  pRc->pNext[2] = (BYTE)(value >> 8);
+  pRc->pNext[3] = (BYTE)value;
+  pRc->pNext += 4;
+}
+
+/*!
+ * \fn put_f32be
+ * Appends an IEEE754 float, MSB first
+ */
+inline void put_f32be(stRespCursor *pRc, float value)
+{
+  U_LONG_FLOAT temp;
+  temp.fVal = value;
+  respCheck(pRc, 4);
+  pRc->pNext[0] = temp.b[3];
+  pRc->pNext[1] = temp.b[2];
+  pRc->pNext[2] = temp.b[1];
+  pRc->pNext[3] = temp.b[0];
+  pRc->pNext += 4;
+}
+
+/*!
+ * \fn put_bytes
+ * Appends n bytes as they are stored (strings, packed ASCII, device Id)
+ */
+inline void put_bytes(stRespCursor *pRc, const void *pSrc, WORD n)
+{
+  respCheck(pRc, n);
+  memcpy(pRc->pNext, pSrc, n);
+  pRc->pNext += n;
+}
 
 
 
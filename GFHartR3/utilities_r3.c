@@ -15,6 +15,10 @@
 #include "hardware.h"
 #include "utilities_r3.h"
 
+// The float unions below overlay a float on an LWORD, and q16 must be 32 bits for the overflow
+// checks: the build fails on an array of negative size otherwise
+typedef char q16SizeCheck[(sizeof(q16) == 4 && sizeof(LWORD) == 4 && sizeof(float) == 4) ? 1 : -1];
+
 // Flash programming utilities. Shut off all interrupts and the 
 // watchdog before calling any flash programming function to prevent
 // undesirable results
@@ -116,7 +120,8 @@ int copyMainFlashToMem (unsigned char * flashPtr, unsigned char * memPtr, int se
 //
 // Implementation notes:
 //
-// memSize does not have to be a multiple of 512 bytes.
+// memSize does not have to be a multiple of 512 bytes. Besides the info segments,
+// only the DB_CACHE_SEGMENT main segment can be written
 // NOTE: This function cannot be used to program VALID_SEGMENT_4, which has a special LOCK
 //       bit, LOCKA!!
 //
@@ -128,8 +133,10 @@ int  copyMemToMainFlash (unsigned char * flashPtr, unsigned char * memPtr, int m
 	int iIdx;
 	unsigned char value = 0x55;
 	// If we're out of bounds, bail early
-	if (((unsigned char *)VALID_SEGMENT_1 > flashPtr) ||
-		(flashPtr + memSize) > INFO_MEMORY_END)
+	if ((((unsigned char *)VALID_SEGMENT_1 > flashPtr) ||
+		(flashPtr + memSize) > INFO_MEMORY_END) &&
+		((DB_CACHE_SEGMENT > flashPtr) ||
+		(flashPtr + memSize) > (DB_CACHE_SEGMENT + BANK_SEGMENT_SIZE)))
 	{
 		return success;
 	}
@@ -241,6 +248,49 @@ int eraseMainSegment(unsigned char * flashPtr, int segSize)
 	return success;
 }
 
+///////////////////////////////////////////////////////////////////////////////////////////
+//
+// Function Name: eraseBankSegment()
+//
+// Description:
+//
+// Erases one BANK_SEGMENT_SIZE main flash segment reserved for data. Only the
+// DB_CACHE_SEGMENT is accepted, the rest of main flash is code.
+//
+// Parameters:
+//
+//     unsigned char * flashPtr: pointer to the start of the segment.
+//
+// Return Type: int.
+//
+// Implementation notes:
+//
+// The CPU is held while the segment erases, around 30 mS
+//
+/////////////////////////////////////////////////////////////////////////////////////////// 
+ 
+int eraseBankSegment(unsigned char * flashPtr)
+{
+	if (DB_CACHE_SEGMENT != flashPtr)
+	{
+		return FALSE;
+	}
+	_disable_interrupts();
+	stopWatchdog(); //MH OK
+	FCTL3 = FWKEY;                  // Clear Lock bit
+	FCTL1 = FWKEY | ERASE;          // Set Erase bit, don't allow interrupts
+	*flashPtr = 0;                  // Dummy write to erase Flash seg
+	// Wait until the BUSY bit clears
+	while (FCTL3 & BUSY)
+	{
+		__no_operation();
+	}
+	FCTL3 = FWKEY | LOCK;   // Set the lock bit
+	startWatchdog();  // MH -> start should match the stopWatchdog() above,  deprecated resetWatchdog();;
+	_enable_interrupts();
+	return TRUE;
+}
+
 ///////////////////////////////////////////////////////////////////////////////////////////
 //
 // Function Name: verifyFlashContents()
@@ -442,3 +492,311 @@ int calcNumSegments (int memSize)
 	return numSegs;
 }
 
+///////////////////////////////////////////////////////////////////////////////////////////
+//
+// Function Name: calcCrc16()
+//
+// Description:
+//
+// Calculates the CRC16-CCITT of a block of memory
+//
+// Parameters:
+//
+//     const unsigned char * pData: the first byte of the block
+//     int size: the number of bytes
+//
+// Return Type: unsigned int - the CRC, seeded with 0xFFFF
+//
+// Implementation notes:
+//
+// Uses the CRC16 hardware module, one byte per write. Must not be called from an ISR.
+// With CRC16_SOFTWARE defined (the host build, it has no CRC module) the same CRC is
+// computed bit by bit
+//
+/////////////////////////////////////////////////////////////////////////////////////////// 
+unsigned int calcCrc16(const unsigned char * pData, int size)
+{
+#ifdef CRC16_SOFTWARE
+	unsigned int crc = 0xFFFF;
+	int bit;
+	unsigned char data;
+
+	while (size-- > 0)
+	{
+		// CRCDI takes the data bits LSB first
+		data = *pData++;
+		for (bit = 0; bit < 8; ++bit, data >>= 1)
+		{
+			crc = (((crc >> 15) ^ data) & 1) ? ((crc << 1) ^ 0x1021) : (crc << 1);
+		}
+	}
+	return crc & 0xFFFF;
+#else
+	CRCINIRES = 0xFFFF;
+	while (size-- > 0)
+	{
+		CRCDI_L = *pData++;
+	}
+	return CRCINIRES;
+#endif
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////
+//
+// Function Name: floatToQ16()
+//
+// Description:
+//
+// Converts an IEEE754 32-bit float to Q16.16, rounding to the nearest LSB
+//
+// Parameters:
+//
+//     float fValue: the number to be converted.
+//     q16 * pQ: the result, untouched when the conversion fails
+//
+// Return Type: int, 1 on success, 0 if |fValue| >= Q16_INPUT_LIMIT, infinite or NaN
+//
+// Implementation notes:
+//
+// Works on the bit pattern with integer shifts only, no soft-float library call
+//
+///////////////////////////////////////////////////////////////////////////////////////////
+
+int floatToQ16(float fValue, q16 * pQ)
+{
+	union
+	{
+		float fValue;
+		LWORD bits;
+	} in;
+	LWORD mantissa;
+	int exponent, shift;
+
+	in.fValue = fValue;
+	exponent = (int)((in.bits >> 23) & 0xFF);
+	// Magnitudes below 2^-17 (zero and denormals included) round to 0
+	if (exponent < 127 - 17)
+	{
+		*pQ = 0;
+		return 1;
+	}
+	// 2^14 and beyond, infinity and NaN do not fit
+	if (exponent >= 127 + 14)
+	{
+		return 0;
+	}
+	// 1.23 mantissa, the value is mantissa * 2^(exponent-127-23), times 2^16 for Q16.16
+	mantissa = (in.bits & 0x007FFFFFUL) | 0x00800000UL;
+	shift = exponent - (127 + 23 - Q16_FRAC_BITS);
+	if (shift >= 0)
+	{
+		mantissa <<= shift;
+	}
+	else
+	{
+		mantissa = (mantissa + (1UL << (-shift - 1))) >> -shift;
+	}
+	*pQ = (in.bits & 0x80000000UL) ? -(q16)mantissa : (q16)mantissa;
+	return 1;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////
+//
+// Function Name: q16ToFloat()
+//
+// Description:
+//
+// Converts a Q16.16 value to the IEEE754 32-bit floating-point equivalent
+//
+// Parameters:
+//
+//     q16 qValue: the number to be converted.
+//
+// Return Type: float.
+//
+// Implementation notes:
+//
+// Builds the bit pattern with integer shifts only. Values with more than 24 significant
+// bits are rounded to the nearest float
+//
+///////////////////////////////////////////////////////////////////////////////////////////
+
+float q16ToFloat(q16 qValue)
+{
+	union
+	{
+		float fValue;
+		LWORD bits;
+	} out;
+	LWORD magnitude, sign = 0;
+	int exponent = 127 + 23 - Q16_FRAC_BITS, shift = 0;
+
+	if (!qValue)
+	{
+		out.bits = 0;
+		return out.fValue;
+	}
+	if (qValue < 0)
+	{
+		sign = 0x80000000UL;
+		magnitude = -(LWORD)qValue;
+	}
+	else
+	{
+		magnitude = (LWORD)qValue;
+	}
+	// Too many bits for the mantissa: round them off
+	while ((magnitude >> shift) & 0xFF000000UL)
+	{
+		++shift;
+	}
+	if (shift)
+	{
+		magnitude = (magnitude + (1UL << (shift - 1))) >> shift;
+		exponent += shift;
+		if (magnitude & 0x01000000UL)
+		{
+			magnitude >>= 1;
+			++exponent;
+		}
+	}
+	// Normalize so the hidden bit lands on bit 23
+	while (!(magnitude & 0x00800000UL))
+	{
+		magnitude <<= 1;
+		--exponent;
+	}
+	out.bits = sign | ((LWORD)exponent << 23) | (magnitude & 0x007FFFFFUL);
+	return out.fValue;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////
+//
+// Function Name: q16Div()
+//
+// Description:
+//
+// Divides two Q16.16 values
+//
+// Parameters:
+//
+//     q16 num: the dividend
+//     q16 den: the divisor
+//
+// Return Type: q16, the quotient truncated toward zero, saturated to +/-Q16_MAX
+//
+// Implementation notes:
+//
+// One shift and subtract loop over the dividend bits followed by 16 zero bits, so no
+// run time library divide (the MSP430 has no divide instruction). The loop starts at the
+// top set bit of the dividend. The overflow test is a shift and a compare
+//
+///////////////////////////////////////////////////////////////////////////////////////////
+
+q16 q16Div(q16 num, q16 den)
+{
+	LWORD n, d, quotient, remainder;
+	int negative = ((num < 0) != (den < 0));
+	int i;
+
+	n = (num < 0) ? -(LWORD)num : (LWORD)num;
+	d = (den < 0) ? -(LWORD)den : (LWORD)den;
+	// A zero divisor, or an integer part of 2^15 or more (n >= d * 2^15), saturates
+	if (!d || (n >> (31 - Q16_FRAC_BITS)) >= d)
+	{
+		return negative ? -Q16_MAX : Q16_MAX;
+	}
+	// Skip the leading zeros of the dividend
+	i = 32 + Q16_FRAC_BITS;
+	while (i > Q16_FRAC_BITS && !(n & 0x80000000UL))
+	{
+		n <<= 1;
+		--i;
+	}
+	quotient = 0;
+	remainder = 0;
+	// remainder < d <= 2^31, so the shift never overflows
+	for (; i > 0; --i)
+	{
+		remainder = (remainder << 1) | (n >> 31);
+		n <<= 1;
+		quotient <<= 1;
+		if (remainder >= d)
+		{
+			remainder -= d;
+			quotient |= 1;
+		}
+	}
+	return negative ? -(q16)quotient : (q16)quotient;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////
+//
+// Function Name: q16PercentRange()
+//
+// Description:
+//
+// Computes a value as a percent of a range, the fixed point CalculatePercentRange()
+//
+// Parameters:
+//
+//     q16 upper, lower: the range, as returned by floatToQ16()
+//     q16 value: the value to express
+//
+// Return Type: q16, the percent, saturated to +/-Q16_MAX
+//
+// Implementation notes:
+//
+// The inputs are bounded by Q16_INPUT_LIMIT so the differences cannot overflow
+//
+///////////////////////////////////////////////////////////////////////////////////////////
+
+q16 q16PercentRange(q16 upper, q16 lower, q16 value)
+{
+	q16 ratio = q16Div(value - lower, upper - lower);
+
+	if (ratio > Q16_MAX / 100)
+	{
+		return Q16_MAX;
+	}
+	if (ratio < -(Q16_MAX / 100))
+	{
+		return -Q16_MAX;
+	}
+	return ratio * 100;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////
+//
+// Function Name: floatOrderKey()
+//
+// Description:
+//
+// Maps an IEEE754 32-bit float to a 32-bit signed that sorts the same way
+//
+// Parameters:
+//
+//     float fValue: the number to be mapped
+//
+// Return Type: SLWORD, compare two keys instead of the two floats
+//
+// Implementation notes:
+//
+// Positive floats already order as integers, negative ones are sign-magnitude and are flipped
+// into two's complement. -0 and +0 both map to 0. Used for the PV limit checks, which must
+// stay exact over the whole float range
+//
+///////////////////////////////////////////////////////////////////////////////////////////
+
+SLWORD floatOrderKey(float fValue)
+{
+	union
+	{
+		float fValue;
+		SLWORD bits;
+	} in;
+
+	in.fValue = fValue;
+	return (in.bits < 0) ? -(in.bits & (SLWORD)0x7FFFFFFF) : in.bits;
+}
+
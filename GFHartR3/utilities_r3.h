@@ -40,6 +40,7 @@
 int copyMainFlashToMem (unsigned char *, unsigned char *, int);
 int copyMemToMainFlash (unsigned char *, unsigned char *, int);
 int eraseMainSegment(unsigned char *, int);
+int eraseBankSegment(unsigned char *);
 int verifyFlashContents(unsigned char *, unsigned char *, int);
 void syncToRam(unsigned char *, unsigned char *, int);
 int syncToFlash(unsigned char *, unsigned char *, int);
@@ -51,14 +52,48 @@ int calcNumSegments (int);
 // The Information memory segment starts at 0x18OO and goes to address 0x1c00,
 // So these areas must be avoided. Program memory starts at 0x4400, at 
 // the other end of the flash memory 
+// The host build (host/msp430f5528.h) keeps the information memory and the DB cache segment in RAM
+#ifdef HOST_INFO_FLASH
+#define VALID_SEGMENT_1 HOST_INFO_FLASH
+#else
 #define VALID_SEGMENT_1 (unsigned char *)0x1800
+#endif
 #define VALID_SEGMENT_2 (unsigned char *)(VALID_SEGMENT_1+MAIN_SEGMENT_SIZE)  // 1200
 #define VALID_SEGMENT_3 (unsigned char *)(VALID_SEGMENT_2+MAIN_SEGMENT_SIZE)  // 1400
 #define VALID_SEGMENT_4 (unsigned char *)(VALID_SEGMENT_3+MAIN_SEGMENT_SIZE)  // 1600
-#define INFO_MEMORY_END (unsigned char *)0x1A00
+#define INFO_MEMORY_END (VALID_SEGMENT_1 + 4 * MAIN_SEGMENT_SIZE)
+// A main flash segment kept out of the code space (DBCACHE in the linker command file)
+#define BANK_SEGMENT_SIZE	512
+#ifdef HOST_BANK_FLASH
+#define DB_CACHE_SEGMENT HOST_BANK_FLASH
+#else
+#define DB_CACHE_SEGMENT (unsigned char *)0x4400
+#endif
 
 // Misc. utility prototypes
 float IntToFloat (int);
+unsigned int calcCrc16(const unsigned char *, int);
+
+// Q16.16 fixed point: a 32-bit signed holding the value times 65536. The limit checks and the
+// percent of range run in it, the IEEE754 floats are only converted where they enter or leave
+// the device
+typedef SLWORD q16;
+#define Q16_FRAC_BITS   16
+#define Q16_ONE         ((q16)1 << Q16_FRAC_BITS)
+#define Q16_MAX         ((q16)0x7FFFFFFF)
+// For constants only, the compiler folds the float math
+#define Q16_CONST(f)    ((q16)((f) * 65536.0 + (((f) < 0) ? -0.5 : 0.5)))
+// floatToQ16() accepts magnitudes below 2^14, so the difference of two values still fits
+#define Q16_INPUT_LIMIT 16384
+// Narrower ranges lose percent of range precision to the input rounding (2^-17 on each end),
+// their percent of range stays in float
+#define Q16_PERCENT_MIN_SPAN  Q16_ONE
+
+int floatToQ16(float, q16 *);
+float q16ToFloat(q16);
+q16 q16Div(q16, q16);
+q16 q16PercentRange(q16, q16, q16);
+SLWORD floatOrderKey(float);
 
 
 #endif /*UTILITIES_H_*/